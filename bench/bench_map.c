@@ -0,0 +1,450 @@
+/**
+ * bench_map.c
+ *
+ * Measure the main operations on synthetic maps of increasing sizes.
+ *
+ * Usage: bench_map [-s MAX_SIZE] [-o RESULTS] [-b BASELINE] [-r RATIO]
+ *
+ * For each size N from 10 up to MAX_SIZE (4096 by default), a map of three
+ * layers of N x N cells is generated: a full ground layer (dense storage), a
+ * layer with a quarter of its cells occupied (chunked storage) and a sparse
+ * top layer (run-length storage), using the tiles of
+ * `data/map10x10-64x64.json`. The following operations are measured:
+ *
+ * - map-lookup: random `map_get_tile_by_location`
+ * - map-iteration: `map_get_occupied_location` over the whole map
+ * - tileset-lookup: random `tile_by_id` in a tileset of N tiles
+ * - graph-build: `graph_create` (up to `MAX_GRAPH_SIZE`)
+ * - graph-search: `graph_shortest_walk` between opposite corners (up to
+ *   `MAX_GRAPH_SIZE`)
+ * - map-search: `graph_shortest_walk_in_map` between opposite corners (up to
+ *   `MAX_SEARCH_SIZE`)
+ * - render: `render_draw` of a viewport at the center of the image
+ *
+ * Each operation is repeated `REPETITIONS` times and the fastest run is kept.
+ * The results are printed as a table and written to RESULTS as a JSON array
+ * with one object per line, whose members are "benchmark", "size", "layers",
+ * "ops" and "nanoseconds". If a BASELINE file written by a previous run is
+ * given, each result is compared with the baseline, and the program fails if
+ * an operation is more than RATIO times slower (1.25 by default).
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "../src/graph.h"
+#include "../src/parser.h"
+#include "../src/render.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TILESET_MAP "../data/map10x10-64x64.json"
+#define DEFAULT_MAX_SIZE 4096
+#define DEFAULT_RATIO 1.25
+#define NUM_LAYERS 3
+#define NUM_LOOKUPS 1000000
+#define MAX_GRAPH_SIZE 1024
+#define MAX_SEARCH_SIZE 1024
+#define VIEWPORT_SIZE 512
+#define REPETITIONS 3
+#define NAME_LENGTH 32
+
+/**
+ * Where the results of the lookups are stored, so that they are not optimized
+ * out
+ */
+volatile unsigned long sink;
+
+// Types //
+// ----- //
+
+/**
+ * The result of a benchmark
+ */
+struct result {
+    char benchmark[NAME_LENGTH]; // The name of the benchmark
+    unsigned int size;           // The number of rows and columns
+    unsigned long ops;           // The number of operations
+    long long nanoseconds;       // The time of the fastest run
+};
+
+/**
+ * The results of all benchmarks
+ */
+struct results {
+    struct result *results;  // The results
+    unsigned int num_results; // The number of results
+    unsigned int capacity;    // The capacity of the results
+};
+
+// Help functions //
+// -------------- //
+
+/**
+ * Return the current time, in nanoseconds
+ *
+ * @return  The time
+ */
+long long now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+/**
+ * Return a pseudo-random number (xorshift)
+ *
+ * @param state  The state of the generator, updated by the function
+ * @return       The number
+ */
+uint32_t next_random(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/**
+ * Return a hash of a cell, used to scatter the tiles of the upper layers
+ *
+ * @param x  The row of the cell
+ * @param y  The column of the cell
+ * @return   The hash
+ */
+uint32_t hash_cell(unsigned int x, unsigned int y) {
+    uint32_t h = x * 0x9e3779b1u ^ y * 0x85ebca6bu;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    return h ^ (h >> 12);
+}
+
+/**
+ * Create a synthetic map of N x N cells and three layers
+ *
+ * @param size  The number of rows and columns
+ * @return      The map
+ */
+struct map *create_map(unsigned int size) {
+    struct map *map = map_create();
+    enum layer_storage storages[NUM_LAYERS] = {
+        LAYER_DENSE, LAYER_CHUNKED, LAYER_DENSE
+    };
+    uint32_t moduli[NUM_LAYERS] = {1, 4, 64};
+    struct layer *layer = NULL;
+    for (unsigned int z = 0; z < NUM_LAYERS; ++z) {
+        layer = map_add_layer_with_storage(map, storages[z], size, size,
+                                           0, 0, z);
+        for (unsigned int x = 0; x < size; ++x)
+            for (unsigned int y = 0; y < size; ++y)
+                if (hash_cell(x, y) % moduli[z] == 0)
+                    map_set_layer_tile(layer, x, y, 2);
+    }
+    map_convert_layer(layer, LAYER_RLE);
+    return map;
+}
+
+/**
+ * Return the first top-free ground location on the diagonal of a map
+ *
+ * The locations are tried from one corner of the map towards the center.
+ *
+ * @param map     The map
+ * @param size    The number of rows and columns of the map
+ * @param corner  True to start from the last row and column
+ * @return        The location
+ */
+struct location ground_location(const struct map *map, unsigned int size,
+                                bool corner) {
+    struct location location = {0, 0, 0};
+    for (unsigned int i = 0; i < size / 2; ++i) {
+        location.x = location.y = corner ? size - 1 - i : i;
+        if (map_is_location_top_free(map, location.x, location.y, 0))
+            break;
+    }
+    return location;
+}
+
+/**
+ * Return the result of a benchmark on a given size
+ *
+ * @param results    The results
+ * @param benchmark  The name of the benchmark
+ * @param size       The size of the map
+ * @return           The result or NULL
+ */
+struct result *find_result(const struct results *results,
+                           const char *benchmark, unsigned int size) {
+    for (unsigned int i = 0; i < results->num_results; ++i)
+        if (strcmp(results->results[i].benchmark, benchmark) == 0 &&
+            results->results[i].size == size)
+            return results->results + i;
+    return NULL;
+}
+
+/**
+ * Add a result, keeping the fastest run of a benchmark
+ *
+ * @param results      The results
+ * @param benchmark    The name of the benchmark
+ * @param size         The size of the map
+ * @param ops          The number of operations
+ * @param nanoseconds  The time of the run
+ */
+void add_result(struct results *results, const char *benchmark,
+                unsigned int size, unsigned long ops, long long nanoseconds) {
+    struct result *previous = find_result(results, benchmark, size);
+    if (previous != NULL) {
+        if (nanoseconds < previous->nanoseconds) {
+            previous->nanoseconds = nanoseconds;
+            previous->ops = ops;
+        }
+        return;
+    }
+    if (results->num_results == results->capacity) {
+        results->capacity *= 2;
+        results->results = realloc(results->results,
+                                   results->capacity * sizeof(struct result));
+    }
+    struct result *result = results->results + results->num_results++;
+    strncpy(result->benchmark, benchmark, NAME_LENGTH - 1);
+    result->benchmark[NAME_LENGTH - 1] = '\0';
+    result->size = size;
+    result->ops = ops;
+    result->nanoseconds = nanoseconds;
+}
+
+/**
+ * Run the benchmarks on a map of a given size
+ *
+ * @param isomap   The isomap whose tileset is used
+ * @param size     The number of rows and columns of the map
+ * @param results  The results, updated by the function
+ */
+void bench_size(struct isomap *isomap, unsigned int size,
+                struct results *results) {
+    struct map *map = create_map(size);
+    struct map *original = isomap->map;
+    isomap->map = map;
+    struct tileset *tileset = tile_create_tileset();
+    for (unsigned int i = 0; i < size; ++i)
+        tile_add_to_tileset(tileset, 7 * i + 1, "tile.png");
+    struct location start = ground_location(map, size, false);
+    struct location end = ground_location(map, size, true);
+    struct render_projection projection = render_get_projection(isomap);
+    struct render_viewport viewport = {
+        (int)projection.width / 2 - VIEWPORT_SIZE / 2,
+        (int)projection.height / 2 - VIEWPORT_SIZE / 2,
+        VIEWPORT_SIZE, VIEWPORT_SIZE
+    };
+    cairo_surface_t *surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, viewport.width,
+                                   viewport.height);
+    for (unsigned int r = 0; r < REPETITIONS; ++r) {
+        uint32_t state = 2463534242u;
+        unsigned long sum = 0;
+        long long start_time = now();
+        for (unsigned int i = 0; i < NUM_LOOKUPS; ++i) {
+            int x = next_random(&state) % size;
+            int y = next_random(&state) % size;
+            sum += map_get_tile_by_location(map, x, y, i % NUM_LAYERS);
+        }
+        add_result(results, "map-lookup", size, NUM_LOOKUPS,
+                   now() - start_time);
+        sink = sum;
+
+        unsigned long num_cells = 0;
+        start_time = now();
+        for (const struct location *location =
+                 map_get_occupied_location(map, true);
+             location != NULL;
+             location = map_get_occupied_location(map, false))
+            ++num_cells;
+        add_result(results, "map-iteration", size, num_cells,
+                   now() - start_time);
+
+        unsigned long num_found = 0;
+        start_time = now();
+        for (unsigned int i = 0; i < NUM_LOOKUPS; ++i)
+            num_found += tile_by_id(tileset, next_random(&state) %
+                                             (7 * size)) != NULL;
+        add_result(results, "tileset-lookup", size, NUM_LOOKUPS,
+                   now() - start_time);
+        sink = num_found;
+
+        if (size <= MAX_GRAPH_SIZE) {
+            start_time = now();
+            struct graph *graph = graph_create(map, isomap->tileset);
+            add_result(results, "graph-build", size, graph->num_nodes,
+                       now() - start_time);
+            start_time = now();
+            struct graph_walk *walk = graph_shortest_walk(graph, &start, &end);
+            add_result(results, "graph-search", size, graph->num_nodes,
+                       now() - start_time);
+            if (walk != NULL) graph_delete_walk(walk);
+            graph_delete(graph);
+        }
+
+        if (size <= MAX_SEARCH_SIZE) {
+            start_time = now();
+            struct graph_walk *walk =
+                graph_shortest_walk_in_map(map, isomap->tileset, &start, &end);
+            add_result(results, "map-search", size, (unsigned long)size * size,
+                       now() - start_time);
+            if (walk != NULL) graph_delete_walk(walk);
+        }
+
+        start_time = now();
+        render_draw(isomap, &projection, &viewport, surface, 1, RENDER_DIRECT);
+        add_result(results, "render", size, 1, now() - start_time);
+    }
+    cairo_surface_destroy(surface);
+    tile_delete_tileset(tileset);
+    isomap->map = original;
+    map_delete(map);
+}
+
+/**
+ * Load the results of a previous run
+ *
+ * @param filename  The filename of the results
+ * @param results   The results, set by the function
+ * @return          True if the file is valid
+ */
+bool load_results(const char *filename, struct results *results) {
+    FILE *input = fopen(filename, "r");
+    if (input == NULL)
+        return false;
+    struct parser *parser = malloc(sizeof(struct parser));
+    parser_initialize(parser, input);
+    bool valid = parser_next(parser) == PARSER_ARRAY_START;
+    enum parser_token token;
+    while (valid && (token = parser_next(parser)) == PARSER_OBJECT_START) {
+        struct result result = {"", 0, 0, 0};
+        while (valid && (token = parser_next(parser)) == PARSER_KEY) {
+            if (strcmp(parser->string, "benchmark") == 0) {
+                valid = parser_next(parser) == PARSER_STRING;
+                snprintf(result.benchmark, NAME_LENGTH, "%.*s", NAME_LENGTH - 1,
+                         parser->string);
+            } else if (strcmp(parser->string, "size") == 0) {
+                result.size = parser_read_integer(parser);
+            } else if (strcmp(parser->string, "ops") == 0) {
+                result.ops = parser_read_integer(parser);
+            } else if (strcmp(parser->string, "nanoseconds") == 0) {
+                result.nanoseconds = parser_read_integer(parser);
+            } else {
+                valid = parser_skip(parser, parser_next(parser));
+            }
+        }
+        valid = valid && token == PARSER_OBJECT_END;
+        if (valid)
+            add_result(results, result.benchmark, result.size, result.ops,
+                       result.nanoseconds);
+    }
+    valid = valid && token == PARSER_ARRAY_END;
+    free(parser);
+    fclose(input);
+    return valid;
+}
+
+/**
+ * Write results as a JSON array, with one result per line
+ *
+ * @param stream   The stream
+ * @param results  The results
+ */
+void write_results(FILE *stream, const struct results *results) {
+    fprintf(stream, "[\n");
+    for (unsigned int i = 0; i < results->num_results; ++i) {
+        const struct result *result = results->results + i;
+        fprintf(stream, "{\"benchmark\": \"%s\", \"size\": %u, \"layers\": %d, "
+                "\"ops\": %lu, \"nanoseconds\": %lld}%s\n", result->benchmark,
+                result->size, NUM_LAYERS, result->ops, result->nanoseconds,
+                i + 1 < results->num_results ? "," : "");
+    }
+    fprintf(stream, "]\n");
+}
+
+/**
+ * Return the time per operation of a result, in nanoseconds
+ *
+ * @param result  The result
+ * @return        The time per operation
+ */
+double time_per_op(const struct result *result) {
+    return (double)result->nanoseconds / (result->ops > 0 ? result->ops : 1);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int max_size = DEFAULT_MAX_SIZE;
+    const char *output_filename = NULL, *baseline_filename = NULL;
+    double max_ratio = DEFAULT_RATIO;
+    int c;
+    while ((c = getopt(argc, argv, "s:o:b:r:")) != -1) {
+        switch (c) {
+            case 's': max_size = atoi(optarg); break;
+            case 'o': output_filename = optarg; break;
+            case 'b': baseline_filename = optarg; break;
+            case 'r': max_ratio = atof(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-s MAX_SIZE] [-o RESULTS] "
+                        "[-b BASELINE] [-r RATIO]\n", argv[0]);
+                return 1;
+        }
+    }
+    FILE *input = fopen(TILESET_MAP, "r");
+    struct isomap *isomap = input == NULL ? NULL :
+                            isomap_create_from_json_file(input);
+    if (input != NULL)
+        fclose(input);
+    if (isomap == NULL) {
+        fprintf(stderr, "Error: invalid map %s\n", TILESET_MAP);
+        return 1;
+    }
+    struct results baseline = {malloc(sizeof(struct result)), 0, 1};
+    if (baseline_filename != NULL &&
+        !load_results(baseline_filename, &baseline)) {
+        fprintf(stderr, "Error: invalid baseline %s\n", baseline_filename);
+        return 1;
+    }
+
+    struct results results = {malloc(sizeof(struct result)), 0, 1};
+    unsigned int sizes[] = {10, 64, 256, 1024, 4096};
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]) &&
+                             sizes[s] <= max_size; ++s)
+        bench_size(isomap, sizes[s], &results);
+
+    unsigned int num_regressions = 0;
+    printf("%-16s %6s %12s %12s %12s\n", "benchmark", "size", "ops",
+           "ns/op", "baseline");
+    for (unsigned int i = 0; i < results.num_results; ++i) {
+        const struct result *result = results.results + i;
+        printf("%-16s %6u %12lu %12.1f", result->benchmark, result->size,
+               result->ops, time_per_op(result));
+        const struct result *previous =
+            find_result(&baseline, result->benchmark, result->size);
+        if (previous != NULL) {
+            double ratio = time_per_op(result) / time_per_op(previous);
+            printf(" %11.2fx%s", ratio, ratio > max_ratio ? " slower" : "");
+            num_regressions += ratio > max_ratio;
+        }
+        printf("\n");
+    }
+    if (output_filename != NULL) {
+        FILE *output = fopen(output_filename, "w");
+        if (output == NULL) {
+            fprintf(stderr, "Error: invalid file path %s\n", output_filename);
+            return 1;
+        }
+        write_results(output, &results);
+        fclose(output);
+    }
+    if (num_regressions > 0)
+        printf("%u benchmark%s more than %.2fx slower than the baseline\n",
+               num_regressions, num_regressions == 1 ? " is" : "s are",
+               max_ratio);
+    free(results.results);
+    free(baseline.results);
+    isomap_delete(isomap);
+    return num_regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * bench_render.c
+ *
+ * Compare the number of tiles drawn per second by the rendering backends.
+ *
+ * Usage: bench_render [MAP [REPETITIONS]]
+ *
+ * The full image of the map is drawn REPETITIONS times with one thread by
+ * each backend.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "../src/map.h"
+#include "../src/render.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_MAP "../data/map10x10-256x256.json"
+#define DEFAULT_REPETITIONS 5
+
+/**
+ * Return the current time, in seconds
+ *
+ * @return  The time
+ */
+double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Draw the full image of an isomap repeatedly and print the tiles per second
+ *
+ * @param isomap       The isomap
+ * @param name         The name of the backend
+ * @param backend      The backend
+ * @param repetitions  The number of repetitions
+ * @return             The number of tiles per second
+ */
+double bench_backend(const struct isomap *isomap, const char *name,
+                     enum render_backend backend, unsigned int repetitions) {
+    unsigned long num_tiles = 0;
+    for (const struct location *location =
+             map_get_occupied_location(isomap->map, true);
+         location != NULL;
+         location = map_get_occupied_location(isomap->map, false))
+        ++num_tiles;
+    struct render_projection projection = render_get_projection(isomap);
+    struct render_viewport viewport = render_full_viewport(&projection);
+    cairo_surface_t *surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                   viewport.width, viewport.height);
+    unsigned long num_drawn = 0;
+    double start = now();
+    for (unsigned int r = 0; r < repetitions; ++r)
+        num_drawn += num_tiles - render_draw(isomap, &projection, &viewport,
+                                             surface, 1, backend);
+    double seconds = now() - start;
+    cairo_surface_destroy(surface);
+    printf("%-8s %10lu %10.3f %12.0f\n", name, num_drawn, seconds,
+           num_drawn / seconds);
+    return num_drawn / seconds;
+}
+
+int main(int argc, char *argv[]) {
+    const char *filename = argc > 1 ? argv[1] : DEFAULT_MAP;
+    unsigned int repetitions = argc > 2 ? atoi(argv[2]) : DEFAULT_REPETITIONS;
+    FILE *input = fopen(filename, "r");
+    if (input == NULL) {
+        fprintf(stderr, "Error: invalid file path\n");
+        return 1;
+    }
+    struct isomap *isomap = isomap_create_from_json_file(input);
+    fclose(input);
+    if (isomap == NULL) {
+        fprintf(stderr, "Error: invalid map\n");
+        return 1;
+    }
+    printf("%-8s %10s %10s %12s\n", "backend", "tiles", "seconds", "tiles/s");
+    double cairo = bench_backend(isomap, "cairo", RENDER_CAIRO, repetitions);
+    double direct = bench_backend(isomap, "direct", RENDER_DIRECT,
+                                  repetitions);
+    printf("speedup of direct: %.2fx\n", direct / cairo);
+    isomap_delete(isomap);
+    return 0;
+}
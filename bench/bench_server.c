@@ -0,0 +1,209 @@
+/**
+ * bench_server.c
+ *
+ * Measure the latency of the requests answered by a server (see `server.h`).
+ *
+ * Usage: bench_server [MAP [CLIENTS [REQUESTS]]]
+ *
+ * A server with one worker per client is started on the map, then each client
+ * sends REQUESTS requests of each kind, one at a time, between random
+ * top-free locations or on random viewports. The median and 99th percentile
+ * of the latencies are printed for each kind of request.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "../src/graph.h"
+#include "../src/server.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_MAP "../data/map10x10-256x256.json"
+#define DEFAULT_CLIENTS 4
+#define DEFAULT_REQUESTS 200
+#define SOCKET_PATH "bench_server.sock"
+#define REQUEST_LENGTH 64
+#define VIEWPORT_SIZE 256
+#define NUM_KINDS 3
+
+/**
+ * The kinds of requests
+ */
+const char *kinds[NUM_KINDS] = {"DISTANCE", "WALK", "RENDER"};
+
+/**
+ * A server or a client of the benchmark
+ */
+struct bench {
+    struct isomap *isomap;      // The isomap
+    const struct graph *graph;  // The graph of the isomap
+    unsigned int num_workers;   // The number of workers of the server
+    unsigned int num_requests;  // The number of requests of each kind
+    unsigned int seed;          // The seed of the random requests
+    double *latencies;          // The latencies, in seconds, by kind
+};
+
+/**
+ * Return the current time, in seconds
+ *
+ * @return  The time
+ */
+double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Run the server of the benchmark
+ *
+ * @param data  The benchmark
+ * @return      NULL
+ */
+void *run_server(void *data) {
+    struct bench *bench = data;
+    server_run(bench->isomap, SOCKET_PATH, bench->num_workers, RENDER_DIRECT);
+    return NULL;
+}
+
+/**
+ * Connect to the server, waiting for it to listen
+ *
+ * @return  The file descriptor of the connection
+ */
+int connect_server(void) {
+    struct timespec delay = {0, 10000000};
+    int fd;
+    for (unsigned int i = 0; (fd = server_connect(SOCKET_PATH)) < 0 && i < 500;
+         ++i)
+        nanosleep(&delay, NULL);
+    return fd;
+}
+
+/**
+ * Send random requests of each kind and store their latencies
+ *
+ * @param data  The benchmark of the client
+ * @return      NULL
+ */
+void *run_client(void *data) {
+    struct bench *bench = data;
+    struct render_projection projection = render_get_projection(bench->isomap);
+    int fd = connect_server();
+    for (unsigned int k = 0; k < NUM_KINDS; ++k) {
+        for (unsigned int r = 0; r < bench->num_requests; ++r) {
+            char request[REQUEST_LENGTH];
+            if (k < 2) {
+                const struct graph_node *nodes = bench->graph->nodes;
+                unsigned int num_nodes = bench->graph->num_nodes;
+                const struct location *start =
+                    &nodes[rand_r(&bench->seed) % num_nodes].location;
+                const struct location *end =
+                    &nodes[rand_r(&bench->seed) % num_nodes].location;
+                snprintf(request, REQUEST_LENGTH, "%s %d,%d,%d %d,%d,%d",
+                         kinds[k], start->x, start->y, start->z,
+                         end->x, end->y, end->z);
+            } else {
+                snprintf(request, REQUEST_LENGTH, "RENDER %u,%u,%u,%u qoi",
+                         rand_r(&bench->seed) % projection.width,
+                         rand_r(&bench->seed) % projection.height,
+                         VIEWPORT_SIZE, VIEWPORT_SIZE);
+            }
+            char *response;
+            size_t length;
+            double start = now();
+            server_request(fd, request, &response, &length);
+            bench->latencies[k * bench->num_requests + r] = now() - start;
+            free(response);
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+/**
+ * Compare two latencies
+ *
+ * @param first   The first latency
+ * @param second  The second latency
+ * @return        The comparison
+ */
+int compare_latencies(const void *first, const void *second) {
+    double a = *(const double*)first, b = *(const double*)second;
+    return (a > b) - (a < b);
+}
+
+int main(int argc, char *argv[]) {
+    const char *filename = argc > 1 ? argv[1] : DEFAULT_MAP;
+    unsigned int num_clients = argc > 2 ? atoi(argv[2]) : DEFAULT_CLIENTS;
+    unsigned int num_requests = argc > 3 ? atoi(argv[3]) : DEFAULT_REQUESTS;
+    FILE *input = fopen(filename, "r");
+    if (input == NULL) {
+        fprintf(stderr, "Error: invalid file path\n");
+        return 1;
+    }
+    struct isomap *isomap = isomap_create_from_json_file(input);
+    fclose(input);
+    if (isomap == NULL) {
+        fprintf(stderr, "Error: invalid map\n");
+        return 1;
+    }
+    struct graph *graph = graph_create(isomap->map, isomap->tileset);
+    if (num_clients == 0 || num_requests == 0 || graph->num_nodes == 0) {
+        fprintf(stderr, "Error: nothing to request\n");
+        return 1;
+    }
+    unlink(SOCKET_PATH);
+    struct bench server_bench = {.isomap = isomap, .num_workers = num_clients};
+    pthread_t server;
+    pthread_create(&server, NULL, run_server, &server_bench);
+
+    struct bench benches[num_clients];
+    pthread_t clients[num_clients];
+    double start = now();
+    for (unsigned int c = 0; c < num_clients; ++c) {
+        benches[c] = (struct bench){
+            .isomap       = isomap,
+            .graph        = graph,
+            .num_requests = num_requests,
+            .seed         = c + 1,
+            .latencies    = malloc(NUM_KINDS * num_requests * sizeof(double))
+        };
+        pthread_create(clients + c, NULL, run_client, benches + c);
+    }
+    for (unsigned int c = 0; c < num_clients; ++c)
+        pthread_join(clients[c], NULL);
+    double seconds = now() - start;
+
+    printf("%-8s %10s %10s %10s\n", "request", "count", "p50 (ms)",
+           "p99 (ms)");
+    unsigned int count = num_clients * num_requests;
+    double *latencies = malloc(count * sizeof(double));
+    for (unsigned int k = 0; k < NUM_KINDS; ++k) {
+        for (unsigned int c = 0; c < num_clients; ++c)
+            memcpy(latencies + c * num_requests,
+                   benches[c].latencies + k * num_requests,
+                   num_requests * sizeof(double));
+        qsort(latencies, count, sizeof(double), compare_latencies);
+        printf("%-8s %10u %10.3f %10.3f\n", kinds[k], count,
+               1000 * latencies[count / 2], 1000 * latencies[count * 99 / 100]);
+    }
+    printf("%u clients, %.0f requests/s\n", num_clients,
+           NUM_KINDS * count / seconds);
+    free(latencies);
+
+    int fd = connect_server();
+    char *response;
+    size_t length;
+    server_request(fd, "SHUTDOWN", &response, &length);
+    free(response);
+    close(fd);
+    pthread_join(server, NULL);
+    for (unsigned int c = 0; c < num_clients; ++c)
+        free(benches[c].latencies);
+    graph_delete(graph);
+    isomap_delete(isomap);
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Help functions //
+// -------------- //
+
+/**
+ * Return the smallest multiple of the maximal alignment greater than or equal
+ * to a size
+ *
+ * @param size  The size
+ * @return      The aligned size
+ */
+size_t arena_align(size_t size) {
+    return (size + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) *
+           _Alignof(max_align_t);
+}
+
+/**
+ * Add a block to an arena
+ *
+ * A shared block becomes the current block. A dedicated block, meant for a
+ * single allocation, is inserted behind the current block, so that the free
+ * space of the latter is not lost.
+ *
+ * @param arena      The arena
+ * @param size       The number of bytes of the block
+ * @param dedicated  True if the block is meant for a single allocation
+ * @return           The block
+ */
+struct arena_block *arena_add_block(struct arena *arena, size_t size,
+                                    bool dedicated) {
+    struct arena_block *block = malloc(sizeof(struct arena_block) + size);
+    block->size = size;
+    block->used = 0;
+    if (dedicated && arena->blocks != NULL) {
+        block->next = arena->blocks->next;
+        arena->blocks->next = block;
+    } else {
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+    ++arena->num_blocks;
+    arena->reserved += size;
+    return block;
+}
+
+// Functions //
+// --------- //
+
+struct arena *arena_create(void) {
+    struct arena *arena = malloc(sizeof(struct arena));
+    arena->blocks = NULL;
+    arena->last = NULL;
+    arena->last_size = 0;
+    arena->num_blocks = 0;
+    arena->num_allocations = 0;
+    arena->used = 0;
+    arena->reserved = 0;
+    arena->high_water = 0;
+    return arena;
+}
+
+void arena_delete(struct arena *arena) {
+    arena_reset(arena);
+    free(arena);
+}
+
+void arena_reset(struct arena *arena) {
+    while (arena->blocks != NULL) {
+        struct arena_block *block = arena->blocks;
+        arena->blocks = block->next;
+        free(block);
+    }
+    arena->last = NULL;
+    arena->last_size = 0;
+    arena->num_blocks = 0;
+    arena->used = 0;
+    arena->reserved = 0;
+}
+
+void *arena_alloc(struct arena *arena, size_t size) {
+    if (arena == NULL)
+        return malloc(size);
+    size = arena_align(size);
+    struct arena_block *block = arena->blocks;
+    if (size > ARENA_BLOCK_SIZE / 4)
+        block = arena_add_block(arena, size, true);
+    else if (block == NULL || block->size - block->used < size)
+        block = arena_add_block(arena, ARENA_BLOCK_SIZE, false);
+    void *ptr = (char*)block->data + block->used;
+    block->used += size;
+    arena->last = ptr;
+    arena->last_size = size;
+    ++arena->num_allocations;
+    arena->used += size;
+    if (arena->used > arena->high_water)
+        arena->high_water = arena->used;
+    return ptr;
+}
+
+void *arena_calloc(struct arena *arena, size_t count, size_t size) {
+    if (arena == NULL)
+        return calloc(count, size);
+    void *ptr = arena_alloc(arena, count * size);
+    memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void *arena_realloc(struct arena *arena, void *ptr,
+                    size_t old_size, size_t new_size) {
+    if (arena == NULL)
+        return realloc(ptr, new_size);
+    struct arena_block *block = arena->blocks;
+    if (ptr != NULL && ptr == arena->last &&
+        (char*)ptr + arena->last_size == (char*)block->data + block->used) {
+        size_t size = arena_align(new_size);
+        size_t start = (char*)ptr - (char*)block->data;
+        if (start + size <= block->size) {
+            block->used = start + size;
+            arena->used = arena->used - arena->last_size + size;
+            arena->last_size = size;
+            if (arena->used > arena->high_water)
+                arena->high_water = arena->used;
+            return ptr;
+        }
+    }
+    void *new_ptr = arena_alloc(arena, new_size);
+    if (ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+        arena->used -= arena_align(old_size);
+    }
+    return new_ptr;
+}
+
+void arena_free(struct arena *arena, void *ptr) {
+    if (arena == NULL)
+        free(ptr);
+}
+
+void arena_print_stats(FILE *stream,
+                       const struct arena *arena,
+                       const char *prefix) {
+    fprintf(stream, "%sArena of %zu block%s\n", prefix, arena->num_blocks,
+            arena->num_blocks <= 1 ? "" : "s");
+    fprintf(stream, "%s  allocations: %zu\n", prefix, arena->num_allocations);
+    fprintf(stream, "%s  bytes used: %zu\n", prefix, arena->used);
+    fprintf(stream, "%s  bytes reserved: %zu\n", prefix, arena->reserved);
+    fprintf(stream, "%s  high-water mark: %zu\n", prefix, arena->high_water);
+}
@@ -0,0 +1,157 @@
+/**
+ * arena.h
+ *
+ * Handle arenas (also called regions) of memory.
+ *
+ * An arena hands out memory from large blocks obtained with `malloc`, by
+ * simply bumping a pointer. Individual allocations are never freed: the whole
+ * arena is released at once when it is deleted. This is well suited for data
+ * structures made of many small objects that all share the same lifetime, such
+ * as the layers of a map, the directions of a tileset or the neighbors of the
+ * nodes of a graph.
+ *
+ *     block 2 (current)              block 1 (full)
+ *    +-------------+------------+   +-----------------------------+
+ *    | used        | free       |-->| used                        |
+ *    +-------------+------------+   +-----------------------------+
+ *                  ^
+ *                  next allocation
+ *
+ * Allocations larger than a quarter of a block get a block of their own, so
+ * that the free space of the current block is not wasted.
+ *
+ * All functions accept a NULL arena, in which case they behave as the
+ * corresponding functions of the standard library (`malloc`, `calloc`,
+ * `realloc` and `free`). This allows modules to be written once, whether
+ * their data lives in an arena or on the heap.
+ *
+ * The module provides the following data structures:
+ *
+ * - `struct arena_block`: a block of memory of an arena
+ * - `struct arena`: the arena itself
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE 65536
+
+// Types //
+// ----- //
+
+/**
+ * A block of memory of an arena
+ */
+struct arena_block {
+    struct arena_block *next; // The previous block of the arena
+    size_t size;              // The number of bytes of the block
+    size_t used;              // The number of bytes already handed out
+    max_align_t data[];       // The bytes of the block
+};
+
+/**
+ * An arena
+ */
+struct arena {
+    struct arena_block *blocks; // The blocks, the current one first
+    void *last;                 // The last allocation (or NULL)
+    size_t last_size;           // The size of the last allocation
+    size_t num_blocks;          // The number of blocks
+    size_t num_allocations;     // The number of allocations
+    size_t used;                // The number of bytes in use
+    size_t reserved;            // The number of bytes of the blocks
+    size_t high_water;          // The largest number of bytes in use
+};
+
+// Functions //
+// --------- //
+
+/**
+ * Create an empty arena
+ *
+ * Note: `arena_delete` should be called when the arena is not needed anymore.
+ *
+ * @return  The arena
+ */
+struct arena *arena_create(void);
+
+/**
+ * Delete an arena, releasing all the memory allocated in it
+ *
+ * @param arena  The arena to delete
+ */
+void arena_delete(struct arena *arena);
+
+/**
+ * Release all the memory allocated in an arena, without deleting it
+ *
+ * The high-water mark is kept, so that the peak usage of an arena that is
+ * reused many times can still be reported.
+ *
+ * @param arena  The arena
+ */
+void arena_reset(struct arena *arena);
+
+/**
+ * Allocate memory in an arena
+ *
+ * The memory is suitably aligned for any type.
+ *
+ * @param arena  The arena (or NULL for the heap)
+ * @param size   The number of bytes
+ * @return       The allocated memory
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * Allocate zero-initialized memory in an arena
+ *
+ * @param arena  The arena (or NULL for the heap)
+ * @param count  The number of elements
+ * @param size   The number of bytes of each element
+ * @return       The allocated memory
+ */
+void *arena_calloc(struct arena *arena, size_t count, size_t size);
+
+/**
+ * Resize memory allocated in an arena
+ *
+ * If `ptr` is the last allocation of the arena and there is enough room in
+ * its block, it is resized in place. Otherwise, new memory is allocated and
+ * the content is copied, the old memory being only released with the arena
+ * (it is no longer counted as used, though).
+ *
+ * @param arena     The arena (or NULL for the heap)
+ * @param ptr       The memory to resize (or NULL)
+ * @param old_size  The current number of bytes of `ptr`
+ * @param new_size  The new number of bytes
+ * @return          The resized memory
+ */
+void *arena_realloc(struct arena *arena, void *ptr,
+                    size_t old_size, size_t new_size);
+
+/**
+ * Free memory allocated in an arena
+ *
+ * Nothing happens if the arena is not NULL, since the memory is released
+ * with the arena.
+ *
+ * @param arena  The arena (or NULL for the heap)
+ * @param ptr    The memory to free
+ */
+void arena_free(struct arena *arena, void *ptr);
+
+/**
+ * Print the statistics of an arena to a stream
+ *
+ * @param stream  The stream
+ * @param arena   The arena
+ * @param prefix  The prefix to print for each line
+ */
+void arena_print_stats(FILE *stream,
+                       const struct arena *arena,
+                       const char *prefix);
+
+#endif
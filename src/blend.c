@@ -0,0 +1,164 @@
+#include "blend.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BLEND_X86_64
+#include <immintrin.h>
+#endif
+
+// Help functions //
+// -------------- //
+
+/**
+ * Draw a pixel over another one
+ *
+ * @param source  The source pixel
+ * @param target  The target pixel
+ * @return        The resulting pixel
+ */
+uint32_t blend_over_pixel(uint32_t source, uint32_t target) {
+    uint32_t alpha = 255 - (source >> 24);
+    uint32_t pixel = 0;
+    for (unsigned int k = 0; k < 32; k += 8) {
+        uint32_t t = ((target >> k) & 0xff) * alpha + 0x80;
+        uint32_t value = ((source >> k) & 0xff) + ((t + (t >> 8)) >> 8);
+        pixel |= (value > 255 ? 255 : value) << k;
+    }
+    return pixel;
+}
+
+#ifdef BLEND_X86_64
+
+/**
+ * Draw 4 pixels over 4 other ones with SSE2
+ *
+ * The 16-bit products are rounded as in `blend_over_pixel`.
+ *
+ * @param source  The source pixels
+ * @param target  The target pixels
+ * @return        The resulting pixels
+ */
+__m128i blend_over_sse2_pixels(__m128i source, __m128i target) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i rounding = _mm_set1_epi16(0x80);
+    __m128i alpha = _mm_sub_epi32(_mm_set1_epi32(255),
+                                  _mm_srli_epi32(source, 24));
+    alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+    __m128i low = _mm_mullo_epi16(_mm_unpacklo_epi8(target, zero),
+                                  _mm_unpacklo_epi32(alpha, alpha));
+    __m128i high = _mm_mullo_epi16(_mm_unpackhi_epi8(target, zero),
+                                   _mm_unpackhi_epi32(alpha, alpha));
+    low = _mm_add_epi16(low, rounding);
+    high = _mm_add_epi16(high, rounding);
+    low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+    high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+    return _mm_adds_epu8(source, _mm_packus_epi16(low, high));
+}
+
+/**
+ * Draw a row of pixels over another one with SSE2
+ *
+ * @param target      The target pixels, updated by the function
+ * @param source      The source pixels
+ * @param num_pixels  The number of pixels
+ * @return            The number of pixels drawn (a multiple of 4)
+ */
+unsigned int blend_over_sse2(uint32_t *target, const uint32_t *source,
+                             unsigned int num_pixels) {
+    __m128i opaque = _mm_set1_epi32((int)0xff000000);
+    __m128i zero = _mm_setzero_si128();
+    unsigned int i;
+    for (i = 0; i + 4 <= num_pixels; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(source + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, opaque),
+                                              opaque)) == 0xffff) {
+            _mm_storeu_si128((__m128i*)(target + i), s);
+        } else if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) != 0xffff) {
+            __m128i d = _mm_loadu_si128((const __m128i*)(target + i));
+            _mm_storeu_si128((__m128i*)(target + i),
+                             blend_over_sse2_pixels(s, d));
+        }
+    }
+    return i;
+}
+
+/**
+ * Draw 8 pixels over 8 other ones with AVX2
+ *
+ * @param source  The source pixels
+ * @param target  The target pixels
+ * @return        The resulting pixels
+ */
+__attribute__((target("avx2")))
+__m256i blend_over_avx2_pixels(__m256i source, __m256i target) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i rounding = _mm256_set1_epi16(0x80);
+    __m256i alpha = _mm256_sub_epi32(_mm256_set1_epi32(255),
+                                     _mm256_srli_epi32(source, 24));
+    alpha = _mm256_or_si256(alpha, _mm256_slli_epi32(alpha, 16));
+    __m256i low = _mm256_mullo_epi16(_mm256_unpacklo_epi8(target, zero),
+                                     _mm256_unpacklo_epi32(alpha, alpha));
+    __m256i high = _mm256_mullo_epi16(_mm256_unpackhi_epi8(target, zero),
+                                      _mm256_unpackhi_epi32(alpha, alpha));
+    low = _mm256_add_epi16(low, rounding);
+    high = _mm256_add_epi16(high, rounding);
+    low = _mm256_srli_epi16(_mm256_add_epi16(low, _mm256_srli_epi16(low, 8)),
+                            8);
+    high = _mm256_srli_epi16(_mm256_add_epi16(high,
+                                              _mm256_srli_epi16(high, 8)), 8);
+    return _mm256_adds_epu8(source, _mm256_packus_epi16(low, high));
+}
+
+/**
+ * Draw a row of pixels over another one with AVX2
+ *
+ * @param target      The target pixels, updated by the function
+ * @param source      The source pixels
+ * @param num_pixels  The number of pixels
+ * @return            The number of pixels drawn (a multiple of 8)
+ */
+__attribute__((target("avx2")))
+unsigned int blend_over_avx2(uint32_t *target, const uint32_t *source,
+                             unsigned int num_pixels) {
+    __m256i opaque = _mm256_set1_epi32((int)0xff000000);
+    __m256i zero = _mm256_setzero_si256();
+    unsigned int i;
+    for (i = 0; i + 8 <= num_pixels; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(source + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(
+                _mm256_and_si256(s, opaque), opaque)) == -1) {
+            _mm256_storeu_si256((__m256i*)(target + i), s);
+        } else if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) != -1) {
+            __m256i d = _mm256_loadu_si256((const __m256i*)(target + i));
+            _mm256_storeu_si256((__m256i*)(target + i),
+                                blend_over_avx2_pixels(s, d));
+        }
+    }
+    return i;
+}
+
+#endif
+
+// Functions //
+// --------- //
+
+void blend_over(uint32_t *target, const uint32_t *source,
+                unsigned int num_pixels) {
+    unsigned int i = 0;
+#ifdef BLEND_X86_64
+    if (__builtin_cpu_supports("avx2"))
+        i = blend_over_avx2(target, source, num_pixels);
+    i += blend_over_sse2(target + i, source + i, num_pixels - i);
+#endif
+    blend_over_scalar(target + i, source + i, num_pixels - i);
+}
+
+void blend_over_scalar(uint32_t *target, const uint32_t *source,
+                       unsigned int num_pixels) {
+    for (unsigned int i = 0; i < num_pixels; ++i) {
+        uint32_t alpha = source[i] >> 24;
+        if (alpha == 255)
+            target[i] = source[i];
+        else if (source[i] != 0)
+            target[i] = blend_over_pixel(source[i], target[i]);
+    }
+}
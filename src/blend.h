@@ -0,0 +1,50 @@
+/**
+ * blend.h
+ *
+ * Composite rows of premultiplied ARGB32 pixels.
+ *
+ * The only operation is the "over" operator, which draws a source pixel `s`
+ * above a target pixel `d`. Each of the four channels of the result is
+ *
+ *     s + d * (255 - alpha(s)) / 255
+ *
+ * where the product is rounded to the nearest integer and the sum is
+ * saturated to 255, exactly as cairo (through pixman) does, so that both
+ * give the same pixels.
+ *
+ * The rows are processed 8 pixels at a time with AVX2, or 4 pixels at a time
+ * with SSE2, when the processor supports them, and one pixel at a time
+ * otherwise. Runs of opaque or fully transparent source pixels are copied or
+ * skipped without any arithmetic.
+ */
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <stdint.h>
+
+// Functions //
+// --------- //
+
+/**
+ * Draw a row of pixels over another one
+ *
+ * @param target     The target pixels, updated by the function
+ * @param source     The source pixels
+ * @param num_pixels The number of pixels
+ */
+void blend_over(uint32_t *target, const uint32_t *source,
+                unsigned int num_pixels);
+
+/**
+ * Draw a row of pixels over another one, one pixel at a time
+ *
+ * The result is the same as with `blend_over`, which should be preferred.
+ *
+ * @param target     The target pixels, updated by the function
+ * @param source     The source pixels
+ * @param num_pixels The number of pixels
+ */
+void blend_over_scalar(uint32_t *target, const uint32_t *source,
+                       unsigned int num_pixels);
+
+#endif
@@ -0,0 +1,163 @@
+#include "chunk.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Help functions //
+// -------------- //
+
+/**
+ * Return the hash of chunk coordinates
+ *
+ * @param row     The row of the chunk
+ * @param column  The column of the chunk
+ * @return        The hash value
+ */
+unsigned int chunk_hash(unsigned int row, unsigned int column) {
+    unsigned int h = row * 0x9e3779b1u ^ column * 0x85ebca77u;
+    return h ^ (h >> 15);
+}
+
+/**
+ * Compare two chunks in row-major order
+ *
+ * @param chunk1  The first chunk
+ * @param chunk2  The second chunk
+ * @return        0  if the two chunks have the same coordinates
+ *                <0 if the first chunk comes before the second
+ *                >0 if the first chunk comes after the second
+ */
+int chunk_compare(const void *chunk1, const void *chunk2) {
+    const struct chunk *c1 = chunk1, *c2 = chunk2;
+    if (c1->row != c2->row)
+        return c1->row < c2->row ? -1 : 1;
+    if (c1->column != c2->column)
+        return c1->column < c2->column ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Return the slot of a chunk in the hash table
+ *
+ * If the chunk is not allocated, the returned slot is the free slot where it
+ * should be inserted.
+ *
+ * @param table   The chunk table
+ * @param row     The row of the chunk
+ * @param column  The column of the chunk
+ * @return        The slot index
+ */
+unsigned int chunk_find_slot(const struct chunk_table *table,
+                             unsigned int row, unsigned int column) {
+    unsigned int mask = table->num_slots - 1;
+    unsigned int s = chunk_hash(row, column) & mask;
+    while (table->slots[s] != -1) {
+        const struct chunk *chunk = table->chunks + table->slots[s];
+        if (chunk->row == row && chunk->column == column)
+            break;
+        s = (s + 1) & mask;
+    }
+    return s;
+}
+
+/**
+ * Return the position in row-major order of the first chunk at or after the
+ * given chunk coordinates
+ *
+ * @param table   The chunk table
+ * @param row     The row of the chunk
+ * @param column  The column of the chunk
+ * @return        The position, between 0 and the number of chunks
+ */
+unsigned int chunk_find_position(const struct chunk_table *table,
+                                 unsigned int row, unsigned int column) {
+    struct chunk key = {row, column, NULL};
+    unsigned int low = 0, high = table->num_chunks;
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        if (chunk_compare(table->chunks + table->order[middle], &key) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/**
+ * Rebuild the hash table of a chunk table with the given number of slots
+ *
+ * @param table      The chunk table
+ * @param num_slots  The number of slots (a power of 2)
+ */
+void chunk_rehash(struct chunk_table *table, unsigned int num_slots) {
+    free(table->slots);
+    table->num_slots = num_slots;
+    table->slots = malloc(num_slots * sizeof(int));
+    for (unsigned int s = 0; s < num_slots; ++s)
+        table->slots[s] = -1;
+    for (unsigned int i = 0; i < table->num_chunks; ++i) {
+        const struct chunk *chunk = table->chunks + i;
+        table->slots[chunk_find_slot(table, chunk->row, chunk->column)] = i;
+    }
+}
+
+// Functions //
+// --------- //
+
+struct chunk_table *chunk_create_table(void) {
+    struct chunk_table *table = malloc(sizeof(struct chunk_table));
+    table->chunks = malloc(sizeof(struct chunk));
+    table->order = malloc(sizeof(unsigned int));
+    table->num_chunks = 0;
+    table->capacity = 1;
+    table->slots = NULL;
+    chunk_rehash(table, 8);
+    return table;
+}
+
+void chunk_delete_table(struct chunk_table *table) {
+    for (unsigned int i = 0; i < table->num_chunks; ++i)
+        free(table->chunks[i].tiles);
+    free(table->chunks);
+    free(table->order);
+    free(table->slots);
+    free(table);
+}
+
+tile_id *chunk_get(const struct chunk_table *table,
+                   unsigned int row, unsigned int column) {
+    int i = table->slots[chunk_find_slot(table, row, column)];
+    return i == -1 ? NULL : table->chunks[i].tiles;
+}
+
+tile_id *chunk_get_or_add(struct chunk_table *table,
+                          unsigned int row, unsigned int column) {
+    unsigned int s = chunk_find_slot(table, row, column);
+    if (table->slots[s] != -1)
+        return table->chunks[table->slots[s]].tiles;
+    if (table->num_chunks == table->capacity) {
+        table->capacity *= 2;
+        table->chunks = realloc(table->chunks,
+                                table->capacity * sizeof(struct chunk));
+        table->order = realloc(table->order,
+                               table->capacity * sizeof(unsigned int));
+    }
+    unsigned int p = chunk_find_position(table, row, column);
+    memmove(table->order + p + 1, table->order + p,
+            (table->num_chunks - p) * sizeof(unsigned int));
+    table->order[p] = table->num_chunks;
+    struct chunk *chunk = table->chunks + table->num_chunks;
+    chunk->row = row;
+    chunk->column = column;
+    chunk->tiles = calloc(CHUNK_SIZE * CHUNK_SIZE, sizeof(tile_id));
+    table->slots[s] = table->num_chunks;
+    ++table->num_chunks;
+    if (2 * table->num_chunks > table->num_slots)
+        chunk_rehash(table, 2 * table->num_slots);
+    return chunk->tiles;
+}
+
+const struct chunk *chunk_next(const struct chunk_table *table,
+                               unsigned int row, unsigned int column) {
+    unsigned int p = chunk_find_position(table, row, column);
+    return p < table->num_chunks ? table->chunks + table->order[p] : NULL;
+}
@@ -0,0 +1,129 @@
+/**
+ * chunk.h
+ *
+ * Handle sparse layers split into fixed-size chunks.
+ *
+ * A chunk is a square of `CHUNK_SIZE x CHUNK_SIZE` cells of a layer. A chunk
+ * table only allocates the chunks containing at least one tile, so that a
+ * layer covering a huge, mostly empty rectangle stays small in memory.
+ *
+ * Chunks are identified by their row and column in chunk units, i.e. the cell
+ * at row `r` and column `c` of a layer belongs to the chunk at row
+ * `r / CHUNK_SIZE` and column `c / CHUNK_SIZE`:
+ *
+ *          column 0   column 1
+ *         +--------+--------+
+ *  row 0  | chunk  | (not   |
+ *         |        |  alloc)|
+ *         +--------+--------+
+ *  row 1  | (not   | chunk  |
+ *         |  alloc)|        |
+ *         +--------+--------+
+ *
+ * Chunks are retrieved in constant time through an open addressing hash table
+ * and can also be visited in row-major order, which allows iterating over a
+ * chunked layer without ever looking at its empty regions. The row-major
+ * order is an index kept up to date when chunks are added (in constant time
+ * when they are added in that order, as when a layer is loaded), so that
+ * visiting the chunks never modifies the table and several threads can read
+ * a table at once.
+ *
+ * The module provides the following data structures:
+ *
+ * - `struct chunk`: a chunk of tiles
+ * - `struct chunk_table`: the allocated chunks of a layer
+ */
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include "map.h"
+
+#include <stdbool.h>
+
+#define CHUNK_SIZE 32
+
+// Types //
+// ----- //
+
+/**
+ * A chunk of tiles
+ */
+struct chunk {
+    unsigned int row;    // The row of the chunk, in chunk units
+    unsigned int column; // The column of the chunk, in chunk units
+    tile_id *tiles;      // The tiles of the chunk, row by row
+};
+
+/**
+ * A table of chunks
+ *
+ * Invariant: the chunks of indices `order[0]`, `order[1]`, ... are ordered by
+ * row, then by column.
+ */
+struct chunk_table {
+    struct chunk *chunks;    // The allocated chunks, in insertion order
+    unsigned int *order;     // The chunk indices, in row-major order
+    unsigned int num_chunks; // The number of allocated chunks
+    unsigned int capacity;   // The chunks capacity
+    int *slots;              // The hash table (chunk indices, -1 if free)
+    unsigned int num_slots;  // The number of slots (a power of 2)
+};
+
+// Functions //
+// --------- //
+
+/**
+ * Create an empty chunk table
+ *
+ * @return  The chunk table
+ */
+struct chunk_table *chunk_create_table(void);
+
+/**
+ * Delete a chunk table and all its chunks
+ *
+ * @param table  The chunk table to delete
+ */
+void chunk_delete_table(struct chunk_table *table);
+
+/**
+ * Return the tiles of the chunk at the given chunk coordinates
+ *
+ * If the chunk is not allocated, return NULL.
+ *
+ * @param table   The chunk table
+ * @param row     The row of the chunk
+ * @param column  The column of the chunk
+ * @return        The tiles of the chunk or NULL
+ */
+tile_id *chunk_get(const struct chunk_table *table,
+                   unsigned int row, unsigned int column);
+
+/**
+ * Return the tiles of the chunk at the given chunk coordinates
+ *
+ * If the chunk is not allocated, it is created with empty tiles.
+ *
+ * @param table   The chunk table
+ * @param row     The row of the chunk
+ * @param column  The column of the chunk
+ * @return        The tiles of the chunk
+ */
+tile_id *chunk_get_or_add(struct chunk_table *table,
+                          unsigned int row, unsigned int column);
+
+/**
+ * Return the first allocated chunk at or after the given chunk coordinates
+ *
+ * Chunks are compared in row-major order. If there is no such chunk, return
+ * NULL.
+ *
+ * @param table   The chunk table
+ * @param row     The row of the chunk
+ * @param column  The column of the chunk
+ * @return        The first chunk at or after (row, column) or NULL
+ */
+const struct chunk *chunk_next(const struct chunk_table *table,
+                               unsigned int row, unsigned int column);
+
+#endif
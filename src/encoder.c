@@ -0,0 +1,539 @@
+#include "encoder.h"
+#include "stats.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define ENCODER_NUM_FILTERS 5
+#define ENCODER_QOI_OP_INDEX 0x00
+#define ENCODER_QOI_OP_DIFF 0x40
+#define ENCODER_QOI_OP_LUMA 0x80
+#define ENCODER_QOI_OP_RUN 0xc0
+#define ENCODER_QOI_OP_RGB 0xfe
+#define ENCODER_QOI_OP_RGBA 0xff
+#define ENCODER_QOI_MAX_RUN 62
+
+// Types //
+// ----- //
+
+/**
+ * Consecutive rows of a PNG image, filtered and compressed on their own
+ */
+struct encoder_chunk {
+    const struct encoder *encoder; // The encoder
+    const unsigned char *data;     // The first pixel of the first row
+    int stride;                    // The number of bytes between two rows
+    unsigned int num_rows;         // The number of rows
+    bool first;                    // True if the chunk starts the call
+    unsigned char *output;         // The compressed rows
+    unsigned long output_length;   // The length of the compressed rows
+    unsigned long length;          // The length of the filtered rows
+    unsigned long adler;           // The checksum of the filtered rows
+    bool valid;                    // False if the compression failed
+};
+
+/**
+ * The chunks compressed by one thread
+ */
+struct encoder_job {
+    struct encoder_chunk *chunks; // The chunks of the call
+    unsigned int num_chunks;      // The number of chunks of the call
+    unsigned int first;           // The first chunk of the thread
+    unsigned int step;            // The step between two chunks of the thread
+};
+
+// Help functions //
+// -------------- //
+
+/**
+ * Store a 32-bit integer in big-endian order
+ *
+ * @param bytes  The 4 bytes receiving the integer
+ * @param value  The integer
+ */
+void encoder_store_uint32(unsigned char *bytes, uint32_t value) {
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+/**
+ * Write bytes to the stream of an encoder
+ *
+ * @param encoder  The encoder
+ * @param data     The bytes
+ * @param length   The number of bytes
+ */
+void encoder_write(struct encoder *encoder, const void *data,
+                   unsigned long length) {
+    if (length > 0 && fwrite(data, 1, length, encoder->stream) != length)
+        encoder->valid = false;
+}
+
+/**
+ * Write a chunk of a PNG file
+ *
+ * @param encoder  The encoder
+ * @param type     The type of the chunk (4 characters)
+ * @param data     The data of the chunk
+ * @param length   The length of the data
+ */
+void encoder_write_chunk(struct encoder *encoder, const char *type,
+                         const unsigned char *data, uint32_t length) {
+    unsigned char bytes[4];
+    encoder_store_uint32(bytes, length);
+    encoder_write(encoder, bytes, 4);
+    encoder_write(encoder, type, 4);
+    encoder_write(encoder, data, length);
+    uLong crc = crc32(0, (const Bytef*)type, 4);
+    if (length > 0)
+        crc = crc32(crc, data, length);
+    encoder_store_uint32(bytes, crc);
+    encoder_write(encoder, bytes, 4);
+}
+
+/**
+ * Convert a row of premultiplied ARGB32 pixels to non-premultiplied RGBA
+ *
+ * @param row     The RGBA bytes
+ * @param pixels  The ARGB32 pixels
+ * @param width   The number of pixels
+ */
+void encoder_convert_row(unsigned char *row, const uint32_t *pixels,
+                         unsigned int width) {
+    for (unsigned int i = 0; i < width; ++i, row += 4) {
+        uint32_t pixel = pixels[i];
+        uint32_t alpha = pixel >> 24;
+        if (alpha == 0) {
+            row[0] = row[1] = row[2] = row[3] = 0;
+        } else if (alpha == 255) {
+            row[0] = pixel >> 16;
+            row[1] = pixel >> 8;
+            row[2] = pixel;
+            row[3] = 255;
+        } else {
+            row[0] = (((pixel >> 16) & 0xff) * 255 + alpha / 2) / alpha;
+            row[1] = (((pixel >> 8) & 0xff) * 255 + alpha / 2) / alpha;
+            row[2] = ((pixel & 0xff) * 255 + alpha / 2) / alpha;
+            row[3] = alpha;
+        }
+    }
+}
+
+/**
+ * Return the Paeth predictor of a byte
+ *
+ * @param a  The byte on the left
+ * @param b  The byte above
+ * @param c  The byte above on the left
+ * @return   The predictor
+ */
+unsigned char encoder_paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+/**
+ * Filter a row with each PNG filter and return the best one
+ *
+ * As in libpng, the best filter is the one minimizing the sum of the
+ * absolute values of the filtered bytes, seen as signed bytes.
+ *
+ * @param row       The row, in RGBA
+ * @param previous  The row above, in RGBA
+ * @param length    The number of bytes of a row
+ * @param filtered  The row filtered with each filter, starting with the
+ *                  filter type
+ * @return          The best filtered row
+ */
+unsigned char *encoder_filter_row(const unsigned char *row,
+                                  const unsigned char *previous,
+                                  unsigned int length,
+                                  unsigned char *filtered[]) {
+    unsigned long sums[ENCODER_NUM_FILTERS] = {0, 0, 0, 0, 0};
+    for (unsigned int f = 0; f < ENCODER_NUM_FILTERS; ++f)
+        filtered[f][0] = f;
+    for (unsigned int i = 0; i < length; ++i) {
+        int a = i >= 4 ? row[i - 4] : 0;
+        int b = previous[i];
+        int c = i >= 4 ? previous[i - 4] : 0;
+        unsigned char values[ENCODER_NUM_FILTERS] = {
+            row[i],
+            row[i] - a,
+            row[i] - b,
+            row[i] - (a + b) / 2,
+            row[i] - encoder_paeth(a, b, c)
+        };
+        for (unsigned int f = 0; f < ENCODER_NUM_FILTERS; ++f) {
+            filtered[f][i + 1] = values[f];
+            sums[f] += abs((signed char)values[f]);
+        }
+    }
+    unsigned int best = 0;
+    for (unsigned int f = 1; f < ENCODER_NUM_FILTERS; ++f)
+        if (sums[f] < sums[best])
+            best = f;
+    return filtered[best];
+}
+
+/**
+ * Filter and compress a chunk of a PNG image
+ *
+ * The rows are compressed as a raw deflate stream ending with a sync flush,
+ * so that the compressed chunks can be concatenated.
+ *
+ * @param chunk  The chunk
+ */
+void encoder_compress_chunk(struct encoder_chunk *chunk) {
+    const struct encoder *encoder = chunk->encoder;
+    unsigned int length = 4 * encoder->width;
+    unsigned char *rows[2] = {malloc(length + 1), malloc(length + 1)};
+    unsigned char *filtered[ENCODER_NUM_FILTERS];
+    for (unsigned int f = 0; f < ENCODER_NUM_FILTERS; ++f)
+        filtered[f] = malloc(length + 1);
+    if (chunk->first)
+        memcpy(rows[0], encoder->row, length);
+    else
+        encoder_convert_row(rows[0],
+                            (const uint32_t*)(chunk->data - chunk->stride),
+                            encoder->width);
+    chunk->length = (unsigned long)chunk->num_rows * (length + 1);
+    unsigned char *rows_filtered = malloc(chunk->length);
+    for (unsigned int r = 0; r < chunk->num_rows; ++r) {
+        encoder_convert_row(rows[1], (const uint32_t*)(chunk->data +
+                                                       (long)r * chunk->stride),
+                            encoder->width);
+        unsigned char *row = rows_filtered + r * (length + 1);
+        if (encoder->level == 0) {
+            row[0] = 0;
+            memcpy(row + 1, rows[1], length);
+        } else {
+            memcpy(row, encoder_filter_row(rows[1], rows[0], length, filtered),
+                   length + 1);
+        }
+        unsigned char *swap = rows[0];
+        rows[0] = rows[1];
+        rows[1] = swap;
+    }
+    chunk->adler = adler32(adler32(0, NULL, 0), rows_filtered, chunk->length);
+    z_stream zstream;
+    memset(&zstream, 0, sizeof(z_stream));
+    chunk->valid = deflateInit2(&zstream, encoder->level, Z_DEFLATED, -15, 8,
+                                Z_DEFAULT_STRATEGY) == Z_OK;
+    unsigned long capacity = deflateBound(&zstream, chunk->length) + 16;
+    chunk->output = malloc(capacity);
+    zstream.next_in = rows_filtered;
+    zstream.avail_in = chunk->length;
+    zstream.next_out = chunk->output;
+    zstream.avail_out = capacity;
+    chunk->valid = chunk->valid && deflate(&zstream, Z_SYNC_FLUSH) == Z_OK &&
+                   zstream.avail_in == 0;
+    chunk->output_length = capacity - zstream.avail_out;
+    deflateEnd(&zstream);
+    free(rows_filtered);
+    for (unsigned int f = 0; f < ENCODER_NUM_FILTERS; ++f)
+        free(filtered[f]);
+    free(rows[0]);
+    free(rows[1]);
+}
+
+/**
+ * Compress the chunks of a thread
+ *
+ * @param job  The job of the thread (a `struct encoder_job *`)
+ * @return     NULL
+ */
+void *encoder_run_job(void *job) {
+    const struct encoder_job *j = job;
+    for (unsigned int c = j->first; c < j->num_chunks; c += j->step)
+        encoder_compress_chunk(j->chunks + c);
+    return NULL;
+}
+
+/**
+ * Compress the chunks of a thread helping the encoding thread
+ *
+ * The CPU time of the thread is added to the encoding phase.
+ *
+ * @param job  The job of the thread (a `struct encoder_job *`)
+ * @return     NULL
+ */
+void *encoder_run_job_thread(void *job) {
+    STATS_START(timer);
+    encoder_run_job(job);
+    STATS_STOP_CPU(timer, STATS_ENCODE);
+    return NULL;
+}
+
+/**
+ * Encode rows of a PNG image
+ *
+ * The rows are cut into chunks at the multiples of `ENCODER_CHUNK_ROWS`,
+ * which are compressed by the threads, then written in order, each one in
+ * its own IDAT chunk.
+ *
+ * @param encoder   The encoder
+ * @param data      The first pixel of the first row
+ * @param stride    The number of bytes between two rows
+ * @param num_rows  The number of rows
+ */
+void encoder_write_png_rows(struct encoder *encoder,
+                            const unsigned char *data,
+                            int stride,
+                            unsigned int num_rows) {
+    unsigned int num_chunks = 0;
+    unsigned int capacity = num_rows / ENCODER_CHUNK_ROWS + 2;
+    struct encoder_chunk *chunks = malloc(capacity *
+                                          sizeof(struct encoder_chunk));
+    for (unsigned int r = 0; r < num_rows; ) {
+        unsigned int size = ENCODER_CHUNK_ROWS -
+                            (encoder->num_rows + r) % ENCODER_CHUNK_ROWS;
+        if (size > num_rows - r)
+            size = num_rows - r;
+        chunks[num_chunks++] = (struct encoder_chunk){
+            .encoder  = encoder,
+            .data     = data + (long)r * stride,
+            .stride   = stride,
+            .num_rows = size,
+            .first    = r == 0
+        };
+        r += size;
+    }
+    unsigned int num_threads = encoder->num_threads < num_chunks ?
+                               encoder->num_threads : num_chunks;
+    struct encoder_job *jobs = malloc(num_threads * sizeof(struct encoder_job));
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    for (unsigned int t = 0; t < num_threads; ++t)
+        jobs[t] = (struct encoder_job){chunks, num_chunks, t, num_threads};
+    for (unsigned int t = 1; t < num_threads; ++t)
+        pthread_create(threads + t, NULL, encoder_run_job_thread,
+                       jobs + t);
+    if (num_threads > 0)
+        encoder_run_job(jobs);
+    for (unsigned int t = 1; t < num_threads; ++t)
+        pthread_join(threads[t], NULL);
+    for (unsigned int c = 0; c < num_chunks; ++c) {
+        if (!chunks[c].valid)
+            encoder->valid = false;
+        encoder_write_chunk(encoder, "IDAT", chunks[c].output,
+                            chunks[c].output_length);
+        encoder->adler = adler32_combine(encoder->adler, chunks[c].adler,
+                                         chunks[c].length);
+        free(chunks[c].output);
+    }
+    encoder_convert_row(encoder->row, (const uint32_t*)(data + (long)(num_rows
+                                                        - 1) * stride),
+                        encoder->width);
+    free(threads);
+    free(jobs);
+    free(chunks);
+}
+
+/**
+ * Encode a pixel of a QOI image into a buffer
+ *
+ * @param encoder  The encoder
+ * @param pixel    The pixel, as the bytes R, G, B and A in memory order
+ * @param bytes    The buffer, where the encoded bytes are written
+ * @return         The number of encoded bytes
+ */
+unsigned int encoder_encode_qoi_pixel(struct encoder *encoder,
+                                      const unsigned char *pixel,
+                                      unsigned char *bytes) {
+    uint32_t value;
+    memcpy(&value, pixel, 4);
+    unsigned int n = 0;
+    if (value == encoder->qoi_previous) {
+        if (++encoder->qoi_run == ENCODER_QOI_MAX_RUN) {
+            bytes[n++] = ENCODER_QOI_OP_RUN | (encoder->qoi_run - 1);
+            encoder->qoi_run = 0;
+        }
+        return n;
+    }
+    if (encoder->qoi_run > 0) {
+        bytes[n++] = ENCODER_QOI_OP_RUN | (encoder->qoi_run - 1);
+        encoder->qoi_run = 0;
+    }
+    unsigned char previous[4];
+    memcpy(previous, &encoder->qoi_previous, 4);
+    encoder->qoi_previous = value;
+    unsigned int index = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 +
+                          pixel[3] * 11) % 64;
+    if (encoder->qoi_index[index] == value) {
+        bytes[n++] = ENCODER_QOI_OP_INDEX | index;
+        return n;
+    }
+    encoder->qoi_index[index] = value;
+    if (pixel[3] != previous[3]) {
+        bytes[n++] = ENCODER_QOI_OP_RGBA;
+        memcpy(bytes + n, pixel, 4);
+        return n + 4;
+    }
+    signed char dr = pixel[0] - previous[0];
+    signed char dg = pixel[1] - previous[1];
+    signed char db = pixel[2] - previous[2];
+    signed char dr_dg = dr - dg, db_dg = db - dg;
+    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+        bytes[n++] = ENCODER_QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 |
+                     (db + 2);
+    } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+               db_dg >= -8 && db_dg <= 7) {
+        bytes[n++] = ENCODER_QOI_OP_LUMA | (dg + 32);
+        bytes[n++] = (dr_dg + 8) << 4 | (db_dg + 8);
+    } else {
+        bytes[n++] = ENCODER_QOI_OP_RGB;
+        memcpy(bytes + n, pixel, 3);
+        n += 3;
+    }
+    return n;
+}
+
+/**
+ * Encode a row of an uncompressed or QOI image
+ *
+ * The row is in `encoder->row`.
+ *
+ * @param encoder  The encoder
+ */
+void encoder_write_other_row(struct encoder *encoder) {
+    unsigned int width = encoder->width;
+    if (encoder->format == ENCODER_RAW || encoder->format == ENCODER_PAM) {
+        encoder_write(encoder, encoder->row, 4 * width);
+    } else if (encoder->format == ENCODER_PPM) {
+        for (unsigned int i = 0; i < width; ++i)
+            memcpy(encoder->buffer + 3 * i, encoder->row + 4 * i, 3);
+        encoder_write(encoder, encoder->buffer, 3 * width);
+    } else {
+        unsigned long n = 0;
+        for (unsigned int i = 0; i < width; ++i)
+            n += encoder_encode_qoi_pixel(encoder, encoder->row + 4 * i,
+                                          encoder->buffer + n);
+        encoder_write(encoder, encoder->buffer, n);
+    }
+}
+
+// Functions //
+// --------- //
+
+bool encoder_format_by_name(const char *name, enum encoder_format *format) {
+    static const char *names[] = {"png", "raw", "ppm", "pam", "qoi"};
+    for (unsigned int f = 0; f < sizeof(names) / sizeof(names[0]); ++f) {
+        if (strcmp(name, names[f]) == 0) {
+            *format = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct encoder *encoder_create(FILE *stream,
+                               enum encoder_format format,
+                               unsigned int width,
+                               unsigned int height,
+                               int level,
+                               unsigned int num_threads) {
+    struct encoder *encoder = malloc(sizeof(struct encoder));
+    encoder->stream = stream;
+    encoder->format = format;
+    encoder->width = width;
+    encoder->height = height;
+    encoder->num_rows = 0;
+    encoder->level = level < 0 ? 0 : level > 9 ? 9 : level;
+    encoder->num_threads = num_threads > 0 ? num_threads : 1;
+    encoder->adler = adler32(0, NULL, 0);
+    encoder->row = calloc(4 * (size_t)width + 1, 1);
+    encoder->buffer = malloc(5 * (size_t)width + 1);
+    memset(encoder->qoi_index, 0, sizeof(encoder->qoi_index));
+    unsigned char previous[4] = {0, 0, 0, 255};
+    memcpy(&encoder->qoi_previous, previous, 4);
+    encoder->qoi_run = 0;
+    encoder->valid = true;
+    char header[128];
+    if (format == ENCODER_PNG) {
+        static const unsigned char signature[8] = {
+            0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+        };
+        encoder_write(encoder, signature, 8);
+        unsigned char bytes[13] = {0};
+        encoder_store_uint32(bytes, width);
+        encoder_store_uint32(bytes + 4, height);
+        bytes[8] = 8; // The bit depth
+        bytes[9] = 6; // The color type (RGBA)
+        encoder_write_chunk(encoder, "IHDR", bytes, 13);
+        unsigned int flevel = encoder->level < 2 ? 0 : encoder->level < 6 ? 1 :
+                              encoder->level == 6 ? 2 : 3;
+        unsigned char zlib_header[2] = {0x78, flevel << 6};
+        zlib_header[1] += (31 - (zlib_header[0] * 256 + zlib_header[1]) % 31)
+                          % 31;
+        encoder_write_chunk(encoder, "IDAT", zlib_header, 2);
+    } else if (format == ENCODER_PPM) {
+        encoder_write(encoder, header,
+                      sprintf(header, "P6\n%u %u\n255\n", width, height));
+    } else if (format == ENCODER_PAM) {
+        encoder_write(encoder, header,
+                      sprintf(header, "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\n"
+                              "MAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",
+                              width, height));
+    } else if (format == ENCODER_QOI) {
+        unsigned char bytes[14] = {'q', 'o', 'i', 'f'};
+        encoder_store_uint32(bytes + 4, width);
+        encoder_store_uint32(bytes + 8, height);
+        bytes[12] = 4; // The number of channels
+        bytes[13] = 0; // sRGB with linear alpha
+        encoder_write(encoder, bytes, 14);
+    }
+    return encoder;
+}
+
+bool encoder_write_rows(struct encoder *encoder,
+                        const unsigned char *data,
+                        int stride,
+                        unsigned int num_rows) {
+    if (num_rows > encoder->height - encoder->num_rows)
+        num_rows = encoder->height - encoder->num_rows;
+    if (num_rows == 0 || !encoder->valid)
+        return encoder->valid;
+    STATS_START(timer);
+    if (encoder->format == ENCODER_PNG) {
+        encoder_write_png_rows(encoder, data, stride, num_rows);
+    } else {
+        for (unsigned int r = 0; r < num_rows; ++r) {
+            encoder_convert_row(encoder->row,
+                                (const uint32_t*)(data + (long)r * stride),
+                                encoder->width);
+            encoder_write_other_row(encoder);
+        }
+    }
+    encoder->num_rows += num_rows;
+    STATS_STOP(timer, STATS_ENCODE);
+    return encoder->valid;
+}
+
+bool encoder_delete(struct encoder *encoder) {
+    STATS_START(timer);
+    if (encoder->format == ENCODER_PNG) {
+        unsigned char end[6] = {0x03, 0x00}; // An empty final block
+        encoder_store_uint32(end + 2, encoder->adler);
+        encoder_write_chunk(encoder, "IDAT", end, 6);
+        encoder_write_chunk(encoder, "IEND", NULL, 0);
+    } else if (encoder->format == ENCODER_QOI) {
+        unsigned char end[9] = {0, 0, 0, 0, 0, 0, 0, 0, 1};
+        if (encoder->qoi_run > 0) {
+            end[0] = ENCODER_QOI_OP_RUN | (encoder->qoi_run - 1);
+            encoder_write(encoder, end, 1);
+            end[0] = 0;
+        }
+        encoder_write(encoder, end + 1, 8);
+    }
+    bool valid = encoder->valid && encoder->num_rows == encoder->height &&
+                 fflush(encoder->stream) == 0;
+    STATS_STOP(timer, STATS_ENCODE);
+    free(encoder->row);
+    free(encoder->buffer);
+    free(encoder);
+    return valid;
+}
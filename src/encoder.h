@@ -0,0 +1,139 @@
+/**
+ * encoder.h
+ *
+ * Encode images to files in a streaming fashion.
+ *
+ * An encoder receives the rows of an image from top to bottom, in as many
+ * calls as needed, and writes them to a stream as soon as they are encoded.
+ * Only the rows of the current call and a few buffers are kept in memory, so
+ * that images much larger than the available memory can be written, as long
+ * as they are produced a few rows at a time.
+ *
+ * The rows are given as premultiplied ARGB32 pixels, as stored in cairo image
+ * surfaces, and written as non-premultiplied 8-bit pixels, as cairo does. The
+ * supported formats are:
+ *
+ * - PNG: each row is filtered with the PNG filter that is likely to compress
+ *   best, then compressed with zlib at a given level (0 only stores the
+ *   rows, without filtering them). The rows are cut into chunks of
+ *   `ENCODER_CHUNK_ROWS` rows, filtered and compressed independently by
+ *   several threads, then written in order. The file does not depend on the
+ *   number of threads.
+ * - raw: the RGBA bytes of the rows, without any header
+ * - PPM: the binary portable pixmap format (P6), without the alpha channel
+ * - PAM: the portable arbitrary map format (P7), with the RGB_ALPHA tuples
+ * - QOI: the "quite OK image" format, a fast lossless compression
+ *
+ * The module provides the following data structures:
+ *
+ * - `enum encoder_format`: the format of an image
+ * - `struct encoder`: an image being encoded
+ */
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define ENCODER_DEFAULT_LEVEL 6
+#define ENCODER_CHUNK_ROWS 64
+
+// Types //
+// ----- //
+
+/**
+ * The format of an image
+ */
+enum encoder_format {
+    ENCODER_PNG, // Portable network graphics
+    ENCODER_RAW, // RGBA bytes, without header
+    ENCODER_PPM, // Portable pixmap (RGB)
+    ENCODER_PAM, // Portable arbitrary map (RGBA)
+    ENCODER_QOI, // Quite OK image
+};
+
+/**
+ * An image being encoded
+ */
+struct encoder {
+    FILE *stream;                // The stream
+    enum encoder_format format;  // The format of the image
+    unsigned int width;          // The width of the image
+    unsigned int height;         // The height of the image
+    unsigned int num_rows;       // The number of rows already encoded
+    int level;                   // The compression level (PNG)
+    unsigned int num_threads;    // The number of threads (PNG)
+    unsigned long adler;         // The checksum of the filtered rows (PNG)
+    unsigned char *row;          // The last row, in RGBA
+    unsigned char *buffer;       // The bytes of a row being written
+    uint32_t qoi_index[64];      // The recently seen pixels (QOI)
+    uint32_t qoi_previous;       // The previous pixel, in RGBA (QOI)
+    unsigned int qoi_run;        // The length of the current run (QOI)
+    bool valid;                  // False if an error occurred
+};
+
+// Functions //
+// --------- //
+
+/**
+ * Return the image format associated with a name
+ *
+ * The names are "png", "raw", "ppm", "pam" and "qoi".
+ *
+ * @param name    The name of the format
+ * @param format  The format, set by the function
+ * @return        True if the name is known
+ */
+bool encoder_format_by_name(const char *name, enum encoder_format *format);
+
+/**
+ * Create an encoder writing an image to a stream
+ *
+ * The header of the image is written immediately.
+ *
+ * @param stream       The stream
+ * @param format       The format of the image
+ * @param width        The width of the image
+ * @param height       The height of the image
+ * @param level        The compression level of PNG images, from 0 (no
+ *                     compression) to 9 (best compression)
+ * @param num_threads  The number of threads compressing PNG images (0 is the
+ *                     same as 1)
+ * @return             The encoder
+ */
+struct encoder *encoder_create(FILE *stream,
+                               enum encoder_format format,
+                               unsigned int width,
+                               unsigned int height,
+                               int level,
+                               unsigned int num_threads);
+
+/**
+ * Encode rows of an image
+ *
+ * The rows following the last encoded row are given. Rows beyond the height
+ * of the image are ignored.
+ *
+ * @param encoder   The encoder
+ * @param data      The first pixel of the first row (premultiplied ARGB32)
+ * @param stride    The number of bytes between two rows
+ * @param num_rows  The number of rows
+ * @return          True if no error occurred so far
+ */
+bool encoder_write_rows(struct encoder *encoder,
+                        const unsigned char *data,
+                        int stride,
+                        unsigned int num_rows);
+
+/**
+ * Finish an image and delete its encoder
+ *
+ * The stream is flushed but not closed.
+ *
+ * @param encoder  The encoder
+ * @return         True if all rows were encoded and written without error
+ */
+bool encoder_delete(struct encoder *encoder);
+
+#endif
@@ -7,6 +7,28 @@ struct vect geometry_box_to_vect(const struct box *b) {
                          b->zmax - b->zmin};
 }
 
+bool geometry_is_box_empty(const struct box *b) {
+    return b->xmax < b->xmin || b->ymax < b->ymin || b->zmax < b->zmin;
+}
+
+struct box geometry_union_box(const struct box *b1, const struct box *b2) {
+    if (geometry_is_box_empty(b1)) return *b2;
+    if (geometry_is_box_empty(b2)) return *b1;
+    return (struct box){b1->xmin < b2->xmin ? b1->xmin : b2->xmin,
+                        b1->ymin < b2->ymin ? b1->ymin : b2->ymin,
+                        b1->zmin < b2->zmin ? b1->zmin : b2->zmin,
+                        b1->xmax > b2->xmax ? b1->xmax : b2->xmax,
+                        b1->ymax > b2->ymax ? b1->ymax : b2->ymax,
+                        b1->zmax > b2->zmax ? b1->zmax : b2->zmax};
+}
+
+unsigned long geometry_box_volume(const struct box *b) {
+    if (geometry_is_box_empty(b)) return 0;
+    return (unsigned long)(b->xmax - b->xmin + 1) *
+           (unsigned long)(b->ymax - b->ymin + 1) *
+           (unsigned long)(b->zmax - b->zmin + 1);
+}
+
 void geometry_print_location(FILE *stream, const struct location *l) {
     fprintf(stream, "location(%d,%d,%d)", l->x, l->y, l->z);
 }
@@ -45,6 +45,37 @@ struct box {
  */
 struct vect geometry_box_to_vect(const struct box *b);
 
+/**
+ * Indicate if a box is empty
+ *
+ * A box is empty if one of its maximum coordinates is smaller than the
+ * corresponding minimum coordinate.
+ *
+ * @param b  The box
+ * @return   true if the box is empty
+ *           false otherwise
+ */
+bool geometry_is_box_empty(const struct box *b);
+
+/**
+ * Return the smallest box containing two boxes
+ *
+ * Empty boxes are ignored.
+ *
+ * @param b1  The first box
+ * @param b2  The second box
+ * @return    The union box
+ */
+struct box geometry_union_box(const struct box *b1, const struct box *b2);
+
+/**
+ * Return the number of locations in a box
+ *
+ * @param b  The box
+ * @return   The volume of the box
+ */
+unsigned long geometry_box_volume(const struct box *b);
+
 /**
  * Print a location to a stream
  *
@@ -1,8 +1,13 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include "graph.h"
+#include "arena.h"
 #include "queue.h"
+#include "stats.h"
+#include "writer.h"
 
 // Help functions //
 // -------------- //
@@ -21,14 +26,15 @@ void graph_add_isolated_node(struct graph *graph,
                              const struct location *location) {
     if (graph->num_nodes == graph->capacity) {
         graph->capacity *= 2;
-        graph->nodes = realloc(graph->nodes,
-                               graph->capacity * sizeof(struct graph_node));
+        graph->nodes = arena_realloc(graph->arena, graph->nodes,
+                                     graph->num_nodes * sizeof(struct graph_node),
+                                     graph->capacity * sizeof(struct graph_node));
     }
     struct graph_node *node = graph->nodes + graph->num_nodes;
     node->index = graph->num_nodes;
     node->tile = tile;
     node->location = *location;
-    node->neighbors = malloc(sizeof(struct graph_node*));
+    node->neighbors = arena_alloc(graph->arena, sizeof(struct graph_node*));
     node->num_neighbors = 0;
     node->capacity = 1;
     ++graph->num_nodes;
@@ -57,116 +63,365 @@ void graph_add_nodes(struct graph *graph,
 /**
  * Add a neighbor to a node
  *
+ * @param graph     The graph
  * @param node      The node
  * @param neighbor  The neighbor
  */
-void graph_add_neighbor_to_node(struct graph_node *node,
+void graph_add_neighbor_to_node(struct graph *graph,
+                                struct graph_node *node,
                                 struct graph_node *neighbor) {
     if (node->num_neighbors == node->capacity) {
         node->capacity *= 2;
-        node->neighbors = realloc(node->neighbors,
-                                  node->capacity * sizeof(struct map_cell_node*));
+        node->neighbors = arena_realloc(graph->arena, node->neighbors,
+                                        node->num_neighbors *
+                                        sizeof(struct graph_node*),
+                                        node->capacity *
+                                        sizeof(struct graph_node*));
     }
     node->neighbors[node->num_neighbors] = neighbor;
     ++node->num_neighbors;
 }
 
+/**
+ * Compare two locations in the order of the nodes of a graph
+ *
+ * The nodes of a graph are ordered by layer, then by row, then by column,
+ * and the layers of a map are ordered by height.
+ *
+ * @param first   The first location
+ * @param second  The second location
+ * @return        A negative, zero or positive number, as with `strcmp`
+ */
+int graph_compare_locations(const struct location *first,
+                            const struct location *second) {
+    if (first->z != second->z) return first->z < second->z ? -1 : 1;
+    if (first->x != second->x) return first->x < second->x ? -1 : 1;
+    if (first->y != second->y) return first->y < second->y ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Return the node at the given location in a graph
+ *
+ * Since the nodes are ordered by location (see `graph_compare_locations`),
+ * the node is found by a binary search. If no such node exists, return NULL.
+ *
+ * @param graph     The graph
+ * @param location  The location
+ */
+struct graph_node *graph_get_node(const struct graph *graph,
+                                  const struct location *location) {
+    unsigned int low = 0, high = graph->num_nodes;
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        int comparison = graph_compare_locations(&graph->nodes[middle].location,
+                                                 location);
+        if (comparison == 0)
+            return graph->nodes + middle;
+        else if (comparison < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return NULL;
+}
+
 /**
  * Add all edges to a graph from the given map
  *
  * There is an edge between two nodes if the directions allow a move from one
- * node to the other.
+ * node to the other. The neighbor of each outgoing direction is found by a
+ * binary search, then the neighbors of each node are ordered as the nodes
+ * (insertion sort, since a node has few neighbors), so that searches visit
+ * them in the same order as if all pairs of nodes were compared.
  *
  * @param graph  The graph
  */
 void graph_add_edges(struct graph *graph) {
     for (unsigned int i = 0; i < graph->num_nodes; ++i) {
-        for (unsigned int j = 0; j < graph->num_nodes; ++j) {
-            const struct location *location1 = &graph->nodes[i].location;
-            const struct location *location2 = &graph->nodes[j].location;
-            const struct tile *u = graph->nodes[i].tile;
-            const struct tile *v = graph->nodes[j].tile;
-            for (unsigned int d = 0; d < u->num_directions[1]; ++d) {
-                const struct vect *dir1 = u->directions[1] + d;
-                for (unsigned int e = 0; e < v->num_directions[0]; ++e) {
-                    const struct vect *dir2 = v->directions[0] + e;
-                    if (dir1->dx == -dir2->dx &&
-                        dir1->dy == -dir2->dy &&
-                        dir1->dz == -dir2->dz &&
-                        location1->x + dir1->dx == location2->x &&
-                        location1->y + dir1->dy == location2->y &&
-                        location1->z + dir1->dz == location2->z) {
-                        graph_add_neighbor_to_node(graph->nodes + i, graph->nodes + j);
-                    }
-                }
+        struct graph_node *node = graph->nodes + i;
+        const struct tile *u = node->tile;
+        const struct vect *outgoing = tile_get_directions(graph->tileset,
+                                                          u, false);
+        for (unsigned int d = 0; d < u->num_directions[1]; ++d) {
+            const struct vect *dir1 = outgoing + d;
+            struct location location = {node->location.x + dir1->dx,
+                                         node->location.y + dir1->dy,
+                                         node->location.z + dir1->dz};
+            struct graph_node *neighbor = graph_get_node(graph, &location);
+            if (neighbor == NULL)
+                continue;
+            const struct tile *v = neighbor->tile;
+            const struct vect *incoming = tile_get_directions(graph->tileset,
+                                                              v, true);
+            for (unsigned int e = 0; e < v->num_directions[0]; ++e) {
+                const struct vect *dir2 = incoming + e;
+                if (dir1->dx == -dir2->dx &&
+                    dir1->dy == -dir2->dy &&
+                    dir1->dz == -dir2->dz)
+                    graph_add_neighbor_to_node(graph, node, neighbor);
             }
         }
+        for (unsigned int n = 1; n < node->num_neighbors; ++n) {
+            struct graph_node *neighbor = node->neighbors[n];
+            unsigned int k = n;
+            for (; k > 0 && node->neighbors[k - 1] > neighbor; --k)
+                node->neighbors[k] = node->neighbors[k - 1];
+            node->neighbors[k] = neighbor;
+        }
     }
 }
 
 /**
- * Print a node to a stream
+ * Write a location with a writer, as `geometry_print_location` prints it
  *
- * @param stream  The stream
- * @param node    The node to print
+ * @param writer    The writer
+ * @param location  The location
+ */
+void graph_write_location(struct writer *writer,
+                          const struct location *location) {
+    writer_put_string(writer, "location(");
+    writer_put_integer(writer, location->x);
+    writer_put_char(writer, ',');
+    writer_put_integer(writer, location->y);
+    writer_put_char(writer, ',');
+    writer_put_integer(writer, location->z);
+    writer_put_char(writer, ')');
+}
+
+/**
+ * Write a node with a writer
+ *
+ * @param writer  The writer
+ * @param node    The node to write
+ * @param prefix  The prefix of each line
  */
-void graph_print_node(FILE *stream, const struct graph_node *node, const char *prefix) {
-    fprintf(stream, "%s  Node with tile-id=%d at ", prefix, node->tile->id);
-    geometry_print_location(stream, &node->location);
-    fprintf(stream, " with %d neighbor%s\n", node->num_neighbors,
-            node->num_neighbors <= 1 ? "" : "s");
+void graph_write_node(struct writer *writer,
+                      const struct graph_node *node,
+                      const char *prefix) {
+    writer_put_string(writer, prefix);
+    writer_put_string(writer, "  Node with tile-id=");
+    writer_put_integer(writer, node->tile->id);
+    writer_put_string(writer, " at ");
+    graph_write_location(writer, &node->location);
+    writer_put_string(writer, " with ");
+    writer_put_integer(writer, node->num_neighbors);
+    writer_put_string(writer,
+                      node->num_neighbors <= 1 ? " neighbor\n" : " neighbors\n");
     for (unsigned int n = 0; n < node->num_neighbors; ++n) {
-        fprintf(stream, "%s    Neighbor %d is at ", prefix, n);
-        geometry_print_location(stream, &node->neighbors[n]->location);
-        fprintf(stream, "\n");
+        writer_put_string(writer, prefix);
+        writer_put_string(writer, "    Neighbor ");
+        writer_put_integer(writer, n);
+        writer_put_string(writer, " is at ");
+        graph_write_location(writer, &node->neighbors[n]->location);
+        writer_put_char(writer, '\n');
     }
 }
 
 /**
- * Return the node at the given location in a graph
+ * A location explored by a search over a map
+ */
+struct graph_explored {
+    struct location location; // The location
+    const struct tile *tile;  // The tile at the location
+    unsigned int predecessor; // The index of the location it was reached from
+};
+
+/**
+ * The locations explored by a search over a map
+ *
+ * The explored locations are stored in the order they are discovered, which
+ * is also the order in which a breadth-first search visits them, and an open
+ * addressing hash table gives the index of each explored location.
+ */
+struct graph_search {
+    struct graph_explored *explored; // The explored locations
+    unsigned int num_explored;       // The number of explored locations
+    unsigned int capacity;           // The capacity of the explored locations
+    unsigned int *slots;             // The hash table (index + 1, or 0)
+    unsigned int num_slots;          // The number of slots (a power of 2)
+};
+
+/**
+ * Return the slot of a location in the hash table of a search
  *
- * If no such node exists, return NULL.
+ * The slot is either the one of the location, if it was explored, or the
+ * empty slot where it would be inserted.
  *
- * @param graph     The graph
+ * @param search    The search
  * @param location  The location
+ * @return          The slot
  */
-struct graph_node *graph_get_node(const struct graph *graph,
-                                  const struct location *location) {
-    for (unsigned int i = 0; i < graph->num_nodes; ++i)
-        if (geometry_equal_location(&graph->nodes[i].location, location))
-            return graph->nodes + i;
+unsigned int graph_search_slot(const struct graph_search *search,
+                               const struct location *location) {
+    uint32_t hash = (uint32_t)location->x * UINT32_C(73856093) ^
+                    (uint32_t)location->y * UINT32_C(19349663) ^
+                    (uint32_t)location->z * UINT32_C(83492791);
+    hash *= UINT32_C(2654435769);
+    unsigned int slot = (hash ^ hash >> 16) & (search->num_slots - 1);
+    while (search->slots[slot] != 0 &&
+           !geometry_equal_location(&search->explored[search->slots[slot] - 1]
+                                    .location, location))
+        slot = (slot + 1) & (search->num_slots - 1);
+    return slot;
+}
+
+/**
+ * Add an explored location to a search
+ *
+ * @param search       The search
+ * @param slot         The slot of the location (see `graph_search_slot`)
+ * @param location     The location
+ * @param tile         The tile at the location
+ * @param predecessor  The index of the location it was reached from
+ */
+void graph_search_add(struct graph_search *search,
+                      unsigned int slot,
+                      const struct location *location,
+                      const struct tile *tile,
+                      unsigned int predecessor) {
+    if (search->num_explored == search->capacity) {
+        search->capacity *= 2;
+        search->explored = realloc(search->explored, search->capacity *
+                                   sizeof(struct graph_explored));
+    }
+    search->explored[search->num_explored] =
+        (struct graph_explored){*location, tile, predecessor};
+    search->slots[slot] = ++search->num_explored;
+    if (2 * search->num_explored > search->num_slots) {
+        search->num_slots *= 2;
+        free(search->slots);
+        search->slots = calloc(search->num_slots, sizeof(unsigned int));
+        for (unsigned int i = 0; i < search->num_explored; ++i)
+            search->slots[graph_search_slot(search,
+                                            &search->explored[i].location)]
+                = i + 1;
+    }
+}
+
+/**
+ * Return the tile of a location reachable with an outgoing direction
+ *
+ * The location is reachable if it is top-free and if its tile has the
+ * opposite incoming direction, as for the edges of a graph.
+ *
+ * @param map        The map
+ * @param tileset    The tileset
+ * @param location   The location
+ * @param direction  The outgoing direction
+ * @return           The tile at the location, or NULL if it is not reachable
+ */
+const struct tile *graph_reachable_tile(const struct map *map,
+                                        const struct tileset *tileset,
+                                        const struct location *location,
+                                        const struct vect *direction) {
+    if (!map_is_location_top_free(map, location->x, location->y, location->z))
+        return NULL;
+    const struct tile *tile =
+        tile_by_id(tileset, map_get_tile_by_location(map, location->x,
+                                                     location->y,
+                                                     location->z));
+    if (tile == NULL)
+        return NULL;
+    const struct vect *incoming = tile_get_directions(tileset, tile, true);
+    for (unsigned int e = 0; e < tile->num_directions[0]; ++e)
+        if (incoming[e].dx == -direction->dx &&
+            incoming[e].dy == -direction->dy &&
+            incoming[e].dz == -direction->dz)
+            return tile;
     return NULL;
 }
 
+/**
+ * Return the walk ending at an explored location of a search
+ *
+ * The nodes of the walk are allocated with its array of nodes, so that
+ * `graph_delete_walk` releases them too.
+ *
+ * @param search  The search
+ * @param end     The index of the last location of the walk
+ * @return        The walk
+ */
+struct graph_walk *graph_retrieve_search_walk(const struct graph_search *search,
+                                              unsigned int end) {
+    unsigned int n = 1;
+    for (unsigned int i = end; i != 0; i = search->explored[i].predecessor)
+        ++n;
+    struct graph_walk *walk = malloc(sizeof(struct graph_walk));
+    walk->nodes = malloc(n * (sizeof(struct graph_node*) +
+                              sizeof(struct graph_node)));
+    walk->num_nodes = n;
+    walk->capacity = n;
+    struct graph_node *nodes = (struct graph_node*)(walk->nodes + n);
+    unsigned int i = end;
+    for (unsigned int k = n; k-- > 0; i = search->explored[i].predecessor) {
+        nodes[k] = (struct graph_node){
+            .index         = k,
+            .tile          = search->explored[i].tile,
+            .location      = search->explored[i].location,
+            .neighbors     = NULL,
+            .num_neighbors = 0,
+            .capacity      = 0
+        };
+        walk->nodes[k] = nodes + k;
+    }
+    return walk;
+}
+
 // Functions //
 // --------- //
 
 struct graph *graph_create(const struct map *map,
                            const struct tileset *tileset) {
-    struct graph *graph = malloc(sizeof(struct graph));
-    graph->nodes = malloc(sizeof(struct graph_node));
+    return graph_create_in_arena(NULL, map, tileset);
+}
+
+struct graph *graph_create_in_arena(struct arena *arena,
+                                    const struct map *map,
+                                    const struct tileset *tileset) {
+    struct graph *graph = arena_alloc(arena, sizeof(struct graph));
+    graph->nodes = arena_alloc(arena, sizeof(struct graph_node));
     graph->num_nodes = 0;
     graph->capacity = 1;
-    graph_add_nodes(graph, map, tileset);
-    graph_add_edges(graph);
+    graph->arena = arena;
     graph->map = map;
     graph->tileset = tileset;
+    STATS_START(nodes_timer);
+    graph_add_nodes(graph, map, tileset);
+    STATS_STOP(nodes_timer, STATS_GRAPH_NODES);
+    STATS_START(edges_timer);
+    graph_add_edges(graph);
+    STATS_STOP(edges_timer, STATS_GRAPH_EDGES);
+    STATS_ADD(STATS_NODES, graph->num_nodes);
+    STATS_ADD(STATS_EDGES, graph_num_edges(graph));
     return graph;
 }
 
 void graph_delete(struct graph *graph) {
     for (unsigned int i = 0; i < graph->num_nodes; ++i) {
-        free(graph->nodes[i].neighbors);
+        arena_free(graph->arena, graph->nodes[i].neighbors);
     }
-    free(graph->nodes);
-    free(graph);
+    arena_free(graph->arena, graph->nodes);
+    arena_free(graph->arena, graph);
+}
+
+unsigned long graph_num_edges(const struct graph *graph) {
+    unsigned long num_edges = 0;
+    for (unsigned int i = 0; i < graph->num_nodes; ++i)
+        num_edges += graph->nodes[i].num_neighbors;
+    return num_edges;
 }
 
 void graph_print(FILE *stream, const struct graph *graph, const char *prefix) {
-    fprintf(stream, "%sGraph of %d nodes\n", prefix, graph->num_nodes);
-    for (unsigned int i = 0; i < graph->num_nodes; ++i) {
-        graph_print_node(stream, graph->nodes + i, prefix);
-    }
+    struct writer writer;
+    writer_initialize(&writer, stream);
+    writer_put_string(&writer, prefix);
+    writer_put_string(&writer, "Graph of ");
+    writer_put_integer(&writer, graph->num_nodes);
+    writer_put_string(&writer, " nodes\n");
+    for (unsigned int i = 0; i < graph->num_nodes; ++i)
+        graph_write_node(&writer, graph->nodes + i, prefix);
+    writer_flush(&writer);
 }
 
 struct graph_walk *graph_retrieve_walk(struct graph_node **predecessors,
@@ -207,34 +462,39 @@ struct graph_walk *graph_retrieve_walk(struct graph_node **predecessors,
 struct graph_walk *graph_shortest_walk(const struct graph *graph,
                                        const struct location *start,
                                        const struct location *end) {
-    struct graph_node *predecessors[graph->num_nodes];
-    int distance[graph->num_nodes];
-    for (unsigned int i = 0; i < graph->num_nodes; ++i) {
-        predecessors[i] = NULL;
-        distance[i] = -1;
-    }
     struct graph_node *start_node = graph_get_node(graph, start);
     struct graph_node *end_node = graph_get_node(graph, end);
     if (start_node == NULL || end_node == NULL) return NULL;
+    STATS_START(timer);
+    struct graph_node **predecessors =
+        calloc(graph->num_nodes, sizeof(struct graph_node*));
     queue q;
     queue_initialize(&q);
     queue_push(&q, start_node);
-    distance[start_node->index] = 0;
     predecessors[start_node->index] = start_node;
-    while (!queue_is_empty(&q)) {
+    unsigned int num_expanded = 0, queue_size = 1, queue_max = 1;
+    while (!queue_is_empty(&q) && predecessors[end_node->index] == NULL) {
         struct graph_node *node = queue_pop(&q);
+        ++num_expanded;
+        --queue_size;
         for (unsigned int i = 0; i < node->num_neighbors; ++i) {
             struct graph_node *neighbor = node->neighbors[i];
-            unsigned int index = neighbor->index;
-            if (distance[index] == -1) {
-                distance[index] = distance[node->index] + 1;
-                predecessors[index] = node;
+            if (predecessors[neighbor->index] == NULL) {
+                predecessors[neighbor->index] = node;
                 queue_push(&q, neighbor);
+                ++queue_size;
             }
         }
+        if (queue_size > queue_max)
+            queue_max = queue_size;
     }
+    queue_delete(&q);
     struct graph_walk *walk =
         graph_retrieve_walk(predecessors, start_node, end_node);
+    free(predecessors);
+    STATS_STOP(timer, STATS_SEARCH);
+    STATS_ADD(STATS_EXPANDED, num_expanded);
+    STATS_MAX(STATS_QUEUE_MAX, queue_max);
     return walk;
 }
 
@@ -242,12 +502,96 @@ void graph_print_walk(FILE *stream, const struct graph_walk *walk, const char *p
     fprintf(stream, "%swalk of %d nodes: [ ", prefix, walk->num_nodes);
     for (unsigned int i = 0; i < walk->num_nodes; ++i) {
         geometry_print_location(stream, &walk->nodes[i]->location);
-        printf(" ");
+        fprintf(stream, " ");
     }
-    printf("]\n");
+    fprintf(stream, "]\n");
 }
 
 void graph_delete_walk(struct graph_walk *walk) {
     free(walk->nodes);
     free(walk);
 }
+
+struct graph_walk *graph_shortest_walk_in_map(const struct map *map,
+                                              const struct tileset *tileset,
+                                              const struct location *start,
+                                              const struct location *end) {
+    if (!map_is_location_top_free(map, start->x, start->y, start->z) ||
+        !map_is_location_top_free(map, end->x, end->y, end->z))
+        return NULL;
+    STATS_START(timer);
+    struct graph_search search = {
+        .explored     = malloc(sizeof(struct graph_explored)),
+        .num_explored = 0,
+        .capacity     = 1,
+        .slots        = calloc(2, sizeof(unsigned int)),
+        .num_slots    = 2
+    };
+    graph_search_add(&search, graph_search_slot(&search, start), start,
+                     tile_by_id(tileset, map_get_tile_by_location(map,
+                                start->x, start->y, start->z)), 0);
+    struct graph_explored *neighbors = malloc(sizeof(struct graph_explored));
+    unsigned int neighbor_capacity = 1;
+    bool found = geometry_equal_location(start, end);
+    unsigned int end_index = 0;
+    unsigned int num_expanded = 0, queue_max = 1;
+    for (unsigned int i = 0; !found && i < search.num_explored; ++i) {
+        struct graph_explored node = search.explored[i];
+        if (node.tile == NULL)
+            continue;
+        ++num_expanded;
+        const struct vect *outgoing = tile_get_directions(tileset, node.tile,
+                                                          false);
+        unsigned int num_neighbors = 0;
+        if (node.tile->num_directions[1] > neighbor_capacity) {
+            neighbor_capacity = node.tile->num_directions[1];
+            neighbors = realloc(neighbors, neighbor_capacity *
+                                sizeof(struct graph_explored));
+        }
+        for (unsigned int d = 0; d < node.tile->num_directions[1]; ++d) {
+            struct location location = {node.location.x + outgoing[d].dx,
+                                         node.location.y + outgoing[d].dy,
+                                         node.location.z + outgoing[d].dz};
+            const struct tile *tile = graph_reachable_tile(map, tileset,
+                                                           &location,
+                                                           outgoing + d);
+            if (tile == NULL)
+                continue;
+            unsigned int k = num_neighbors;
+            while (k > 0 && graph_compare_locations(&neighbors[k - 1].location,
+                                                    &location) > 0)
+                --k;
+            if (k > 0 && geometry_equal_location(&neighbors[k - 1].location,
+                                                 &location))
+                continue;
+            memmove(neighbors + k + 1, neighbors + k,
+                    (num_neighbors - k) * sizeof(struct graph_explored));
+            neighbors[k] = (struct graph_explored){location, tile, i};
+            ++num_neighbors;
+        }
+        for (unsigned int k = 0; !found && k < num_neighbors; ++k) {
+            unsigned int slot = graph_search_slot(&search,
+                                                  &neighbors[k].location);
+            if (search.slots[slot] == 0) {
+                graph_search_add(&search, slot, &neighbors[k].location,
+                                 neighbors[k].tile, i);
+                if (geometry_equal_location(&neighbors[k].location, end)) {
+                    found = true;
+                    end_index = search.num_explored - 1;
+                }
+            }
+        }
+        if (search.num_explored - i - 1 > queue_max)
+            queue_max = search.num_explored - i - 1;
+    }
+    struct graph_walk *walk = found ?
+                              graph_retrieve_search_walk(&search, end_index) :
+                              NULL;
+    free(neighbors);
+    free(search.explored);
+    free(search.slots);
+    STATS_STOP(timer, STATS_SEARCH);
+    STATS_ADD(STATS_EXPANDED, num_expanded);
+    STATS_MAX(STATS_QUEUE_MAX, queue_max);
+    return walk;
+}
@@ -15,6 +15,9 @@
  * The interest of representing a map by a graph is that one can, in
  * particular, compute a walk between two cells in the map.
  *
+ * A graph can be created in an arena (see `arena.h`), usually the one of the
+ * map it represents, so that it is released at once with the map.
+ *
  * The module provides four data structures:
  *
  * - `struct graph_node`: a node in the graph
@@ -55,6 +58,7 @@ struct graph {
     struct graph_node *nodes;      // The nodes in the graph
     unsigned int num_nodes;        // The number of nodes
     unsigned int capacity;         // The nodes capacity
+    struct arena *arena;           // The arena of the graph (or NULL)
 };
 
 /**
@@ -85,6 +89,21 @@ struct graph_walk {
 struct graph *graph_create(const struct map *map,
                            const struct tileset *tileset);
 
+/**
+ * Create a graph from a map and a tileset in an arena
+ *
+ * Behaves exactly as `graph_create`, except that the graph, its nodes and
+ * their neighbors are allocated in the arena.
+ *
+ * @param arena    The arena (or NULL for the heap)
+ * @param map      The map
+ * @param tileset  The tileset used in the map
+ * @return         The graph induced by the map
+ */
+struct graph *graph_create_in_arena(struct arena *arena,
+                                    const struct map *map,
+                                    const struct tileset *tileset);
+
 /**
  * Delete the given graph
  *
@@ -92,6 +111,14 @@ struct graph *graph_create(const struct map *map,
  */
 void graph_delete(struct graph *graph);
 
+/**
+ * Return the number of edges of a graph
+ *
+ * @param graph  The graph
+ * @return       The number of edges
+ */
+unsigned long graph_num_edges(const struct graph *graph);
+
 /**
  * Print the given graph to a stream
  *
@@ -120,6 +147,33 @@ struct graph_walk *graph_shortest_walk(const struct graph *graph,
                                        const struct location *start,
                                        const struct location *end);
 
+/**
+ * Return a shortest walk between two locations in a map, without its graph
+ *
+ * The map and its tileset are seen as an implicit graph: the neighbors of a
+ * location are computed only when the location is reached, from the outgoing
+ * directions of its tile, so that the time and memory needed depend on the
+ * number of locations explored before reaching the end, and not on the size
+ * of the map. The walk is the same as the one returned by
+ * `graph_shortest_walk` on the graph of the map.
+ *
+ * If such a walk does not exist, then NULL is returned. The nodes of the walk
+ * have no neighbors.
+ *
+ * Note: `graph_delete_walk` should be called when the walk is not needed
+ * anymore.
+ *
+ * @param map      The map
+ * @param tileset  The tileset used in the map
+ * @param start    The starting location
+ * @param end      The ending location
+ * @return         A shortest walk between two cells
+ */
+struct graph_walk *graph_shortest_walk_in_map(const struct map *map,
+                                              const struct tileset *tileset,
+                                              const struct location *start,
+                                              const struct location *end);
+
 /**
  * Delete the given walk
  *
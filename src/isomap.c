@@ -1,148 +1,941 @@
+#define _POSIX_C_SOURCE 200809L
 #include "isomap.h"
+#include "arena.h"
 #include "map.h"
+#include "parser.h"
 #include "tile.h"
-#include <jansson.h>
-#include <cairo.h>
+#include "chunk.h"
+#include "rle.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BINARY_MAGIC "ISOMAPB"
+#define BINARY_VERSION 2
+#define BINARY_BYTE_ORDER 0x01020304
+#define BINARY_ALIGNMENT 64
+
+_Static_assert(sizeof(tile_id) == sizeof(int32_t),
+               "tiles are stored as 32-bit integers in binary files");
+_Static_assert(sizeof(unsigned long) == sizeof(uint64_t),
+               "run starts are stored as 64-bit integers in binary files");
+
+// Types //
+// ----- //
+
+/**
+ * The header of a binary isomap
+ */
+struct binary_header {
+    char magic[8];           // BINARY_MAGIC, followed by a null byte
+    uint32_t version;        // BINARY_VERSION
+    uint32_t byte_order;     // BINARY_BYTE_ORDER, in the byte order of the file
+    uint32_t tile_width;     // The width of a tile
+    uint32_t z_offset;       // The vertical offset between two layers
+    uint32_t num_tiles;      // The number of tiles in the tileset
+    uint32_t num_layers;     // The number of layers
+    uint64_t tileset_offset; // The position of the first tile
+    uint64_t layers_offset;  // The position of the layer directory
+};
+
+/**
+ * A tile of a binary isomap
+ *
+ * It is followed by its null-terminated filename, padded with null bytes to a
+ * multiple of 4 bytes, then by its incoming and outgoing directions, each
+ * direction being 3 signed 32-bit integers.
+ */
+struct binary_tile {
+    int32_t id;                  // The tile id
+    uint32_t filename_length;    // The length of the filename
+    uint32_t num_directions[2];  // The number of incoming/outgoing directions
+    uint32_t rectangle[4];       // The source rectangle in the image
+};
+
+/**
+ * An entry of the layer directory of a binary isomap
+ *
+ * The data of the layer depends on its storage:
+ *
+ * - dense: the `num_rows * num_columns` tiles, row by row
+ * - run-length: the starts of the runs (unsigned 64-bit integers), then the
+ *   tiles of the runs
+ * - chunked: the rows and columns of the chunks (unsigned 32-bit integers),
+ *   then, at the next aligned position, the tiles of the chunks
+ */
+struct binary_layer {
+    uint32_t storage;     // The storage of the layer
+    uint32_t num_rows;    // The number of rows
+    uint32_t num_columns; // The number of columns
+    int32_t offset[3];    // The offset with respect to the origin
+    uint64_t data_offset; // The position of the data of the layer
+    uint64_t num_items;   // The number of tiles, runs or chunks
+};
+
+/**
+ * A layer being loaded from a JSON file
+ *
+ * The layer is added to the map as soon as its dimensions and its offset are
+ * known. The tiles given before that are kept aside and set when it is added.
+ */
+struct json_layer {
+    unsigned int num_rows;           // The number of rows
+    unsigned int num_columns;        // The number of columns
+    int offset[3];                   // The offset with respect to the origin
+    enum layer_storage storage;      // The storage of the tiles
+    bool has_num_rows;               // True if the number of rows is known
+    bool has_num_columns;            // True if the number of columns is known
+    bool has_offset;                 // True if the offset is known
+    bool added;                      // True if the layer was added
+    struct layer *layer;             // The added layer (NULL if rejected)
+    tile_id *pending_tiles;          // The tiles of `data` read before
+    unsigned long num_pending_tiles; // The number of such tiles
+    int *pending_cells;              // The triples of `cells` read before
+    unsigned long num_pending_cells; // The number of such triples
+};
 
 // Help functions //
 // -------------- //
 
 /**
- * Load directions for a given tile in an isomap
+ * Load an array, each element being loaded by a function
+ *
+ * If the value is not an array, it is skipped.
+ *
+ * @param isomap  The isomap
+ * @param parser  The parser, just before the value
+ * @param load    The function loading an element, given its first token
+ * @return        True if the array is valid
+ */
+bool isomap_load_array(struct isomap *isomap,
+                       struct parser *parser,
+                       bool (*load)(struct isomap *isomap,
+                                    struct parser *parser,
+                                    enum parser_token token)) {
+    enum parser_token token = parser_next(parser);
+    if (token != PARSER_ARRAY_START)
+        return parser_skip(parser, token);
+    while ((token = parser_next(parser)) != PARSER_ARRAY_END)
+        if (token == PARSER_ERROR || !load(isomap, parser, token))
+            return false;
+    return true;
+}
+
+/**
+ * Load a tuple of integers, such as a direction [dx, dy, dz]
+ *
+ * Missing values are 0 and extra values are ignored. If the value is not an
+ * array, it is skipped and all values are 0.
+ *
+ * @param parser      The parser
+ * @param token       The first token of the tuple
+ * @param values      The values of the tuple
+ * @param num_values  The number of values of the tuple
+ * @return            True if the tuple is valid
+ */
+bool isomap_load_integers(struct parser *parser,
+                          enum parser_token token,
+                          int values[],
+                          unsigned int num_values) {
+    for (unsigned int i = 0; i < num_values; ++i)
+        values[i] = 0;
+    if (token != PARSER_ARRAY_START)
+        return parser_skip(parser, token);
+    for (unsigned int i = 0;
+         (token = parser_next(parser)) != PARSER_ARRAY_END;
+         ++i) {
+        if (token == PARSER_INTEGER && i < num_values)
+            values[i] = parser->integer;
+        else if (!parser_skip(parser, token))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Load the directions of a tile
+ *
+ * The directions are kept in a growing array, since the id of the tile might
+ * not be known yet.
+ *
+ * @param parser          The parser, just before the array of directions
+ * @param directions      The directions, reallocated by the function
+ * @param num_directions  The number of directions, updated by the function
+ * @return                True if the directions are valid
+ */
+bool isomap_load_directions(struct parser *parser,
+                            struct vect **directions,
+                            unsigned int *num_directions) {
+    enum parser_token token = parser_next(parser);
+    if (token != PARSER_ARRAY_START)
+        return parser_skip(parser, token);
+    while ((token = parser_next(parser)) != PARSER_ARRAY_END) {
+        if ((*num_directions & (*num_directions - 1)) == 0)
+            *directions = realloc(*directions, (*num_directions == 0 ? 1 :
+                                                2 * *num_directions) *
+                                               sizeof(struct vect));
+        int values[3];
+        if (token == PARSER_ERROR ||
+            !isomap_load_integers(parser, token, values, 3))
+            return false;
+        (*directions)[(*num_directions)++] =
+            (struct vect){values[0], values[1], values[2]};
+    }
+    return true;
+}
+
+/**
+ * Load a tile into the tileset of an isomap
+ *
+ * @param isomap  The isomap
+ * @param parser  The parser
+ * @param token   The first token of the tile
+ * @return        True if the tile is valid
+ */
+bool isomap_load_tile(struct isomap *isomap,
+                      struct parser *parser,
+                      enum parser_token token) {
+    if (token != PARSER_OBJECT_START)
+        return parser_skip(parser, token);
+    tile_id id = 0;
+    char filename[PATH_LENGTH] = "";
+    int rectangle[4] = {0, 0, 0, 0};
+    struct vect *directions[2] = {NULL, NULL};
+    unsigned int num_directions[2] = {0, 0};
+    bool valid = true;
+    while (valid && (token = parser_next(parser)) == PARSER_KEY) {
+        if (strcmp(parser->string, "id") == 0) {
+            id = parser_read_integer(parser);
+        } else if (strcmp(parser->string, "filename") == 0) {
+            token = parser_next(parser);
+            if (token == PARSER_STRING)
+                strncpy(filename, parser->string, PATH_LENGTH - 1);
+            else
+                valid = parser_skip(parser, token);
+        } else if (strcmp(parser->string, "rectangle") == 0) {
+            valid = isomap_load_integers(parser, parser_next(parser),
+                                         rectangle, 4) &&
+                    rectangle[0] >= 0 && rectangle[1] >= 0 &&
+                    rectangle[2] > 0 && rectangle[3] > 0;
+        } else if (strcmp(parser->string, "incoming") == 0) {
+            valid = isomap_load_directions(parser, directions,
+                                           num_directions);
+        } else if (strcmp(parser->string, "outgoing") == 0) {
+            valid = isomap_load_directions(parser, directions + 1,
+                                           num_directions + 1);
+        } else {
+            valid = parser_skip(parser, parser_next(parser));
+        }
+    }
+    valid = valid && token == PARSER_OBJECT_END;
+    if (valid) {
+        struct tile *tile = tile_add_to_tileset(isomap->tileset, id, filename);
+        if (tile != NULL)
+            tile_set_rectangle(isomap->tileset, tile, rectangle[0], rectangle[1],
+                               rectangle[2], rectangle[3]);
+        for (unsigned int o = 0; o <= 1; ++o)
+            for (unsigned int d = 0; d < num_directions[o]; ++d)
+                tile_add_direction(isomap->tileset, id,
+                                   directions[o][d].dx, directions[o][d].dy,
+                                   directions[o][d].dz, o == 0);
+    }
+    free(directions[0]);
+    free(directions[1]);
+    return valid;
+}
+
+/**
+ * Return the layer storage associated with a name
+ *
+ * The names are "dense", "chunked" and "rle". If the name is NULL or
+ * unknown, the dense storage is returned.
+ *
+ * @param name  The name of the storage
+ * @return      The storage
+ */
+enum layer_storage isomap_storage_by_name(const char *name) {
+    if (name != NULL && strcmp(name, "chunked") == 0)
+        return LAYER_CHUNKED;
+    if (name != NULL && strcmp(name, "rle") == 0)
+        return LAYER_RLE;
+    return LAYER_DENSE;
+}
+
+/**
+ * Set a tile of a layer being loaded, given its index in the `data` array
+ *
+ * Tiles beyond the last cell of the layer are ignored, as well as all tiles
+ * of a layer that could not be added.
+ *
+ * @param layer  The layer being loaded
+ * @param index  The index of the tile
+ * @param id     The id of the tile
+ */
+void isomap_set_json_layer_tile(struct json_layer *layer,
+                                unsigned long index,
+                                tile_id id) {
+    if (layer->layer != NULL &&
+        index < (unsigned long)layer->num_rows * layer->num_columns)
+        map_set_layer_tile(layer->layer, index / layer->num_columns,
+                           index % layer->num_columns, id);
+}
+
+/**
+ * Set a tile of a layer being loaded, given as a triple [row, column, id]
+ *
+ * Cells outside of the layer are ignored, as well as all cells of a layer
+ * that could not be added.
+ *
+ * @param layer  The layer being loaded
+ * @param cell   The row, the column and the id of the tile
+ */
+void isomap_set_json_layer_cell(struct json_layer *layer, const int cell[3]) {
+    unsigned int row = cell[0], column = cell[1];
+    if (layer->layer != NULL &&
+        row < layer->num_rows && column < layer->num_columns)
+        map_set_layer_tile(layer->layer, row, column, cell[2]);
+}
+
+/**
+ * Add a layer being loaded to the map of an isomap
  *
- * @param isomap           The isomap
- * @param id               The id of the tile
- * @param json_directions  The JSON object containing the directions
+ * The tiles that were read before the layer could be added are set.
+ *
+ * @param isomap  The isomap
+ * @param layer   The layer being loaded
  */
-void isomap_load_directions(struct isomap *isomap,
-                            tile_id id,
-                            const json_t *json_directions,
-                            bool incoming) {
-    unsigned int i;
-    json_t *json_direction;
-    json_array_foreach(json_directions, i, json_direction) {
-        int dx, dy, dz;
-        dx = json_integer_value(json_array_get(json_direction, 0));
-        dy = json_integer_value(json_array_get(json_direction, 1));
-        dz = json_integer_value(json_array_get(json_direction, 2));
-        tile_add_direction(isomap->tileset, id, dx, dy, dz, incoming);
+void isomap_add_json_layer(struct isomap *isomap, struct json_layer *layer) {
+    layer->added = true;
+    layer->layer = map_add_layer_with_storage(isomap->map, layer->storage,
+                                              layer->num_rows,
+                                              layer->num_columns,
+                                              layer->offset[0],
+                                              layer->offset[1],
+                                              layer->offset[2]);
+    for (unsigned long i = 0; i < layer->num_pending_tiles; ++i)
+        isomap_set_json_layer_tile(layer, i, layer->pending_tiles[i]);
+    for (unsigned long i = 0; i < layer->num_pending_cells; ++i)
+        isomap_set_json_layer_cell(layer, layer->pending_cells + 3 * i);
+    free(layer->pending_tiles);
+    free(layer->pending_cells);
+    layer->pending_tiles = NULL;
+    layer->pending_cells = NULL;
+}
+
+/**
+ * Load the `data` array of a layer
+ *
+ * If the layer is already added, the tiles are scanned directly into it.
+ * Otherwise, they are kept aside until the layer is added.
+ *
+ * @param parser  The parser, just before the array
+ * @param layer   The layer being loaded
+ * @return        True if the array is valid
+ */
+bool isomap_load_json_layer_data(struct parser *parser,
+                                 struct json_layer *layer) {
+    enum parser_token token = parser_next(parser);
+    if (token != PARSER_ARRAY_START)
+        return parser_skip(parser, token);
+    unsigned long num_cells =
+        (unsigned long)layer->num_rows * layer->num_columns;
+    tile_id *tiles = layer->layer != NULL &&
+                     layer->layer->storage == LAYER_DENSE &&
+                     num_cells > 0 ? layer->layer->tiles[0] : NULL;
+    for (unsigned long i = 0;
+         (token = parser_next(parser)) != PARSER_ARRAY_END;
+         ++i) {
+        tile_id id = token == PARSER_INTEGER ? parser->integer : 0;
+        if (token != PARSER_INTEGER && !parser_skip(parser, token))
+            return false;
+        if (tiles != NULL) {
+            if (i < num_cells) tiles[i] = id;
+        } else if (layer->added) {
+            isomap_set_json_layer_tile(layer, i, id);
+        } else {
+            if ((i & (i - 1)) == 0)
+                layer->pending_tiles = realloc(layer->pending_tiles,
+                                               (i == 0 ? 1 : 2 * i) *
+                                               sizeof(tile_id));
+            layer->pending_tiles[i] = id;
+            layer->num_pending_tiles = i + 1;
+        }
     }
+    return true;
 }
 
 /**
- * Load tiles from a JSON array into the given isomap
+ * Load the `cells` array of a layer
+ *
+ * Each cell is a triple [row, column, id]. If the layer is already added,
+ * the cells are set directly. Otherwise, they are kept aside until the layer
+ * is added.
  *
- * @param map           The map into which the tiles are loaded
- * @param json_tileset  The JSON array containing the tiles
+ * @param parser  The parser, just before the array
+ * @param layer   The layer being loaded
+ * @return        True if the array is valid
  */
-void isomap_load_tileset(struct isomap *isomap, const json_t *json_tileset) {
-    for (unsigned int i = 0; i < json_array_size(json_tileset); ++i) {
-        json_t *json_tile = json_array_get(json_tileset, i);
-        tile_id id = json_integer_value(json_object_get(json_tile, "id"));
-        json_t *json_filename = json_object_get(json_tile, "filename");
-        const char *filename = json_string_value(json_filename);
-        tile_add_to_tileset(isomap->tileset, id, filename);
-        isomap_load_directions(isomap, id, json_object_get(json_tile, "incoming"), true);
-        isomap_load_directions(isomap, id, json_object_get(json_tile, "outgoing"), false);
+bool isomap_load_json_layer_cells(struct parser *parser,
+                                  struct json_layer *layer) {
+    enum parser_token token = parser_next(parser);
+    if (token != PARSER_ARRAY_START)
+        return parser_skip(parser, token);
+    while ((token = parser_next(parser)) != PARSER_ARRAY_END) {
+        int cell[3];
+        if (token == PARSER_ERROR || !isomap_load_integers(parser, token, cell, 3))
+            return false;
+        if (layer->added) {
+            isomap_set_json_layer_cell(layer, cell);
+        } else {
+            unsigned long n = layer->num_pending_cells;
+            if ((n & (n - 1)) == 0)
+                layer->pending_cells = realloc(layer->pending_cells,
+                                               3 * (n == 0 ? 1 : 2 * n) *
+                                               sizeof(int));
+            memcpy(layer->pending_cells + 3 * n, cell, sizeof(cell));
+            ++layer->num_pending_cells;
+        }
     }
+    return true;
 }
 
 /**
- * Loads layers into the given isomap
+ * Load a layer into the map of an isomap
+ *
+ * The tiles of a layer are given either by the `data` array (all tiles, row
+ * by row), or by the `cells` array (only the nonempty tiles, as triples
+ * `[row, column, id]`). The layer is added to the map as soon as its
+ * dimensions and its offset are known, which is the case when the keys are
+ * given in the usual order.
  *
- * @param isomap       The isomap
- * @param json_layers  The JSON array containing the layers
+ * @param isomap  The isomap
+ * @param parser  The parser
+ * @param token   The first token of the layer
+ * @return        True if the layer is valid
  */
-void isomap_load_map(struct isomap *isomap, const json_t *json_layers) {
-    unsigned int i;
-    json_t *json_layer;
-    json_array_foreach(json_layers, i, json_layer) {
-        unsigned int num_rows, num_columns;
-        int dx, dy, dz;
-        num_rows = json_integer_value(json_object_get(json_layer, "num-rows"));
-        num_columns = json_integer_value(json_object_get(json_layer, "num-cols"));
-        json_t *json_offset = json_object_get(json_layer, "offset");
-        dx = json_integer_value(json_array_get(json_offset, 0));
-        dy = json_integer_value(json_array_get(json_offset, 1));
-        dz = json_integer_value(json_array_get(json_offset, 2));
-        struct layer *layer = map_add_layer(isomap->map, num_rows, num_columns, dx, dy, dz);
-        json_t *data = json_object_get(json_layer, "data");
-        unsigned int j;
-        json_t *data_tile;
-        json_array_foreach(data, j, data_tile) {
-            unsigned int id = json_integer_value(data_tile);
-            layer->tiles[j / num_columns][j % num_columns] = id;
+bool isomap_load_layer(struct isomap *isomap,
+                       struct parser *parser,
+                       enum parser_token token) {
+    if (token != PARSER_OBJECT_START)
+        return parser_skip(parser, token);
+    struct json_layer layer = {
+        .storage = LAYER_DENSE
+    };
+    bool valid = true;
+    while (valid && (token = parser_next(parser)) == PARSER_KEY) {
+        const char *key = parser->string;
+        if (strcmp(key, "num-rows") == 0) {
+            layer.num_rows = parser_read_integer(parser);
+            layer.has_num_rows = true;
+        } else if (strcmp(key, "num-cols") == 0) {
+            layer.num_columns = parser_read_integer(parser);
+            layer.has_num_columns = true;
+        } else if (strcmp(key, "offset") == 0) {
+            valid = isomap_load_integers(parser, parser_next(parser),
+                                         layer.offset, 3);
+            layer.has_offset = true;
+        } else if (strcmp(key, "storage") == 0) {
+            token = parser_next(parser);
+            layer.storage = isomap_storage_by_name(token == PARSER_STRING ?
+                                                   parser->string : NULL);
+            valid = parser_skip(parser, token);
+            if (layer.layer != NULL)
+                map_convert_layer(layer.layer, layer.storage);
+        } else if (strcmp(key, "data") == 0 || strcmp(key, "cells") == 0) {
+            bool data = strcmp(key, "data") == 0;
+            if (!layer.added && layer.has_num_rows &&
+                layer.has_num_columns && layer.has_offset)
+                isomap_add_json_layer(isomap, &layer);
+            valid = data ? isomap_load_json_layer_data(parser, &layer)
+                         : isomap_load_json_layer_cells(parser, &layer);
+        } else {
+            valid = parser_skip(parser, parser_next(parser));
         }
     }
+    valid = valid && token == PARSER_OBJECT_END;
+    if (valid && !layer.added)
+        isomap_add_json_layer(isomap, &layer);
+    free(layer.pending_tiles);
+    free(layer.pending_cells);
+    return valid;
+}
+
+/**
+ * Load an isomap from a JSON document
+ *
+ * @param isomap  The isomap
+ * @param parser  The parser, at the beginning of the document
+ * @return        True if the document is valid
+ */
+bool isomap_load(struct isomap *isomap, struct parser *parser) {
+    if (parser_next(parser) != PARSER_OBJECT_START)
+        return false;
+    enum parser_token token;
+    bool valid = true;
+    while (valid && (token = parser_next(parser)) == PARSER_KEY) {
+        if (strcmp(parser->string, "tile-width") == 0)
+            isomap->tile_width = parser_read_integer(parser);
+        else if (strcmp(parser->string, "z-offset") == 0)
+            isomap->z_offset = parser_read_integer(parser);
+        else if (strcmp(parser->string, "tileset") == 0) {
+            STATS_START(timer);
+            valid = isomap_load_array(isomap, parser, isomap_load_tile);
+            tile_sort_tileset(isomap->tileset);
+            STATS_STOP(timer, STATS_LOAD_TILESET);
+        }
+        else if (strcmp(parser->string, "layers") == 0) {
+            STATS_START(timer);
+            valid = isomap_load_array(isomap, parser, isomap_load_layer);
+            STATS_STOP(timer, STATS_LOAD_MAP);
+        }
+        else
+            valid = parser_skip(parser, parser_next(parser));
+    }
+    return valid && token == PARSER_OBJECT_END &&
+           parser_next(parser) == PARSER_END;
+}
+
+/**
+ * Return the smallest multiple of `alignment` greater than or equal to `n`
+ *
+ * @param n          The number to align
+ * @param alignment  The alignment
+ * @return           The aligned number
+ */
+uint64_t isomap_align(uint64_t n, uint64_t alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * Write null bytes to a stream until a position is reached
+ *
+ * @param stream    The stream
+ * @param position  The current position, updated by the function
+ * @param target    The position to reach
+ */
+void isomap_write_padding(FILE *stream, uint64_t *position, uint64_t target) {
+    for (; *position < target; ++*position)
+        fputc(0, stream);
+}
+
+/**
+ * Return the size of the data of a layer in a binary file
+ *
+ * @param layer      The layer
+ * @param num_items  The number of tiles, runs or chunks, set by the function
+ * @return           The size in bytes
+ */
+uint64_t isomap_binary_layer_size(const struct layer *layer,
+                                  uint64_t *num_items) {
+    if (layer->storage == LAYER_CHUNKED) {
+        *num_items = layer->chunks->num_chunks;
+        return isomap_align(*num_items * 2 * sizeof(uint32_t),
+                            BINARY_ALIGNMENT) +
+               *num_items * CHUNK_SIZE * CHUNK_SIZE * sizeof(tile_id);
+    } else if (layer->storage == LAYER_RLE) {
+        *num_items = layer->runs->length == 0 ? 0 : layer->runs->num_runs;
+        return *num_items * (sizeof(uint64_t) + sizeof(tile_id));
+    } else {
+        *num_items = (uint64_t)layer->num_rows * layer->num_columns;
+        return *num_items * sizeof(tile_id);
+    }
+}
+
+/**
+ * Write the data of a layer to a stream in the binary format
+ *
+ * @param stream    The stream
+ * @param layer     The layer
+ * @param position  The current position, updated by the function
+ */
+void isomap_write_binary_layer(FILE *stream,
+                               const struct layer *layer,
+                               uint64_t *position) {
+    uint64_t num_items;
+    uint64_t end = *position + isomap_binary_layer_size(layer, &num_items);
+    if (layer->storage == LAYER_CHUNKED) {
+        const struct chunk *chunk;
+        for (chunk = chunk_next(layer->chunks, 0, 0);
+             chunk != NULL;
+             chunk = chunk_next(layer->chunks, chunk->row, chunk->column + 1)) {
+            uint32_t coordinates[2] = {chunk->row, chunk->column};
+            fwrite(coordinates, sizeof(uint32_t), 2, stream);
+        }
+        *position += num_items * 2 * sizeof(uint32_t);
+        isomap_write_padding(stream, position,
+                             isomap_align(*position, BINARY_ALIGNMENT));
+        for (chunk = chunk_next(layer->chunks, 0, 0);
+             chunk != NULL;
+             chunk = chunk_next(layer->chunks, chunk->row, chunk->column + 1))
+            fwrite(chunk->tiles, sizeof(tile_id), CHUNK_SIZE * CHUNK_SIZE,
+                   stream);
+    } else if (layer->storage == LAYER_RLE) {
+        fwrite(layer->runs->starts, sizeof(uint64_t), num_items, stream);
+        fwrite(layer->runs->values, sizeof(tile_id), num_items, stream);
+    } else {
+        for (unsigned int i = 0; i < layer->num_rows; ++i)
+            fwrite(layer->tiles[i], sizeof(tile_id), layer->num_columns, stream);
+    }
+    *position = end;
+}
+
+/**
+ * Write the header, the tileset and the layer directory of a binary isomap
+ *
+ * @param stream   The stream
+ * @param isomap   The isomap
+ * @param dense    True if all the layers are described as dense layers,
+ *                 whatever their storage
+ * @param entries  The layer directory, set by the function
+ * @return         The number of bytes written
+ */
+uint64_t isomap_write_binary_header(FILE *stream,
+                                    const struct isomap *isomap,
+                                    bool dense,
+                                    struct binary_layer entries[]) {
+    const struct tileset *tileset = isomap->tileset;
+    const struct map *map = isomap->map;
+    struct binary_header header = {
+        .magic = BINARY_MAGIC,
+        .version = BINARY_VERSION,
+        .byte_order = BINARY_BYTE_ORDER,
+        .tile_width = isomap->tile_width,
+        .z_offset = isomap->z_offset,
+        .num_tiles = tileset->num_tiles,
+        .num_layers = map->num_layers,
+        .tileset_offset = sizeof(struct binary_header)
+    };
+    uint64_t position = header.tileset_offset;
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i) {
+        const struct tile *tile = tileset->tiles + i;
+        position += sizeof(struct binary_tile) +
+                    isomap_align(strlen(tile_source_filename(tileset, tile)) + 1,
+                                 4) +
+                    (tile->num_directions[0] + tile->num_directions[1]) *
+                    3 * sizeof(int32_t);
+    }
+    header.layers_offset = isomap_align(position, sizeof(uint64_t));
+    position = header.layers_offset +
+               map->num_layers * sizeof(struct binary_layer);
+    for (unsigned int l = 0; l < map->num_layers; ++l) {
+        const struct layer *layer = map->layers + l;
+        position = isomap_align(position, BINARY_ALIGNMENT);
+        entries[l] = (struct binary_layer){
+            .storage = dense ? LAYER_DENSE : layer->storage,
+            .num_rows = layer->num_rows,
+            .num_columns = layer->num_columns,
+            .offset = {layer->offset.dx, layer->offset.dy, layer->offset.dz},
+            .data_offset = position
+        };
+        if (dense) {
+            entries[l].num_items = (uint64_t)layer->num_rows *
+                                   layer->num_columns;
+            position += entries[l].num_items * sizeof(tile_id);
+        } else {
+            position += isomap_binary_layer_size(layer,
+                                                 &entries[l].num_items);
+        }
+    }
+    position = 0;
+    fwrite(&header, sizeof(header), 1, stream);
+    position += sizeof(header);
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i) {
+        const struct tile *tile = tileset->tiles + i;
+        const char *filename = tile_source_filename(tileset, tile);
+        const unsigned int *rectangle = tileset->infos[i].rectangle;
+        struct binary_tile entry = {
+            .id = tile->id,
+            .filename_length = strlen(filename),
+            .num_directions = {tile->num_directions[0], tile->num_directions[1]},
+            .rectangle = {rectangle[0], rectangle[1],
+                          rectangle[2], rectangle[3]}
+        };
+        fwrite(&entry, sizeof(entry), 1, stream);
+        fwrite(filename, 1, entry.filename_length, stream);
+        position += sizeof(entry) + entry.filename_length;
+        isomap_write_padding(stream, &position,
+                             isomap_align(position + 1, 4));
+        for (unsigned int o = 0; o <= 1; ++o) {
+            const struct vect *directions = tile_get_directions(tileset, tile,
+                                                                o == 0);
+            for (unsigned int d = 0; d < tile->num_directions[o]; ++d) {
+                const struct vect *v = directions + d;
+                int32_t direction[3] = {v->dx, v->dy, v->dz};
+                fwrite(direction, sizeof(int32_t), 3, stream);
+                position += sizeof(direction);
+            }
+        }
+    }
+    isomap_write_padding(stream, &position, header.layers_offset);
+    fwrite(entries, sizeof(struct binary_layer), map->num_layers, stream);
+    position += map->num_layers * sizeof(struct binary_layer);
+    return position;
+}
+
+/**
+ * Tell if a range of bytes lies in a binary file and is aligned
+ *
+ * @param size       The size of the file
+ * @param offset     The position of the range
+ * @param length     The length of the range
+ * @param alignment  The required alignment of the position
+ * @return           True if the range is valid
+ */
+bool isomap_binary_range_is_valid(uint64_t size, uint64_t offset,
+                                  uint64_t length, uint64_t alignment) {
+    return offset % alignment == 0 && offset <= size && length <= size - offset;
+}
+
+/**
+ * Load the tileset of a binary isomap
+ *
+ * @param isomap  The isomap, whose mapping is set
+ * @param header  The header of the binary file
+ * @return        True if the tileset is valid
+ */
+bool isomap_load_binary_tileset(struct isomap *isomap,
+                                const struct binary_header *header) {
+    const char *mapping = isomap->mapping;
+    uint64_t position = header->tileset_offset;
+    for (unsigned int i = 0; i < header->num_tiles; ++i) {
+        if (!isomap_binary_range_is_valid(isomap->mapping_size, position,
+                                          sizeof(struct binary_tile), 4))
+            return false;
+        const struct binary_tile *tile = (const void*)(mapping + position);
+        position += sizeof(struct binary_tile);
+        uint64_t filename_size =
+            isomap_align((uint64_t)tile->filename_length + 1, 4);
+        uint64_t num_directions = (uint64_t)tile->num_directions[0] +
+                                  tile->num_directions[1];
+        if (!isomap_binary_range_is_valid(isomap->mapping_size, position,
+                                          filename_size, 4) ||
+            mapping[position + tile->filename_length] != '\0' ||
+            !isomap_binary_range_is_valid(isomap->mapping_size,
+                                          position + filename_size,
+                                          num_directions * 3 * sizeof(int32_t),
+                                          4))
+            return false;
+        struct tile *added = tile_add_to_tileset(isomap->tileset, tile->id,
+                                                 mapping + position);
+        if (added != NULL)
+            tile_set_rectangle(isomap->tileset, added,
+                               tile->rectangle[0], tile->rectangle[1],
+                               tile->rectangle[2], tile->rectangle[3]);
+        position += filename_size;
+        const int32_t *directions = (const void*)(mapping + position);
+        for (uint64_t d = 0; d < num_directions; ++d)
+            tile_add_direction(isomap->tileset, tile->id,
+                               directions[3 * d], directions[3 * d + 1],
+                               directions[3 * d + 2],
+                               d < tile->num_directions[0]);
+        position += num_directions * 3 * sizeof(int32_t);
+    }
+    return true;
+}
+
+/**
+ * Load a layer of a binary isomap
+ *
+ * The tiles of dense and run-length layers are used in place. The tiles of
+ * chunked layers are copied, since their chunks are individually allocated.
+ *
+ * @param isomap  The isomap, whose mapping is set
+ * @param entry   The entry of the layer in the layer directory
+ * @return        True if the layer is valid
+ */
+bool isomap_load_binary_layer(struct isomap *isomap,
+                              const struct binary_layer *entry) {
+    char *mapping = isomap->mapping;
+    uint64_t size = isomap->mapping_size;
+    uint64_t n = entry->num_items;
+    uint64_t num_cells = (uint64_t)entry->num_rows * entry->num_columns;
+    const int32_t *offset = entry->offset;
+    if (entry->storage == LAYER_DENSE) {
+        if (n != num_cells || n > size / sizeof(tile_id) ||
+            !isomap_binary_range_is_valid(size, entry->data_offset,
+                                          n * sizeof(tile_id), sizeof(tile_id)))
+            return false;
+        return map_add_layer_with_tiles(isomap->map,
+                                        entry->num_rows, entry->num_columns,
+                                        offset[0], offset[1], offset[2],
+                                        (tile_id*)(mapping + entry->data_offset))
+               != NULL;
+    } else if (entry->storage == LAYER_RLE) {
+        struct rle *runs;
+        if (num_cells == 0) {
+            if (n != 0)
+                return false;
+            runs = rle_create(0);
+        } else {
+            if (n == 0 || n > size / (sizeof(uint64_t) + sizeof(tile_id)) ||
+                !isomap_binary_range_is_valid(size, entry->data_offset,
+                                              n * (sizeof(uint64_t) +
+                                                   sizeof(tile_id)),
+                                              sizeof(uint64_t)))
+                return false;
+            unsigned long *starts =
+                (unsigned long*)(mapping + entry->data_offset);
+            tile_id *values = (tile_id*)(starts + n);
+            if (starts[0] != 0 || starts[n - 1] >= num_cells)
+                return false;
+            for (uint64_t r = 1; r < n; ++r)
+                if (starts[r] <= starts[r - 1])
+                    return false;
+            runs = rle_create_borrowed(starts, values, n, num_cells);
+        }
+        if (map_add_layer_with_runs(isomap->map,
+                                    entry->num_rows, entry->num_columns,
+                                    offset[0], offset[1], offset[2],
+                                    runs) == NULL) {
+            rle_delete(runs);
+            return false;
+        }
+        return true;
+    } else if (entry->storage == LAYER_CHUNKED) {
+        uint64_t chunk_size = CHUNK_SIZE * CHUNK_SIZE * sizeof(tile_id);
+        uint64_t tiles_offset = isomap_align(entry->data_offset +
+                                             n * 2 * sizeof(uint32_t),
+                                             BINARY_ALIGNMENT);
+        if (n > size / chunk_size ||
+            !isomap_binary_range_is_valid(size, entry->data_offset,
+                                          n * 2 * sizeof(uint32_t),
+                                          sizeof(uint32_t)) ||
+            !isomap_binary_range_is_valid(size, tiles_offset,
+                                          n * chunk_size, sizeof(tile_id)))
+            return false;
+        struct layer *layer =
+            map_add_layer_with_storage(isomap->map, LAYER_CHUNKED,
+                                       entry->num_rows, entry->num_columns,
+                                       offset[0], offset[1], offset[2]);
+        if (layer == NULL)
+            return false;
+        const uint32_t *coordinates =
+            (const uint32_t*)(mapping + entry->data_offset);
+        for (uint64_t c = 0; c < n; ++c) {
+            if ((uint64_t)coordinates[2 * c] * CHUNK_SIZE >= entry->num_rows ||
+                (uint64_t)coordinates[2 * c + 1] * CHUNK_SIZE >= entry->num_columns)
+                return false;
+            tile_id *tiles = chunk_get_or_add(layer->chunks, coordinates[2 * c],
+                                              coordinates[2 * c + 1]);
+            memcpy(tiles, mapping + tiles_offset + c * chunk_size, chunk_size);
+        }
+        return true;
+    }
+    return false;
 }
 
 // Functions //
 // --------- //
 
 struct isomap *isomap_create_from_json_file(FILE *file) {
-    struct isomap *isomap;
-
-    json_t *json_root, *json_tileset, *json_layers;
-    json_error_t error;
-    json_root = json_loadf(file, 0, &error);
-    json_tileset = json_object_get(json_root, "tileset");
-    json_layers = json_object_get(json_root, "layers");
-    isomap = malloc(sizeof(struct isomap));
-    isomap->tile_width
-        = json_integer_value(json_object_get(json_root, "tile-width"));
-    isomap->z_offset
-        = json_integer_value(json_object_get(json_root, "z-offset"));
-    isomap->tileset = tile_create_tileset();
-    isomap->map = map_create();
-    isomap_load_tileset(isomap, json_tileset);
-    isomap_load_map(isomap, json_layers);
-    json_decref(json_root);
+    STATS_START(timer);
+    struct arena *arena = arena_create();
+    struct isomap *isomap = arena_alloc(arena, sizeof(struct isomap));
+    isomap->arena = arena;
+    isomap->tile_width = 0;
+    isomap->z_offset = 0;
+    isomap->tileset = tile_create_tileset_in_arena(arena);
+    isomap->map = map_create_in_arena(arena);
+    isomap->mapping = NULL;
+    isomap->mapping_size = 0;
+    struct parser *parser = malloc(sizeof(struct parser));
+    parser_initialize(parser, file);
+    bool valid = isomap_load(isomap, parser);
+    free(parser);
+    STATS_STOP(timer, STATS_LOAD);
+    if (!valid) {
+        isomap_delete(isomap);
+        return NULL;
+    }
+    return isomap;
+}
+
+struct isomap *isomap_create_from_binary_file(FILE *file) {
+    STATS_START(timer);
+    struct stat status;
+    int fd = fileno(file);
+    if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) ||
+        (uint64_t)status.st_size < sizeof(struct binary_header))
+        return NULL;
+    void *mapping = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+        return NULL;
+    const struct binary_header *header = mapping;
+    if (memcmp(header->magic, BINARY_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != BINARY_VERSION ||
+        header->byte_order != BINARY_BYTE_ORDER ||
+        !isomap_binary_range_is_valid(status.st_size, header->layers_offset,
+                                      (uint64_t)header->num_layers *
+                                      sizeof(struct binary_layer),
+                                      sizeof(uint64_t))) {
+        munmap(mapping, status.st_size);
+        return NULL;
+    }
+    struct arena *arena = arena_create();
+    struct isomap *isomap = arena_alloc(arena, sizeof(struct isomap));
+    isomap->arena = arena;
+    isomap->tile_width = header->tile_width;
+    isomap->z_offset = header->z_offset;
+    isomap->tileset = tile_create_tileset_in_arena(arena);
+    isomap->map = map_create_in_arena(arena);
+    isomap->mapping = mapping;
+    isomap->mapping_size = status.st_size;
+    STATS_START(tileset_timer);
+    bool valid = isomap_load_binary_tileset(isomap, header);
+    tile_sort_tileset(isomap->tileset);
+    STATS_STOP(tileset_timer, STATS_LOAD_TILESET);
+    STATS_START(map_timer);
+    const struct binary_layer *entries =
+        (const void*)((char*)mapping + header->layers_offset);
+    for (unsigned int l = 0; valid && l < header->num_layers; ++l)
+        valid = isomap_load_binary_layer(isomap, entries + l);
+    STATS_STOP(map_timer, STATS_LOAD_MAP);
+    STATS_STOP(timer, STATS_LOAD);
+    if (!valid) {
+        isomap_delete(isomap);
+        return NULL;
+    }
     return isomap;
 }
 
+void isomap_write_binary(FILE *stream, const struct isomap *isomap) {
+    const struct map *map = isomap->map;
+    struct binary_layer entries[map->num_layers];
+    uint64_t position = isomap_write_binary_header(stream, isomap, false,
+                                                   entries);
+    for (unsigned int l = 0; l < map->num_layers; ++l) {
+        isomap_write_padding(stream, &position, entries[l].data_offset);
+        isomap_write_binary_layer(stream, map->layers + l, &position);
+    }
+}
+
+uint64_t isomap_write_binary_start(FILE *stream, const struct isomap *isomap) {
+    struct binary_layer entries[isomap->map->num_layers];
+    return isomap_write_binary_header(stream, isomap, true, entries);
+}
+
+void isomap_write_binary_row(FILE *stream,
+                             const tile_id *tiles,
+                             unsigned int num_columns,
+                             unsigned int row,
+                             uint64_t *position) {
+    if (row == 0)
+        isomap_write_padding(stream, position,
+                             isomap_align(*position, BINARY_ALIGNMENT));
+    fwrite(tiles, sizeof(tile_id), num_columns, stream);
+    *position += (uint64_t)num_columns * sizeof(tile_id);
+}
+
 void isomap_delete(struct isomap *isomap) {
     tile_delete_tileset(isomap->tileset);
     map_delete(isomap->map);
-    free(isomap);
-}
-
-void isomap_draw_to_png(const struct isomap *isomap,
-                        const char *output_filename) {
-    struct box bounding_box = map_get_bounding_box(isomap->map);
-    struct vect box_vect = geometry_box_to_vect(&bounding_box);
-    int h_step = isomap->tile_width / 2;
-    int v_step = isomap->tile_width / 4;
-    int l_step = isomap->z_offset;
-
-    unsigned int surface_width
-        = h_step * (box_vect.dx + box_vect.dy + 3);
-    unsigned int surface_height
-        = v_step * (box_vect.dx + box_vect.dy + 2) + l_step * (box_vect.dz + 2);
-    cairo_surface_t *output_image =
-        cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-                                   surface_width, surface_height);
-    cairo_t *cr = cairo_create(output_image);
-    cairo_set_source_rgb(cr, 0, 0.1, 0);
-    cairo_rectangle(cr, 0, 0, surface_width, surface_height);
-    cairo_fill(cr);
-    const struct location *location;
-    for (location = map_get_occupied_location(isomap->map, true);
-         location != NULL;
-         location = map_get_occupied_location(isomap->map, false)) {
-        int origin_x = h_step * (box_vect.dx + 0.5);
-        int origin_y = (box_vect.dz - location->z) * l_step;
-        int x = origin_x - location->x * h_step + location->y * h_step;
-        int y = origin_y + location->x * v_step + location->y * v_step;
-        tile_id id = map_get_tile_by_location(isomap->map, location->x,
-                                              location->y, location->z);
-        struct tile *tile = tile_by_id(isomap->tileset, id);
-        cairo_surface_t *surface = cairo_image_surface_create_from_png(tile->filename);
-        cairo_set_source_surface(cr, surface, x, y);
-        cairo_paint(cr);
-        cairo_surface_destroy(surface);
-    }
-    cairo_surface_write_to_png(output_image, output_filename);
-    cairo_surface_destroy(output_image);
+    if (isomap->mapping != NULL)
+        munmap(isomap->mapping, isomap->mapping_size);
+    arena_delete(isomap->arena);
 }
 
 void isomap_print(FILE *stream, const struct isomap *isomap, const char *prefix) {
@@ -3,21 +3,30 @@
  *
  * Handle isometric maps.
  *
+ * An isomap is allocated with its tileset and its map in a single arena (see
+ * `arena.h`), which is released by `isomap_delete`. Graphs derived from the
+ * map can be created in the same arena.
+ *
  * @author  Alexandre Blondin Massé
  */
 #ifndef ISOMAP_H
 #define ISOMAP_H
 
+#include "map.h"
+#include <stdint.h>
 #include <stdio.h>
 
 // Types //
 // ----- //
 
 struct isomap {
+    struct arena *arena; // The arena of the isomap
     unsigned int tile_width;
     unsigned int z_offset;
     struct map *map;
     struct tileset *tileset;
+    void *mapping;       // The memory-mapped binary file (or NULL)
+    size_t mapping_size; // The size of the mapping
 };
 
 // Functions //
@@ -26,26 +35,78 @@ struct isomap {
 /**
  * Create an isomap from a JSON file
  *
+ * The file is parsed in a streaming fashion (see `parser.h`): the tiles of
+ * the layers are scanned directly into the map, so that the memory used
+ * while loading is the memory of the map plus a small read buffer.
+ *
+ * If the file is not a valid JSON document whose root is an object, return
+ * NULL. Missing or unexpected keys and values are ignored.
+ *
  * @param file  The input stream
- * @return      The resulting isomap
+ * @return      The resulting isomap or NULL
  */
 struct isomap *isomap_create_from_json_file(FILE *file);
 
 /**
- * Delete an isomap
+ * Create an isomap from a binary file
+ *
+ * The file is mapped in memory and the tiles of its dense and run-length
+ * layers are used in place, without being copied. Therefore, the file must be
+ * a regular file (not a pipe). See the README for the description of the
+ * format.
+ *
+ * If the file is not a valid binary isomap, return NULL.
+ *
+ * @param file  The input stream
+ * @return      The resulting isomap or NULL
+ */
+struct isomap *isomap_create_from_binary_file(FILE *file);
+
+/**
+ * Write an isomap to a stream in the binary format
  *
+ * @param stream  The stream
  * @param isomap  The isomap
  */
-void isomap_delete(struct isomap *isomap);
+void isomap_write_binary(FILE *stream, const struct isomap *isomap);
 
 /**
- * Draw an isomap to a PNG file
+ * Start writing an isomap to a stream in the binary format, row by row
+ *
+ * The header, the tileset and the layer directory are written as with
+ * `isomap_write_binary`, except that all the layers are written as dense
+ * layers and that only their dimensions and offsets are used: their tiles are
+ * then written by the caller with `isomap_write_binary_row`, layer by layer
+ * and row by row. Therefore, a map too large to fit in memory can be written
+ * by giving empty run-length layers of the right dimensions.
  *
- * @param isomap           The map to be drawn
- * @param output_filename  The output filename
+ * @param stream  The stream
+ * @param isomap  The isomap
+ * @return        The number of bytes written
  */
-void isomap_draw_to_png(const struct isomap *isomap,
-                        const char *output_filename);
+uint64_t isomap_write_binary_start(FILE *stream, const struct isomap *isomap);
+
+/**
+ * Write a row of tiles of a layer started with `isomap_write_binary_start`
+ *
+ * @param stream       The stream
+ * @param tiles        The tiles of the row
+ * @param num_columns  The number of columns of the layer
+ * @param row          The index of the row in its layer
+ * @param position     The number of bytes written, updated by the function
+ */
+void isomap_write_binary_row(FILE *stream,
+                             const tile_id *tiles,
+                             unsigned int num_columns,
+                             unsigned int row,
+                             uint64_t *position);
+
+/**
+ * Delete an isomap
+ *
+ * @param isomap  The isomap
+ */
+void isomap_delete(struct isomap *isomap);
 
 /**
  * Print an isomap to a stream
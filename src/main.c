@@ -5,9 +5,15 @@
  *
  * @author Alexandre Blondin Masse
  */
+#define _POSIX_C_SOURCE 200809L
 #include "isomap.h"
+#include "arena.h"
 #include "geometry.h"
 #include "graph.h"
+#include "render.h"
+#include "serializer.h"
+#include "server.h"
+#include "stats.h"
 
 #include <stdio.h>
 #include <stdbool.h>
@@ -15,15 +21,31 @@
 #include <stdlib.h>
 #include <getopt.h>
 
-#define FORMAT_LENGTH 5
+#define FORMAT_LENGTH 8
 #define FILENAME_LENGTH 200
+#ifndef ISOMAP_NO_STATS
+#define USAGE_STATS "\
+    [--stats[=FORMAT]]\n"
+#define USAGE_STATS_OPTION "\
+  --stats[=FORMAT]           Print the time spent in each phase and\n\
+                             some counters on stderr, as text (the\n\
+                             default) or json.\n"
+#else
+#define USAGE_STATS ""
+#define USAGE_STATS_OPTION ""
+#endif
 #define USAGE "\
 Usage: %s [-h|--help] [-s|--start X,Y,Z] [-e|--end X,Y,Z]\n\
     [-w|--with-walk] [-f|--output-format FORMAT]\n\
     [-i|--input-filename PATH] [-o|--output-filename PATH]\n\
+    [-I|--input-format FORMAT] [-t|--threads N]\n\
+    [-V|--viewport X,Y,W,H] [-T|--tile-size N]\n\
+    [-b|--backend BACKEND] [--png-level N]\n\
+    [-q|--queries PATH] [--serve SOCKET]\n" USAGE_STATS "\
 \n\
 Generate an isometric map from a JSON file. The file must respect\n\
 the right JSON format. See the README file for more details.\n\
+Maps can also be converted to and read from a binary format.\n\
 By default, read the file on stdin and write the result on stdout.\n\
 \n\
 Optional arguments:\n\
@@ -35,13 +57,53 @@ Optional arguments:\n\
   -w|--with-walk             Also display a shortest walk between\n\
                              the start and end locations.\n\
   -f|--output-format FORMAT  Select the ouput format (either text,\n\
-                             or png). The default format is text.\n\
+                             png, pyramid, binary, raw, ppm, pam,\n\
+                             qoi, json or ndjson). The default\n\
+                             format is text.\n\
+                             The pyramid format writes square PNG\n\
+                             images in the directory PATH/z/x/y.png.\n\
+                             The raw, ppm, pam and qoi formats are\n\
+                             faster to write than png.\n\
+                             The json and ndjson formats write the\n\
+                             summary of the graph of the map, the\n\
+                             walk (with -w) and the results of the\n\
+                             queries (with -q) as JSON records.\n\
   -i|--input-filename PATH   Read the JSON file from the file PATH\n\
                              If present, ignore stdin.\n\
   -o|--output-filename PATH  Write the output to the file PATH.\n\
-                             Mandatory for the PNG output format.\n\
+                             Mandatory for the PNG and pyramid\n\
+                             output formats.\n\
                              If present, does not write on stdout.\n\
-"
+  -I|--input-format FORMAT   Select the input format (either json\n\
+                             or binary). The default format is json.\n\
+                             A binary map must be a regular file.\n\
+  -t|--threads N             The number of threads used to draw and\n\
+                             encode the images. Default value is 1.\n\
+  -V|--viewport X,Y,W,H      Only draw the rectangle of the PNG output\n\
+                             of width W and height H whose top left\n\
+                             corner is (X,Y).\n\
+  -T|--tile-size N           The size of the images of the pyramid\n\
+                             output (an even number). Default value\n\
+                             is 256.\n\
+  -b|--backend BACKEND       Select the way the tiles are drawn\n\
+                             (either cairo or direct, which writes\n\
+                             the pixels directly). The default\n\
+                             backend is cairo.\n\
+  --png-level N              The compression level of the PNG and\n\
+                             pyramid outputs, from 0 (no compression,\n\
+                             fastest) to 9 (best compression).\n\
+                             Default value is 6.\n\
+  -q|--queries PATH          Answer the WALK and DISTANCE queries of\n\
+                             the file PATH, one per line, as in the\n\
+                             requests of --serve. Only with the json\n\
+                             and ndjson formats.\n\
+  --serve SOCKET             Instead of writing an output, answer\n\
+                             walk, distance and render requests on\n\
+                             the Unix domain socket SOCKET, with N\n\
+                             worker threads (see -t), until a\n\
+                             SHUTDOWN request or a termination\n\
+                             signal is received. See the README file\n\
+                             for the protocol.\n" USAGE_STATS_OPTION
 
 /**
  * Parsing errors
@@ -53,6 +115,13 @@ enum status {
     ISOMAP_ERROR_PNG_FORMAT_WITHOUT_FILENAME = 3,
     ISOMAP_ERROR_BAD_OPTION                  = 4,
     ISOMAP_ERROR_INVALID_PATH                = 5,
+    ISOMAP_ERROR_INVALID_MAP                 = 6,
+    ISOMAP_ERROR_THREADS                     = 7,
+    ISOMAP_ERROR_VIEWPORT                    = 8,
+    ISOMAP_ERROR_TILE_SIZE                   = 9,
+    ISOMAP_ERROR_WRITE                       = 10,
+    ISOMAP_ERROR_PNG_LEVEL                   = 11,
+    ISOMAP_ERROR_SOCKET                      = 12,
 };
 
 /**
@@ -64,8 +133,18 @@ struct arguments {
     struct location start;                 // The start location
     struct location end;                   // The end location
     char output_format[FORMAT_LENGTH];     // The output format
+    char input_format[FORMAT_LENGTH];      // The input format
     char input_filename[FILENAME_LENGTH];  // The input filename
     char output_filename[FILENAME_LENGTH]; // The output filename
+    unsigned int num_threads;              // The number of drawing threads
+    bool has_viewport;                     // Draw only a viewport?
+    struct render_viewport viewport;       // The viewport
+    unsigned int tile_size;                // The size of the pyramid images
+    char backend[FORMAT_LENGTH];           // The drawing backend
+    int png_level;                         // The PNG compression level
+    char query_filename[FILENAME_LENGTH];  // The queries filename (or empty)
+    char socket_path[FILENAME_LENGTH];     // The socket to serve (or empty)
+    char stats_format[FORMAT_LENGTH];      // The stats format (or empty)
     enum status status;                    // The status of the program
 };
 
@@ -87,6 +166,67 @@ enum status parse_coordinates(const char *s, int *x, int *y, int *z) {
     return num_parsed == 3 && tail == '\0' ? ISOMAP_OK : ISOMAP_ERROR_COORDINATES;
 }
 
+/**
+ * Retrieve a positive number of threads from a string
+ *
+ * @param s            The string containing the number
+ * @param num_threads  The number of threads
+ * @return             The status
+ */
+enum status parse_threads(const char *s, unsigned int *num_threads) {
+    char tail = '\0';
+    int num_parsed = sscanf(s, "%u%c", num_threads, &tail);
+    return num_parsed == 1 && *num_threads > 0 && s[0] != '-' ?
+           ISOMAP_OK : ISOMAP_ERROR_THREADS;
+}
+
+/**
+ * Retrieve a viewport X,Y,W,H from a string
+ *
+ * @param s         The string containing the viewport
+ * @param viewport  The viewport
+ * @return          The status
+ */
+enum status parse_viewport(const char *s, struct render_viewport *viewport) {
+    char tail = '\0';
+    int width, height;
+    int num_parsed = sscanf(s, "%d,%d,%d,%d%c", &viewport->x, &viewport->y,
+                            &width, &height, &tail);
+    if (num_parsed != 4 || width <= 0 || height <= 0)
+        return ISOMAP_ERROR_VIEWPORT;
+    viewport->width = width;
+    viewport->height = height;
+    return ISOMAP_OK;
+}
+
+/**
+ * Retrieve a positive even size of the pyramid images from a string
+ *
+ * @param s          The string containing the size
+ * @param tile_size  The size
+ * @return           The status
+ */
+enum status parse_tile_size(const char *s, unsigned int *tile_size) {
+    char tail = '\0';
+    int num_parsed = sscanf(s, "%u%c", tile_size, &tail);
+    return num_parsed == 1 && *tile_size > 0 && *tile_size % 2 == 0 &&
+           s[0] != '-' ? ISOMAP_OK : ISOMAP_ERROR_TILE_SIZE;
+}
+
+/**
+ * Retrieve a PNG compression level between 0 and 9 from a string
+ *
+ * @param s          The string containing the level
+ * @param png_level  The level
+ * @return           The status
+ */
+enum status parse_png_level(const char *s, int *png_level) {
+    char tail = '\0';
+    int num_parsed = sscanf(s, "%d%c", png_level, &tail);
+    return num_parsed == 1 && *png_level >= 0 && *png_level <= 9 ?
+           ISOMAP_OK : ISOMAP_ERROR_PNG_LEVEL;
+}
+
 /**
  * Print usage to a stream
  *
@@ -105,12 +245,23 @@ void print_usage(char *argv[], FILE *file) {
  * @return      The parsed arguments
  */
 struct arguments parse_arguments(int argc, char *argv[]) {
+    enum encoder_format format;
+    enum serializer_format records_format;
     struct arguments arguments = {
         .show_help       = false,
         .with_walk       = false,
         .output_format   = "text",
+        .input_format    = "json",
         .input_filename  = "",
         .output_filename = "",
+        .num_threads     = 1,
+        .has_viewport    = false,
+        .tile_size       = RENDER_TILE_SIZE,
+        .backend         = "cairo",
+        .png_level       = ENCODER_DEFAULT_LEVEL,
+        .query_filename  = "",
+        .socket_path     = "",
+        .stats_format    = "",
         .status          = ISOMAP_OK
     };
     arguments.start.x = 0;
@@ -129,12 +280,23 @@ struct arguments parse_arguments(int argc, char *argv[]) {
         {"output-format",   required_argument, 0, 'f'},
         {"input-filename",  required_argument, 0, 'i'},
         {"output-filename", required_argument, 0, 'o'},
+        {"input-format",    required_argument, 0, 'I'},
+        {"threads",         required_argument, 0, 't'},
+        {"viewport",        required_argument, 0, 'V'},
+        {"tile-size",       required_argument, 0, 'T'},
+        {"backend",         required_argument, 0, 'b'},
+        {"png-level",       required_argument, 0, 'L'},
+        {"queries",         required_argument, 0, 'q'},
+        {"serve",           required_argument, 0, 'S'},
+#ifndef ISOMAP_NO_STATS
+        {"stats",           optional_argument, 0, 'P'},
+#endif
         {0, 0, 0, 0}
     };
 
     while (true) {
         int option_index = 0;
-        int c = getopt_long(argc, argv, "hws:e:f:i:o:", long_opts, &option_index);
+        int c = getopt_long(argc, argv, "hws:e:f:i:o:I:t:V:T:b:q:", long_opts, &option_index);
         if (c == -1) break;
         switch (c) {
             case 'h': arguments.show_help = true; break;
@@ -153,6 +315,30 @@ struct arguments parse_arguments(int argc, char *argv[]) {
                       break;
             case 'o': strncpy(arguments.output_filename, optarg, FILENAME_LENGTH - 1);
                       break;
+            case 'I': strncpy(arguments.input_format, optarg, FORMAT_LENGTH - 1);
+                      break;
+            case 't': arguments.status = arguments.status != ISOMAP_OK ? arguments.status :
+                                         parse_threads(optarg, &arguments.num_threads);
+                      break;
+            case 'V': arguments.status = arguments.status != ISOMAP_OK ? arguments.status :
+                                         parse_viewport(optarg, &arguments.viewport);
+                      arguments.has_viewport = true;
+                      break;
+            case 'T': arguments.status = arguments.status != ISOMAP_OK ? arguments.status :
+                                         parse_tile_size(optarg, &arguments.tile_size);
+                      break;
+            case 'b': strncpy(arguments.backend, optarg, FORMAT_LENGTH - 1);
+                      break;
+            case 'L': arguments.status = arguments.status != ISOMAP_OK ? arguments.status :
+                                         parse_png_level(optarg, &arguments.png_level);
+                      break;
+            case 'q': strncpy(arguments.query_filename, optarg, FILENAME_LENGTH - 1);
+                      break;
+            case 'S': strncpy(arguments.socket_path, optarg, FILENAME_LENGTH - 1);
+                      break;
+            case 'P': strncpy(arguments.stats_format, optarg ? optarg : "text",
+                              FORMAT_LENGTH - 1);
+                      break;
             case '?': arguments.status = ISOMAP_ERROR_BAD_OPTION;
                       break;
         }
@@ -169,14 +355,59 @@ struct arguments parse_arguments(int argc, char *argv[]) {
         fprintf(stderr, "Error: the coordinates must be 3 integers separated by commas\n");
         print_usage(argv, stderr);
         exit(ISOMAP_ERROR_COORDINATES);
+    } else if (arguments.status == ISOMAP_ERROR_THREADS) {
+        fprintf(stderr, "Error: the number of threads must be a positive integer\n");
+        print_usage(argv, stderr);
+        exit(ISOMAP_ERROR_THREADS);
+    } else if (arguments.status == ISOMAP_ERROR_VIEWPORT) {
+        fprintf(stderr, "Error: the viewport must be 4 integers X,Y,W,H with positive W and H\n");
+        print_usage(argv, stderr);
+        exit(ISOMAP_ERROR_VIEWPORT);
+    } else if (arguments.status == ISOMAP_ERROR_TILE_SIZE) {
+        fprintf(stderr, "Error: the tile size must be a positive even integer\n");
+        print_usage(argv, stderr);
+        exit(ISOMAP_ERROR_TILE_SIZE);
+    } else if (arguments.status == ISOMAP_ERROR_PNG_LEVEL) {
+        fprintf(stderr, "Error: the PNG level must be an integer between 0 and 9\n");
+        print_usage(argv, stderr);
+        exit(ISOMAP_ERROR_PNG_LEVEL);
     } else if (strcmp(arguments.output_format, "text") != 0 &&
-               strcmp(arguments.output_format, "png")  != 0) {
+               strcmp(arguments.output_format, "pyramid") != 0 &&
+               strcmp(arguments.output_format, "binary") != 0 &&
+               !encoder_format_by_name(arguments.output_format, &format) &&
+               !serializer_format_by_name(arguments.output_format,
+                                          &records_format)) {
         fprintf(stderr, "Error: format %s not supported\n", arguments.output_format);
         print_usage(argv, stderr);
         exit(ISOMAP_ERROR_FORMAT_NOT_SUPPORTED);
-    } else if (strcmp(arguments.output_format, "png") == 0 &&
+    } else if (strcmp(arguments.query_filename, "") != 0 &&
+               !serializer_format_by_name(arguments.output_format,
+                                          &records_format)) {
+        fprintf(stderr, "Error: queries are only supported with the json "
+                        "and ndjson formats\n");
+        print_usage(argv, stderr);
+        exit(ISOMAP_ERROR_FORMAT_NOT_SUPPORTED);
+    } else if (strcmp(arguments.input_format, "json")   != 0 &&
+               strcmp(arguments.input_format, "binary") != 0) {
+        fprintf(stderr, "Error: input format %s not supported\n", arguments.input_format);
+        print_usage(argv, stderr);
+        exit(ISOMAP_ERROR_FORMAT_NOT_SUPPORTED);
+    } else if (strcmp(arguments.stats_format, "") != 0 &&
+               strcmp(arguments.stats_format, "text") != 0 &&
+               strcmp(arguments.stats_format, "json") != 0) {
+        fprintf(stderr, "Error: stats format %s not supported\n", arguments.stats_format);
+        print_usage(argv, stderr);
+        exit(ISOMAP_ERROR_FORMAT_NOT_SUPPORTED);
+    } else if (strcmp(arguments.backend, "cairo")  != 0 &&
+               strcmp(arguments.backend, "direct") != 0) {
+        fprintf(stderr, "Error: backend %s not supported\n", arguments.backend);
+        print_usage(argv, stderr);
+        exit(ISOMAP_ERROR_FORMAT_NOT_SUPPORTED);
+    } else if ((strcmp(arguments.output_format, "png") == 0 ||
+                strcmp(arguments.output_format, "pyramid") == 0) &&
                strcmp(arguments.output_filename, "")  == 0) {
-        fprintf(stderr, "Error: output filename is mandatory with png format\n");
+        fprintf(stderr, "Error: output filename is mandatory with %s format\n",
+                arguments.output_format);
         print_usage(argv, stderr);
         exit(ISOMAP_ERROR_PNG_FORMAT_WITHOUT_FILENAME);
     }
@@ -191,13 +422,14 @@ struct arguments parse_arguments(int argc, char *argv[]) {
  */
 void print_walk(const struct isomap *isomap,
                 const struct arguments *arguments) {
-    struct graph *graph = graph_create(isomap->map, isomap->tileset);
-    struct graph_walk *walk = graph_shortest_walk(graph,
+    struct graph_walk *walk = graph_shortest_walk_in_map(isomap->map,
+            isomap->tileset,
             &arguments->start,
             &arguments->end);
     if (walk != NULL) {
         printf("A ");
         graph_print_walk(stdout, walk, "");
+        graph_delete_walk(walk);
     } else {
         printf("No walk between ");
         geometry_print_location(stdout, &arguments->start);
@@ -207,8 +439,126 @@ void print_walk(const struct isomap *isomap,
     }
 }
 
+/**
+ * Retrieve the (x,y,z) coordinates at the start of a query, after blanks
+ *
+ * @param s         The query, moved after the coordinates
+ * @param location  The location
+ * @return          True if the coordinates were retrieved
+ */
+bool parse_query_location(char **s, struct location *location) {
+    int *coordinates[3] = {&location->x, &location->y, &location->z};
+    for (unsigned int i = 0; i < 3; ++i) {
+        char *end;
+        if (i > 0 && *(*s)++ != ',')
+            return false;
+        *coordinates[i] = strtol(*s, &end, 10);
+        if (end == *s)
+            return false;
+        *s = end;
+    }
+    return true;
+}
+
+/**
+ * Answer the walk and distance queries of a stream, one per line
+ *
+ * Blank lines are ignored, and an error record is written for each invalid
+ * line. The queries are parsed without `sscanf`, which would be slower than
+ * writing their results.
+ *
+ * @param serializer  The serializer of the results
+ * @param graph       The graph of the map
+ * @param queries     The stream of the queries
+ */
+void answer_queries(struct serializer *serializer,
+                    const struct graph *graph,
+                    FILE *queries) {
+    char *line = NULL;
+    size_t capacity = 0;
+    unsigned long line_number = 0;
+    struct location start, end;
+    while (getline(&line, &capacity, queries) != -1) {
+        ++line_number;
+        char *command = line + strspn(line, " \t\r\n");
+        if (*command == '\0')
+            continue;
+        size_t length = strcspn(command, " \t\r\n");
+        bool distance = length == 8 && strncmp(command, "DISTANCE", 8) == 0;
+        char *args = command + length;
+        if (!distance && (length != 4 || strncmp(command, "WALK", 4) != 0)) {
+            serializer_write_error(serializer, line_number,
+                                   "expected a WALK or DISTANCE query");
+        } else if (!parse_query_location(&args, &start) ||
+                   !parse_query_location(&args, &end) ||
+                   args[strspn(args, " \t\r\n")] != '\0') {
+            serializer_write_error(serializer, line_number,
+                                   "expected two locations X,Y,Z");
+        } else {
+            struct graph_walk *walk = graph_shortest_walk(graph, &start, &end);
+            if (distance)
+                serializer_write_distance(serializer, &start, &end, walk);
+            else
+                serializer_write_walk(serializer, &start, &end, walk);
+            if (walk != NULL) graph_delete_walk(walk);
+        }
+    }
+    free(line);
+}
+
+/**
+ * Write the summary of the graph of the isomap, the walk between the start
+ * and end locations (if requested) and the results of the queries (if any)
+ * as JSON records
+ *
+ * @param output     The output stream
+ * @param isomap     The isomap
+ * @param arguments  The parsed arguments
+ * @param format     The format of the records
+ * @param queries    The stream of the queries (or NULL)
+ */
+void write_records(FILE *output,
+                   const struct isomap *isomap,
+                   const struct arguments *arguments,
+                   enum serializer_format format,
+                   FILE *queries) {
+    struct serializer *serializer = malloc(sizeof(struct serializer));
+    serializer_initialize(serializer, output, format);
+    struct graph *graph = graph_create(isomap->map, isomap->tileset);
+    serializer_write_graph(serializer, graph);
+    if (arguments->with_walk) {
+        struct graph_walk *walk = graph_shortest_walk(graph, &arguments->start,
+                                                      &arguments->end);
+        serializer_write_walk(serializer, &arguments->start, &arguments->end,
+                              walk);
+        if (walk != NULL) graph_delete_walk(walk);
+    }
+    if (queries != NULL)
+        answer_queries(serializer, graph, queries);
+    serializer_finish(serializer);
+    graph_delete(graph);
+    free(serializer);
+}
+
+/**
+ * Print the statistics of the run to stderr, if they were requested
+ *
+ * @param isomap     The isomap
+ * @param arguments  The parsed arguments
+ */
+void print_stats(const struct isomap *isomap,
+                 const struct arguments *arguments) {
+    if (strcmp(arguments->stats_format, "") == 0)
+        return;
+    STATS_MAX(STATS_ARENA_RESERVED, isomap->arena->reserved);
+    STATS_MAX(STATS_ARENA_USED_MAX, isomap->arena->high_water);
+    stats_print(stderr, strcmp(arguments->stats_format, "json") == 0);
+}
+
 int main(int argc, char *argv[]) {
     struct arguments arguments = parse_arguments(argc, argv);
+    if (strcmp(arguments.stats_format, "") != 0)
+        stats_enable();
     if (arguments.status == ISOMAP_OK) {
         FILE *input = stdin;
         if (strcmp(arguments.input_filename, "") != 0) {
@@ -218,24 +568,82 @@ int main(int argc, char *argv[]) {
                 exit(ISOMAP_ERROR_INVALID_PATH);
             }
         }
-        struct isomap *isomap = isomap_create_from_json_file(input);
+        struct isomap *isomap = strcmp(arguments.input_format, "binary") == 0 ?
+                                isomap_create_from_binary_file(input) :
+                                isomap_create_from_json_file(input);
         if (input != stdin)
             fclose(input);
-        FILE *output = stdout;
-        if (strcmp(arguments.output_filename, "") != 0) {
-            output = fopen(arguments.output_filename, "w");
+        if (isomap == NULL) {
+            fprintf(stderr, "Error: invalid map\n");
+            exit(ISOMAP_ERROR_INVALID_MAP);
+        }
+        enum render_backend backend = strcmp(arguments.backend, "direct") == 0 ?
+                                      RENDER_DIRECT : RENDER_CAIRO;
+        if (strcmp(arguments.socket_path, "") != 0) {
+            bool listening = server_run(isomap, arguments.socket_path,
+                                        arguments.num_threads, backend);
+            print_stats(isomap, &arguments);
+            isomap_delete(isomap);
+            if (!listening) {
+                fprintf(stderr, "Error: cannot listen on the socket %s\n",
+                        arguments.socket_path);
+                exit(ISOMAP_ERROR_SOCKET);
+            }
+            return ISOMAP_OK;
+        }
+        enum encoder_format format;
+        enum serializer_format records_format;
+        FILE *output = stdout, *queries = NULL;
+        if (strcmp(arguments.query_filename, "") != 0) {
+            queries = fopen(arguments.query_filename, "r");
+            if (queries == NULL) {
+                fprintf(stderr, "Error: invalid file path\n");
+                exit(ISOMAP_ERROR_INVALID_PATH);
+            }
+        }
+        if (strcmp(arguments.output_format, "pyramid") == 0) {
+            if (render_draw_pyramid(isomap, arguments.output_filename,
+                                    arguments.tile_size, arguments.png_level,
+                                    arguments.num_threads, backend) == 0) {
+                fprintf(stderr, "Error: invalid file path\n");
+                exit(ISOMAP_ERROR_INVALID_PATH);
+            }
+        } else if (strcmp(arguments.output_filename, "") != 0) {
+            output = fopen(arguments.output_filename, "wb");
             if (output == NULL) {
                 fprintf(stderr, "Error: invalid file path\n");
                 exit(ISOMAP_ERROR_INVALID_PATH);
             }
         }
         if (strcmp(arguments.output_format, "text") == 0) {
+            STATS_START(timer);
             isomap_print(output, isomap, "");
+            STATS_STOP(timer, STATS_WRITE);
             if (arguments.with_walk) print_walk(isomap, &arguments);
             if (output != stdout) fclose(output);
-        } else if (strcmp(arguments.output_format, "png") == 0) {
-            isomap_draw_to_png(isomap, arguments.output_filename);
+        } else if (strcmp(arguments.output_format, "binary") == 0) {
+            STATS_START(timer);
+            isomap_write_binary(output, isomap);
+            STATS_STOP(timer, STATS_WRITE);
+            if (output != stdout) fclose(output);
+        } else if (serializer_format_by_name(arguments.output_format,
+                                             &records_format)) {
+            write_records(output, isomap, &arguments, records_format, queries);
+            if (queries != NULL) fclose(queries);
+            if (output != stdout) fclose(output);
+        } else if (encoder_format_by_name(arguments.output_format, &format)) {
+            bool written = render_draw_to_stream(isomap,
+                                  arguments.has_viewport ? &arguments.viewport : NULL,
+                                  output, format, arguments.png_level,
+                                  arguments.num_threads, backend);
+            if (output != stdout && fclose(output) != 0)
+                written = false;
+            if (!written) {
+                fprintf(stderr, "Error: cannot write the image\n");
+                exit(ISOMAP_ERROR_WRITE);
+            }
         }
+        print_stats(isomap, &arguments);
         isomap_delete(isomap);
     }
     return arguments.status;
@@ -1,4 +1,9 @@
 #include "map.h"
+#include "arena.h"
+#include "chunk.h"
+#include "rle.h"
+#include "stats.h"
+#include "writer.h"
 #include <stdio.h>
 #include <assert.h>
 
@@ -58,35 +63,164 @@ void map_print_layer(FILE *stream,
                      const struct layer *layer,
                      const char *prefix);
 
-// Functions //
-// --------- //
+/**
+ * Find the first occupied cell of a dense layer at or after a given cell
+ *
+ * Cells are visited row by row. If an occupied cell is found, `row` and
+ * `column` are updated with its coordinates.
+ *
+ * @param layer   The layer
+ * @param row     The row of the cell where to start
+ * @param column  The column of the cell where to start
+ * @return        True if an occupied cell was found
+ */
+bool map_next_occupied_in_dense_layer(const struct layer *layer,
+                                      unsigned int *row,
+                                      unsigned int *column) {
+    for (unsigned int r = *row; r < layer->num_rows; ++r) {
+        for (unsigned int c = r == *row ? *column : 0;
+             c < layer->num_columns;
+             ++c) {
+            if (layer->tiles[r][c] != 0) {
+                *row = r; *column = c;
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-struct map *map_create(void) {
-    struct map *map = malloc(sizeof(struct map));
-    map->layers = malloc(sizeof(struct layer));
-    map->num_layers = 0;
-    map->capacity = 1;
-    return map;
+/**
+ * Find the first occupied cell of a chunked layer at or after a given cell
+ *
+ * Cells are visited row by row, but the cells of unallocated chunks are
+ * skipped. If an occupied cell is found, `row` and `column` are updated with
+ * its coordinates.
+ *
+ * @param layer   The layer
+ * @param row     The row of the cell where to start
+ * @param column  The column of the cell where to start
+ * @return        True if an occupied cell was found
+ */
+bool map_next_occupied_in_chunked_layer(const struct layer *layer,
+                                        unsigned int *row,
+                                        unsigned int *column) {
+    unsigned int r = *row, c = *column;
+    while (r < layer->num_rows) {
+        unsigned int chunk_row = r / CHUNK_SIZE;
+        const struct chunk *chunk = chunk_next(layer->chunks, chunk_row, 0);
+        if (chunk == NULL)
+            return false;
+        if (chunk->row > chunk_row) {
+            r = chunk->row * CHUNK_SIZE; c = 0;
+            continue;
+        }
+        chunk = chunk_next(layer->chunks, chunk_row, c / CHUNK_SIZE);
+        if (chunk == NULL || chunk->row != chunk_row) {
+            ++r; c = 0;
+            continue;
+        }
+        unsigned int first = chunk->column * CHUNK_SIZE;
+        unsigned int last = first + CHUNK_SIZE;
+        if (c < first) c = first;
+        if (last > layer->num_columns) last = layer->num_columns;
+        const tile_id *tiles = chunk->tiles + (r % CHUNK_SIZE) * CHUNK_SIZE;
+        for (; c < last; ++c) {
+            if (tiles[c - first] != 0) {
+                *row = r; *column = c;
+                return true;
+            }
+        }
+        if (c >= layer->num_columns) {
+            ++r; c = 0;
+        }
+    }
+    return false;
 }
 
-void map_delete_layer(struct layer *layer) {
-    for (unsigned int i = 0; i < layer->num_rows; ++i) {
-        free(layer->tiles[i]);
+/**
+ * Find the first occupied cell of a run-length layer at or after a given cell
+ *
+ * Empty runs are skipped in one step. If an occupied cell is found, `row` and
+ * `column` are updated with its coordinates.
+ *
+ * @param layer   The layer
+ * @param row     The row of the cell where to start
+ * @param column  The column of the cell where to start
+ * @return        True if an occupied cell was found
+ */
+bool map_next_occupied_in_rle_layer(const struct layer *layer,
+                                    unsigned int *row,
+                                    unsigned int *column) {
+    unsigned long index = (unsigned long)*row * layer->num_columns + *column;
+    if (index >= layer->runs->length)
+        return false;
+    unsigned int run = rle_find_run(layer->runs, index);
+    while (layer->runs->values[run] == 0) {
+        if (++run == layer->runs->num_runs)
+            return false;
+        index = layer->runs->starts[run];
     }
-    free(layer->tiles);
+    *row = index / layer->num_columns;
+    *column = index % layer->num_columns;
+    return true;
 }
 
-void map_delete(struct map *map) {
-    for (unsigned int l = 0; l < map->num_layers; ++l)
-        map_delete_layer(map->layers + l);
-    free(map->layers);
-    free(map);
+/**
+ * Record a change in a map and increment its version
+ *
+ * The change is merged with the last one when the box containing both is
+ * small and not much larger than the two boxes together. When the log is
+ * full, its two oldest changes are merged.
+ *
+ * @param map  The map
+ * @param box  The locations that changed
+ */
+void map_record_change(struct map *map, const struct box *box) {
+    ++map->version;
+    if (map->num_changes > 0) {
+        struct map_change *last = map->changes + map->num_changes - 1;
+        struct box merged = geometry_union_box(&last->box, box);
+        unsigned long volume = geometry_box_volume(&merged);
+        if (volume <= MAP_MAX_MERGED_VOLUME &&
+            volume <= 2 * (geometry_box_volume(&last->box) +
+                           geometry_box_volume(box))) {
+            last->version = map->version;
+            last->box = merged;
+            return;
+        }
+    }
+    if (map->num_changes == MAP_MAX_CHANGES) {
+        map->changes[1].box = geometry_union_box(&map->changes[0].box,
+                                                 &map->changes[1].box);
+        for (unsigned int i = 1; i < map->num_changes; ++i)
+            map->changes[i - 1] = map->changes[i];
+        --map->num_changes;
+    }
+    map->changes[map->num_changes].version = map->version;
+    map->changes[map->num_changes].box = *box;
+    ++map->num_changes;
 }
 
-struct layer *map_add_layer(struct map *map,
-                            unsigned int num_rows,
-                            unsigned int num_columns,
-                            int dx, int dy, int dz) {
+/**
+ * Insert a layer without storage in a map
+ *
+ * The layers are kept ordered by their heights. If the map already contains a
+ * layer of the given height, then nothing happens and the function returns
+ * `NULL`.
+ *
+ * @param map          The map
+ * @param num_rows     The number of rows of the layer
+ * @param num_columns  The number of columns of the layer
+ * @param dx           The x-offset of the layer
+ * @param dy           The y-offset of the layer
+ * @param dz           The z-offset (height) of the layer
+ * @return             The new layer or NULL
+ */
+struct layer *map_insert_layer(struct map *map,
+                               unsigned int num_rows,
+                               unsigned int num_columns,
+                               int dx, int dy, int dz) {
     struct layer *layer;
     for (layer = map->layers;
          layer < map->layers + map->num_layers && layer->offset.dz < dz;
@@ -95,8 +229,9 @@ struct layer *map_add_layer(struct map *map,
         return NULL;
     if (map->num_layers == map->capacity) {
         map->capacity *= 2;
-        map->layers = realloc(map->layers,
-                              map->capacity * sizeof(struct layer));
+        map->layers = arena_realloc(map->arena, map->layers,
+                                    map->num_layers * sizeof(struct layer),
+                                    map->capacity * sizeof(struct layer));
     }
     for (layer = map->layers + map->num_layers;
          layer > map->layers && (layer - 1)->offset.dz > dz;
@@ -105,13 +240,247 @@ struct layer *map_add_layer(struct map *map,
     layer->num_rows = num_rows;
     layer->num_columns = num_columns;
     layer->offset = (struct vect){dx, dy, dz};
-    layer->tiles = malloc(num_rows * sizeof(tile_id*));
-    for (unsigned int i = 0; i < num_rows; ++i)
-        layer->tiles[i] = calloc(num_columns, sizeof(tile_id));
+    layer->arena = map->arena;
     ++map->num_layers;
+    STATS_ADD(STATS_LAYERS, 1);
+    STATS_ADD(STATS_CELLS, (unsigned long)num_rows * num_columns);
+    if (num_rows > 0 && num_columns > 0) {
+        struct box box = {dx, dy, dz,
+                          dx + (int)num_rows - 1, dy + (int)num_columns - 1, dz};
+        map_record_change(map, &box);
+    }
+    return layer;
+}
+
+/**
+ * Initialize the empty storage of a layer
+ *
+ * @param layer    The layer, whose dimensions are already set
+ * @param storage  The storage
+ */
+void map_initialize_layer_storage(struct layer *layer,
+                                  enum layer_storage storage) {
+    layer->storage = storage;
+    layer->tiles = NULL;
+    layer->chunks = NULL;
+    layer->runs = NULL;
+    layer->borrowed = false;
+    if (storage == LAYER_CHUNKED) {
+        layer->chunks = chunk_create_table();
+    } else if (storage == LAYER_RLE) {
+        layer->runs = rle_create((unsigned long)layer->num_rows *
+                                 layer->num_columns);
+    } else if (layer->num_rows > 0) {
+        tile_id *tiles = arena_calloc(layer->arena,
+                                      (size_t)layer->num_rows *
+                                      layer->num_columns,
+                                      sizeof(tile_id));
+        layer->tiles = arena_alloc(layer->arena,
+                                   layer->num_rows * sizeof(tile_id*));
+        for (unsigned int i = 0; i < layer->num_rows; ++i)
+            layer->tiles[i] = tiles + (size_t)i * layer->num_columns;
+    }
+}
+
+/**
+ * Write a layer with a writer, as `map_print_layer` prints it
+ *
+ * The tiles of dense layers are read directly from their rows.
+ *
+ * @param writer  The writer
+ * @param layer   The layer
+ * @param prefix  The prefix of each row
+ */
+void map_write_layer(struct writer *writer,
+                     const struct layer *layer,
+                     const char *prefix) {
+    writer_put_string(writer, "A layer of ");
+    writer_put_integer(writer, layer->num_rows);
+    writer_put_string(writer,
+                      layer->num_rows <= 1 ? " row and " : " rows and ");
+    writer_put_integer(writer, layer->num_columns);
+    writer_put_string(writer,
+                      layer->num_columns <= 1 ? " column" : " columns");
+    writer_put_string(writer, " (offset = (");
+    writer_put_integer(writer, layer->offset.dx);
+    writer_put_char(writer, ',');
+    writer_put_integer(writer, layer->offset.dy);
+    writer_put_char(writer, ',');
+    writer_put_integer(writer, layer->offset.dz);
+    writer_put_string(writer, "))\n");
+    for (unsigned int i = 0; i < layer->num_rows; ++i) {
+        writer_put_string(writer, prefix);
+        writer_put_string(writer, "    ");
+        if (layer->storage == LAYER_DENSE) {
+            const tile_id *tiles = layer->tiles[i];
+            for (unsigned int j = 0; j < layer->num_columns; ++j) {
+                writer_put_integer(writer, tiles[j]);
+                writer_put_char(writer, ' ');
+            }
+        } else {
+            for (unsigned int j = 0; j < layer->num_columns; ++j) {
+                writer_put_integer(writer, map_get_layer_tile(layer, i, j));
+                writer_put_char(writer, ' ');
+            }
+        }
+        writer_put_char(writer, '\n');
+    }
+}
+
+// Functions //
+// --------- //
+
+struct map *map_create(void) {
+    return map_create_in_arena(NULL);
+}
+
+struct map *map_create_in_arena(struct arena *arena) {
+    struct map *map = arena_alloc(arena, sizeof(struct map));
+    map->layers = arena_alloc(arena, sizeof(struct layer));
+    map->num_layers = 0;
+    map->capacity = 1;
+    map->arena = arena;
+    map->version = 0;
+    map->num_changes = 0;
+    return map;
+}
+
+void map_delete_layer(struct layer *layer) {
+    if (layer->storage == LAYER_CHUNKED) {
+        chunk_delete_table(layer->chunks);
+    } else if (layer->storage == LAYER_RLE) {
+        rle_delete(layer->runs);
+    } else if (layer->tiles != NULL) {
+        if (!layer->borrowed)
+            arena_free(layer->arena, layer->tiles[0]);
+        arena_free(layer->arena, layer->tiles);
+    }
+}
+
+void map_delete(struct map *map) {
+    for (unsigned int l = 0; l < map->num_layers; ++l)
+        map_delete_layer(map->layers + l);
+    arena_free(map->arena, map->layers);
+    arena_free(map->arena, map);
+}
+
+struct layer *map_add_layer(struct map *map,
+                            unsigned int num_rows,
+                            unsigned int num_columns,
+                            int dx, int dy, int dz) {
+    return map_add_layer_with_storage(map, LAYER_DENSE,
+                                      num_rows, num_columns, dx, dy, dz);
+}
+
+struct layer *map_add_layer_with_storage(struct map *map,
+                                         enum layer_storage storage,
+                                         unsigned int num_rows,
+                                         unsigned int num_columns,
+                                         int dx, int dy, int dz) {
+    struct layer *layer = map_insert_layer(map, num_rows, num_columns,
+                                           dx, dy, dz);
+    if (layer != NULL)
+        map_initialize_layer_storage(layer, storage);
+    return layer;
+}
+
+struct layer *map_add_layer_with_tiles(struct map *map,
+                                       unsigned int num_rows,
+                                       unsigned int num_columns,
+                                       int dx, int dy, int dz,
+                                       tile_id *tiles) {
+    struct layer *layer = map_insert_layer(map, num_rows, num_columns,
+                                           dx, dy, dz);
+    if (layer != NULL) {
+        layer->storage = LAYER_DENSE;
+        layer->chunks = NULL;
+        layer->runs = NULL;
+        layer->borrowed = true;
+        layer->tiles = arena_alloc(layer->arena, num_rows * sizeof(tile_id*));
+        for (unsigned int i = 0; i < num_rows; ++i)
+            layer->tiles[i] = tiles + (unsigned long)i * num_columns;
+    }
     return layer;
 }
 
+struct layer *map_add_layer_with_runs(struct map *map,
+                                      unsigned int num_rows,
+                                      unsigned int num_columns,
+                                      int dx, int dy, int dz,
+                                      struct rle *runs) {
+    struct layer *layer = map_insert_layer(map, num_rows, num_columns,
+                                           dx, dy, dz);
+    if (layer != NULL) {
+        layer->storage = LAYER_RLE;
+        layer->tiles = NULL;
+        layer->chunks = NULL;
+        layer->runs = runs;
+        layer->borrowed = false;
+    }
+    return layer;
+}
+
+void map_convert_layer(struct layer *layer, enum layer_storage storage) {
+    if (layer->storage == storage) return;
+    struct layer old = *layer;
+    map_initialize_layer_storage(layer, storage);
+    unsigned int r = 0, c = 0;
+    while (map_next_occupied_in_layer(&old, &r, &c)) {
+        map_set_layer_tile(layer, r, c, map_get_layer_tile(&old, r, c));
+        ++c;
+    }
+    map_delete_layer(&old);
+}
+
+bool map_next_occupied_in_layer(const struct layer *layer,
+                                unsigned int *row,
+                                unsigned int *column) {
+    if (*column >= layer->num_columns) {
+        ++*row; *column = 0;
+    }
+    if (layer->storage == LAYER_CHUNKED)
+        return map_next_occupied_in_chunked_layer(layer, row, column);
+    else if (layer->storage == LAYER_RLE)
+        return map_next_occupied_in_rle_layer(layer, row, column);
+    else
+        return map_next_occupied_in_dense_layer(layer, row, column);
+}
+
+tile_id map_get_layer_tile(const struct layer *layer,
+                           unsigned int row, unsigned int column) {
+    if (layer->storage == LAYER_CHUNKED) {
+        const tile_id *tiles = chunk_get(layer->chunks,
+                                         row / CHUNK_SIZE,
+                                         column / CHUNK_SIZE);
+        if (tiles == NULL) return 0;
+        return tiles[(row % CHUNK_SIZE) * CHUNK_SIZE + column % CHUNK_SIZE];
+    } else if (layer->storage == LAYER_RLE) {
+        return rle_get(layer->runs,
+                       (unsigned long)row * layer->num_columns + column);
+    } else {
+        return layer->tiles[row][column];
+    }
+}
+
+void map_set_layer_tile(struct layer *layer,
+                        unsigned int row, unsigned int column,
+                        tile_id tile) {
+    if (layer->storage == LAYER_CHUNKED) {
+        tile_id *tiles = chunk_get(layer->chunks,
+                                   row / CHUNK_SIZE, column / CHUNK_SIZE);
+        if (tiles == NULL && tile == 0) return;
+        if (tiles == NULL)
+            tiles = chunk_get_or_add(layer->chunks,
+                                     row / CHUNK_SIZE, column / CHUNK_SIZE);
+        tiles[(row % CHUNK_SIZE) * CHUNK_SIZE + column % CHUNK_SIZE] = tile;
+    } else if (layer->storage == LAYER_RLE) {
+        rle_set(layer->runs,
+                (unsigned long)row * layer->num_columns + column, tile);
+    } else {
+        layer->tiles[row][column] = tile;
+    }
+}
+
 tile_id map_get_tile_by_location(const struct map *map,
                                  int x, int y, int z) {
     int l = map_layer_by_height(map, z);
@@ -120,13 +489,13 @@ tile_id map_get_tile_by_location(const struct map *map,
         int y2 = y - map->layers[l].offset.dy;
         if (x2 >= 0 && x2 < (int)map->layers[l].num_rows &&
             y2 >= 0 && y2 < (int)map->layers[l].num_columns) {
-            return map->layers[l].tiles[x2][y2];
+            return map_get_layer_tile(map->layers + l, x2, y2);
         }
     }
     return -1;
 }
 
-void map_set_tile_by_location(const struct map *map,
+void map_set_tile_by_location(struct map *map,
                               int x, int y, int z,
                               tile_id tile) {
     int l = map_layer_by_height(map, z);
@@ -134,8 +503,11 @@ void map_set_tile_by_location(const struct map *map,
         int x2 = x - map->layers[l].offset.dx;
         int y2 = y - map->layers[l].offset.dy;
         if (x2 >= 0 && x2 < (int)map->layers[l].num_rows &&
-            y2 >= 0 && y2 < (int)map->layers[l].num_columns) {
-            map->layers[l].tiles[x2][y2] = tile;
+            y2 >= 0 && y2 < (int)map->layers[l].num_columns &&
+            map_get_layer_tile(map->layers + l, x2, y2) != tile) {
+            map_set_layer_tile(map->layers + l, x2, y2, tile);
+            struct box box = {x, y, z, x, y, z};
+            map_record_change(map, &box);
         }
     }
 }
@@ -150,27 +522,28 @@ bool map_is_location_top_free(const struct map *map,
 void map_print_layer(FILE *stream,
                      const struct layer *layer,
                      const char *prefix) {
-    fprintf(stream, "A layer of %d row%s and %d column%s",
-            layer->num_rows, layer->num_rows <= 1 ? "" : "s",
-            layer->num_columns, layer->num_columns <= 1 ? "" : "s");
-    fprintf(stream, " (offset = (%d,%d,%d))\n",
-            layer->offset.dx, layer->offset.dy, layer->offset.dz);
-    for (unsigned int i = 0; i < layer->num_rows; ++i) {
-        fprintf(stream, "%s    ", prefix);
-        for (unsigned int j = 0; j < layer->num_columns; ++j) {
-            fprintf(stream, "%d ", layer->tiles[i][j]);
-        }
-        fprintf(stream, "\n");
-    }
+    struct writer writer;
+    writer_initialize(&writer, stream);
+    map_write_layer(&writer, layer, prefix);
+    writer_flush(&writer);
 }
 
 void map_print(FILE *stream, const struct map *map, const char *prefix) {
-    fprintf(stream, "%sA map of %d layer%s\n", prefix, map->num_layers,
-            map->num_layers <= 1 ? "" : "s");
+    struct writer writer;
+    writer_initialize(&writer, stream);
+    writer_put_string(&writer, prefix);
+    writer_put_string(&writer, "A map of ");
+    writer_put_integer(&writer, map->num_layers);
+    writer_put_string(&writer,
+                      map->num_layers <= 1 ? " layer\n" : " layers\n");
     for (unsigned int i = 0; i < map->num_layers; ++i) {
-        fprintf(stream, "%s  Layer %d: ", prefix, i);
-        map_print_layer(stream, &map->layers[i], prefix);
+        writer_put_string(&writer, prefix);
+        writer_put_string(&writer, "  Layer ");
+        writer_put_integer(&writer, i);
+        writer_put_string(&writer, ": ");
+        map_write_layer(&writer, &map->layers[i], prefix);
     }
+    writer_flush(&writer);
 }
 
 const struct location *map_get_occupied_location(const struct map *map,
@@ -178,20 +551,19 @@ const struct location *map_get_occupied_location(const struct map *map,
     static unsigned int l = 0, r = 0, c = 0;
     static struct location location;
     if (from_start) {
-        l = 0; r = 0; c = -1;
-    }
-    do {
+        l = 0; r = 0; c = 0;
+    } else {
         ++c;
-        if (c == map->layers[l].num_columns)
-            {++r; c = 0;}
-        if (r == map->layers[l].num_rows)
-            {++l; r = 0;}
-        if (l == map->num_layers) return NULL;
-    } while (map->layers[l].tiles[r][c] == 0);
-    location.x = r + map->layers[l].offset.dx;
-    location.y = c + map->layers[l].offset.dy;
-    location.z = map->layers[l].offset.dz;
-    return &location;
+    }
+    for (; l < map->num_layers; ++l, r = 0, c = 0) {
+        if (map_next_occupied_in_layer(map->layers + l, &r, &c)) {
+            location.x = r + map->layers[l].offset.dx;
+            location.y = c + map->layers[l].offset.dy;
+            location.z = map->layers[l].offset.dz;
+            return &location;
+        }
+    }
+    return NULL;
 }
 
 const struct location *map_get_top_free_location(const struct map *map,
@@ -205,21 +577,45 @@ const struct location *map_get_top_free_location(const struct map *map,
 }
 
 struct box map_get_bounding_box(const struct map *map) {
-    const struct location *location = map_get_occupied_location(map, true);
     struct box box = {0, 0, 0, -1, -1, -1};
-    if (location != NULL) {
-        int xmin = location->x, xmax = location->x;
-        int ymin = location->y, ymax = location->y;
-        int zmin = location->z, zmax = location->z;
-        while ((location = map_get_occupied_location(map, false)) != NULL) {
-            xmin = location->x < xmin ? location->x : xmin;
-            xmax = location->x > xmax ? location->x : xmax;
-            ymin = location->y < ymin ? location->y : ymin;
-            ymax = location->y > ymax ? location->y : ymax;
-            zmin = location->z < zmin ? location->z : zmin;
-            zmax = location->z > zmax ? location->z : zmax;
+    bool empty = true;
+    for (unsigned int l = 0; l < map->num_layers; ++l) {
+        const struct layer *layer = map->layers + l;
+        unsigned int r = 0, c = 0;
+        for (; map_next_occupied_in_layer(layer, &r, &c); ++c) {
+            int x = r + layer->offset.dx;
+            int y = c + layer->offset.dy;
+            int z = layer->offset.dz;
+            if (empty) {
+                box = (struct box){x, y, z, x, y, z};
+                empty = false;
+            }
+            box.xmin = x < box.xmin ? x : box.xmin;
+            box.xmax = x > box.xmax ? x : box.xmax;
+            box.ymin = y < box.ymin ? y : box.ymin;
+            box.ymax = y > box.ymax ? y : box.ymax;
+            box.zmin = z < box.zmin ? z : box.zmin;
+            box.zmax = z > box.zmax ? z : box.zmax;
         }
-        box = (struct box){xmin, ymin, zmin, xmax, ymax, zmax};
     }
     return box;
 }
+
+unsigned int map_get_changes(const struct map *map,
+                             unsigned long version,
+                             const struct map_change **changes) {
+    unsigned int i = map->num_changes;
+    while (i > 0 && map->changes[i - 1].version > version)
+        --i;
+    *changes = map->changes + i;
+    return map->num_changes - i;
+}
+
+struct box map_get_changed_box(const struct map *map, unsigned long version) {
+    const struct map_change *changes;
+    unsigned int n = map_get_changes(map, version, &changes);
+    struct box box = {0, 0, 0, -1, -1, -1};
+    for (unsigned int i = 0; i < n; ++i)
+        box = geometry_union_box(&box, &changes[i].box);
+    return box;
+}
@@ -28,9 +28,31 @@
  * Tiles are identified by a positive integer ID (the empty tile is identified
  * by 0). An invalid tile is identified by the value -1.
  *
+ * The tiles of a layer are stored either as a dense matrix, as fixed-size
+ * chunks that are allocated only when a tile is set in them (see `chunk.h`),
+ * or as runs of identical tiles (see `rle.h`). The second storage is meant for
+ * huge layers that are mostly empty, the third one for read-mostly layers made
+ * of long runs of the same tile. All storages are hidden behind the same
+ * functions, and a layer can be converted from one storage to another.
+ *
+ * Every modification of a map through `map_add_layer` (and its variants) or
+ * `map_set_tile_by_location` increments its version and records the box of
+ * the changed locations in a small log. Consumers that keep data derived from
+ * a map (an image, a graph, etc.) remember the version they were computed
+ * from and ask which regions changed since then, instead of assuming that the
+ * whole map changed. Nearby changes are coalesced into a single box of at
+ * most `MAP_MAX_MERGED_VOLUME` locations, and the oldest boxes are merged when
+ * the log is full, so that the returned boxes always cover the changed
+ * locations, but may cover a few others too.
+ *
+ * A map can be created in an arena (see `arena.h`), in which case its layers
+ * and their dense tiles are allocated in the arena and released with it.
+ *
  * The module provides the following data structures:
  *
+ * - `enum layer_storage`: the way the tiles of a layer are stored
  * - `struct layer`: a layer in the map
+ * - `struct map_change`: a region of a map that changed
  * - `struct map`: the map itself
  *
  * @author   Alexandre Blondin Massé
@@ -43,19 +65,48 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#define MAP_MAX_CHANGES 64
+#define MAP_MAX_MERGED_VOLUME 256
+
 // Types //
 // ----- //
 
 typedef int tile_id;
 
+struct arena;
+struct chunk_table;
+struct rle;
+
+/**
+ * The storage of the tiles of a layer
+ */
+enum layer_storage {
+    LAYER_DENSE,   // A matrix of all the tiles
+    LAYER_CHUNKED, // Chunks of tiles, allocated on demand
+    LAYER_RLE,     // Runs of identical tiles, row by row (read-mostly)
+};
+
 /**
  * A layer
  */
 struct layer {
-    tile_id **tiles;          // A matrix of the tiles in the layer
-    unsigned int num_rows;    // The number of rows
-    unsigned int num_columns; // The number of columns
-    struct vect offset;       // The offset with respect to the origin
+    enum layer_storage storage;  // The storage of the tiles
+    tile_id **tiles;             // A matrix of the tiles (dense storage)
+    struct chunk_table *chunks;  // The allocated chunks (chunked storage)
+    struct rle *runs;            // The runs of tiles (run-length storage)
+    bool borrowed;               // True if the dense tiles are not owned
+    unsigned int num_rows;       // The number of rows
+    unsigned int num_columns;    // The number of columns
+    struct vect offset;          // The offset with respect to the origin
+    struct arena *arena;         // The arena of the map (or NULL)
+};
+
+/**
+ * A region of a map that changed
+ */
+struct map_change {
+    unsigned long version; // The version of the map after the change
+    struct box box;        // The locations that changed
 };
 
 /**
@@ -65,11 +116,16 @@ struct layer {
  *
  * * The layers are ordered by their heights
  * * Two layers always have different height
+ * * The changes are ordered by increasing versions
  */
 struct map {
     struct layer *layers;    // The layers
     unsigned int num_layers; // The current number of layers
     unsigned int capacity;   // The maximum number of layers
+    struct arena *arena;     // The arena of the map (or NULL)
+    unsigned long version;   // The number of modifications of the map
+    struct map_change changes[MAP_MAX_CHANGES]; // The last changes
+    unsigned int num_changes;                   // The number of changes
 };
 
 // Functions //
@@ -82,6 +138,19 @@ struct map {
  */
 struct map *map_create(void);
 
+/**
+ * Create an empty map in an arena
+ *
+ * The map, its layers and their dense tiles are allocated in the arena. The
+ * chunks and the runs of the layers are still allocated on the heap, since
+ * they are frequently resized, so that `map_delete` must still be called
+ * before the arena is deleted.
+ *
+ * @param arena  The arena (or NULL for the heap)
+ * @return       The created map
+ */
+struct map *map_create_in_arena(struct arena *arena);
+
 /**
  * Delete a map
  *
@@ -120,6 +189,133 @@ struct layer *map_add_layer(struct map *map,
                             unsigned int num_columns,
                             int dx, int dy, int dz);
 
+/**
+ * Add a layer with the given storage to a map
+ *
+ * Behaves exactly as `map_add_layer`, except that the tiles of the layer are
+ * stored according to `storage`.
+ *
+ * @param map          The map
+ * @param storage      The storage of the tiles
+ * @param num_rows     The number of rows of the layer
+ * @param num_columns  The number of columns of the layer
+ * @param dx           The x-offset of the layer
+ * @param dy           The y-offset of the layer
+ * @param dz           The z-offset (height) of the layer
+ * @return             The new layer or NULL
+ */
+struct layer *map_add_layer_with_storage(struct map *map,
+                                         enum layer_storage storage,
+                                         unsigned int num_rows,
+                                         unsigned int num_columns,
+                                         int dx, int dy, int dz);
+
+/**
+ * Add a dense layer whose tiles are stored in borrowed memory
+ *
+ * The tiles are given row by row in a block of `num_rows * num_columns`
+ * tiles, which is not owned by the map and must outlive it (for instance, a
+ * memory-mapped file). The block is used in place, without being copied, so
+ * modifying the layer modifies the block.
+ *
+ * @param map          The map
+ * @param num_rows     The number of rows of the layer
+ * @param num_columns  The number of columns of the layer
+ * @param dx           The x-offset of the layer
+ * @param dy           The y-offset of the layer
+ * @param dz           The z-offset (height) of the layer
+ * @param tiles        The tiles of the layer
+ * @return             The new layer or NULL
+ */
+struct layer *map_add_layer_with_tiles(struct map *map,
+                                       unsigned int num_rows,
+                                       unsigned int num_columns,
+                                       int dx, int dy, int dz,
+                                       tile_id *tiles);
+
+/**
+ * Add a run-length layer made of the given runs
+ *
+ * The map takes ownership of the runs, which must describe exactly
+ * `num_rows * num_columns` cells. If the layer cannot be added, the runs are
+ * left untouched.
+ *
+ * @param map          The map
+ * @param num_rows     The number of rows of the layer
+ * @param num_columns  The number of columns of the layer
+ * @param dx           The x-offset of the layer
+ * @param dy           The y-offset of the layer
+ * @param dz           The z-offset (height) of the layer
+ * @param runs         The runs of the layer
+ * @return             The new layer or NULL
+ */
+struct layer *map_add_layer_with_runs(struct map *map,
+                                      unsigned int num_rows,
+                                      unsigned int num_columns,
+                                      int dx, int dy, int dz,
+                                      struct rle *runs);
+
+/**
+ * Convert a layer to another storage
+ *
+ * The tiles of the layer are preserved. Run-length layers are meant to be
+ * converted to dense layers before being heavily edited, and back afterwards.
+ *
+ * @param layer    The layer
+ * @param storage  The new storage
+ */
+void map_convert_layer(struct layer *layer, enum layer_storage storage);
+
+/**
+ * Return the tile at the given cell of a layer
+ *
+ * The row and the column are relative to the layer, i.e. they do not take
+ * its offset into account. They are assumed to be valid.
+ *
+ * @param layer   The layer
+ * @param row     The row of the cell
+ * @param column  The column of the cell
+ * @return        The tile
+ */
+tile_id map_get_layer_tile(const struct layer *layer,
+                           unsigned int row, unsigned int column);
+
+/**
+ * Set the tile at the given cell of a layer
+ *
+ * The row and the column are relative to the layer, i.e. they do not take
+ * its offset into account. They are assumed to be valid.
+ *
+ * The change is not recorded in the map, so that this function is meant for
+ * filling a layer that was just added. Use `map_set_tile_by_location`
+ * otherwise.
+ *
+ * @param layer   The layer
+ * @param row     The row of the cell
+ * @param column  The column of the cell
+ * @param tile    The tile
+ */
+void map_set_layer_tile(struct layer *layer,
+                        unsigned int row, unsigned int column,
+                        tile_id tile);
+
+/**
+ * Find the first occupied cell of a layer at or after a given cell
+ *
+ * The cells are visited row by row. If the column is past the last column,
+ * the search starts at the beginning of the next row. Empty chunks and runs
+ * are skipped at once.
+ *
+ * @param layer   The layer
+ * @param row     The row of the cell where to start, updated by the function
+ * @param column  The column of the cell where to start, updated by the
+ *                function
+ * @return        True if an occupied cell was found
+ */
+bool map_next_occupied_in_layer(const struct layer *layer,
+                                unsigned int *row,
+                                unsigned int *column);
+
 /**
  * Return the tile associated with a location
  *
@@ -136,7 +332,9 @@ tile_id map_get_tile_by_location(const struct map *map,
 /**
  * Set the tile associated with a location
  *
- * If there is no tile at the given location, then nothing happens.
+ * If there is no tile at the given location, then nothing happens. If the
+ * tile is modified, the version of the map is incremented and the change is
+ * recorded.
  *
  * @param map   The map
  * @param x     The x-coordinate of the location
@@ -144,7 +342,7 @@ tile_id map_get_tile_by_location(const struct map *map,
  * @param z     The z-coordinate of the location
  * @param tile  The tile
  */
-void map_set_tile_by_location(const struct map *map,
+void map_set_tile_by_location(struct map *map,
                               int x, int y, int z,
                               tile_id tile);
 
@@ -173,6 +371,10 @@ bool map_is_location_top_free(const struct map *map,
  * * When the returned value is `NULL`, it means that all locations have been
  *   iterated over
  *
+ * Locations are visited layer by layer, then row by row. The unallocated
+ * chunks of chunked layers and the empty runs of run-length layers are
+ * skipped without being looked at.
+ *
  * @param map         The map
  * @param from_start  If true, starts from the first location
  *                    If false, returns the next available location or NULL
@@ -202,7 +404,10 @@ const struct location *map_get_top_free_location(const struct map *map,
  * Return the bounding box dimensions of a map
  *
  * The bounding box of the map is the smallest 3D rectangle that contains all
- * its nonempty tiles.
+ * its nonempty tiles. The unallocated chunks of chunked layers and the empty
+ * runs of run-length layers are skipped. Unlike `map_get_occupied_location`,
+ * the function keeps no state between calls, so that several threads can
+ * call it at once.
  *
  * If all tiles are empty, return a dummy box.
  *
@@ -211,4 +416,31 @@ const struct location *map_get_top_free_location(const struct map *map,
  */
 struct box map_get_bounding_box(const struct map *map);
 
+/**
+ * Return the changes of a map since a given version
+ *
+ * The returned changes are the last ones of the log, ordered by increasing
+ * versions, and their boxes cover all the locations modified after
+ * `version`. If nothing changed since `version`, return 0.
+ *
+ * @param map      The map
+ * @param version  The version
+ * @param changes  Set to the first change after the version
+ * @return         The number of changes
+ */
+unsigned int map_get_changes(const struct map *map,
+                             unsigned long version,
+                             const struct map_change **changes);
+
+/**
+ * Return the smallest box containing all changes since a given version
+ *
+ * If nothing changed since `version`, return an empty box.
+ *
+ * @param map      The map
+ * @param version  The version
+ * @return         The changed box
+ */
+struct box map_get_changed_box(const struct map *map, unsigned long version);
+
 #endif
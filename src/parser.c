@@ -0,0 +1,369 @@
+#include "parser.h"
+#include <limits.h>
+#include <string.h>
+
+// Help functions //
+// -------------- //
+
+/**
+ * Return the next character of a document without consuming it
+ *
+ * The buffer is refilled when it is exhausted. At the end of the stream,
+ * return EOF.
+ *
+ * @param parser  The parser
+ * @return        The character or EOF
+ */
+int parser_peek(struct parser *parser) {
+    if (parser->position == parser->length) {
+        parser->length = fread(parser->buffer, 1, PARSER_BUFFER_SIZE,
+                               parser->stream);
+        parser->position = 0;
+        if (parser->length == 0)
+            return EOF;
+    }
+    return (unsigned char)parser->buffer[parser->position];
+}
+
+/**
+ * Return the next character of a document and consume it
+ *
+ * @param parser  The parser
+ * @return        The character or EOF
+ */
+int parser_get(struct parser *parser) {
+    int c = parser_peek(parser);
+    if (c != EOF)
+        ++parser->position;
+    return c;
+}
+
+/**
+ * Consume the whitespace of a document
+ *
+ * @param parser  The parser
+ * @return        The next character or EOF
+ */
+int parser_skip_whitespace(struct parser *parser) {
+    while (true) {
+        int c = parser_peek(parser);
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            return c;
+        ++parser->position;
+    }
+}
+
+/**
+ * Mark a document as invalid
+ *
+ * @param parser  The parser
+ * @return        PARSER_ERROR
+ */
+enum parser_token parser_fail(struct parser *parser) {
+    parser->state = PARSER_FAILED;
+    return PARSER_ERROR;
+}
+
+/**
+ * Consume a literal (true, false or null)
+ *
+ * @param parser   The parser
+ * @param literal  The expected literal
+ * @return         True if the literal was found
+ */
+bool parser_consume_literal(struct parser *parser, const char *literal) {
+    for (; *literal != '\0'; ++literal)
+        if (parser_get(parser) != *literal)
+            return false;
+    return true;
+}
+
+/**
+ * Append a character to the current string
+ *
+ * The string is silently truncated when it is too long.
+ *
+ * @param parser  The parser
+ * @param length  The length of the string, updated by the function
+ * @param c       The character
+ */
+void parser_append(struct parser *parser, size_t *length, char c) {
+    if (*length < PARSER_STRING_LENGTH - 1)
+        parser->string[(*length)++] = c;
+}
+
+/**
+ * Read the four hexadecimal digits of a unicode escape sequence
+ *
+ * @param parser  The parser
+ * @return        The code unit, or -1 if the digits are invalid
+ */
+long parser_read_hexadecimal(struct parser *parser) {
+    long code = 0;
+    for (unsigned int i = 0; i < 4; ++i) {
+        int c = parser_get(parser);
+        if (c >= '0' && c <= '9') code = 16 * code + c - '0';
+        else if (c >= 'a' && c <= 'f') code = 16 * code + c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') code = 16 * code + c - 'A' + 10;
+        else return -1;
+    }
+    return code;
+}
+
+/**
+ * Read a unicode escape sequence and append it to the current string in
+ * UTF-8
+ *
+ * The leading `\u` is already consumed.
+ *
+ * @param parser  The parser
+ * @param length  The length of the string, updated by the function
+ * @return        True if the sequence is valid
+ */
+bool parser_read_unicode(struct parser *parser, size_t *length) {
+    long code = parser_read_hexadecimal(parser);
+    if (code <= 0 || (code >= 0xdc00 && code <= 0xdfff))
+        return false;
+    if (code >= 0xd800 && code <= 0xdbff) {
+        if (parser_get(parser) != '\\' || parser_get(parser) != 'u')
+            return false;
+        long low = parser_read_hexadecimal(parser);
+        if (low < 0xdc00 || low > 0xdfff)
+            return false;
+        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+    }
+    if (code < 0x80) {
+        parser_append(parser, length, code);
+    } else if (code < 0x800) {
+        parser_append(parser, length, 0xc0 | (code >> 6));
+        parser_append(parser, length, 0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        parser_append(parser, length, 0xe0 | (code >> 12));
+        parser_append(parser, length, 0x80 | ((code >> 6) & 0x3f));
+        parser_append(parser, length, 0x80 | (code & 0x3f));
+    } else {
+        parser_append(parser, length, 0xf0 | (code >> 18));
+        parser_append(parser, length, 0x80 | ((code >> 12) & 0x3f));
+        parser_append(parser, length, 0x80 | ((code >> 6) & 0x3f));
+        parser_append(parser, length, 0x80 | (code & 0x3f));
+    }
+    return true;
+}
+
+/**
+ * Read a string into `parser->string`
+ *
+ * The leading quote is already consumed.
+ *
+ * @param parser  The parser
+ * @return        True if the string is valid
+ */
+bool parser_read_string(struct parser *parser) {
+    size_t length = 0;
+    while (true) {
+        int c = parser_get(parser);
+        if (c == '"') {
+            break;
+        } else if (c == EOF || c < 0x20) {
+            return false;
+        } else if (c == '\\') {
+            c = parser_get(parser);
+            switch (c) {
+                case '"': case '\\': case '/':
+                    parser_append(parser, &length, c); break;
+                case 'b': parser_append(parser, &length, '\b'); break;
+                case 'f': parser_append(parser, &length, '\f'); break;
+                case 'n': parser_append(parser, &length, '\n'); break;
+                case 'r': parser_append(parser, &length, '\r'); break;
+                case 't': parser_append(parser, &length, '\t'); break;
+                case 'u':
+                    if (!parser_read_unicode(parser, &length)) return false;
+                    break;
+                default: return false;
+            }
+        } else {
+            parser_append(parser, &length, c);
+        }
+    }
+    parser->string[length] = '\0';
+    return true;
+}
+
+/**
+ * Read a number
+ *
+ * Integers are scanned digit by digit into `parser->integer`. The other
+ * numbers are only checked.
+ *
+ * @param parser  The parser
+ * @return        PARSER_INTEGER, PARSER_REAL or PARSER_ERROR
+ */
+enum parser_token parser_read_number(struct parser *parser) {
+    bool negative = false;
+    unsigned long long value = 0;
+    bool overflow = false;
+    if (parser_peek(parser) == '-') {
+        negative = true;
+        ++parser->position;
+    }
+    int c = parser_peek(parser);
+    if (c < '0' || c > '9')
+        return PARSER_ERROR;
+    if (c == '0') {
+        ++parser->position;
+        c = parser_peek(parser);
+    } else {
+        for (; c >= '0' && c <= '9'; c = parser_peek(parser)) {
+            if (value > (ULLONG_MAX - 9) / 10) overflow = true;
+            value = 10 * value + (c - '0');
+            ++parser->position;
+        }
+    }
+    bool real = false;
+    if (c == '.') {
+        real = true;
+        ++parser->position;
+        c = parser_peek(parser);
+        if (c < '0' || c > '9') return PARSER_ERROR;
+        while (c >= '0' && c <= '9') {
+            ++parser->position;
+            c = parser_peek(parser);
+        }
+    }
+    if (c == 'e' || c == 'E') {
+        real = true;
+        ++parser->position;
+        c = parser_peek(parser);
+        if (c == '+' || c == '-') {
+            ++parser->position;
+            c = parser_peek(parser);
+        }
+        if (c < '0' || c > '9') return PARSER_ERROR;
+        while (c >= '0' && c <= '9') {
+            ++parser->position;
+            c = parser_peek(parser);
+        }
+    }
+    if (real)
+        return PARSER_REAL;
+    if (overflow || value > (unsigned long long)LLONG_MAX + negative)
+        return PARSER_ERROR;
+    parser->integer = negative ? (long long)(0 - value) : (long long)value;
+    return PARSER_INTEGER;
+}
+
+/**
+ * Update the state of a parser after a complete value
+ *
+ * @param parser  The parser
+ */
+void parser_end_value(struct parser *parser) {
+    parser->state = parser->depth == 0 ? PARSER_EXPECT_END_OF_DOCUMENT
+                                       : PARSER_EXPECT_SEPARATOR;
+}
+
+// Functions //
+// --------- //
+
+void parser_initialize(struct parser *parser, FILE *stream) {
+    parser->stream = stream;
+    parser->position = 0;
+    parser->length = 0;
+    parser->state = PARSER_EXPECT_VALUE;
+    parser->depth = 0;
+    parser->string[0] = '\0';
+    parser->integer = 0;
+}
+
+enum parser_token parser_next(struct parser *parser) {
+    if (parser->state == PARSER_FAILED)
+        return PARSER_ERROR;
+    int c = parser_skip_whitespace(parser);
+    if (parser->state == PARSER_EXPECT_END_OF_DOCUMENT)
+        return c == EOF ? PARSER_END : parser_fail(parser);
+    char container = parser->depth > 0 ?
+                     parser->containers[parser->depth - 1] : '\0';
+    if (parser->state == PARSER_EXPECT_SEPARATOR && c == ',') {
+        ++parser->position;
+        c = parser_skip_whitespace(parser);
+        parser->state = container == '{' ? PARSER_EXPECT_KEY
+                                         : PARSER_EXPECT_VALUE;
+    } else if (c == '}' || c == ']') {
+        if ((c == '}') != (container == '{') ||
+            (parser->state != PARSER_EXPECT_SEPARATOR &&
+             parser->state != PARSER_EXPECT_KEY_OR_END &&
+             parser->state != PARSER_EXPECT_VALUE_OR_END))
+            return parser_fail(parser);
+        ++parser->position;
+        --parser->depth;
+        parser_end_value(parser);
+        return c == '}' ? PARSER_OBJECT_END : PARSER_ARRAY_END;
+    } else if (parser->state == PARSER_EXPECT_SEPARATOR) {
+        return parser_fail(parser);
+    }
+    if (parser->state == PARSER_EXPECT_KEY ||
+        parser->state == PARSER_EXPECT_KEY_OR_END) {
+        if (parser_get(parser) != '"' || !parser_read_string(parser) ||
+            parser_skip_whitespace(parser) != ':')
+            return parser_fail(parser);
+        ++parser->position;
+        parser->state = PARSER_EXPECT_VALUE;
+        return PARSER_KEY;
+    }
+    enum parser_token token;
+    switch (c) {
+        case '{':
+        case '[':
+            if (parser->depth == PARSER_MAX_DEPTH)
+                return parser_fail(parser);
+            ++parser->position;
+            parser->containers[parser->depth++] = c;
+            parser->state = c == '{' ? PARSER_EXPECT_KEY_OR_END
+                                     : PARSER_EXPECT_VALUE_OR_END;
+            return c == '{' ? PARSER_OBJECT_START : PARSER_ARRAY_START;
+        case '"':
+            ++parser->position;
+            token = parser_read_string(parser) ? PARSER_STRING : PARSER_ERROR;
+            break;
+        case 't':
+            token = parser_consume_literal(parser, "true") ? PARSER_TRUE
+                                                           : PARSER_ERROR;
+            break;
+        case 'f':
+            token = parser_consume_literal(parser, "false") ? PARSER_FALSE
+                                                            : PARSER_ERROR;
+            break;
+        case 'n':
+            token = parser_consume_literal(parser, "null") ? PARSER_NULL
+                                                           : PARSER_ERROR;
+            break;
+        default:
+            token = parser_read_number(parser);
+    }
+    if (token == PARSER_ERROR)
+        return parser_fail(parser);
+    parser_end_value(parser);
+    return token;
+}
+
+bool parser_skip(struct parser *parser, enum parser_token token) {
+    if (token != PARSER_OBJECT_START && token != PARSER_ARRAY_START)
+        return token != PARSER_ERROR && token != PARSER_END &&
+               token != PARSER_OBJECT_END && token != PARSER_ARRAY_END &&
+               token != PARSER_KEY;
+    unsigned int depth = parser->depth - 1;
+    while (parser->depth > depth) {
+        token = parser_next(parser);
+        if (token == PARSER_ERROR)
+            return false;
+    }
+    return true;
+}
+
+long long parser_read_integer(struct parser *parser) {
+    enum parser_token token = parser_next(parser);
+    if (token == PARSER_INTEGER)
+        return parser->integer;
+    parser_skip(parser, token);
+    return 0;
+}
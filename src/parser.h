@@ -0,0 +1,129 @@
+/**
+ * parser.h
+ *
+ * Parse JSON documents in a streaming fashion.
+ *
+ * A parser reads a JSON document from a stream through a small buffer and
+ * returns its tokens one at a time, so that the document is never entirely
+ * loaded in memory. The caller walks the document by calling `parser_next`
+ * repeatedly, and stores the values it is interested in directly where they
+ * belong, for instance in the tiles of a layer. The values it is not
+ * interested in are skipped with `parser_skip`.
+ *
+ * For instance, the document `{"a": [1, 2]}` is returned as the tokens
+ *
+ *     PARSER_OBJECT_START, PARSER_KEY ("a"), PARSER_ARRAY_START,
+ *     PARSER_INTEGER (1), PARSER_INTEGER (2), PARSER_ARRAY_END,
+ *     PARSER_OBJECT_END, PARSER_END
+ *
+ * The commas and colons are checked by the parser but never returned. If the
+ * document is not valid JSON, `PARSER_ERROR` is returned and all the
+ * following calls return it too.
+ *
+ * The module provides the following data structures:
+ *
+ * - `enum parser_token`: the type of a token
+ * - `struct parser`: the parser itself
+ */
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define PARSER_BUFFER_SIZE 65536
+#define PARSER_STRING_LENGTH 1024
+#define PARSER_MAX_DEPTH 64
+
+// Types //
+// ----- //
+
+/**
+ * The type of a token
+ */
+enum parser_token {
+    PARSER_ERROR,        // The document is invalid
+    PARSER_END,          // The end of the document
+    PARSER_OBJECT_START, // The beginning of an object
+    PARSER_OBJECT_END,   // The end of an object
+    PARSER_ARRAY_START,  // The beginning of an array
+    PARSER_ARRAY_END,    // The end of an array
+    PARSER_KEY,          // A key of an object (in `string`)
+    PARSER_STRING,       // A string (in `string`)
+    PARSER_INTEGER,      // An integer (in `integer`)
+    PARSER_REAL,         // A number that is not an integer
+    PARSER_TRUE,         // The literal true
+    PARSER_FALSE,        // The literal false
+    PARSER_NULL,         // The literal null
+};
+
+/**
+ * What a parser expects next
+ */
+enum parser_state {
+    PARSER_EXPECT_VALUE,           // A value
+    PARSER_EXPECT_VALUE_OR_END,    // A value or the end of an array
+    PARSER_EXPECT_KEY,             // A key
+    PARSER_EXPECT_KEY_OR_END,      // A key or the end of an object
+    PARSER_EXPECT_SEPARATOR,       // A comma or the end of a container
+    PARSER_EXPECT_END_OF_DOCUMENT, // Nothing but whitespace
+    PARSER_FAILED,                 // Nothing, the document is invalid
+};
+
+/**
+ * A streaming JSON parser
+ */
+struct parser {
+    FILE *stream;                       // The stream
+    char buffer[PARSER_BUFFER_SIZE];    // The characters read in advance
+    size_t position;                    // The next character in the buffer
+    size_t length;                      // The number of characters read
+    enum parser_state state;            // What is expected next
+    char containers[PARSER_MAX_DEPTH];  // The open containers ('[' or '{')
+    unsigned int depth;                 // The number of open containers
+    char string[PARSER_STRING_LENGTH];  // The last string (maybe truncated)
+    long long integer;                  // The last integer
+};
+
+// Functions //
+// --------- //
+
+/**
+ * Initialize a parser
+ *
+ * @param parser  The parser
+ * @param stream  The stream containing the document
+ */
+void parser_initialize(struct parser *parser, FILE *stream);
+
+/**
+ * Return the next token of a document
+ *
+ * @param parser  The parser
+ * @return        The token
+ */
+enum parser_token parser_next(struct parser *parser);
+
+/**
+ * Skip a value of a document
+ *
+ * The value starts with the token that was just returned by `parser_next`. If
+ * it is an object or an array, all the tokens up to its end are skipped.
+ *
+ * @param parser  The parser
+ * @param token   The first token of the value
+ * @return        True if the value was skipped without error
+ */
+bool parser_skip(struct parser *parser, enum parser_token token);
+
+/**
+ * Read an integer value
+ *
+ * Any value that is not an integer is skipped and read as 0.
+ *
+ * @param parser  The parser
+ * @return        The integer
+ */
+long long parser_read_integer(struct parser *parser);
+
+#endif
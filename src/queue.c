@@ -6,12 +6,18 @@
 void queue_initialize(queue *q) {
     q->first = NULL;
     q->last = NULL;
+    q->unused = NULL;
 }
 
 void queue_delete(queue *q) {
     while (!queue_is_empty(q)) {
         queue_pop(q);
     }
+    while (q->unused != NULL) {
+        struct queue_node *node = q->unused;
+        q->unused = node->next;
+        free(node);
+    }
 }
 
 bool queue_is_empty(const queue *q) {
@@ -21,7 +27,11 @@ bool queue_is_empty(const queue *q) {
 
 void queue_push(queue *q, void *value) {
     assert(q != NULL);
-    struct queue_node *node = malloc(sizeof(struct queue_node));
+    struct queue_node *node = q->unused;
+    if (node != NULL)
+        q->unused = node->next;
+    else
+        node = malloc(sizeof(struct queue_node));
     node->value = value;
     node->next = NULL;
     node->prev = q->last;
@@ -39,7 +49,8 @@ void *queue_pop(queue *q) {
     void *value = q->first->value;
     struct queue_node *node = q->first;
     q->first = node->next;
-    free(node);
+    node->next = q->unused;
+    q->unused = node;
     return value;
 }
 
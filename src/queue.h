@@ -3,6 +3,10 @@
  *
  * Provides a generic queue data structure and functions operating on it.
  *
+ * The nodes of popped values are kept aside and reused by the next pushes, so
+ * that a queue through which many values go (for instance, during a breadth
+ * first search) only allocates as many nodes as its maximal length.
+ *
  * @author  Alexandre Blondin Massé
  */
 #ifndef QUEUE_H
@@ -19,9 +23,10 @@ struct queue_node {          // A node in the queue
     struct queue_node *next; // The next node in the queue
 };
 
-typedef struct {              // A simple queue
-    struct queue_node *first; // The first node in the queue
-    struct queue_node *last;  // The last node in the queue
+typedef struct {               // A simple queue
+    struct queue_node *first;  // The first node in the queue
+    struct queue_node *last;   // The last node in the queue
+    struct queue_node *unused; // The nodes available for reuse
 } queue;
 
 // Functions //
@@ -0,0 +1,869 @@
+#define _POSIX_C_SOURCE 200809L
+#include "render.h"
+#include "blend.h"
+#include "map.h"
+#include "tile.h"
+#include "stats.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Types //
+// ----- //
+
+/**
+ * A tile image to paint at some position of a viewport
+ */
+struct sprite {
+    unsigned int tile_index; // The index of the tile in the tileset
+    int x;                   // The x-coordinate of the top left corner
+    int y;                   // The y-coordinate of the top left corner
+    int height;              // The height of the image
+};
+
+/**
+ * A row of pixels of a tile image, as seen by the occlusion culling
+ *
+ * A pixel is visible if it is not fully transparent, and opaque if it hides
+ * completely what is below it.
+ */
+struct image_row {
+    int first;        // The first visible pixel
+    int end;          // One past the last visible pixel
+    int opaque_first; // The first pixel of the longest run of opaque pixels
+    int opaque_end;   // One past the last pixel of this run
+};
+
+/**
+ * A horizontal band of a viewport, drawn by a single thread
+ */
+struct band {
+    const struct tileset *tileset; // The tileset, whose images are decoded
+    cairo_surface_t *surface;      // The surface of the viewport
+    const struct sprite *sprites;  // The sprites, from back to front
+    unsigned int num_sprites;      // The number of sprites
+    int y;                         // The first row of the band
+    int height;                    // The number of rows of the band
+    enum render_backend backend;   // The backend drawing the tiles
+};
+
+/**
+ * A tile pyramid being rendered
+ */
+struct pyramid {
+    const struct isomap *isomap;          // The isomap
+    struct render_projection projection;  // The projection of the isomap
+    const char *directory;                // The directory of the pyramid
+    unsigned int tile_size;               // The size of the images
+    unsigned int num_levels;              // The number of zoom levels
+    unsigned int num_threads;             // The number of threads
+    enum render_backend backend;          // The backend drawing the tiles
+    int png_level;                        // The PNG compression level
+};
+
+// Help functions //
+// -------------- //
+
+/**
+ * Return the largest integer less than or equal to a quotient
+ *
+ * @param a  The dividend
+ * @param b  The divisor, positive
+ * @return   The quotient, rounded down
+ */
+long long render_floor_div(long long a, long long b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/**
+ * Fill a surface with the background color
+ *
+ * @param cr      The context of the surface
+ * @param width   The width of the surface
+ * @param height  The height of the surface
+ */
+void render_fill_background(cairo_t *cr, int width, int height) {
+    cairo_set_source_rgb(cr, 0, 0.1, 0);
+    cairo_rectangle(cr, 0, 0, width, height);
+    cairo_fill(cr);
+}
+
+/**
+ * Decode the images of the tiles of a tileset
+ *
+ * @param tileset     The tileset
+ * @param max_width   The largest width of an image, set by the function
+ * @param max_height  The largest height of an image, set by the function
+ */
+void render_decode_images(struct tileset *tileset,
+                          int *max_width, int *max_height) {
+    *max_width = *max_height = 0;
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i) {
+        cairo_surface_t *image = tile_get_image(tileset, tileset->tiles + i);
+        if (cairo_surface_status(image) != CAIRO_STATUS_SUCCESS)
+            continue;
+        cairo_surface_flush(image);
+        if (cairo_image_surface_get_width(image) > *max_width)
+            *max_width = cairo_image_surface_get_width(image);
+        if (cairo_image_surface_get_height(image) > *max_height)
+            *max_height = cairo_image_surface_get_height(image);
+    }
+}
+
+/**
+ * Add a sprite for a cell of a map, if its image overlaps a viewport
+ *
+ * @param isomap       The isomap
+ * @param projection   The projection of the isomap
+ * @param viewport     The viewport
+ * @param location     The location of the cell
+ * @param id           The tile of the cell
+ * @param sprites      The sprites, updated by the function
+ * @param num_sprites  The number of sprites, updated by the function
+ * @param capacity     The capacity of the sprites, updated by the function
+ */
+void render_add_sprite(const struct isomap *isomap,
+                       const struct render_projection *projection,
+                       const struct render_viewport *viewport,
+                       const struct location *location,
+                       tile_id id,
+                       struct sprite **sprites,
+                       unsigned int *num_sprites,
+                       unsigned int *capacity) {
+    struct tile *tile = tile_by_id(isomap->tileset, id);
+    if (tile == NULL || cairo_surface_status(tile->image) != CAIRO_STATUS_SUCCESS)
+        return;
+    int x = projection->origin_x + (location->y - location->x) *
+            projection->h_step - viewport->x;
+    int y = (projection->dz - location->z) * projection->l_step +
+            (location->x + location->y) * projection->v_step - viewport->y;
+    int height = cairo_image_surface_get_height(tile->image);
+    if (x >= (int)viewport->width || y >= (int)viewport->height ||
+        x + cairo_image_surface_get_width(tile->image) <= 0 || y + height <= 0)
+        return;
+    if (*num_sprites == *capacity) {
+        *capacity *= 2;
+        *sprites = realloc(*sprites, *capacity * sizeof(struct sprite));
+    }
+    (*sprites)[(*num_sprites)++] = (struct sprite){
+        .tile_index = tile - isomap->tileset->tiles,
+        .x          = x,
+        .y          = y,
+        .height     = height
+    };
+}
+
+/**
+ * Return the sprites of a viewport, from back to front
+ *
+ * The images of the tiles are decoded at this point, so that they can be
+ * shared by the threads drawing the bands. The locations whose tile is not
+ * in the tileset, or whose image could not be decoded, are ignored.
+ *
+ * In each layer, the only cells visited are the ones whose image may overlap
+ * the viewport, that is, the cells (x,y) such that y - x and x + y lie in
+ * some intervals. When the whole layer lies in these intervals, only its
+ * occupied cells are visited instead.
+ *
+ * Note: the returned array should be freed by the caller.
+ *
+ * @param isomap       The isomap
+ * @param projection   The projection of the isomap
+ * @param viewport     The viewport
+ * @param num_sprites  The number of sprites, set by the function
+ * @return             The sprites
+ */
+struct sprite *render_get_sprites(const struct isomap *isomap,
+                                  const struct render_projection *projection,
+                                  const struct render_viewport *viewport,
+                                  unsigned int *num_sprites) {
+    int max_width, max_height;
+    render_decode_images(isomap->tileset, &max_width, &max_height);
+    unsigned int capacity = 1;
+    struct sprite *sprites = malloc(sizeof(struct sprite));
+    *num_sprites = 0;
+    for (unsigned int l = 0; l < isomap->map->num_layers; ++l) {
+        const struct layer *layer = isomap->map->layers + l;
+        if (layer->num_rows == 0 || layer->num_columns == 0)
+            continue;
+        long long ox = layer->offset.dx, oy = layer->offset.dy;
+        struct location location = {0, 0, layer->offset.dz};
+        long long top = (long long)(projection->dz - location.z) *
+                        projection->l_step;
+        long long u_min = LLONG_MIN / 4, u_max = LLONG_MAX / 4;
+        long long s_min = LLONG_MIN / 4, s_max = LLONG_MAX / 4;
+        if (projection->h_step > 0) {
+            u_min = render_floor_div((long long)viewport->x - max_width -
+                                     projection->origin_x,
+                                     projection->h_step);
+            u_max = render_floor_div((long long)viewport->x + viewport->width -
+                                     projection->origin_x,
+                                     projection->h_step) + 1;
+        }
+        if (projection->v_step > 0) {
+            s_min = render_floor_div((long long)viewport->y - max_height - top,
+                                     projection->v_step);
+            s_max = render_floor_div((long long)viewport->y + viewport->height -
+                                     top, projection->v_step) + 1;
+        }
+        long long last_x = ox + layer->num_rows - 1;
+        long long last_y = oy + layer->num_columns - 1;
+        if (oy - last_x >= u_min && last_y - ox <= u_max &&
+            ox + oy >= s_min && last_x + last_y <= s_max) {
+            unsigned int r = 0, c = 0;
+            for (; map_next_occupied_in_layer(layer, &r, &c); ++c) {
+                location.x = r + ox;
+                location.y = c + oy;
+                render_add_sprite(isomap, projection, viewport, &location,
+                                  map_get_layer_tile(layer, r, c),
+                                  &sprites, num_sprites, &capacity);
+            }
+            continue;
+        }
+        long long x_min = render_floor_div(s_min - u_max, 2);
+        long long x_max = render_floor_div(s_max - u_min, 2) + 1;
+        if (x_min < ox) x_min = ox;
+        if (x_max > last_x) x_max = last_x;
+        for (long long x = x_min; x <= x_max; ++x) {
+            long long y_min = oy, y_max = last_y;
+            if (u_min + x > y_min) y_min = u_min + x;
+            if (s_min - x > y_min) y_min = s_min - x;
+            if (u_max + x < y_max) y_max = u_max + x;
+            if (s_max - x < y_max) y_max = s_max - x;
+            for (long long y = y_min; y <= y_max; ++y) {
+                tile_id id = map_get_layer_tile(layer, x - ox, y - oy);
+                if (id == 0)
+                    continue;
+                location.x = x;
+                location.y = y;
+                render_add_sprite(isomap, projection, viewport, &location, id,
+                                  &sprites, num_sprites, &capacity);
+            }
+        }
+    }
+    return sprites;
+}
+
+/**
+ * Return the rows of a tile image, as seen by the occlusion culling
+ *
+ * Note: the returned array should be freed by the caller.
+ *
+ * @param image  The image, in premultiplied ARGB32 format
+ * @return       The rows of the image
+ */
+struct image_row *render_get_image_rows(cairo_surface_t *image) {
+    int width = cairo_image_surface_get_width(image);
+    int height = cairo_image_surface_get_height(image);
+    int stride = cairo_image_surface_get_stride(image);
+    const unsigned char *data = cairo_image_surface_get_data(image);
+    struct image_row *rows = malloc((height > 0 ? height : 1) *
+                                    sizeof(struct image_row));
+    for (int y = 0; y < height; ++y) {
+        const uint32_t *pixels = (const uint32_t*)(data + y * stride);
+        struct image_row row = {width, 0, 0, 0};
+        int run_first = 0;
+        for (int x = 0; x < width; ++x) {
+            if (pixels[x] != 0) {
+                if (row.first == width) row.first = x;
+                row.end = x + 1;
+            }
+            if (pixels[x] >> 24 != 0xff) {
+                run_first = x + 1;
+            } else if (x + 1 - run_first > row.opaque_end - row.opaque_first) {
+                row.opaque_first = run_first;
+                row.opaque_end = x + 1;
+            }
+        }
+        rows[y] = row;
+    }
+    return rows;
+}
+
+/**
+ * Remove the sprites that are completely hidden by the sprites drawn after
+ * them
+ *
+ * The sprites are visited from front to back, while keeping track of the
+ * pixels of the viewport that are already covered by opaque pixels. A sprite
+ * whose visible pixels are all covered cannot change the viewport, since any
+ * pixel painted over with an opaque pixel takes the value of the latter. Only
+ * the longest run of opaque pixels of each row of an image is taken into
+ * account, which is exact for the convex shapes of the tiles, and only misses
+ * some culling otherwise.
+ *
+ * @param tileset      The tileset, whose images are decoded
+ * @param sprites      The sprites, from back to front
+ * @param num_sprites  The number of sprites, updated by the function
+ * @param width        The width of the viewport
+ * @param height       The height of the viewport
+ * @return             The number of removed sprites
+ */
+unsigned int render_cull_sprites(const struct tileset *tileset,
+                                 struct sprite *sprites,
+                                 unsigned int *num_sprites,
+                                 int width, int height) {
+    struct image_row **rows = calloc(tileset->num_tiles,
+                                     sizeof(struct image_row*));
+    unsigned char *covered = calloc((size_t)width * height + 1, 1);
+    bool *hidden = malloc((*num_sprites + 1) * sizeof(bool));
+    for (unsigned int s = *num_sprites; s-- > 0;) {
+        const struct sprite *sprite = sprites + s;
+        unsigned int i = sprite->tile_index;
+        if (rows[i] == NULL)
+            rows[i] = render_get_image_rows(tileset->tiles[i].image);
+        hidden[s] = true;
+        for (int r = 0; r < sprite->height && hidden[s]; ++r) {
+            int y = sprite->y + r;
+            int x0 = sprite->x + rows[i][r].first;
+            int x1 = sprite->x + rows[i][r].end;
+            if (x0 < 0) x0 = 0;
+            if (x1 > width) x1 = width;
+            if (y >= 0 && y < height && x0 < x1 &&
+                memchr(covered + (size_t)y * width + x0, 0, x1 - x0) != NULL)
+                hidden[s] = false;
+        }
+        if (hidden[s])
+            continue;
+        for (int r = 0; r < sprite->height; ++r) {
+            int y = sprite->y + r;
+            int x0 = sprite->x + rows[i][r].opaque_first;
+            int x1 = sprite->x + rows[i][r].opaque_end;
+            if (x0 < 0) x0 = 0;
+            if (x1 > width) x1 = width;
+            if (y >= 0 && y < height && x0 < x1)
+                memset(covered + (size_t)y * width + x0, 1, x1 - x0);
+        }
+    }
+    unsigned int num_visible = 0;
+    for (unsigned int s = 0; s < *num_sprites; ++s)
+        if (!hidden[s])
+            sprites[num_visible++] = sprites[s];
+    unsigned int num_culled = *num_sprites - num_visible;
+    *num_sprites = num_visible;
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i)
+        free(rows[i]);
+    free(rows);
+    free(covered);
+    free(hidden);
+    return num_culled;
+}
+
+/**
+ * Draw the sprites of a band with cairo
+ *
+ * The decoded images are wrapped in surfaces that belong to the band, as is
+ * the surface of the band itself (see `render_draw_band`), so that no cairo
+ * object is shared between threads.
+ *
+ * @param b   The band
+ * @param cr  The context of the band
+ */
+void render_paint_sprites(const struct band *b, cairo_t *cr) {
+    const struct tileset *tileset = b->tileset;
+    cairo_surface_t **images = calloc(tileset->num_tiles,
+                                      sizeof(cairo_surface_t*));
+    for (unsigned int s = 0; s < b->num_sprites; ++s) {
+        const struct sprite *sprite = b->sprites + s;
+        if (sprite->y >= b->y + b->height || sprite->y + sprite->height <= b->y)
+            continue;
+        unsigned int i = sprite->tile_index;
+        if (images[i] == NULL) {
+            cairo_surface_t *image = tileset->tiles[i].image;
+            images[i] = cairo_image_surface_create_for_data(
+                cairo_image_surface_get_data(image),
+                cairo_image_surface_get_format(image),
+                cairo_image_surface_get_width(image),
+                cairo_image_surface_get_height(image),
+                cairo_image_surface_get_stride(image));
+        }
+        cairo_set_source_surface(cr, images[i], sprite->x, sprite->y - b->y);
+        cairo_paint(cr);
+    }
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i)
+        if (images[i] != NULL)
+            cairo_surface_destroy(images[i]);
+    free(images);
+}
+
+/**
+ * Draw the sprites of a band directly in the pixels of its surface
+ *
+ * Each row of a sprite that lies in the band is clipped to the surface and
+ * composited with `blend_over`.
+ *
+ * @param b  The band
+ */
+void render_blend_sprites(const struct band *b) {
+    int width = cairo_image_surface_get_width(b->surface);
+    int stride = cairo_image_surface_get_stride(b->surface);
+    unsigned char *data = cairo_image_surface_get_data(b->surface);
+    for (unsigned int s = 0; s < b->num_sprites; ++s) {
+        const struct sprite *sprite = b->sprites + s;
+        cairo_surface_t *image = b->tileset->tiles[sprite->tile_index].image;
+        int image_stride = cairo_image_surface_get_stride(image);
+        const unsigned char *image_data = cairo_image_surface_get_data(image);
+        int first = sprite->y > b->y ? sprite->y : b->y;
+        int end = sprite->y + sprite->height < b->y + b->height ?
+                  sprite->y + sprite->height : b->y + b->height;
+        int left = sprite->x > 0 ? sprite->x : 0;
+        int right = sprite->x + cairo_image_surface_get_width(image);
+        if (right > width)
+            right = width;
+        for (int y = first; y < end && left < right; ++y)
+            blend_over((uint32_t*)(data + y * stride) + left,
+                       (const uint32_t*)(image_data +
+                                         (y - sprite->y) * image_stride) +
+                       left - sprite->x,
+                       right - left);
+    }
+}
+
+/**
+ * Draw a band of a viewport
+ *
+ * The band is filled through its own cairo context, then its sprites are
+ * drawn by the backend of the band. The context draws on a standalone surface
+ * wrapping the rows of the band in the pixels of the viewport: cairo surfaces
+ * must not be used by several threads at once, so the threads only share
+ * disjoint rows of pixels, never a surface. Only the sprites overlapping the
+ * band are drawn, in the same order as for the whole viewport, so that the
+ * pixels of the band are exactly the ones a single thread would produce.
+ *
+ * @param band  The band (a `struct band *`)
+ * @return      NULL
+ */
+void *render_draw_band(void *band) {
+    const struct band *b = band;
+    int width = cairo_image_surface_get_width(b->surface);
+    int stride = cairo_image_surface_get_stride(b->surface);
+    unsigned char *data = cairo_image_surface_get_data(b->surface);
+    cairo_surface_t *surface = cairo_image_surface_create_for_data(
+        data + b->y * stride, cairo_image_surface_get_format(b->surface), width,
+        b->height, stride);
+    cairo_t *cr = cairo_create(surface);
+    render_fill_background(cr, width, b->height);
+    if (b->backend == RENDER_CAIRO) {
+        render_paint_sprites(b, cr);
+        cairo_destroy(cr);
+    } else {
+        cairo_destroy(cr);
+        cairo_surface_flush(surface);
+        render_blend_sprites(b);
+    }
+    cairo_surface_destroy(surface);
+    return NULL;
+}
+
+/**
+ * Render a band of a viewport in a thread helping the drawing thread
+ *
+ * The CPU time of the thread is added to the drawing phase.
+ *
+ * @param band  The band (a `struct band *`)
+ * @return      NULL
+ */
+void *render_draw_band_thread(void *band) {
+    STATS_START(timer);
+    render_draw_band(band);
+    STATS_STOP_CPU(timer, STATS_DRAW);
+    return NULL;
+}
+
+/**
+ * Return the rectangle of a viewport covered by the tile images of the
+ * locations of a box
+ *
+ * @param projection  The projection of the isomap
+ * @param viewport    The viewport
+ * @param box         The box
+ * @param max_width   The largest width of a tile image
+ * @param max_height  The largest height of a tile image
+ * @param rectangle   The rectangle, relative to the viewport, set by the
+ *                    function
+ * @return            True if the rectangle is not empty
+ */
+bool render_get_box_rectangle(const struct render_projection *projection,
+                              const struct render_viewport *viewport,
+                              const struct box *box,
+                              int max_width, int max_height,
+                              struct render_viewport *rectangle) {
+    if (geometry_is_box_empty(box))
+        return false;
+    long long left = projection->origin_x +
+                     ((long long)box->ymin - box->xmax) * projection->h_step;
+    long long right = projection->origin_x + max_width +
+                      ((long long)box->ymax - box->xmin) * projection->h_step;
+    long long top = ((long long)projection->dz - box->zmax) *
+                    projection->l_step +
+                    ((long long)box->xmin + box->ymin) * projection->v_step;
+    long long bottom = ((long long)projection->dz - box->zmin) *
+                       projection->l_step + max_height +
+                       ((long long)box->xmax + box->ymax) * projection->v_step;
+    left = left > viewport->x ? left - viewport->x : 0;
+    top = top > viewport->y ? top - viewport->y : 0;
+    right -= viewport->x;
+    bottom -= viewport->y;
+    if (right > viewport->width) right = viewport->width;
+    if (bottom > viewport->height) bottom = viewport->height;
+    if (left >= right || top >= bottom)
+        return false;
+    *rectangle = (struct render_viewport){left, top, right - left,
+                                          bottom - top};
+    return true;
+}
+
+/**
+ * Create a directory, unless it already exists
+ *
+ * @param path  The path of the directory
+ * @return      True if the directory exists
+ */
+bool render_make_directory(const char *path) {
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+/**
+ * Shrink an image to half its size into a quarter of another image
+ *
+ * Each pixel of the result is the average of a block of 2x2 pixels.
+ *
+ * @param source  The image to shrink
+ * @param target  The image receiving the result
+ * @param x       The x-coordinate of the quarter in the target image
+ * @param y       The y-coordinate of the quarter in the target image
+ */
+void render_shrink(cairo_surface_t *source, cairo_surface_t *target,
+                   int x, int y) {
+    cairo_surface_flush(source);
+    cairo_surface_flush(target);
+    int width = cairo_image_surface_get_width(source) / 2;
+    int height = cairo_image_surface_get_height(source) / 2;
+    int source_stride = cairo_image_surface_get_stride(source);
+    int target_stride = cairo_image_surface_get_stride(target);
+    const unsigned char *source_data = cairo_image_surface_get_data(source);
+    unsigned char *target_data = cairo_image_surface_get_data(target);
+    for (int j = 0; j < height; ++j) {
+        const uint32_t *above = (const uint32_t*)(source_data +
+                                                  2 * j * source_stride);
+        const uint32_t *below = (const uint32_t*)(source_data +
+                                                  (2 * j + 1) * source_stride);
+        uint32_t *pixels = (uint32_t*)(target_data + (y + j) * target_stride) +
+                           x;
+        for (int i = 0; i < width; ++i) {
+            uint32_t pixel = 0;
+            for (int k = 0; k < 32; k += 8) {
+                uint32_t sum = ((above[2 * i] >> k) & 0xff) +
+                               ((above[2 * i + 1] >> k) & 0xff) +
+                               ((below[2 * i] >> k) & 0xff) +
+                               ((below[2 * i + 1] >> k) & 0xff);
+                pixel |= ((sum + 2) / 4) << k;
+            }
+            pixels[i] = pixel;
+        }
+    }
+    cairo_surface_mark_dirty(target);
+}
+
+/**
+ * Write an image of a pyramid to a PNG file
+ *
+ * @param pyramid  The pyramid
+ * @param image    The image
+ * @param path     The path of the file
+ * @return         True if the file was written without error
+ */
+bool render_write_pyramid_image(const struct pyramid *pyramid,
+                                cairo_surface_t *image,
+                                const char *path) {
+    FILE *output = fopen(path, "wb");
+    if (output == NULL)
+        return false;
+    cairo_surface_flush(image);
+    struct encoder *encoder =
+        encoder_create(output, ENCODER_PNG, pyramid->tile_size,
+                       pyramid->tile_size, pyramid->png_level,
+                       pyramid->num_threads);
+    encoder_write_rows(encoder, cairo_image_surface_get_data(image),
+                       cairo_image_surface_get_stride(image),
+                       pyramid->tile_size);
+    bool written = encoder_delete(encoder);
+    return fclose(output) == 0 && written;
+}
+
+/**
+ * Render an image of a pyramid, together with all the images below it
+ *
+ * @param pyramid  The pyramid
+ * @param level    The zoom level of the image
+ * @param column   The column of the image
+ * @param row      The row of the image
+ * @return         The image, or NULL if a file could not be written
+ */
+cairo_surface_t *render_draw_pyramid_image(const struct pyramid *pyramid,
+                                           unsigned int level,
+                                           unsigned int column,
+                                           unsigned int row) {
+    unsigned int size = pyramid->tile_size;
+    cairo_surface_t *image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                        size, size);
+    bool valid = true;
+    if (level == pyramid->num_levels - 1) {
+        struct render_viewport viewport = {column * size, row * size,
+                                           size, size};
+        render_draw(pyramid->isomap, &pyramid->projection, &viewport, image,
+                    pyramid->num_threads, pyramid->backend);
+    } else {
+        cairo_t *cr = cairo_create(image);
+        render_fill_background(cr, size, size);
+        cairo_destroy(cr);
+        unsigned long scale = (unsigned long)size <<
+                              (pyramid->num_levels - level - 2);
+        for (unsigned int i = 0; i < 4 && valid; ++i) {
+            unsigned int c = 2 * column + i % 2, r = 2 * row + i / 2;
+            if (c * scale >= pyramid->projection.width ||
+                r * scale >= pyramid->projection.height)
+                continue;
+            cairo_surface_t *child = render_draw_pyramid_image(pyramid,
+                                                               level + 1, c, r);
+            if (child == NULL) {
+                valid = false;
+            } else {
+                render_shrink(child, image, i % 2 * size / 2, i / 2 * size / 2);
+                cairo_surface_destroy(child);
+            }
+        }
+    }
+    char path[PATH_LENGTH];
+    snprintf(path, PATH_LENGTH, "%s/%u", pyramid->directory, level);
+    valid = valid && render_make_directory(path);
+    snprintf(path, PATH_LENGTH, "%s/%u/%u", pyramid->directory, level, column);
+    valid = valid && render_make_directory(path);
+    snprintf(path, PATH_LENGTH, "%s/%u/%u/%u.png", pyramid->directory, level,
+             column, row);
+    valid = valid && render_write_pyramid_image(pyramid, image, path);
+    if (!valid) {
+        cairo_surface_destroy(image);
+        return NULL;
+    }
+    return image;
+}
+
+// Functions //
+// --------- //
+
+struct render_projection render_get_projection(const struct isomap *isomap) {
+    struct box bounding_box = map_get_bounding_box(isomap->map);
+    struct vect box_vect = geometry_box_to_vect(&bounding_box);
+    struct render_projection projection = {
+        .h_step = isomap->tile_width / 2,
+        .v_step = isomap->tile_width / 4,
+        .l_step = isomap->z_offset,
+        .dz     = box_vect.dz
+    };
+    projection.origin_x = projection.h_step * (box_vect.dx + 0.5);
+    projection.width = projection.h_step * (box_vect.dx + box_vect.dy + 3);
+    projection.height = projection.v_step * (box_vect.dx + box_vect.dy + 2) +
+                        projection.l_step * (box_vect.dz + 2);
+    return projection;
+}
+
+struct render_viewport render_full_viewport(
+    const struct render_projection *projection) {
+    return (struct render_viewport){0, 0, projection->width,
+                                    projection->height};
+}
+
+unsigned int render_draw(const struct isomap *isomap,
+                         const struct render_projection *projection,
+                         const struct render_viewport *viewport,
+                         cairo_surface_t *surface,
+                         unsigned int num_threads,
+                         enum render_backend backend) {
+    STATS_START(timer);
+    unsigned int num_sprites;
+    struct sprite *sprites = render_get_sprites(isomap, projection, viewport,
+                                                &num_sprites);
+    unsigned int num_culled = render_cull_sprites(isomap->tileset, sprites,
+                                                  &num_sprites,
+                                                  viewport->width,
+                                                  viewport->height);
+    unsigned int height = viewport->height;
+    if (num_threads == 0)
+        num_threads = 1;
+    if (num_threads > height)
+        num_threads = height > 0 ? height : 1;
+    int band_height = (height + num_threads - 1) / num_threads;
+    if (band_height > 0)
+        num_threads = (height + band_height - 1) / band_height;
+    struct band *bands = malloc(num_threads * sizeof(struct band));
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    cairo_surface_flush(surface);
+    for (unsigned int b = 0; b < num_threads; ++b) {
+        int y = b * band_height;
+        bands[b] = (struct band){
+            .tileset     = isomap->tileset,
+            .surface     = surface,
+            .sprites     = sprites,
+            .num_sprites = num_sprites,
+            .y           = y,
+            .height      = (int)height - y < band_height ?
+                           (int)height - y : band_height,
+            .backend     = backend
+        };
+    }
+    for (unsigned int b = 1; b < num_threads; ++b)
+        pthread_create(threads + b, NULL, render_draw_band_thread,
+                       bands + b);
+    render_draw_band(bands);
+    for (unsigned int b = 1; b < num_threads; ++b)
+        pthread_join(threads[b], NULL);
+    cairo_surface_mark_dirty(surface);
+    free(threads);
+    free(bands);
+    free(sprites);
+    STATS_STOP(timer, STATS_DRAW);
+    STATS_ADD(STATS_TILES_DRAWN, num_sprites);
+    STATS_ADD(STATS_TILES_CULLED, num_culled);
+    return num_culled;
+}
+
+unsigned long render_update(const struct isomap *isomap,
+                            const struct render_projection *projection,
+                            const struct render_viewport *viewport,
+                            cairo_surface_t *surface,
+                            const struct box *boxes,
+                            unsigned int num_boxes,
+                            unsigned int num_threads,
+                            enum render_backend backend) {
+    int max_width, max_height;
+    render_decode_images(isomap->tileset, &max_width, &max_height);
+    cairo_surface_flush(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char *data = cairo_image_surface_get_data(surface);
+    unsigned long area = 0;
+    for (unsigned int b = 0; b < num_boxes; ++b) {
+        struct render_viewport rectangle;
+        if (!render_get_box_rectangle(projection, viewport, boxes + b,
+                                      max_width, max_height, &rectangle))
+            continue;
+        cairo_surface_t *patch = cairo_image_surface_create_for_data(
+            data + rectangle.y * stride + 4 * rectangle.x,
+            CAIRO_FORMAT_ARGB32, rectangle.width, rectangle.height, stride);
+        rectangle.x += viewport->x;
+        rectangle.y += viewport->y;
+        render_draw(isomap, projection, &rectangle, patch, num_threads,
+                    backend);
+        cairo_surface_destroy(patch);
+        area += (unsigned long)rectangle.width * rectangle.height;
+    }
+    cairo_surface_mark_dirty(surface);
+    return area;
+}
+
+bool render_update_since(const struct isomap *isomap,
+                         const struct render_projection *projection,
+                         const struct render_viewport *viewport,
+                         cairo_surface_t *surface,
+                         unsigned long version,
+                         unsigned int num_threads,
+                         enum render_backend backend) {
+    struct render_projection current = render_get_projection(isomap);
+    if (memcmp(&current, projection, sizeof(struct render_projection)) != 0)
+        return false;
+    const struct map_change *changes;
+    unsigned int num_changes = map_get_changes(isomap->map, version, &changes);
+    struct box boxes[MAP_MAX_CHANGES];
+    for (unsigned int c = 0; c < num_changes; ++c)
+        boxes[c] = changes[c].box;
+    render_update(isomap, projection, viewport, surface, boxes, num_changes,
+                  num_threads, backend);
+    return true;
+}
+
+bool render_draw_to_stream(const struct isomap *isomap,
+                           const struct render_viewport *viewport,
+                           FILE *stream,
+                           enum encoder_format format,
+                           int level,
+                           unsigned int num_threads,
+                           enum render_backend backend) {
+    struct render_projection projection = render_get_projection(isomap);
+    struct render_viewport full_viewport = render_full_viewport(&projection);
+    if (viewport == NULL)
+        viewport = &full_viewport;
+    unsigned int strip_height = viewport->height < RENDER_STRIP_HEIGHT ?
+                                viewport->height : RENDER_STRIP_HEIGHT;
+    cairo_surface_t *surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                   viewport->width, strip_height);
+    struct encoder *encoder = encoder_create(stream, format, viewport->width,
+                                             viewport->height, level,
+                                             num_threads);
+    for (unsigned int y = 0; y < viewport->height; y += strip_height) {
+        struct render_viewport strip = {
+            viewport->x, viewport->y + y, viewport->width,
+            viewport->height - y < strip_height ? viewport->height - y
+                                                : strip_height
+        };
+        render_draw(isomap, &projection, &strip, surface, num_threads,
+                    backend);
+        cairo_surface_flush(surface);
+        if (!encoder_write_rows(encoder, cairo_image_surface_get_data(surface),
+                                cairo_image_surface_get_stride(surface),
+                                strip.height))
+            break;
+    }
+    bool written = encoder_delete(encoder);
+    cairo_surface_destroy(surface);
+    return written;
+}
+
+bool render_draw_to_png(const struct isomap *isomap,
+                        const struct render_viewport *viewport,
+                        const char *output_filename,
+                        unsigned int num_threads,
+                        enum render_backend backend) {
+    FILE *output = fopen(output_filename, "wb");
+    if (output == NULL)
+        return false;
+    bool written = render_draw_to_stream(isomap, viewport, output, ENCODER_PNG,
+                                         ENCODER_DEFAULT_LEVEL, num_threads,
+                                         backend);
+    return fclose(output) == 0 && written;
+}
+
+unsigned int render_draw_pyramid(const struct isomap *isomap,
+                                 const char *directory,
+                                 unsigned int tile_size,
+                                 int png_level,
+                                 unsigned int num_threads,
+                                 enum render_backend backend) {
+    struct pyramid pyramid = {
+        .isomap      = isomap,
+        .projection  = render_get_projection(isomap),
+        .directory   = directory,
+        .tile_size   = tile_size,
+        .num_levels  = 1,
+        .num_threads = num_threads,
+        .backend     = backend,
+        .png_level   = png_level
+    };
+    unsigned long size = tile_size;
+    while (size < pyramid.projection.width ||
+           size < pyramid.projection.height) {
+        size *= 2;
+        ++pyramid.num_levels;
+    }
+    if (!render_make_directory(directory))
+        return 0;
+    cairo_surface_t *image = render_draw_pyramid_image(&pyramid, 0, 0, 0);
+    if (image == NULL)
+        return 0;
+    cairo_surface_destroy(image);
+    return pyramid.num_levels;
+}
@@ -0,0 +1,269 @@
+/**
+ * render.h
+ *
+ * Render isomaps to images.
+ *
+ * The image of an isomap is the isometric projection of all its tiles, drawn
+ * from back to front over a dark green background. A location (x,y,z) is
+ * drawn with the top left corner of its tile image at
+ *
+ *     X = origin_x + (y - x) * tile_width / 2
+ *     Y = (dz - z) * z_offset + (x + y) * tile_width / 4
+ *
+ * where `origin_x` and `dz` depend on the dimensions of the bounding box of
+ * the map. These values are gathered in a `struct render_projection`, which
+ * is computed once and reused for as many renders as needed. The images of
+ * the tiles are decoded only once and kept with the tileset (see
+ * `tile_get_image`).
+ *
+ * Any rectangle of the image, called a viewport, can be rendered on its own:
+ * only the locations whose tile image overlaps the viewport are visited, so
+ * that the cost of a render depends on the size of the viewport and not on
+ * the size of the map. The pixels of a viewport are exactly the pixels of the
+ * same rectangle in the full image.
+ *
+ * After a few locations of the map are modified, an image that was already
+ * rendered can be patched instead of being rendered again: only the
+ * rectangles of the image that the modified locations may cover are rendered
+ * again, each one as a viewport, so that the cost of the update depends on
+ * the size of the modification and not on the size of the map.
+ *
+ * The image can also be cut into a pyramid of square PNG images, as expected
+ * by most web map viewers: at the deepest zoom level, one pixel of an image
+ * is one pixel of the full image, and each level above halves the
+ * resolution, up to level 0, which is a single image. The image of zoom level
+ * `z` in column `x` and row `y` is stored in the file `z/x/y.png`.
+ *
+ * The tiles are drawn by one of two backends: cairo, which paints each tile
+ * image through a cairo context, or a direct backend, which composites the
+ * rows of the tile images straight into the pixels of the surface (see
+ * `blend.h`). Both give the same pixels.
+ *
+ * The module provides the following data structures:
+ *
+ * - `enum render_backend`: the way the tiles are drawn
+ * - `struct render_projection`: the projection of an isomap
+ * - `struct render_viewport`: a rectangle of the image of an isomap
+ */
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "encoder.h"
+#include "geometry.h"
+#include "isomap.h"
+#include <stdbool.h>
+#include <cairo.h>
+
+#define RENDER_TILE_SIZE 256
+#define RENDER_STRIP_HEIGHT 256
+
+// Types //
+// ----- //
+
+/**
+ * The way the tiles are drawn
+ */
+enum render_backend {
+    RENDER_CAIRO,  // With cairo_paint
+    RENDER_DIRECT, // Directly in the pixels of the surface
+};
+
+/**
+ * The isometric projection of an isomap
+ */
+struct render_projection {
+    int h_step;          // The horizontal step between two columns
+    int v_step;          // The vertical step between two rows
+    int l_step;          // The vertical step between two layers
+    int origin_x;        // The x-coordinate of the location (0,0,z)
+    int dz;              // The height of the bounding box of the map
+    unsigned int width;  // The width of the full image
+    unsigned int height; // The height of the full image
+};
+
+/**
+ * A rectangle of the image of an isomap
+ */
+struct render_viewport {
+    int x;               // The x-coordinate of the top left corner
+    int y;               // The y-coordinate of the top left corner
+    unsigned int width;  // The width of the rectangle
+    unsigned int height; // The height of the rectangle
+};
+
+// Functions //
+// --------- //
+
+/**
+ * Return the projection of an isomap
+ *
+ * The projection should be computed again when the bounding box of the map
+ * changes.
+ *
+ * @param isomap  The isomap
+ * @return        The projection
+ */
+struct render_projection render_get_projection(const struct isomap *isomap);
+
+/**
+ * Return the viewport covering the full image of a projection
+ *
+ * @param projection  The projection
+ * @return            The viewport
+ */
+struct render_viewport render_full_viewport(
+    const struct render_projection *projection);
+
+/**
+ * Render a viewport of an isomap to a surface
+ *
+ * The surface must be an ARGB32 image surface as wide as the viewport and at
+ * least as high: the rows below the viewport are left untouched.
+ * It is split into horizontal bands of equal height, one per thread, each
+ * band being drawn independently. The tiles that are completely hidden by
+ * opaque tiles drawn after them are not drawn at all. Neither the threads nor
+ * the hidden tiles change the result.
+ *
+ * @param isomap       The isomap
+ * @param projection   The projection of the isomap
+ * @param viewport     The viewport
+ * @param surface      The surface
+ * @param num_threads  The number of threads (0 is the same as 1)
+ * @param backend      The backend drawing the tiles
+ * @return             The number of hidden tiles that were not drawn
+ */
+unsigned int render_draw(const struct isomap *isomap,
+                         const struct render_projection *projection,
+                         const struct render_viewport *viewport,
+                         cairo_surface_t *surface,
+                         unsigned int num_threads,
+                         enum render_backend backend);
+
+/**
+ * Render again the parts of a viewport covered by boxes of locations
+ *
+ * The surface contains the viewport, as rendered by `render_draw` before
+ * some locations of the boxes were modified. For each box, the rectangle of
+ * the viewport that the tile images of its locations may cover is rendered
+ * again in place, with all the locations overlapping it, in depth order. The
+ * result is the same as if the whole viewport were rendered again, as long as
+ * the projection did not change.
+ *
+ * @param isomap       The isomap
+ * @param projection   The projection of the isomap
+ * @param viewport     The viewport
+ * @param surface      The surface
+ * @param boxes        The boxes
+ * @param num_boxes    The number of boxes
+ * @param num_threads  The number of threads (0 is the same as 1)
+ * @param backend      The backend drawing the tiles
+ * @return             The number of pixels rendered again
+ */
+unsigned long render_update(const struct isomap *isomap,
+                            const struct render_projection *projection,
+                            const struct render_viewport *viewport,
+                            cairo_surface_t *surface,
+                            const struct box *boxes,
+                            unsigned int num_boxes,
+                            unsigned int num_threads,
+                            enum render_backend backend);
+
+/**
+ * Render again the parts of a viewport modified since a version of the map
+ *
+ * The boxes of the changes of the map since `version` (see
+ * `map_get_changes`) are rendered again with `render_update`. If the
+ * projection of the isomap is no longer `projection`, for instance because
+ * its bounding box grew, nothing is done: the whole viewport must be rendered
+ * again with the new projection.
+ *
+ * @param isomap       The isomap
+ * @param projection   The projection used to render the surface
+ * @param viewport     The viewport
+ * @param surface      The surface
+ * @param version      The version of the map when the surface was rendered
+ * @param num_threads  The number of threads (0 is the same as 1)
+ * @param backend      The backend drawing the tiles
+ * @return             True if the surface was updated
+ */
+bool render_update_since(const struct isomap *isomap,
+                         const struct render_projection *projection,
+                         const struct render_viewport *viewport,
+                         cairo_surface_t *surface,
+                         unsigned long version,
+                         unsigned int num_threads,
+                         enum render_backend backend);
+
+/**
+ * Render a viewport of an isomap to a stream, in a given image format
+ *
+ * The viewport is rendered in horizontal strips of `RENDER_STRIP_HEIGHT`
+ * rows, each strip being encoded as soon as it is drawn (see `encoder.h`), so
+ * that the memory needed is proportional to the width of the viewport, and
+ * not to its area. The pixels are the same as if the viewport were rendered
+ * at once.
+ *
+ * @param isomap       The isomap
+ * @param viewport     The viewport (or NULL for the full image)
+ * @param stream       The stream, which is not closed
+ * @param format       The image format
+ * @param level        The compression level of PNG images (0 to 9)
+ * @param num_threads  The number of threads drawing the tiles and compressing
+ *                     PNG images (0 is the same as 1)
+ * @param backend      The backend drawing the tiles
+ * @return             True if the image was encoded and written without
+ *                     error
+ */
+bool render_draw_to_stream(const struct isomap *isomap,
+                           const struct render_viewport *viewport,
+                           FILE *stream,
+                           enum encoder_format format,
+                           int level,
+                           unsigned int num_threads,
+                           enum render_backend backend);
+
+/**
+ * Render a viewport of an isomap to a PNG file
+ *
+ * The file is written with `render_draw_to_stream`, at the default
+ * compression level. If the file cannot be opened, nothing is drawn.
+ *
+ * @param isomap           The isomap
+ * @param viewport         The viewport (or NULL for the full image)
+ * @param output_filename  The output filename
+ * @param num_threads      The number of threads (0 is the same as 1)
+ * @param backend          The backend drawing the tiles
+ * @return                 True if the file was opened, written and closed
+ *                         without error
+ */
+bool render_draw_to_png(const struct isomap *isomap,
+                        const struct render_viewport *viewport,
+                        const char *output_filename,
+                        unsigned int num_threads,
+                        enum render_backend backend);
+
+/**
+ * Render an isomap to a pyramid of square PNG images
+ *
+ * The images are written in the files `directory/z/x/y.png`, the
+ * directories being created if needed. Only the images of the deepest zoom
+ * level are rendered: the others are obtained by averaging blocks of 2x2
+ * pixels of the level below. The images are encoded with `encoder.h`.
+ *
+ * @param isomap       The isomap
+ * @param directory    The directory of the pyramid
+ * @param tile_size    The width and height of the images
+ * @param png_level    The compression level of the images (0 to 9)
+ * @param num_threads  The number of threads (0 is the same as 1)
+ * @param backend      The backend drawing the tiles
+ * @return             The number of zoom levels, or 0 if a file could not
+ *                     be written
+ */
+unsigned int render_draw_pyramid(const struct isomap *isomap,
+                                 const char *directory,
+                                 unsigned int tile_size,
+                                 int png_level,
+                                 unsigned int num_threads,
+                                 enum render_backend backend);
+
+#endif
@@ -0,0 +1,136 @@
+#include "rle.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Help functions //
+// -------------- //
+
+/**
+ * Copy the runs of a sequence if they are stored in borrowed memory
+ *
+ * @param rle  The sequence
+ */
+void rle_own(struct rle *rle) {
+    if (!rle->borrowed) return;
+    unsigned long *starts = malloc(rle->capacity * sizeof(unsigned long));
+    tile_id *values = malloc(rle->capacity * sizeof(tile_id));
+    memcpy(starts, rle->starts, rle->num_runs * sizeof(unsigned long));
+    memcpy(values, rle->values, rle->num_runs * sizeof(tile_id));
+    rle->starts = starts;
+    rle->values = values;
+    rle->borrowed = false;
+}
+
+/**
+ * Make sure a sequence can store a given number of runs
+ *
+ * @param rle       The sequence
+ * @param num_runs  The number of runs
+ */
+void rle_reserve(struct rle *rle, unsigned int num_runs) {
+    if (num_runs <= rle->capacity) return;
+    while (rle->capacity < num_runs)
+        rle->capacity *= 2;
+    rle->starts = realloc(rle->starts, rle->capacity * sizeof(unsigned long));
+    rle->values = realloc(rle->values, rle->capacity * sizeof(tile_id));
+}
+
+// Functions //
+// --------- //
+
+struct rle *rle_create(unsigned long length) {
+    struct rle *rle = malloc(sizeof(struct rle));
+    rle->starts = malloc(sizeof(unsigned long));
+    rle->values = malloc(sizeof(tile_id));
+    rle->starts[0] = 0;
+    rle->values[0] = 0;
+    rle->num_runs = 1;
+    rle->capacity = 1;
+    rle->length = length;
+    rle->borrowed = false;
+    return rle;
+}
+
+struct rle *rle_create_borrowed(unsigned long *starts,
+                                tile_id *values,
+                                unsigned int num_runs,
+                                unsigned long length) {
+    struct rle *rle = malloc(sizeof(struct rle));
+    rle->starts = starts;
+    rle->values = values;
+    rle->num_runs = num_runs;
+    rle->capacity = num_runs;
+    rle->length = length;
+    rle->borrowed = true;
+    return rle;
+}
+
+void rle_delete(struct rle *rle) {
+    if (!rle->borrowed) {
+        free(rle->starts);
+        free(rle->values);
+    }
+    free(rle);
+}
+
+unsigned int rle_find_run(const struct rle *rle, unsigned long index) {
+    unsigned int low = 0, high = rle->num_runs;
+    while (high - low > 1) {
+        unsigned int middle = low + (high - low) / 2;
+        if (rle->starts[middle] <= index)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+unsigned long rle_run_end(const struct rle *rle, unsigned int run) {
+    return run + 1 < rle->num_runs ? rle->starts[run + 1] : rle->length;
+}
+
+tile_id rle_get(const struct rle *rle, unsigned long index) {
+    return rle->values[rle_find_run(rle, index)];
+}
+
+void rle_set(struct rle *rle, unsigned long index, tile_id tile) {
+    unsigned int i = rle_find_run(rle, index);
+    if (rle->values[i] == tile) return;
+    rle_own(rle);
+    // The runs first..last are replaced by at most 5 runs
+    unsigned int first = i > 0 ? i - 1 : i;
+    unsigned int last = i + 1 < rle->num_runs ? i + 1 : i;
+    unsigned long piece_starts[5] = {
+        rle->starts[first], rle->starts[i], index, index + 1, rle->starts[last]
+    };
+    unsigned long piece_ends[5] = {
+        rle->starts[i], index, index + 1, rle_run_end(rle, i),
+        rle_run_end(rle, last)
+    };
+    tile_id piece_values[5] = {
+        rle->values[first], rle->values[i], tile, rle->values[i],
+        rle->values[last]
+    };
+    unsigned long starts[5];
+    tile_id values[5];
+    unsigned int n = 0;
+    for (unsigned int p = 0; p < 5; ++p) {
+        if ((p == 0 && first == i) || (p == 4 && last == i)) continue;
+        if (piece_starts[p] >= piece_ends[p]) continue;
+        if (n > 0 && values[n - 1] == piece_values[p]) continue;
+        starts[n] = piece_starts[p];
+        values[n] = piece_values[p];
+        ++n;
+    }
+    unsigned int removed = last - first + 1;
+    unsigned int num_runs = rle->num_runs - removed + n;
+    rle_reserve(rle, num_runs);
+    unsigned int tail = rle->num_runs - last - 1;
+    memmove(rle->starts + first + n, rle->starts + last + 1,
+            tail * sizeof(unsigned long));
+    memmove(rle->values + first + n, rle->values + last + 1,
+            tail * sizeof(tile_id));
+    memcpy(rle->starts + first, starts, n * sizeof(unsigned long));
+    memcpy(rle->values + first, values, n * sizeof(tile_id));
+    rle->num_runs = num_runs;
+}
@@ -0,0 +1,129 @@
+/**
+ * rle.h
+ *
+ * Handle run-length compressed sequences of tiles.
+ *
+ * The cells of a layer, enumerated row by row, are split into maximal runs of
+ * consecutive cells having the same tile. Each run is stored by its first
+ * index and its tile, so that a layer made of long runs of the same tile (for
+ * instance, flat ground or empty air) only uses a few bytes per run instead of
+ * a few bytes per cell:
+ *
+ *     cells:  2 2 2 2 0 0 0 0 0 0 3 2 2
+ *     runs:   (0,2)   (4,0)       (10,3) (11,2)
+ *
+ * Retrieving the tile of a cell is done by a binary search on the runs, hence
+ * in logarithmic time. Modifying a cell may require to split or merge runs,
+ * which takes linear time in the number of runs: the representation is meant
+ * to be read-mostly.
+ *
+ * The runs can also be stored in memory that is not owned by the sequence
+ * (for instance, a memory-mapped file). In that case, they are copied the
+ * first time the sequence is modified.
+ *
+ * The module provides the following data structure:
+ *
+ * - `struct rle`: a run-length compressed sequence of tiles
+ */
+#ifndef RLE_H
+#define RLE_H
+
+#include "map.h"
+
+#include <stdbool.h>
+
+// Types //
+// ----- //
+
+/**
+ * A run-length compressed sequence of tiles
+ *
+ * Invariants:
+ *
+ * * There is always at least one run and `starts[0]` is 0
+ * * The starts are strictly increasing and smaller than `length`
+ * * Two consecutive runs always have different tiles
+ */
+struct rle {
+    unsigned long *starts;  // The index of the first cell of each run
+    tile_id *values;        // The tile of each run
+    unsigned int num_runs;  // The number of runs
+    unsigned int capacity;  // The runs capacity
+    unsigned long length;   // The number of cells
+    bool borrowed;          // True if the runs are not owned
+};
+
+// Functions //
+// --------- //
+
+/**
+ * Create a sequence of empty tiles
+ *
+ * @param length  The number of cells
+ * @return        The sequence
+ */
+struct rle *rle_create(unsigned long length);
+
+/**
+ * Create a sequence from runs stored in borrowed memory
+ *
+ * The memory is not owned by the sequence and must outlive it. It is never
+ * written to: it is copied the first time the sequence is modified.
+ *
+ * @param starts    The index of the first cell of each run
+ * @param values    The tile of each run
+ * @param num_runs  The number of runs (at least 1)
+ * @param length    The number of cells
+ * @return          The sequence
+ */
+struct rle *rle_create_borrowed(unsigned long *starts,
+                                tile_id *values,
+                                unsigned int num_runs,
+                                unsigned long length);
+
+/**
+ * Delete a sequence
+ *
+ * @param rle  The sequence to delete
+ */
+void rle_delete(struct rle *rle);
+
+/**
+ * Return the index of the run containing a cell
+ *
+ * @param rle    The sequence
+ * @param index  The index of the cell
+ * @return       The index of the run
+ */
+unsigned int rle_find_run(const struct rle *rle, unsigned long index);
+
+/**
+ * Return the index following the last cell of a run
+ *
+ * @param rle  The sequence
+ * @param run  The index of the run
+ * @return     The end of the run
+ */
+unsigned long rle_run_end(const struct rle *rle, unsigned int run);
+
+/**
+ * Return the tile of a cell
+ *
+ * @param rle    The sequence
+ * @param index  The index of the cell
+ * @return       The tile
+ */
+tile_id rle_get(const struct rle *rle, unsigned long index);
+
+/**
+ * Set the tile of a cell
+ *
+ * Runs are split and merged so that the invariants are preserved.
+ *
+ * @param rle    The sequence
+ * @param index  The index of the cell
+ * @param tile   The tile
+ */
+void rle_set(struct rle *rle, unsigned long index, tile_id tile);
+
+#endif
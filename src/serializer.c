@@ -0,0 +1,167 @@
+#include "serializer.h"
+#include <string.h>
+
+// Help functions //
+// -------------- //
+
+/**
+ * Start a record of a given type
+ *
+ * @param serializer  The serializer
+ * @param type        The type of the record
+ */
+void serializer_start_record(struct serializer *serializer,
+                             const char *type) {
+    if (serializer->format == SERIALIZER_JSON)
+        writer_put_string(&serializer->writer,
+                          serializer->num_records == 0 ? "[\n" : ",\n");
+    writer_put_string(&serializer->writer, "{\"type\": \"");
+    writer_put_string(&serializer->writer, type);
+    writer_put_char(&serializer->writer, '"');
+    ++serializer->num_records;
+}
+
+/**
+ * End the current record
+ *
+ * @param serializer  The serializer
+ */
+void serializer_end_record(struct serializer *serializer) {
+    writer_put_char(&serializer->writer, '}');
+    if (serializer->format == SERIALIZER_NDJSON)
+        writer_put_char(&serializer->writer, '\n');
+}
+
+/**
+ * Write a key of the current record and the separator following it
+ *
+ * @param serializer  The serializer
+ * @param key         The key
+ */
+void serializer_put_key(struct serializer *serializer, const char *key) {
+    writer_put_string(&serializer->writer, ", \"");
+    writer_put_string(&serializer->writer, key);
+    writer_put_string(&serializer->writer, "\": ");
+}
+
+/**
+ * Write a location as an array [X,Y,Z]
+ *
+ * @param serializer  The serializer
+ * @param location    The location
+ */
+void serializer_put_location(struct serializer *serializer,
+                             const struct location *location) {
+    writer_put_char(&serializer->writer, '[');
+    writer_put_integer(&serializer->writer, location->x);
+    writer_put_char(&serializer->writer, ',');
+    writer_put_integer(&serializer->writer, location->y);
+    writer_put_char(&serializer->writer, ',');
+    writer_put_integer(&serializer->writer, location->z);
+    writer_put_char(&serializer->writer, ']');
+}
+
+/**
+ * Write the start, end and distance of a walk in the current record
+ *
+ * @param serializer  The serializer
+ * @param start       The start location
+ * @param end         The end location
+ * @param walk        A shortest walk from start to end (or NULL)
+ */
+void serializer_put_distance(struct serializer *serializer,
+                             const struct location *start,
+                             const struct location *end,
+                             const struct graph_walk *walk) {
+    serializer_put_key(serializer, "start");
+    serializer_put_location(serializer, start);
+    serializer_put_key(serializer, "end");
+    serializer_put_location(serializer, end);
+    serializer_put_key(serializer, "distance");
+    writer_put_integer(&serializer->writer,
+                       walk == NULL ? -1 : (long long)walk->num_nodes - 1);
+}
+
+// Functions //
+// --------- //
+
+bool serializer_format_by_name(const char *name,
+                               enum serializer_format *format) {
+    static const char *names[] = {"json", "ndjson"};
+    for (unsigned int f = 0; f < sizeof(names) / sizeof(names[0]); ++f) {
+        if (strcmp(name, names[f]) == 0) {
+            *format = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+void serializer_initialize(struct serializer *serializer,
+                           FILE *stream,
+                           enum serializer_format format) {
+    serializer->format = format;
+    serializer->num_records = 0;
+    writer_initialize(&serializer->writer, stream);
+}
+
+void serializer_write_graph(struct serializer *serializer,
+                            const struct graph *graph) {
+    serializer_start_record(serializer, "graph");
+    serializer_put_key(serializer, "layers");
+    writer_put_integer(&serializer->writer, graph->map->num_layers);
+    serializer_put_key(serializer, "nodes");
+    writer_put_integer(&serializer->writer, graph->num_nodes);
+    serializer_put_key(serializer, "edges");
+    writer_put_integer(&serializer->writer, graph_num_edges(graph));
+    serializer_end_record(serializer);
+}
+
+void serializer_write_walk(struct serializer *serializer,
+                           const struct location *start,
+                           const struct location *end,
+                           const struct graph_walk *walk) {
+    serializer_start_record(serializer, "walk");
+    serializer_put_distance(serializer, start, end, walk);
+    serializer_put_key(serializer, "nodes");
+    if (walk == NULL) {
+        writer_put_string(&serializer->writer, "null");
+    } else {
+        writer_put_char(&serializer->writer, '[');
+        for (unsigned int i = 0; i < walk->num_nodes; ++i) {
+            if (i > 0) writer_put_char(&serializer->writer, ',');
+            serializer_put_location(serializer, &walk->nodes[i]->location);
+        }
+        writer_put_char(&serializer->writer, ']');
+    }
+    serializer_end_record(serializer);
+}
+
+void serializer_write_distance(struct serializer *serializer,
+                               const struct location *start,
+                               const struct location *end,
+                               const struct graph_walk *walk) {
+    serializer_start_record(serializer, "distance");
+    serializer_put_distance(serializer, start, end, walk);
+    serializer_end_record(serializer);
+}
+
+void serializer_write_error(struct serializer *serializer,
+                            unsigned long line,
+                            const char *message) {
+    serializer_start_record(serializer, "error");
+    serializer_put_key(serializer, "line");
+    writer_put_integer(&serializer->writer, line);
+    serializer_put_key(serializer, "message");
+    writer_put_char(&serializer->writer, '"');
+    writer_put_string(&serializer->writer, message);
+    writer_put_char(&serializer->writer, '"');
+    serializer_end_record(serializer);
+}
+
+void serializer_finish(struct serializer *serializer) {
+    if (serializer->format == SERIALIZER_JSON)
+        writer_put_string(&serializer->writer,
+                          serializer->num_records == 0 ? "[\n]\n" : "\n]\n");
+    writer_flush(&serializer->writer);
+}
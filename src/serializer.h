@@ -0,0 +1,141 @@
+/**
+ * serializer.h
+ *
+ * Write the results of queries about an isomap as JSON records.
+ *
+ * Each result (a summary of the graph of the map, a walk, a distance or an
+ * error) is a JSON object, called a record, whose key `type` tells which kind
+ * of result it is. For instance:
+ *
+ *     {"type": "graph", "layers": 2, "nodes": 9, "edges": 24}
+ *     {"type": "walk", "start": [0,0,1], "end": [2,2,1], "distance": 4,
+ *      "nodes": [[0,0,1],[0,1,0],[0,2,0],[1,2,0],[2,2,1]]}
+ *     {"type": "distance", "start": [0,0,1], "end": [9,9,0], "distance": -1}
+ *     {"type": "error", "line": 3, "message": "expected two locations X,Y,Z"}
+ *
+ * (the walk record is on a single line). The distance is the number of moves
+ * of a shortest walk, or -1 if there is none, in which case the nodes of a
+ * walk record are `null`.
+ *
+ * The records are written as soon as they are given, through a writer (see
+ * `writer.h`), without building any document in memory. In the `ndjson`
+ * format, each record is written on its own line. In the `json` format, the
+ * records are the elements of an array, one per line, so that the whole
+ * output is a single JSON document once `serializer_finish` is called.
+ *
+ * The module provides the following data structures:
+ *
+ * - `enum serializer_format`: the format of the records
+ * - `struct serializer`: a serializer of records to a stream
+ */
+#ifndef SERIALIZER_H
+#define SERIALIZER_H
+
+#include "graph.h"
+#include "writer.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// Types //
+// ----- //
+
+/**
+ * The format of the records
+ */
+enum serializer_format {
+    SERIALIZER_JSON,   // A JSON array of records
+    SERIALIZER_NDJSON  // One JSON record per line
+};
+
+/**
+ * A serializer of records to a stream
+ */
+struct serializer {
+    enum serializer_format format; // The format of the records
+    unsigned long num_records;     // The number of records written
+    struct writer writer;          // The writer to the stream
+};
+
+// Functions //
+// --------- //
+
+/**
+ * Return the record format associated with a name
+ *
+ * The names are "json" and "ndjson".
+ *
+ * @param name    The name of the format
+ * @param format  The format, set by the function
+ * @return        True if the name is known
+ */
+bool serializer_format_by_name(const char *name,
+                               enum serializer_format *format);
+
+/**
+ * Initialize a serializer writing records to a stream
+ *
+ * @param serializer  The serializer
+ * @param stream      The stream
+ * @param format      The format of the records
+ */
+void serializer_initialize(struct serializer *serializer,
+                           FILE *stream,
+                           enum serializer_format format);
+
+/**
+ * Write the summary of a graph
+ *
+ * @param serializer  The serializer
+ * @param graph       The graph
+ */
+void serializer_write_graph(struct serializer *serializer,
+                            const struct graph *graph);
+
+/**
+ * Write a walk between two locations
+ *
+ * @param serializer  The serializer
+ * @param start       The start location
+ * @param end         The end location
+ * @param walk        A shortest walk from start to end (or NULL)
+ */
+void serializer_write_walk(struct serializer *serializer,
+                           const struct location *start,
+                           const struct location *end,
+                           const struct graph_walk *walk);
+
+/**
+ * Write the distance between two locations
+ *
+ * @param serializer  The serializer
+ * @param start       The start location
+ * @param end         The end location
+ * @param walk        A shortest walk from start to end (or NULL)
+ */
+void serializer_write_distance(struct serializer *serializer,
+                               const struct location *start,
+                               const struct location *end,
+                               const struct graph_walk *walk);
+
+/**
+ * Write an error about a line of queries
+ *
+ * The message is written as is, so that it must not contain any character
+ * to be escaped in a JSON string.
+ *
+ * @param serializer  The serializer
+ * @param line        The number of the line, starting from 1
+ * @param message     The message
+ */
+void serializer_write_error(struct serializer *serializer,
+                            unsigned long line,
+                            const char *message);
+
+/**
+ * Finish the output of a serializer and flush it to its stream
+ *
+ * @param serializer  The serializer
+ */
+void serializer_finish(struct serializer *serializer);
+
+#endif
@@ -0,0 +1,643 @@
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+#include "graph.h"
+#include "queue.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_BACKLOG 64
+#define SERVER_HEADER_LENGTH 32
+#define SERVER_FORMAT_LENGTH 8
+
+// Types //
+// ----- //
+
+/**
+ * A connection to a client
+ *
+ * Only the event loop uses a client, except its response and its shutdown
+ * flag, which are set by a worker while the client is busy.
+ */
+struct server_client {
+    int fd;                                       // The socket
+    char input[SERVER_MAX_REQUEST_LENGTH];        // The bytes received
+    unsigned int input_length;                    // The number of bytes received
+    char request[SERVER_MAX_REQUEST_LENGTH + 1];  // The request being handled
+    char *output;                                 // The response (or NULL)
+    size_t output_length;                         // The length of the response
+    size_t num_sent;                              // The number of bytes sent
+    bool busy;                                    // Request handled by a worker?
+    bool closed;                                  // No more bytes to receive?
+    bool shutdown;                                // Request to stop the server?
+};
+
+/**
+ * A server answering requests about an isomap
+ */
+struct server {
+    const struct isomap *isomap;        // The isomap
+    struct graph *graph;                // The graph of the map
+    enum render_backend backend;        // The backend drawing the tiles
+    int listen_fd;                      // The listening socket
+    int wake[2];                        // A pipe waking up the event loop
+    pthread_mutex_t mutex;              // The mutex of the queues
+    pthread_cond_t cond;                // Signaled when a job is added
+    queue jobs;                         // The clients waiting for a worker
+    queue done;                         // The clients whose response is ready
+    bool closing;                       // Must the workers stop?
+    bool stopping;                      // Must the event loop stop?
+    struct server_client **clients;     // The connected clients
+    unsigned int num_clients;           // The number of clients
+    unsigned int capacity;              // The capacity of the clients
+};
+
+// Signals //
+// ------- //
+
+static volatile sig_atomic_t server_signaled = 0;
+static int server_signal_fd = -1;
+
+/**
+ * Wake up the event loop when a termination signal is received
+ *
+ * @param signal  The signal
+ */
+void server_handle_signal(int signal) {
+    (void)signal;
+    int saved_errno = errno;
+    server_signaled = 1;
+    ssize_t written = write(server_signal_fd, "", 1);
+    (void)written;
+    errno = saved_errno;
+}
+
+// Help functions //
+// -------------- //
+
+/**
+ * Make a file descriptor non-blocking
+ *
+ * @param fd  The file descriptor
+ * @return    True if no error occurred
+ */
+bool server_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/**
+ * Set the response of a client
+ *
+ * @param client   The client
+ * @param ok       True if the request succeeded
+ * @param payload  The bytes following the header
+ * @param length   The number of bytes of the payload
+ */
+void server_respond(struct server_client *client, bool ok,
+                    const char *payload, size_t length) {
+    char header[SERVER_HEADER_LENGTH];
+    int header_length = snprintf(header, SERVER_HEADER_LENGTH, "%s %zu\n",
+                                 ok ? "OK" : "ERROR", length);
+    client->output = malloc(header_length + length);
+    memcpy(client->output, header, header_length);
+    memcpy(client->output + header_length, payload, length);
+    client->output_length = header_length + length;
+    client->num_sent = 0;
+}
+
+/**
+ * Set the response of a client to an error message
+ *
+ * @param client   The client
+ * @param message  The message, without the end of line
+ */
+void server_respond_error(struct server_client *client, const char *message) {
+    char payload[SERVER_MAX_REQUEST_LENGTH + 64];
+    int length = snprintf(payload, sizeof(payload), "%s\n", message);
+    server_respond(client, false, payload,
+                   (size_t)length < sizeof(payload) ? (size_t)length
+                                                    : sizeof(payload) - 1);
+}
+
+/**
+ * Answer a walk or distance request
+ *
+ * @param server    The server
+ * @param client    The client
+ * @param args      The arguments of the request
+ * @param distance  True if only the distance is requested
+ */
+void server_handle_walk(struct server *server, struct server_client *client,
+                        const char *args, bool distance) {
+    struct location start, end;
+    char tail;
+    if (sscanf(args, " %d,%d,%d %d,%d,%d %c", &start.x, &start.y, &start.z,
+               &end.x, &end.y, &end.z, &tail) != 6) {
+        server_respond_error(client, "expected two locations X,Y,Z");
+        return;
+    }
+    struct graph_walk *walk = graph_shortest_walk(server->graph, &start, &end);
+    char *payload;
+    size_t length;
+    FILE *stream = open_memstream(&payload, &length);
+    if (distance) {
+        fprintf(stream, "%d\n", walk == NULL ? -1 : (int)walk->num_nodes - 1);
+    } else if (walk != NULL) {
+        fprintf(stream, "A ");
+        graph_print_walk(stream, walk, "");
+    } else {
+        fprintf(stream, "No walk between ");
+        geometry_print_location(stream, &start);
+        fprintf(stream, " and ");
+        geometry_print_location(stream, &end);
+        fprintf(stream, "\n");
+    }
+    fclose(stream);
+    if (walk != NULL) graph_delete_walk(walk);
+    server_respond(client, true, payload, length);
+    free(payload);
+}
+
+/**
+ * Answer a render request
+ *
+ * @param server  The server
+ * @param client  The client
+ * @param args    The arguments of the request
+ */
+void server_handle_render(struct server *server, struct server_client *client,
+                          const char *args) {
+    struct render_viewport viewport;
+    int width, height, level = ENCODER_DEFAULT_LEVEL;
+    char name[SERVER_FORMAT_LENGTH] = "png", tail;
+    enum encoder_format format = ENCODER_PNG;
+    int num_parsed = sscanf(args, " %d,%d,%d,%d %7s %d %c",
+                            &viewport.x, &viewport.y, &width, &height, name,
+                            &level, &tail);
+    if (num_parsed < 4 || num_parsed > 6 ||
+        width <= 0 || width > SERVER_MAX_VIEWPORT_SIZE ||
+        height <= 0 || height > SERVER_MAX_VIEWPORT_SIZE) {
+        server_respond_error(client, "expected a viewport X,Y,W,H with W and H "
+                                     "between 1 and 16384");
+    } else if (!encoder_format_by_name(name, &format)) {
+        server_respond_error(client, "expected a format png, raw, ppm, pam "
+                                     "or qoi");
+    } else if (level < 0 || level > 9) {
+        server_respond_error(client, "expected a PNG level between 0 and 9");
+    } else {
+        viewport.width = width;
+        viewport.height = height;
+        char *payload;
+        size_t length;
+        FILE *stream = open_memstream(&payload, &length);
+        bool written = render_draw_to_stream(server->isomap, &viewport, stream,
+                                             format, level, 1,
+                                             server->backend);
+        fclose(stream);
+        if (written)
+            server_respond(client, true, payload, length);
+        else
+            server_respond_error(client, "cannot encode the image");
+        free(payload);
+    }
+}
+
+/**
+ * Answer the current request of a client
+ *
+ * @param server  The server
+ * @param client  The client
+ */
+void server_handle(struct server *server, struct server_client *client) {
+    char command[SERVER_MAX_REQUEST_LENGTH + 1];
+    int offset = 0;
+    if (sscanf(client->request, "%s%n", command, &offset) != 1) {
+        server_respond_error(client, "empty request");
+        return;
+    }
+    const char *args = client->request + offset;
+    char tail;
+    if (strcmp(command, "WALK") == 0) {
+        server_handle_walk(server, client, args, false);
+    } else if (strcmp(command, "DISTANCE") == 0) {
+        server_handle_walk(server, client, args, true);
+    } else if (strcmp(command, "RENDER") == 0) {
+        server_handle_render(server, client, args);
+    } else if (sscanf(args, " %c", &tail) == 1 &&
+               (strcmp(command, "PING") == 0 ||
+                strcmp(command, "SHUTDOWN") == 0)) {
+        server_respond_error(client, "expected no arguments");
+    } else if (strcmp(command, "PING") == 0) {
+        server_respond(client, true, "PONG\n", 5);
+    } else if (strcmp(command, "SHUTDOWN") == 0) {
+        server_respond(client, true, "", 0);
+        client->shutdown = true;
+    } else {
+        char message[SERVER_MAX_REQUEST_LENGTH + 32];
+        snprintf(message, sizeof(message), "unknown command %s", command);
+        server_respond_error(client, message);
+    }
+}
+
+/**
+ * Answer the requests of the queue of jobs, until the server stops
+ *
+ * @param data  The server
+ * @return      NULL
+ */
+void *server_work(void *data) {
+    struct server *server = data;
+    pthread_mutex_lock(&server->mutex);
+    while (true) {
+        while (queue_is_empty(&server->jobs) && !server->closing)
+            pthread_cond_wait(&server->cond, &server->mutex);
+        if (queue_is_empty(&server->jobs))
+            break;
+        struct server_client *client = queue_pop(&server->jobs);
+        pthread_mutex_unlock(&server->mutex);
+        server_handle(server, client);
+        pthread_mutex_lock(&server->mutex);
+        queue_push(&server->done, client);
+        ssize_t written = write(server->wake[1], "", 1);
+        (void)written;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    return NULL;
+}
+
+/**
+ * Give the next complete request of a client to the workers
+ *
+ * A request longer than `SERVER_MAX_REQUEST_LENGTH` is answered with an
+ * error, and the connection is closed once the error is sent.
+ *
+ * @param server  The server
+ * @param client  The client, which is neither busy nor sending a response
+ */
+void server_dispatch(struct server *server, struct server_client *client) {
+    char *end = memchr(client->input, '\n', client->input_length);
+    if (end == NULL) {
+        if (client->input_length == SERVER_MAX_REQUEST_LENGTH) {
+            server_respond_error(client, "request too long");
+            client->input_length = 0;
+            client->closed = true;
+        }
+        return;
+    }
+    unsigned int length = end - client->input;
+    memcpy(client->request, client->input, length);
+    if (length > 0 && client->request[length - 1] == '\r')
+        --length;
+    client->request[length] = '\0';
+    client->input_length -= end + 1 - client->input;
+    memmove(client->input, end + 1, client->input_length);
+    client->busy = true;
+    pthread_mutex_lock(&server->mutex);
+    queue_push(&server->jobs, client);
+    pthread_cond_signal(&server->cond);
+    pthread_mutex_unlock(&server->mutex);
+}
+
+/**
+ * Accept the pending connections
+ *
+ * @param server  The server
+ */
+void server_accept(struct server *server) {
+    int fd;
+    while ((fd = accept(server->listen_fd, NULL, NULL)) >= 0) {
+        if (!server_set_nonblocking(fd)) {
+            close(fd);
+            continue;
+        }
+        if (server->num_clients == server->capacity) {
+            server->capacity *= 2;
+            server->clients = realloc(server->clients, server->capacity *
+                                      sizeof(struct server_client*));
+        }
+        struct server_client *client = malloc(sizeof(struct server_client));
+        client->fd = fd;
+        client->input_length = 0;
+        client->output = NULL;
+        client->busy = false;
+        client->closed = false;
+        client->shutdown = false;
+        server->clients[server->num_clients++] = client;
+    }
+}
+
+/**
+ * Receive the available bytes of a client
+ *
+ * @param client  The client
+ */
+void server_receive(struct server_client *client) {
+    ssize_t n = recv(client->fd, client->input + client->input_length,
+                     SERVER_MAX_REQUEST_LENGTH - client->input_length, 0);
+    if (n > 0)
+        client->input_length += n;
+    else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+                        errno != EINTR))
+        client->closed = true;
+}
+
+/**
+ * Send as much of the response of a client as possible
+ *
+ * @param server  The server
+ * @param client  The client
+ */
+void server_send(struct server *server, struct server_client *client) {
+    ssize_t n = send(client->fd, client->output + client->num_sent,
+                     client->output_length - client->num_sent, MSG_NOSIGNAL);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+    if (n < 0) {
+        client->closed = true;
+        client->input_length = 0;
+    } else {
+        client->num_sent += n;
+        if (client->num_sent < client->output_length)
+            return;
+        server->stopping = server->stopping || client->shutdown;
+    }
+    free(client->output);
+    client->output = NULL;
+}
+
+/**
+ * Take back the clients whose response is ready
+ *
+ * @param server  The server
+ */
+void server_collect(struct server *server) {
+    char bytes[64];
+    while (read(server->wake[0], bytes, sizeof(bytes)) > 0);
+    pthread_mutex_lock(&server->mutex);
+    while (!queue_is_empty(&server->done)) {
+        struct server_client *client = queue_pop(&server->done);
+        client->busy = false;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    server->stopping = server->stopping || server_signaled;
+}
+
+/**
+ * Delete a client and close its connection
+ *
+ * @param client  The client
+ */
+void server_delete_client(struct server_client *client) {
+    close(client->fd);
+    free(client->output);
+    free(client);
+}
+
+/**
+ * Handle the connections until the server stops
+ *
+ * @param server  The server
+ */
+void server_loop(struct server *server) {
+    unsigned int fd_capacity = 2;
+    struct pollfd *fds = malloc(fd_capacity * sizeof(struct pollfd));
+    while (!server->stopping) {
+        unsigned int num_fds = 2 + server->num_clients;
+        if (num_fds > fd_capacity) {
+            while (num_fds > fd_capacity) fd_capacity *= 2;
+            fds = realloc(fds, fd_capacity * sizeof(struct pollfd));
+        }
+        fds[0] = (struct pollfd){server->listen_fd, POLLIN, 0};
+        fds[1] = (struct pollfd){server->wake[0], POLLIN, 0};
+        for (unsigned int i = 0; i < server->num_clients; ++i) {
+            const struct server_client *client = server->clients[i];
+            short events = client->busy ? 0 :
+                           client->output != NULL ? POLLOUT :
+                           client->closed ? 0 : POLLIN;
+            fds[2 + i] = (struct pollfd){events == 0 ? -1 : client->fd,
+                                         events, 0};
+        }
+        if (poll(fds, num_fds, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            server_collect(server);
+        for (unsigned int i = 0; i + 2 < num_fds; ++i) {
+            struct server_client *client = server->clients[i];
+            if (fds[2 + i].revents & POLLOUT)
+                server_send(server, client);
+            else if (fds[2 + i].revents & (POLLIN | POLLHUP | POLLERR))
+                server_receive(client);
+        }
+        if (fds[0].revents & POLLIN)
+            server_accept(server);
+        for (unsigned int i = server->num_clients; i > 0; --i) {
+            struct server_client *client = server->clients[i - 1];
+            if (client->busy || client->output != NULL)
+                continue;
+            server_dispatch(server, client);
+            if (!client->busy && client->output == NULL && client->closed) {
+                server_delete_client(client);
+                server->clients[i - 1] =
+                    server->clients[--server->num_clients];
+            }
+        }
+    }
+    free(fds);
+}
+
+/**
+ * Create the listening socket of a server
+ *
+ * @param socket_path  The path of the socket
+ * @return             The file descriptor of the socket, or -1 if an error
+ *                     occurred
+ */
+int server_listen(const char *socket_path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+        return -1;
+    strcpy(address.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, SERVER_BACKLOG) != 0 || !server_set_nonblocking(fd)) {
+        close(fd);
+        unlink(socket_path);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Write all bytes to a connection, waiting as needed
+ *
+ * @param fd      The file descriptor of the connection
+ * @param bytes   The bytes
+ * @param length  The number of bytes
+ * @return        True if all bytes were written
+ */
+bool server_write_all(int fd, const char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t n = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        length -= n;
+    }
+    return true;
+}
+
+/**
+ * Read a given number of bytes from a connection, waiting as needed
+ *
+ * @param fd      The file descriptor of the connection
+ * @param bytes   The bytes, set by the function
+ * @param length  The number of bytes
+ * @return        True if all bytes were read
+ */
+bool server_read_all(int fd, char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t n = recv(fd, bytes, length, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Functions //
+// --------- //
+
+bool server_run(struct isomap *isomap,
+                const char *socket_path,
+                unsigned int num_workers,
+                enum render_backend backend) {
+    int listen_fd = server_listen(socket_path);
+    if (listen_fd < 0)
+        return false;
+    if (num_workers == 0) num_workers = 1;
+    struct server server = {
+        .isomap      = isomap,
+        .backend     = backend,
+        .listen_fd   = listen_fd,
+        .closing     = false,
+        .stopping    = false,
+        .clients     = malloc(sizeof(struct server_client*)),
+        .num_clients = 0,
+        .capacity    = 1
+    };
+    if (pipe(server.wake) != 0) {
+        close(listen_fd);
+        unlink(socket_path);
+        free(server.clients);
+        return false;
+    }
+    server_set_nonblocking(server.wake[0]);
+    server_set_nonblocking(server.wake[1]);
+    for (unsigned int i = 0; i < isomap->tileset->num_tiles; ++i)
+        tile_get_image(isomap->tileset, isomap->tileset->tiles + i);
+    server.graph = graph_create(isomap->map, isomap->tileset);
+    pthread_mutex_init(&server.mutex, NULL);
+    pthread_cond_init(&server.cond, NULL);
+    queue_initialize(&server.jobs);
+    queue_initialize(&server.done);
+    pthread_t workers[num_workers];
+    for (unsigned int w = 0; w < num_workers; ++w)
+        pthread_create(workers + w, NULL, server_work, &server);
+
+    struct sigaction action, old_int, old_term;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = server_handle_signal;
+    sigemptyset(&action.sa_mask);
+    server_signaled = 0;
+    server_signal_fd = server.wake[1];
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+    server_loop(&server);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+
+    pthread_mutex_lock(&server.mutex);
+    server.closing = true;
+    pthread_cond_broadcast(&server.cond);
+    pthread_mutex_unlock(&server.mutex);
+    for (unsigned int w = 0; w < num_workers; ++w)
+        pthread_join(workers[w], NULL);
+    for (unsigned int i = 0; i < server.num_clients; ++i)
+        server_delete_client(server.clients[i]);
+    free(server.clients);
+    queue_delete(&server.jobs);
+    queue_delete(&server.done);
+    pthread_cond_destroy(&server.cond);
+    pthread_mutex_destroy(&server.mutex);
+    graph_delete(server.graph);
+    close(server.wake[0]);
+    close(server.wake[1]);
+    close(listen_fd);
+    unlink(socket_path);
+    return true;
+}
+
+int server_connect(const char *socket_path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+        return -1;
+    strcpy(address.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 &&
+        connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+bool server_request(int fd,
+                    const char *request,
+                    char **response,
+                    size_t *length) {
+    *response = NULL;
+    *length = 0;
+    if (!server_write_all(fd, request, strlen(request)) ||
+        !server_write_all(fd, "\n", 1))
+        return false;
+    char header[SERVER_HEADER_LENGTH];
+    unsigned int n = 0;
+    while (true) {
+        if (n == SERVER_HEADER_LENGTH - 1 || !server_read_all(fd, header + n, 1))
+            return false;
+        if (header[n] == '\n') break;
+        ++n;
+    }
+    header[n] = '\0';
+    char status[SERVER_FORMAT_LENGTH];
+    size_t size;
+    if (sscanf(header, "%7s %zu", status, &size) != 2)
+        return false;
+    char *bytes = malloc(size + 1);
+    if (!server_read_all(fd, bytes, size)) {
+        free(bytes);
+        return false;
+    }
+    bytes[size] = '\0';
+    *response = bytes;
+    *length = size;
+    return strcmp(status, "OK") == 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * server.h
+ *
+ * Answer queries about an isomap over a Unix domain socket.
+ *
+ * The isomap is loaded once, its graph is built once and its tile images are
+ * decoded once, then the server answers the requests of any number of
+ * clients until it receives a `SHUTDOWN` request or a termination signal.
+ * The connections are handled by an event loop (see `poll(2)`), which reads
+ * the requests and writes the responses without blocking, while the requests
+ * themselves are handled by a pool of worker threads. The requests of a
+ * client are handled one at a time and answered in order, but the requests
+ * of different clients are handled concurrently.
+ *
+ * A request is a line of text, made of a command and its arguments separated
+ * by spaces:
+ *
+ * - `WALK X,Y,Z X,Y,Z`: a shortest walk between two locations, printed as
+ *   with the `-w` option
+ * - `DISTANCE X,Y,Z X,Y,Z`: the number of moves of a shortest walk between
+ *   two locations, or -1 if there is none
+ * - `RENDER X,Y,W,H [FORMAT [LEVEL]]`: the image of a viewport, in one of the
+ *   formats of `encoder.h` (png by default), with the given PNG compression
+ *   level
+ * - `PING`: the text `PONG`
+ * - `SHUTDOWN`: stop the server once the response is sent
+ *
+ * A response is a header line `OK LENGTH` or `ERROR LENGTH`, followed by
+ * LENGTH bytes: the result of the request, or an error message. Several
+ * requests can be sent without waiting for their responses.
+ *
+ * The module also provides the functions needed by a client to send requests
+ * to a server and wait for their responses.
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "isomap.h"
+#include "render.h"
+#include <stddef.h>
+
+#define SERVER_MAX_REQUEST_LENGTH 1024
+#define SERVER_MAX_VIEWPORT_SIZE 16384
+
+// Functions //
+// --------- //
+
+/**
+ * Answer the requests of clients about an isomap until the server stops
+ *
+ * The socket file is created by the function and removed when the server
+ * stops. The isomap must not be modified while the server runs.
+ *
+ * @param isomap       The isomap
+ * @param socket_path  The path of the Unix domain socket
+ * @param num_workers  The number of worker threads (0 is the same as 1)
+ * @param backend      The backend drawing the tiles of rendered images
+ * @return             True if the server could listen on the socket
+ */
+bool server_run(struct isomap *isomap,
+                const char *socket_path,
+                unsigned int num_workers,
+                enum render_backend backend);
+
+/**
+ * Connect to a server
+ *
+ * @param socket_path  The path of the Unix domain socket of the server
+ * @return             The file descriptor of the connection, or -1 if the
+ *                     connection failed
+ */
+int server_connect(const char *socket_path);
+
+/**
+ * Send a request to a server and wait for its response
+ *
+ * Note: the response should be freed when it is not needed anymore.
+ *
+ * @param fd        The file descriptor of the connection
+ * @param request   The request, without the end of line
+ * @param response  The bytes of the response, followed by a null byte, or
+ *                  NULL if the connection failed, set by the function
+ * @param length    The number of bytes of the response, set by the function
+ * @return          True if the response starts with `OK`
+ */
+bool server_request(int fd,
+                    const char *request,
+                    char **response,
+                    size_t *length);
+
+#endif
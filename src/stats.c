@@ -0,0 +1,134 @@
+#define _POSIX_C_SOURCE 200809L
+#include "stats.h"
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include <time.h>
+
+bool stats_enabled = false;
+
+/**
+ * The names of the phases
+ */
+const char *stats_phase_names[STATS_NUM_PHASES] = {
+    "load", "load-tileset", "load-map", "graph-nodes", "graph-edges",
+    "search", "decode", "draw", "encode", "write"
+};
+
+/**
+ * The names of the counters
+ */
+const char *stats_counter_names[STATS_NUM_COUNTERS] = {
+    "layers", "cells", "nodes", "edges", "expanded", "queue-max",
+    "tiles-drawn", "tiles-culled", "image-decodes", "arena-reserved",
+    "arena-used-max"
+};
+
+static atomic_ullong stats_calls[STATS_NUM_PHASES];
+static atomic_ullong stats_wall[STATS_NUM_PHASES];
+static atomic_ullong stats_cpu[STATS_NUM_PHASES];
+static atomic_ulong stats_counters[STATS_NUM_COUNTERS];
+
+// Help functions //
+// -------------- //
+
+/**
+ * Return the time of a clock, in nanoseconds
+ *
+ * @param clock  The clock
+ * @return       The time
+ */
+long long stats_clock(clockid_t clock) {
+    struct timespec time;
+    clock_gettime(clock, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+/**
+ * Return the peak resident set size of the process, in kilobytes
+ *
+ * @return  The peak resident set size
+ */
+long stats_peak_rss(void) {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+// Functions //
+// --------- //
+
+void stats_enable(void) {
+    stats_enabled = true;
+}
+
+struct stats_timer stats_start(void) {
+    if (!stats_enabled)
+        return (struct stats_timer){0, 0};
+    return (struct stats_timer){stats_clock(CLOCK_MONOTONIC),
+                                stats_clock(CLOCK_THREAD_CPUTIME_ID)};
+}
+
+void stats_stop(const struct stats_timer *timer, enum stats_phase phase) {
+    if (!stats_enabled)
+        return;
+    atomic_fetch_add(stats_calls + phase, 1);
+    atomic_fetch_add(stats_wall + phase,
+                     stats_clock(CLOCK_MONOTONIC) - timer->wall);
+    atomic_fetch_add(stats_cpu + phase,
+                     stats_clock(CLOCK_THREAD_CPUTIME_ID) - timer->cpu);
+}
+
+void stats_stop_cpu(const struct stats_timer *timer, enum stats_phase phase) {
+    if (!stats_enabled)
+        return;
+    atomic_fetch_add(stats_cpu + phase,
+                     stats_clock(CLOCK_THREAD_CPUTIME_ID) - timer->cpu);
+}
+
+void stats_add(enum stats_counter counter, unsigned long value) {
+    atomic_fetch_add(stats_counters + counter, value);
+}
+
+void stats_max(enum stats_counter counter, unsigned long value) {
+    unsigned long current = atomic_load(stats_counters + counter);
+    while (current < value &&
+           !atomic_compare_exchange_weak(stats_counters + counter, &current,
+                                         value));
+}
+
+unsigned long stats_get_counter(enum stats_counter counter) {
+    return atomic_load(stats_counters + counter);
+}
+
+unsigned long stats_get_calls(enum stats_phase phase) {
+    return atomic_load(stats_calls + phase);
+}
+
+void stats_print(FILE *stream, bool json) {
+    if (json) {
+        fprintf(stream, "{\"phases\": {");
+        for (unsigned int p = 0; p < STATS_NUM_PHASES; ++p)
+            fprintf(stream, "%s\"%s\": {\"calls\": %llu, \"wall_ms\": %.3f, "
+                    "\"cpu_ms\": %.3f}", p == 0 ? "" : ", ",
+                    stats_phase_names[p], atomic_load(stats_calls + p),
+                    atomic_load(stats_wall + p) / 1e6,
+                    atomic_load(stats_cpu + p) / 1e6);
+        fprintf(stream, "}, \"counters\": {");
+        for (unsigned int c = 0; c < STATS_NUM_COUNTERS; ++c)
+            fprintf(stream, "\"%s\": %lu, ", stats_counter_names[c],
+                    atomic_load(stats_counters + c));
+        fprintf(stream, "\"peak-rss-kb\": %ld}}\n", stats_peak_rss());
+    } else {
+        fprintf(stream, "%-16s %8s %12s %12s\n", "phase", "calls",
+                "wall (ms)", "cpu (ms)");
+        for (unsigned int p = 0; p < STATS_NUM_PHASES; ++p)
+            fprintf(stream, "%-16s %8llu %12.3f %12.3f\n",
+                    stats_phase_names[p], atomic_load(stats_calls + p),
+                    atomic_load(stats_wall + p) / 1e6,
+                    atomic_load(stats_cpu + p) / 1e6);
+        fprintf(stream, "%-16s %12s\n", "counter", "value");
+        for (unsigned int c = 0; c < STATS_NUM_COUNTERS; ++c)
+            fprintf(stream, "%-16s %12lu\n", stats_counter_names[c],
+                    atomic_load(stats_counters + c));
+        fprintf(stream, "%-16s %12ld\n", "peak-rss-kb", stats_peak_rss());
+    }
+}
@@ -0,0 +1,183 @@
+/**
+ * stats.h
+ *
+ * Measure where the time goes while an isomap is loaded, searched and
+ * rendered.
+ *
+ * The time spent in each phase of the program (loading the map, building its
+ * graph, searching walks, decoding, drawing and encoding images, ...) is
+ * accumulated over all the calls of the phase, both in wall-clock time and in
+ * CPU time. The CPU time of a call is the one of the thread making it, so that
+ * calls overlapping in several threads do not count each other's time; the
+ * threads helping a call (such as the ones drawing the bands of an image) add
+ * their own CPU time to the phase of the call with `STATS_STOP_CPU`.
+ * Counters accumulate the sizes of the data handled by the phases, such as
+ * the number of cells of the map or the number of tiles drawn. Phases may
+ * nest: the time spent decoding the images of the tiles while drawing is also
+ * counted in the drawing phase.
+ *
+ * Nothing is measured until `stats_enable` is called, and the macros used to
+ * instrument the other modules only test a flag in that case. When the
+ * program is compiled with `ISOMAP_NO_STATS` defined (`make NO_STATS=1`), the
+ * macros expand to nothing at all.
+ *
+ * The module provides the following data structures:
+ *
+ * - `enum stats_phase`: a phase of the program
+ * - `enum stats_counter`: a counter
+ * - `struct stats_timer`: the start of a phase
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Types //
+// ----- //
+
+/**
+ * A phase of the program
+ */
+enum stats_phase {
+    STATS_LOAD,          // Loading a map (parsing its file)
+    STATS_LOAD_TILESET,  // Loading the tileset of a map
+    STATS_LOAD_MAP,      // Loading the layers of a map
+    STATS_GRAPH_NODES,   // Adding the nodes of a graph
+    STATS_GRAPH_EDGES,   // Adding the edges of a graph
+    STATS_SEARCH,        // Searching a shortest walk
+    STATS_DECODE,        // Decoding the PNG images of the tiles
+    STATS_DRAW,          // Compositing the tiles in an image
+    STATS_ENCODE,        // Encoding an image
+    STATS_WRITE,         // Writing a map as text or binary
+    STATS_NUM_PHASES
+};
+
+/**
+ * A counter
+ */
+enum stats_counter {
+    STATS_LAYERS,          // The layers added to maps
+    STATS_CELLS,           // The cells of the layers added to maps
+    STATS_NODES,           // The nodes of graphs (top-free cells)
+    STATS_EDGES,           // The edges of graphs
+    STATS_EXPANDED,        // The nodes expanded by searches
+    STATS_QUEUE_MAX,       // The largest queue of a search
+    STATS_TILES_DRAWN,     // The tiles drawn
+    STATS_TILES_CULLED,    // The tiles hidden by other tiles, not drawn
+    STATS_IMAGE_DECODES,   // The PNG files decoded
+    STATS_ARENA_RESERVED,  // The bytes reserved by the arena of the isomap
+    STATS_ARENA_USED_MAX,  // The high-water mark of the arena of the isomap
+    STATS_NUM_COUNTERS
+};
+
+/**
+ * The start of a phase
+ */
+struct stats_timer {
+    long long wall; // The wall-clock time, in nanoseconds
+    long long cpu;  // The CPU time of the thread, in nanoseconds
+};
+
+// Macros //
+// ------ //
+
+#ifdef ISOMAP_NO_STATS
+#define STATS_START(timer)
+#define STATS_STOP(timer, phase)
+#define STATS_STOP_CPU(timer, phase)
+#define STATS_ADD(counter, value) ((void)sizeof(value))
+#define STATS_MAX(counter, value) ((void)sizeof(value))
+#else
+#define STATS_START(timer) struct stats_timer timer = stats_start()
+#define STATS_STOP(timer, phase) stats_stop(&timer, phase)
+#define STATS_STOP_CPU(timer, phase) stats_stop_cpu(&timer, phase)
+#define STATS_ADD(counter, value) \
+    (stats_enabled ? stats_add(counter, value) : (void)0)
+#define STATS_MAX(counter, value) \
+    (stats_enabled ? stats_max(counter, value) : (void)0)
+#endif
+
+extern bool stats_enabled;
+
+// Functions //
+// --------- //
+
+/**
+ * Start measuring the phases and counters
+ *
+ * This should be called before any thread is started.
+ */
+void stats_enable(void);
+
+/**
+ * Return the start of a phase
+ *
+ * @return  The current times, or zeros if the measures are disabled
+ */
+struct stats_timer stats_start(void);
+
+/**
+ * Add the time elapsed since the start of a phase to the phase
+ *
+ * @param timer  The start of the phase
+ * @param phase  The phase
+ */
+void stats_stop(const struct stats_timer *timer, enum stats_phase phase);
+
+/**
+ * Add the CPU time elapsed since the start of a phase to the phase, without
+ * counting a call nor its wall-clock time
+ *
+ * This is used by the threads helping a call measured by another thread.
+ *
+ * @param timer  The start of the phase, in the calling thread
+ * @param phase  The phase
+ */
+void stats_stop_cpu(const struct stats_timer *timer, enum stats_phase phase);
+
+/**
+ * Add a value to a counter
+ *
+ * @param counter  The counter
+ * @param value    The value
+ */
+void stats_add(enum stats_counter counter, unsigned long value);
+
+/**
+ * Raise a counter to a value, if it is smaller
+ *
+ * @param counter  The counter
+ * @param value    The value
+ */
+void stats_max(enum stats_counter counter, unsigned long value);
+
+/**
+ * Return the value of a counter
+ *
+ * @param counter  The counter
+ * @return         The value
+ */
+unsigned long stats_get_counter(enum stats_counter counter);
+
+/**
+ * Return the number of times a phase was measured
+ *
+ * @param phase  The phase
+ * @return       The number of calls
+ */
+unsigned long stats_get_calls(enum stats_phase phase);
+
+/**
+ * Print the phases, the counters and the peak memory usage to a stream
+ *
+ * The text format is a table of phases followed by a table of counters, the
+ * JSON format is an object on one line, with the members "phases" and
+ * "counters".
+ *
+ * @param stream  The stream
+ * @param json    True for JSON, false for text
+ */
+void stats_print(FILE *stream, bool json);
+
+#endif
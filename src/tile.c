@@ -1,11 +1,15 @@
 #include "tile.h"
+#include "arena.h"
+#include "stats.h"
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifndef ROOT_DIR
 #define ROOT_DIR "."
 #endif
-#define PATH_LENGTH2 (PATH_LENGTH + 1 - sizeof(ROOT_DIR))
+#define TILE_MIN_SLOTS 16
 
 // Implementation //
 // -------------- //
@@ -13,39 +17,217 @@
 /**
  * Print a tile to a stream
  *
- * @param stream  The stream
- * @param tile    The tile to print
- * @param prefix  The prefix to print for each line
+ * @param stream   The stream
+ * @param tileset  The tileset of the tile
+ * @param tile     The tile to print
+ * @param prefix   The prefix to print for each line
  */
 void tile_print(FILE *stream,
+                const struct tileset *tileset,
                 const struct tile *tile,
                 const char *prefix) {
     fprintf(stream, "%s  Tile id=%d\n", prefix, tile->id);
     for (unsigned int o = 0; o <= 1; ++o) {
         fprintf(stream, "%s    %s directions: ", prefix,
                 o == 0 ? "incoming" : "outgoing");
+        const struct vect *directions = tile_get_directions(tileset, tile,
+                                                            o == 0);
         for (unsigned int d = 0; d < tile->num_directions[o]; ++d) {
             if (d > 0) fprintf(stream, ",");
-            geometry_print_vect(stream, tile->directions[o] + d);
+            geometry_print_vect(stream, directions + d);
         }
         fprintf(stream, "\n");
     }
 }
 
+/**
+ * Return the first slot where a tile id is looked for in a tileset
+ *
+ * @param tileset  The tileset
+ * @param id       The id
+ * @return         The slot
+ */
+unsigned int tile_first_slot(const struct tileset *tileset, tile_id id) {
+    uint32_t hash = (uint32_t)id * UINT32_C(2654435769);
+    return (hash ^ hash >> 16) & (tileset->num_slots - 1);
+}
+
+/**
+ * Return the slot of a tile id in a tileset
+ *
+ * The slot is either the one of the tile having the id, or the empty slot
+ * where it would be inserted.
+ *
+ * @param tileset  The tileset
+ * @param id       The id
+ * @return         The slot
+ */
+unsigned int tile_find_slot(const struct tileset *tileset, tile_id id) {
+    unsigned int slot = tile_first_slot(tileset, id);
+    while (tileset->slots[slot] != 0 &&
+           tileset->tiles[tileset->slots[slot] - 1].id != id)
+        slot = (slot + 1) & (tileset->num_slots - 1);
+    return slot;
+}
+
+/**
+ * Rebuild the hash table of a tileset with a given number of slots
+ *
+ * @param tileset    The tileset
+ * @param num_slots  The number of slots (a power of 2)
+ */
+void tile_rebuild_slots(struct tileset *tileset, unsigned int num_slots) {
+    arena_free(tileset->arena, tileset->slots);
+    tileset->slots = arena_calloc(tileset->arena, num_slots,
+                                  sizeof(unsigned int));
+    tileset->num_slots = num_slots;
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i)
+        tileset->slots[tile_find_slot(tileset, tileset->tiles[i].id)] = i + 1;
+}
+
+/**
+ * Return the slot of a filename in the hash table of the image files
+ *
+ * The slot is either the one of the file having the filename, or the empty
+ * slot where it would be inserted.
+ *
+ * @param tileset   The tileset
+ * @param filename  The filename, prefixed by the root directory
+ * @return          The slot
+ */
+unsigned int tile_find_file_slot(const struct tileset *tileset,
+                                 const char *filename) {
+    uint32_t hash = UINT32_C(2166136261);
+    for (const char *c = filename; *c != '\0'; ++c)
+        hash = (hash ^ (unsigned char)*c) * UINT32_C(16777619);
+    unsigned int slot = hash & (tileset->num_file_slots - 1);
+    while (tileset->file_slots[slot] != 0 &&
+           strcmp(tileset->strings +
+                  tileset->files[tileset->file_slots[slot] - 1].filename,
+                  filename) != 0)
+        slot = (slot + 1) & (tileset->num_file_slots - 1);
+    return slot;
+}
+
+/**
+ * Return the index of the image file of a filename, adding it if needed
+ *
+ * The filename is added to the string pool only if it is new.
+ *
+ * @param tileset   The tileset
+ * @param filename  The filename, as given to the tileset
+ * @return          The index of the image file
+ */
+unsigned int tile_intern_file(struct tileset *tileset, const char *filename) {
+    unsigned long length = strlen(ROOT_DIR) + strlen(filename) + 1;
+    if (tileset->strings_length + length > tileset->strings_capacity) {
+        unsigned long capacity = tileset->strings_capacity;
+        while (tileset->strings_length + length > capacity)
+            capacity *= 2;
+        tileset->strings = arena_realloc(tileset->arena, tileset->strings,
+                                         tileset->strings_length, capacity);
+        tileset->strings_capacity = capacity;
+    }
+    char *path = tileset->strings + tileset->strings_length;
+    strcpy(path, ROOT_DIR);
+    strcat(path, filename);
+    unsigned int slot = tile_find_file_slot(tileset, path);
+    if (tileset->file_slots[slot] != 0)
+        return tileset->file_slots[slot] - 1;
+    if (tileset->num_files == tileset->file_capacity) {
+        tileset->file_capacity *= 2;
+        tileset->files = arena_realloc(tileset->arena, tileset->files,
+                                       tileset->num_files *
+                                       sizeof(struct tile_file),
+                                       tileset->file_capacity *
+                                       sizeof(struct tile_file));
+    }
+    tileset->files[tileset->num_files] = (struct tile_file){
+        tileset->strings_length, NULL
+    };
+    tileset->strings_length += length;
+    tileset->file_slots[slot] = ++tileset->num_files;
+    if (2 * tileset->num_files > tileset->num_file_slots) {
+        unsigned int num_slots = 2 * tileset->num_file_slots;
+        arena_free(tileset->arena, tileset->file_slots);
+        tileset->file_slots = arena_calloc(tileset->arena, num_slots,
+                                           sizeof(unsigned int));
+        tileset->num_file_slots = num_slots;
+        for (unsigned int f = 0; f < tileset->num_files; ++f)
+            tileset->file_slots[tile_find_file_slot(tileset, tileset->strings +
+                                tileset->files[f].filename)] = f + 1;
+    }
+    return tileset->num_files - 1;
+}
+
+/**
+ * A tile and its other data, as sorted by `tile_sort_tileset`
+ */
+struct tile_entry {
+    struct tile tile;      // The tile
+    struct tile_info info; // The other data of the tile
+};
+
+/**
+ * Compare two tile entries by id
+ *
+ * @param first   The first entry
+ * @param second  The second entry
+ * @return        A negative, zero or positive number, as with `strcmp`
+ */
+int tile_compare_ids(const void *first, const void *second) {
+    tile_id a = ((const struct tile_entry*)first)->tile.id;
+    tile_id b = ((const struct tile_entry*)second)->tile.id;
+    return (a > b) - (a < b);
+}
+
 // Implementation //
 // -------------- //
 
 struct tileset *tile_create_tileset(void) {
-    struct tileset *tileset = malloc(sizeof(struct tileset));
-    tileset->tiles = malloc(sizeof(struct tile));
+    return tile_create_tileset_in_arena(NULL);
+}
+
+struct tileset *tile_create_tileset_in_arena(struct arena *arena) {
+    struct tileset *tileset = arena_alloc(arena, sizeof(struct tileset));
+    tileset->tiles = arena_alloc(arena, sizeof(struct tile));
+    tileset->infos = arena_alloc(arena, sizeof(struct tile_info));
     tileset->num_tiles = 0;
     tileset->capacity = 1;
+    tileset->slots = arena_calloc(arena, TILE_MIN_SLOTS, sizeof(unsigned int));
+    tileset->num_slots = TILE_MIN_SLOTS;
+    tileset->sorted = true;
+    tileset->directions = arena_alloc(arena, sizeof(struct vect));
+    tileset->num_directions = 0;
+    tileset->direction_capacity = 1;
+    tileset->strings = arena_alloc(arena, PATH_LENGTH);
+    tileset->strings_length = 0;
+    tileset->strings_capacity = PATH_LENGTH;
+    tileset->files = arena_alloc(arena, sizeof(struct tile_file));
+    tileset->num_files = 0;
+    tileset->file_capacity = 1;
+    tileset->file_slots = arena_calloc(arena, TILE_MIN_SLOTS,
+                                       sizeof(unsigned int));
+    tileset->num_file_slots = TILE_MIN_SLOTS;
+    tileset->arena = arena;
     return tileset;
 }
 
 void tile_delete_tileset(struct tileset *tileset) {
-    free(tileset->tiles);
-    free(tileset);
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i)
+        if (tileset->tiles[i].image != NULL)
+            cairo_surface_destroy(tileset->tiles[i].image);
+    for (unsigned int f = 0; f < tileset->num_files; ++f)
+        if (tileset->files[f].source != NULL)
+            cairo_surface_destroy(tileset->files[f].source);
+    arena_free(tileset->arena, tileset->tiles);
+    arena_free(tileset->arena, tileset->infos);
+    arena_free(tileset->arena, tileset->slots);
+    arena_free(tileset->arena, tileset->directions);
+    arena_free(tileset->arena, tileset->strings);
+    arena_free(tileset->arena, tileset->files);
+    arena_free(tileset->arena, tileset->file_slots);
+    arena_free(tileset->arena, tileset);
 }
 
 void tile_print_tileset(FILE *stream,
@@ -56,68 +238,172 @@ void tile_print_tileset(FILE *stream,
             tileset->num_tiles <= 1 ? "" : "s",
             tileset->num_tiles >= 1 ? ":" : "");
     for (unsigned int i = 0; i < tileset->num_tiles; ++i) {
-        tile_print(stream, tileset->tiles + i, prefix);
+        tile_print(stream, tileset, tileset->tiles + i, prefix);
     }
 }
 
 struct tile *tile_add_to_tileset(struct tileset *tileset,
                                  tile_id id,
                                  const char *filename) {
-    unsigned int i;
-    for (i = 0;
-         i < tileset->num_tiles && tileset->tiles[i].id < id;
-         ++i);
-    if (i < tileset->num_tiles && tileset->tiles[i].id == id)
+    unsigned int slot = tile_find_slot(tileset, id);
+    if (tileset->slots[slot] != 0)
         return NULL;
     if (tileset->num_tiles == tileset->capacity) {
         tileset->capacity *= 2;
-        tileset->tiles = realloc(tileset->tiles,
-                                 tileset->capacity * sizeof(struct tile));
+        tileset->tiles = arena_realloc(tileset->arena, tileset->tiles,
+                                       tileset->num_tiles * sizeof(struct tile),
+                                       tileset->capacity * sizeof(struct tile));
+        tileset->infos = arena_realloc(tileset->arena, tileset->infos,
+                                       tileset->num_tiles *
+                                       sizeof(struct tile_info),
+                                       tileset->capacity *
+                                       sizeof(struct tile_info));
     }
-    for (unsigned int j = tileset->num_tiles; j > i; --j) {
-        tileset->tiles[j] = tileset->tiles[j - 1];
-    }
-    tileset->tiles[i].id = id;
-    strncpy(tileset->tiles[i].filename, ROOT_DIR, PATH_LENGTH);
-    strncat(tileset->tiles[i].filename, filename, PATH_LENGTH2);
-    tileset->tiles[i].directions[0] = malloc(sizeof(struct vect));
-    tileset->tiles[i].num_directions[0] = 0;
-    tileset->tiles[i].capacity[0] = 1;
-    tileset->tiles[i].directions[1] = malloc(sizeof(struct vect));
-    tileset->tiles[i].num_directions[1] = 0;
-    tileset->tiles[i].capacity[1] = 1;
+    unsigned int i = tileset->num_tiles;
+    if (i > 0 && tileset->tiles[i - 1].id > id)
+        tileset->sorted = false;
+    tileset->tiles[i] = (struct tile){
+        .id             = id,
+        .directions     = {tileset->num_directions, tileset->num_directions},
+        .num_directions = {0, 0},
+        .image          = NULL
+    };
+    tileset->infos[i] = (struct tile_info){
+        .file      = tile_intern_file(tileset, filename),
+        .capacity  = {0, 0},
+        .rectangle = {0, 0, 0, 0}
+    };
     ++tileset->num_tiles;
+    if (2 * tileset->num_tiles > tileset->num_slots)
+        tile_rebuild_slots(tileset, 2 * tileset->num_slots);
+    else
+        tileset->slots[slot] = tileset->num_tiles;
     return tileset->tiles + i;
 }
 
+void tile_sort_tileset(struct tileset *tileset) {
+    if (tileset->sorted)
+        return;
+    struct tile_entry *entries = malloc(tileset->num_tiles *
+                                        sizeof(struct tile_entry));
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i)
+        entries[i] = (struct tile_entry){tileset->tiles[i], tileset->infos[i]};
+    qsort(entries, tileset->num_tiles, sizeof(struct tile_entry),
+          tile_compare_ids);
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i) {
+        tileset->tiles[i] = entries[i].tile;
+        tileset->infos[i] = entries[i].info;
+    }
+    free(entries);
+    tile_rebuild_slots(tileset, tileset->num_slots);
+    tileset->sorted = true;
+}
+
+const char *tile_get_filename(const struct tileset *tileset,
+                              const struct tile *tile) {
+    const struct tile_info *info = tileset->infos + (tile - tileset->tiles);
+    return tileset->strings + tileset->files[info->file].filename;
+}
+
+const char *tile_source_filename(const struct tileset *tileset,
+                                 const struct tile *tile) {
+    return tile_get_filename(tileset, tile) + strlen(ROOT_DIR);
+}
+
+const struct vect *tile_get_directions(const struct tileset *tileset,
+                                       const struct tile *tile,
+                                       bool incoming) {
+    return tileset->directions + tile->directions[incoming ? 0 : 1];
+}
+
+void tile_set_rectangle(struct tileset *tileset,
+                        const struct tile *tile,
+                        unsigned int x, unsigned int y,
+                        unsigned int width, unsigned int height) {
+    unsigned int *rectangle = tileset->infos[tile - tileset->tiles].rectangle;
+    rectangle[0] = x;
+    rectangle[1] = y;
+    rectangle[2] = width;
+    rectangle[3] = height;
+}
+
+cairo_surface_t *tile_get_image(struct tileset *tileset, struct tile *tile) {
+    if (tile->image != NULL)
+        return tile->image;
+    const struct tile_info *info = tileset->infos + (tile - tileset->tiles);
+    struct tile_file *file = tileset->files + info->file;
+    if (file->source == NULL) {
+        STATS_START(timer);
+        file->source = cairo_image_surface_create_from_png(tileset->strings +
+                                                           file->filename);
+        cairo_surface_flush(file->source);
+        STATS_STOP(timer, STATS_DECODE);
+        STATS_ADD(STATS_IMAGE_DECODES, 1);
+    }
+    if (info->rectangle[2] == 0 ||
+        cairo_surface_status(file->source) != CAIRO_STATUS_SUCCESS) {
+        tile->image = cairo_surface_reference(file->source);
+        return tile->image;
+    }
+    unsigned int width = cairo_image_surface_get_width(file->source);
+    unsigned int height = cairo_image_surface_get_height(file->source);
+    unsigned int x = info->rectangle[0] < width ? info->rectangle[0] : width;
+    unsigned int y = info->rectangle[1] < height ? info->rectangle[1] : height;
+    if (info->rectangle[2] < width - x) width = x + info->rectangle[2];
+    if (info->rectangle[3] < height - y) height = y + info->rectangle[3];
+    int stride = cairo_image_surface_get_stride(file->source);
+    tile->image = cairo_image_surface_create_for_data(
+        cairo_image_surface_get_data(file->source) + y * stride + 4 * x,
+        cairo_image_surface_get_format(file->source),
+        width - x, height - y, stride);
+    return tile->image;
+}
+
 void tile_add_direction(struct tileset *tileset, tile_id id,
                         int dx, int dy, int dz, bool incoming) {
-    unsigned int i;
-    for (i = 0;
-         i < tileset->num_tiles && tileset->tiles[i].id < id;
-         ++i);
-    if (i < tileset->num_tiles && tileset->tiles[i].id == id) {
-        unsigned int o = incoming ? 0 : 1;
-        struct tile *tile = tileset->tiles + i;
-        if (tile->num_directions[o] == tile->capacity[o]) {
-            tile->capacity[o] *= 2;
-            tile->directions[o]
-                = realloc(tile->directions[o],
-                          tile->capacity[o] * sizeof(struct vect));
+    struct tile *tile = tile_by_id(tileset, id);
+    if (tile == NULL)
+        return;
+    unsigned int o = incoming ? 0 : 1;
+    unsigned int *capacity = tileset->infos[tile - tileset->tiles].capacity;
+    if (tile->num_directions[o] == capacity[o]) {
+        unsigned int first = tileset->num_directions;
+        unsigned int num_added = 1;
+        if (tile->directions[o] + capacity[o] != tileset->num_directions)
+            num_added = tile->num_directions[o] > 0 ?
+                        2 * tile->num_directions[o] : 1;
+        else
+            first = tile->directions[o];
+        if (tileset->num_directions + num_added >
+            tileset->direction_capacity) {
+            unsigned int old_capacity = tileset->direction_capacity;
+            while (tileset->num_directions + num_added >
+                   tileset->direction_capacity)
+                tileset->direction_capacity *= 2;
+            tileset->directions = arena_realloc(tileset->arena,
+                                                tileset->directions,
+                                                old_capacity *
+                                                sizeof(struct vect),
+                                                tileset->direction_capacity *
+                                                sizeof(struct vect));
         }
-        tile->directions[o][tile->num_directions[o]] = (struct vect){dx, dy, dz};
-        ++tile->num_directions[o];
+        if (first != tile->directions[o]) {
+            memcpy(tileset->directions + first,
+                   tileset->directions + tile->directions[o],
+                   tile->num_directions[o] * sizeof(struct vect));
+            tile->directions[o] = first;
+            capacity[o] = 0;
+        }
+        capacity[o] += num_added;
+        tileset->num_directions += num_added;
     }
+    tileset->directions[tile->directions[o] + tile->num_directions[o]] =
+        (struct vect){dx, dy, dz};
+    ++tile->num_directions[o];
 }
 
 struct tile *tile_by_id(const struct tileset *tileset,
                         tile_id id) {
-    unsigned int i;
-    for (i = 0;
-         i < tileset->num_tiles && tileset->tiles[i].id < id;
-         ++i);
-    if (i < tileset->num_tiles && tileset->tiles[i].id == id)
-        return tileset->tiles + i;
-    else
-        return NULL;
+    unsigned int index = tileset->slots[tile_find_slot(tileset, id)];
+    return index == 0 ? NULL : tileset->tiles + index - 1;
 }
@@ -11,22 +11,74 @@
 
 /**
  * A tile in a map
+ *
+ * Only the data needed to build graphs and to draw images is stored in a
+ * tile, so that the tiles of a tileset are small and contiguous. Its
+ * directions are ranges of the directions of the tileset (see
+ * `tile_get_directions`) and its other data is stored in a `struct
+ * tile_info`, at the same index.
  */
 struct tile {
     tile_id id;                     // The tile id
-    char filename[PATH_LENGTH];     // The filename of the image for the tile
-    struct vect *directions[2];     // The allowed directions
+    unsigned int directions[2];     // The index of the first direction
     unsigned int num_directions[2]; // The number of allowed directions
-    unsigned int capacity[2];       // The directions capacity
+    cairo_surface_t *image;         // The decoded tile image (or NULL)
+};
+
+/**
+ * The data of a tile that is rarely used
+ */
+struct tile_info {
+    unsigned int file;         // The index of the image file
+    unsigned int capacity[2];  // The capacity of the direction ranges
+    unsigned int rectangle[4]; // The source rectangle [x,y,w,h] in the
+                               // image (w = 0 for the whole image)
+};
+
+/**
+ * An image file of a tileset
+ */
+struct tile_file {
+    unsigned long filename;  // The offset of the filename in the string pool
+    cairo_surface_t *source; // The decoded image file (or NULL)
 };
 
 /**
  * A set of tiles
+ *
+ * The tiles are stored in the order in which they are added, so that adding
+ * a tile takes constant time, and the index of a tile in `tiles` is a dense
+ * index in `[0, num_tiles)`. An open addressing hash table maps the ids,
+ * which can be arbitrary, to these indices, so that finding a tile by its id
+ * also takes constant time.
+ *
+ * The directions of all tiles are stored in a single array, the directions
+ * of a tile being usually consecutive. Each distinct filename is stored once,
+ * in a pool of null-terminated strings, and identifies an image file shared
+ * by all tiles having this filename.
  */
 struct tileset {
-    struct tile *tiles;     // The tiles
-    unsigned int num_tiles; // The number of tiles in the tileset
-    unsigned int capacity;  // The capacity of the tileset
+    struct tile *tiles;              // The tiles
+    struct tile_info *infos;         // The other data of the tiles
+    unsigned int num_tiles;          // The number of tiles in the tileset
+    unsigned int capacity;           // The capacity of the tileset
+    unsigned int *slots;             // The hash table (index + 1 of a tile,
+                                     // or 0)
+    unsigned int num_slots;          // The number of slots (a power of 2)
+    bool sorted;                     // True if the tiles are ordered by id
+    struct vect *directions;         // The directions of the tiles
+    unsigned int num_directions;     // The number of used directions
+    unsigned int direction_capacity; // The capacity of the directions
+    char *strings;                   // The string pool
+    unsigned long strings_length;    // The number of used bytes of the pool
+    unsigned long strings_capacity;  // The capacity of the pool
+    struct tile_file *files;         // The image files
+    unsigned int num_files;          // The number of image files
+    unsigned int file_capacity;      // The capacity of the image files
+    unsigned int *file_slots;        // The hash table of the filenames
+                                     // (index + 1 of a file, or 0)
+    unsigned int num_file_slots;     // The number of slots (a power of 2)
+    struct arena *arena;             // The arena of the tileset (or NULL)
 };
 
 // Functions //
@@ -39,6 +91,16 @@ struct tileset {
  */
 struct tileset *tile_create_tileset(void);
 
+/**
+ * Create an empty tileset in an arena
+ *
+ * The tileset, its tiles and their directions are allocated in the arena.
+ *
+ * @param arena  The arena (or NULL for the heap)
+ * @return       The tileset
+ */
+struct tileset *tile_create_tileset_in_arena(struct arena *arena);
+
 /**
  * Delete a tileset
  *
@@ -60,6 +122,9 @@ void tile_print_tileset(FILE *stream,
 /**
  * Add a tile to a tileset
  *
+ * The tile is added after the other tiles, in constant amortized time. If a
+ * tile with the same id already exists, nothing is added.
+ *
  * @param tileset   The tileset
  * @param id        The id of the added tile
  * @param filename  The image filename of the tile
@@ -69,6 +134,97 @@ struct tile *tile_add_to_tileset(struct tileset *tileset,
                                  tile_id id,
                                  const char *filename);
 
+/**
+ * Order the tiles of a tileset by id
+ *
+ * Nothing happens if the tiles were added in increasing order of id, which is
+ * the usual case. Otherwise, they are sorted in O(n log n) time. The pointers
+ * to the tiles and their indices are invalidated.
+ *
+ * @param tileset  The tileset
+ */
+void tile_sort_tileset(struct tileset *tileset);
+
+/**
+ * Return the image filename of a tile, prefixed by the root directory
+ *
+ * @param tileset  The tileset of the tile
+ * @param tile     The tile
+ * @return         The filename
+ */
+const char *tile_get_filename(const struct tileset *tileset,
+                              const struct tile *tile);
+
+/**
+ * Return the image filename of a tile, as it was given to the tileset
+ *
+ * Unlike `tile_get_filename`, the returned filename is not prefixed by the
+ * root directory of the project.
+ *
+ * @param tileset  The tileset of the tile
+ * @param tile     The tile
+ * @return         The filename
+ */
+const char *tile_source_filename(const struct tileset *tileset,
+                                 const struct tile *tile);
+
+/**
+ * Return the allowed directions of a tile
+ *
+ * The returned directions are valid until a direction is added to the
+ * tileset.
+ *
+ * @param tileset   The tileset of the tile
+ * @param tile      The tile
+ * @param incoming  If true, the incoming directions are returned
+ *                  If false, the outgoing directions are returned
+ * @return          The directions (`tile->num_directions[0]` incoming ones or
+ *                  `tile->num_directions[1]` outgoing ones)
+ */
+const struct vect *tile_get_directions(const struct tileset *tileset,
+                                       const struct tile *tile,
+                                       bool incoming);
+
+/**
+ * Set the source rectangle of a tile
+ *
+ * By default, the image of a tile is its whole image file. When several tiles
+ * are stored in a single image file, called an atlas, the image of each tile
+ * is the rectangle of the atlas given by this function.
+ *
+ * @param tileset  The tileset of the tile
+ * @param tile     The tile
+ * @param x        The x-coordinate of the top left corner of the rectangle
+ * @param y        The y-coordinate of the top left corner of the rectangle
+ * @param width    The width of the rectangle (0 for the whole image file)
+ * @param height   The height of the rectangle
+ */
+void tile_set_rectangle(struct tileset *tileset,
+                        const struct tile *tile,
+                        unsigned int x, unsigned int y,
+                        unsigned int width, unsigned int height);
+
+/**
+ * Return the decoded image of a tile
+ *
+ * The image file is decoded the first time it is requested and kept with the
+ * tile afterwards. The tiles of a tileset that have the same image file, such
+ * as the tiles of an atlas, share it, so that each file is decoded only once
+ * per tileset. It is destroyed with the tileset.
+ *
+ * If the tile has a source rectangle, the returned image is that rectangle of
+ * the image file, clipped to its bounds: its pixels are not copied, but
+ * stored in the image file, with the same stride.
+ *
+ * If the file cannot be decoded, a surface in an error state is returned, as
+ * with `cairo_image_surface_create_from_png`.
+ *
+ * @param tileset  The tileset of the tile
+ * @param tile     The tile
+ * @return         The image
+ */
+cairo_surface_t *tile_get_image(struct tileset *tileset, struct tile *tile);
+
 /**
  * Add an allowed direction to a tile in a tileset
  *
@@ -88,7 +244,7 @@ void tile_add_direction(struct tileset *tileset, tile_id id,
 /**
  * Return the tile by its id in a tileset
  *
- * If the id does not exist, return NULL.
+ * If the id does not exist, return NULL. The time is constant.
  *
  * @param tileset  The tileset
  * @param id       The id of the tile
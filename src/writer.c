@@ -0,0 +1,79 @@
+#include "writer.h"
+#include <string.h>
+
+/**
+ * The decimal digits of the integers from 0 to 99, two by two
+ */
+static const char writer_digits[200] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+// Functions //
+// --------- //
+
+void writer_initialize(struct writer *writer, FILE *stream) {
+    writer->stream = stream;
+    writer->length = 0;
+}
+
+void writer_flush(struct writer *writer) {
+    if (writer->length > 0)
+        fwrite(writer->buffer, 1, writer->length, writer->stream);
+    writer->length = 0;
+}
+
+void writer_put_char(struct writer *writer, char c) {
+    if (writer->length == WRITER_BUFFER_SIZE)
+        writer_flush(writer);
+    writer->buffer[writer->length++] = c;
+}
+
+void writer_put_string(struct writer *writer, const char *string) {
+    size_t length = strlen(string);
+    while (length > 0) {
+        if (writer->length == WRITER_BUFFER_SIZE)
+            writer_flush(writer);
+        size_t n = WRITER_BUFFER_SIZE - writer->length;
+        if (n > length) n = length;
+        memcpy(writer->buffer + writer->length, string, n);
+        writer->length += n;
+        string += n;
+        length -= n;
+    }
+}
+
+void writer_put_integer(struct writer *writer, long long value) {
+    if (writer->length + WRITER_MAX_INTEGER_LENGTH > WRITER_BUFFER_SIZE)
+        writer_flush(writer);
+    char *output = writer->buffer + writer->length;
+    if (value >= 0 && value < 10) {
+        *output = '0' + value;
+        ++writer->length;
+        return;
+    }
+    unsigned long long magnitude = value;
+    if (value < 0) {
+        *output++ = '-';
+        ++writer->length;
+        magnitude = -magnitude;
+    }
+    char digits[WRITER_MAX_INTEGER_LENGTH];
+    char *start = digits + WRITER_MAX_INTEGER_LENGTH;
+    while (magnitude >= 100) {
+        start -= 2;
+        memcpy(start, writer_digits + 2 * (magnitude % 100), 2);
+        magnitude /= 100;
+    }
+    if (magnitude >= 10) {
+        start -= 2;
+        memcpy(start, writer_digits + 2 * magnitude, 2);
+    } else {
+        *--start = '0' + magnitude;
+    }
+    size_t length = digits + WRITER_MAX_INTEGER_LENGTH - start;
+    memcpy(output, start, length);
+    writer->length += length;
+}
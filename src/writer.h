@@ -0,0 +1,83 @@
+/**
+ * writer.h
+ *
+ * Write large texts to a stream quickly.
+ *
+ * Printing a map or a graph with one `fprintf` call per tile or per node is
+ * dominated by the parsing of the format strings and by the locking of the
+ * stream, not by the text itself. A writer gathers the text in a large buffer
+ * instead, converts integers to decimal without going through a format
+ * string, and hands the buffer to the stream with a single `fwrite` call when
+ * it is full. The text written is exactly the one `fprintf` would write.
+ *
+ * A writer must be flushed with `writer_flush` before the stream is used
+ * directly again, so that the texts appear in the right order.
+ *
+ * The module provides the following data structure:
+ *
+ * - `struct writer`: a buffered writer to a stream
+ */
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Types //
+// ----- //
+
+#define WRITER_BUFFER_SIZE 65536
+#define WRITER_MAX_INTEGER_LENGTH 20
+
+/**
+ * A buffered writer to a stream
+ */
+struct writer {
+    FILE *stream;                     // The stream
+    size_t length;                    // The number of buffered bytes
+    char buffer[WRITER_BUFFER_SIZE];  // The buffered bytes
+};
+
+// Functions //
+// --------- //
+
+/**
+ * Initialize a writer to a stream
+ *
+ * @param writer  The writer
+ * @param stream  The stream
+ */
+void writer_initialize(struct writer *writer, FILE *stream);
+
+/**
+ * Write the buffered bytes of a writer to its stream
+ *
+ * @param writer  The writer
+ */
+void writer_flush(struct writer *writer);
+
+/**
+ * Write a character
+ *
+ * @param writer  The writer
+ * @param c       The character
+ */
+void writer_put_char(struct writer *writer, char c);
+
+/**
+ * Write a string
+ *
+ * @param writer  The writer
+ * @param string  The string
+ */
+void writer_put_string(struct writer *writer, const char *string);
+
+/**
+ * Write an integer in decimal, as `fprintf` with `%lld` would
+ *
+ * @param writer  The writer
+ * @param value   The integer
+ */
+void writer_put_integer(struct writer *writer, long long value);
+
+#endif
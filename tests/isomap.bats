@@ -1,5 +1,6 @@
 examples_folder=../examples
 prog=../bin/isomap
+generator=../bin/generate_map
 help_first_line="Usage: ../bin/isomap [-h|--help] [-s|--start X,Y,Z] [-e|--end X,Y,Z]"
 
 # Normal usage
@@ -57,6 +58,119 @@ help_first_line="Usage: ../bin/isomap [-h|--help] [-s|--start X,Y,Z] [-e|--end X
     [ -f "$BATS_TMPDIR/map3x3.png" ]
 }
 
+@test "Drawing with 4 threads gives the same png" {
+    run $prog -f png -o "$BATS_TMPDIR"/map10x10.png < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    run $prog -t 4 -f png -o "$BATS_TMPDIR"/map10x10-4.png < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    cmp "$BATS_TMPDIR"/map10x10.png "$BATS_TMPDIR"/map10x10-4.png
+}
+
+@test "Drawing with an atlas gives the same png" {
+    run $prog -f png -o "$BATS_TMPDIR"/map10x10.png < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    run $prog -f png -o "$BATS_TMPDIR"/map10x10-atlas.png < ../data/map10x10-atlas-64x64.json
+    [ "$status" -eq 0 ]
+    cmp "$BATS_TMPDIR"/map10x10.png "$BATS_TMPDIR"/map10x10-atlas.png
+}
+
+@test "Drawing with the direct backend gives the same png" {
+    run $prog -f png -o "$BATS_TMPDIR"/map10x10.png < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    run $prog -b direct -f png -o "$BATS_TMPDIR"/map10x10-direct.png < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    cmp "$BATS_TMPDIR"/map10x10.png "$BATS_TMPDIR"/map10x10-direct.png
+}
+
+@test "Formats \"ppm\" and \"pam\" write headers on stdout" {
+    run bash -c "$prog -f ppm < ../data/map10x10-64x64.json | head -c 2"
+    [ "$output" = "P6" ]
+    run bash -c "$prog -f pam < ../data/map10x10-64x64.json | head -c 2"
+    [ "$output" = "P7" ]
+}
+
+@test "Format \"qoi\" writes a qoi image" {
+    run $prog -f qoi -o "$BATS_TMPDIR"/map10x10.qoi < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    [ "$(head -c 4 "$BATS_TMPDIR"/map10x10.qoi)" = "qoif" ]
+}
+
+@test "Option --png-level 0 gives a larger png" {
+    run $prog -f png -o "$BATS_TMPDIR"/map10x10.png < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    run $prog --png-level 0 -t 3 -f png -o "$BATS_TMPDIR"/map10x10-0.png < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    [ $(stat -c %s "$BATS_TMPDIR"/map10x10-0.png) -gt $(stat -c %s "$BATS_TMPDIR"/map10x10.png) ]
+}
+
+@test "Option -V draws a viewport of the png" {
+    run $prog -V 100,50,320,200 -f png -o "$BATS_TMPDIR"/viewport.png < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    [ -f "$BATS_TMPDIR/viewport.png" ]
+}
+
+@test "Format \"pyramid\" writes z/x/y images" {
+    rm -rf "$BATS_TMPDIR"/pyramid
+    run $prog -f pyramid -T 128 -o "$BATS_TMPDIR"/pyramid < ../data/map10x10-64x64.json
+    [ "$status" -eq 0 ]
+    [ -f "$BATS_TMPDIR/pyramid/0/0/0.png" ]
+    [ -f "$BATS_TMPDIR/pyramid/3/5/2.png" ]
+    [ ! -e "$BATS_TMPDIR/pyramid/4" ]
+}
+
+@test "Format \"binary\" can be read back with -I binary" {
+    run $prog -f binary -o "$BATS_TMPDIR"/map3x3.bin < ../data/map3x3.json
+    [ "$status" -eq 0 ]
+    run $prog -I binary -w -s 0,0,1 -e 2,2,1 -i "$BATS_TMPDIR"/map3x3.bin
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Tileset of 3 tiles:" ]
+    [ "${lines[10]}" = "A map of 2 layers" ]
+    [[ "${lines[19]}" =~ "A walk of 5 nodes" ]]
+}
+
+@test "Option --stats=json prints the statistics on stderr" {
+    run bash -c "$prog --stats=json < ../data/map3x3.json 2>&1 >/dev/null"
+    [ "$status" -eq 0 ]
+    [[ "${lines[0]}" =~ ^\{\"phases\":\ \{\"load\":\ \{\"calls\":\ 1, ]]
+    [[ "${lines[0]}" =~ \"layers\":\ 2, ]]
+}
+
+@test "Generated maps have the requested layers" {
+    run bash -c "$generator -r 3 -c 4 -l 2 -O 1,0,2 | $prog"
+    [ "$status" -eq 0 ]
+    [ "${lines[22]}" = "A map of 2 layers" ]
+    [ "${lines[23]}" = "  Layer 0: A layer of 3 rows and 4 columns (offset = (0,0,0))" ]
+    [ "${lines[27]}" = "  Layer 1: A layer of 3 rows and 4 columns (offset = (1,0,2))" ]
+}
+
+@test "Generated maps are the same in JSON and binary" {
+    run $generator -r 40 -c 30 -l 3 -s 42 -o "$BATS_TMPDIR"/generated.json
+    [ "$status" -eq 0 ]
+    run $generator -r 40 -c 30 -l 3 -s 42 -f binary -o "$BATS_TMPDIR"/generated.bin
+    [ "$status" -eq 0 ]
+    run bash -c "cmp <($prog -i $BATS_TMPDIR/generated.json) <($prog -I binary -i $BATS_TMPDIR/generated.bin)"
+    [ "$status" -eq 0 ]
+}
+
+@test "Option -f json writes the graph and the walk as a JSON array" {
+    run $prog -f json -w -s 0,0,1 -e 2,2,1 -i ../data/map3x3.json
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "[" ]
+    [ "${lines[1]}" = '{"type": "graph", "layers": 2, "nodes": 9, "edges": 24},' ]
+    [ "${lines[2]}" = '{"type": "walk", "start": [0,0,1], "end": [2,2,1], "distance": 4, "nodes": [[0,0,1],[0,1,0],[0,2,0],[1,2,0],[2,2,1]]}' ]
+    [ "${lines[3]}" = "]" ]
+}
+
+@test "Option -q answers queries as NDJSON records" {
+    printf 'DISTANCE 0,0,1 2,2,1\n\nWALK 0,0,0 2,2,1\nJUMP 1,1,1\n' > "$BATS_TMPDIR"/queries.txt
+    run $prog -f ndjson -q "$BATS_TMPDIR"/queries.txt -i ../data/map3x3.json
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 4 ]
+    [ "${lines[1]}" = '{"type": "distance", "start": [0,0,1], "end": [2,2,1], "distance": 4}' ]
+    [ "${lines[2]}" = '{"type": "walk", "start": [0,0,0], "end": [2,2,1], "distance": -1, "nodes": null}' ]
+    [ "${lines[3]}" = '{"type": "error", "line": 4, "message": "expected a WALK or DISTANCE query"}' ]
+}
+
 # Errors
 
 @test "Format \"dot\" not supported yet" {
@@ -66,6 +180,12 @@ help_first_line="Usage: ../bin/isomap [-h|--help] [-s|--start X,Y,Z] [-e|--end X
     [ "${lines[1]}" = "$help_first_line" ]
 }
 
+@test "Backend opengl not supported" {
+    run $prog -b opengl -f png -o "$BATS_TMPDIR"/map.png < ../data/map3x3.json
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Error: backend opengl not supported" ]
+}
+
 @test "Wrong coordinates with -s a,2,2" {
     run $prog -s a,2,2
     [ "$status" -eq 2 ]
@@ -80,6 +200,40 @@ help_first_line="Usage: ../bin/isomap [-h|--help] [-s|--start X,Y,Z] [-e|--end X
     [ "${lines[1]}" = "$help_first_line" ]
 }
 
+@test "Wrong number of threads with -t 0" {
+    run $prog -t 0
+    [ "$status" -eq 7 ]
+    [ "${lines[0]}" = "Error: the number of threads must be a positive integer" ]
+    [ "${lines[1]}" = "$help_first_line" ]
+}
+
+@test "Wrong viewport with -V 0,0,10" {
+    run $prog -V 0,0,10
+    [ "$status" -eq 8 ]
+    [ "${lines[0]}" = "Error: the viewport must be 4 integers X,Y,W,H with positive W and H" ]
+    [ "${lines[1]}" = "$help_first_line" ]
+}
+
+@test "Wrong tile size with -T 15" {
+    run $prog -T 15
+    [ "$status" -eq 9 ]
+    [ "${lines[0]}" = "Error: the tile size must be a positive even integer" ]
+    [ "${lines[1]}" = "$help_first_line" ]
+}
+
+@test "Wrong png level with --png-level 10" {
+    run $prog --png-level 10
+    [ "$status" -eq 11 ]
+    [ "${lines[0]}" = "Error: the PNG level must be an integer between 0 and 9" ]
+    [ "${lines[1]}" = "$help_first_line" ]
+}
+
+@test "Output file path mandatory with format \"pyramid\"" {
+    run $prog -f pyramid
+    [ "$status" -eq 3 ]
+    [ "${lines[0]}" = "Error: output filename is mandatory with pyramid format" ]
+}
+
 @test "Output file path mandatory with format \"png\"" {
     run $prog -f png
     [ "$status" -eq 3 ]
@@ -103,3 +257,51 @@ help_first_line="Usage: ../bin/isomap [-h|--help] [-s|--start X,Y,Z] [-e|--end X
     [ "$status" -eq 5 ]
     [ "${lines[0]}" = "Error: invalid file path" ]
 }
+
+@test "Handle failed image write" {
+    run $prog -f qoi -o /dev/full < ../data/map3x3.json
+    [ "$status" -eq 10 ]
+    [ "${lines[0]}" = "Error: cannot write the image" ]
+}
+
+@test "Input format xml is not supported" {
+    run $prog -I xml
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Error: input format xml not supported" ]
+}
+
+@test "Handle invalid binary map" {
+    run $prog -I binary -i ../data/map3x3.json
+    [ "$status" -eq 6 ]
+    [ "${lines[0]}" = "Error: invalid map" ]
+}
+
+@test "Handle invalid JSON map" {
+    run $prog -i ../README.md
+    [ "$status" -eq 6 ]
+    [ "${lines[0]}" = "Error: invalid map" ]
+}
+
+@test "Handle invalid socket path" {
+    run $prog --serve "$BATS_TMPDIR/epic.fail/isomap.sock" < ../data/map3x3.json
+    [ "$status" -eq 12 ]
+    [ "${lines[0]}" = "Error: cannot listen on the socket $BATS_TMPDIR/epic.fail/isomap.sock" ]
+}
+
+@test "Queries are not supported with the text format" {
+    run $prog -q "$BATS_TMPDIR"/queries.txt
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Error: queries are only supported with the json and ndjson formats" ]
+}
+
+@test "Stats format xml is not supported" {
+    run $prog --stats=xml
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Error: stats format xml not supported" ]
+}
+
+@test "Wrong density with generator option -d 101" {
+    run $generator -d 101
+    [ "$status" -eq 12 ]
+    [ "${lines[0]}" = "Error: invalid value for option -d" ]
+}
@@ -0,0 +1,74 @@
+#include "../src/arena.h"
+#include "../src/map.h"
+#include "../src/tile.h"
+#include "../src/graph.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <tap.h>
+
+int main () {
+    diag("Creating an empty arena");
+    struct arena *arena = arena_create();
+    ok(arena->num_blocks == 0 && arena->used == 0, "arena is empty");
+    diag("Allocating 3 small objects");
+    int *a = arena_alloc(arena, sizeof(int));
+    char *b = arena_alloc(arena, 3);
+    double *c = arena_calloc(arena, 4, sizeof(double));
+    ok(arena->num_allocations == 3, "arena has 3 allocations");
+    ok(arena->num_blocks == 1, "arena has 1 block");
+    ok((uintptr_t)b % _Alignof(max_align_t) == 0 &&
+       (uintptr_t)c % _Alignof(max_align_t) == 0,
+       "allocations are aligned");
+    ok(c[0] == 0.0 && c[3] == 0.0, "calloc'ed memory is zero");
+    *a = 42;
+    diag("Growing the last allocation");
+    double *d = arena_realloc(arena, c, 4 * sizeof(double), 8 * sizeof(double));
+    ok(d == c, "last allocation is resized in place");
+    diag("Growing an allocation that is not the last one");
+    size_t used = arena->used;
+    int *e = arena_realloc(arena, a, sizeof(int), 10 * sizeof(int));
+    ok(e != a && e[0] == 42, "allocation is copied");
+    ok(arena->used - used < 10 * sizeof(int) + _Alignof(max_align_t),
+       "old allocation is no longer counted as used");
+    diag("Allocating a large object");
+    used = arena->used;
+    arena_alloc(arena, ARENA_BLOCK_SIZE);
+    ok(arena->num_blocks == 2, "large object gets its own block");
+    void *f = arena_alloc(arena, 16);
+    ok((char*)f > (char*)e && (char*)f < (char*)e + 64,
+       "small objects are still allocated in the current block");
+    ok(arena->used == used + ARENA_BLOCK_SIZE + 16, "used bytes are counted");
+    arena_print_stats(stdout, arena, "# ");
+    diag("Resetting the arena");
+    size_t high_water = arena->high_water;
+    arena_reset(arena);
+    ok(arena->used == 0 && arena->num_blocks == 0, "arena is empty again");
+    ok(arena->high_water == high_water, "high-water mark is kept");
+    diag("Creating a map, a tileset and a graph in the arena");
+    struct tileset *tileset = tile_create_tileset_in_arena(arena);
+    tile_add_to_tileset(tileset, 1, "art/flat-64x64.png");
+    int dirs[4][3] = {{1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}};
+    for (int i = 0; i < 4; ++i) {
+        tile_add_direction(tileset, 1, dirs[i][0], dirs[i][1], dirs[i][2], true);
+        tile_add_direction(tileset, 1, dirs[i][0], dirs[i][1], dirs[i][2], false);
+    }
+    struct map *map = map_create_in_arena(arena);
+    map_add_layer(map, 4, 4, 0, 0, 0);
+    for (int x = 0; x < 4; ++x)
+        for (int y = 0; y < 4; ++y)
+            map_set_tile_by_location(map, x, y, 0, 1);
+    struct graph *graph = graph_create_in_arena(arena, map, tileset);
+    ok(graph->num_nodes == 16, "graph has 16 nodes");
+    struct location start = {0, 0, 0}, end = {3, 3, 0};
+    struct graph_walk *walk = graph_shortest_walk(graph, &start, &end);
+    ok(walk != NULL && walk->num_nodes == 7, "walk has 7 nodes");
+    graph_delete_walk(walk);
+    ok(arena->num_allocations > 20, "objects are allocated in the arena");
+    arena_print_stats(stdout, arena, "# ");
+    graph_delete(graph);
+    map_delete(map);
+    tile_delete_tileset(tileset);
+    diag("Deleting the arena");
+    arena_delete(arena);
+    done_testing();
+}
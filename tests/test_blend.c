@@ -0,0 +1,72 @@
+#include "../src/blend.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <cairo.h>
+#include <tap.h>
+
+#define NUM_PIXELS 1000
+
+/**
+ * Return a random premultiplied ARGB32 pixel
+ *
+ * One pixel out of four is opaque and one out of four is fully transparent,
+ * so that the shortcuts of `blend_over` are exercised.
+ *
+ * @return  The pixel
+ */
+uint32_t random_pixel(void) {
+    int kind = rand() % 4;
+    uint32_t alpha = kind == 0 ? 0 : kind == 1 ? 255 : rand() % 256;
+    uint32_t pixel = alpha << 24;
+    for (unsigned int k = 0; k < 24; k += 8)
+        pixel |= (alpha == 0 ? 0 : rand() % (alpha + 1)) << k;
+    return pixel;
+}
+
+int main () {
+    srand(36);
+    uint32_t *source = malloc(NUM_PIXELS * sizeof(uint32_t));
+    uint32_t *target = malloc(NUM_PIXELS * sizeof(uint32_t));
+    uint32_t *expected = malloc(NUM_PIXELS * sizeof(uint32_t));
+    for (unsigned int i = 0; i < NUM_PIXELS; ++i) {
+        source[i] = random_pixel();
+        target[i] = expected[i] = random_pixel();
+    }
+    diag("Compositing with cairo");
+    cairo_surface_t *surface = cairo_image_surface_create_for_data(
+        (unsigned char*)expected, CAIRO_FORMAT_ARGB32, NUM_PIXELS, 1,
+        NUM_PIXELS * sizeof(uint32_t));
+    cairo_surface_t *image = cairo_image_surface_create_for_data(
+        (unsigned char*)source, CAIRO_FORMAT_ARGB32, NUM_PIXELS, 1,
+        NUM_PIXELS * sizeof(uint32_t));
+    cairo_t *cr = cairo_create(surface);
+    cairo_set_source_surface(cr, image, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(surface);
+    cairo_surface_destroy(image);
+    cairo_surface_destroy(surface);
+
+    diag("Compositing row by row");
+    uint32_t *scalar = malloc(NUM_PIXELS * sizeof(uint32_t));
+    for (unsigned int i = 0; i < NUM_PIXELS; ++i)
+        scalar[i] = target[i];
+    blend_over_scalar(scalar, source, NUM_PIXELS);
+    bool same = true;
+    for (unsigned int i = 0; i < NUM_PIXELS; ++i)
+        same = same && scalar[i] == expected[i];
+    ok(same, "scalar compositing gives the same pixels as cairo");
+    blend_over(target, source, 3);
+    blend_over(target + 3, source + 3, 13);
+    blend_over(target + 16, source + 16, NUM_PIXELS - 16);
+    same = true;
+    for (unsigned int i = 0; i < NUM_PIXELS; ++i)
+        same = same && target[i] == expected[i];
+    ok(same, "vectorized compositing gives the same pixels as cairo");
+    free(scalar);
+    free(expected);
+    free(target);
+    free(source);
+    done_testing();
+}
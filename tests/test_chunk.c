@@ -0,0 +1,51 @@
+#include "../src/chunk.h"
+#include <stdio.h>
+#include <tap.h>
+
+int main () {
+    diag("Creating an empty chunk table");
+    struct chunk_table *table = chunk_create_table();
+    ok(table->num_chunks == 0, "empty table has 0 chunk");
+    ok(chunk_get(table, 0, 0) == NULL, "chunk (0,0) is not allocated");
+    ok(chunk_next(table, 0, 0) == NULL, "there is no chunk after (0,0)");
+    diag("Adding chunks (3,1), (0,2), (3,0) and (1000,1000)");
+    tile_id *tiles = chunk_get_or_add(table, 3, 1);
+    tiles[5] = 7;
+    chunk_get_or_add(table, 0, 2);
+    chunk_get_or_add(table, 3, 0);
+    chunk_get_or_add(table, 1000, 1000);
+    ok(table->num_chunks == 4, "table now has 4 chunks");
+    ok(chunk_get_or_add(table, 3, 1) == tiles,
+       "adding chunk (3,1) again returns the same chunk");
+    ok(table->num_chunks == 4, "table still has 4 chunks");
+    ok(chunk_get(table, 3, 1)[5] == 7, "tile 5 of chunk (3,1) is 7");
+    ok(chunk_get(table, 0, 2)[0] == 0, "tiles of a new chunk are empty");
+    ok(chunk_get(table, 2, 3) == NULL, "chunk (2,3) is not allocated");
+    diag("Visiting chunks in row-major order");
+    const struct chunk *chunk = chunk_next(table, 0, 0);
+    ok(chunk->row == 0 && chunk->column == 2, "first chunk is (0,2)");
+    chunk = chunk_next(table, 0, 3);
+    ok(chunk->row == 3 && chunk->column == 0, "chunk after (0,3) is (3,0)");
+    chunk = chunk_next(table, 3, 1);
+    ok(chunk->row == 3 && chunk->column == 1, "chunk at (3,1) is (3,1)");
+    chunk = chunk_next(table, 3, 2);
+    ok(chunk->row == 1000 && chunk->column == 1000,
+       "chunk after (3,2) is (1000,1000)");
+    ok(chunk_next(table, 1000, 1001) == NULL,
+       "there is no chunk after (1000,1001)");
+    ok(chunk_get(table, 3, 1)[5] == 7,
+       "tile 5 of chunk (3,1) is still 7 after visiting the chunks");
+    ok(table->chunks[0].row == 3 && table->chunks[0].column == 1,
+       "visiting the chunks does not move them");
+    diag("Adding 1000 chunks");
+    for (unsigned int i = 0; i < 1000; ++i)
+        chunk_get_or_add(table, 2000 - i, i);
+    ok(table->num_chunks == 1004, "table now has 1004 chunks");
+    ok(chunk_get(table, 1500, 500) != NULL, "chunk (1500,500) is allocated");
+    chunk = chunk_next(table, 1001, 0);
+    ok(chunk->row == 1001 && chunk->column == 999,
+       "chunk after (1001,0) is (1001,999)");
+    diag("Deleting the chunk table");
+    chunk_delete_table(table);
+    done_testing();
+}
@@ -0,0 +1,224 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/graph.h"
+#include "../src/isomap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <tap.h>
+
+#define REPETITIONS 5
+#define SIZE_GROWTH 2
+#define MAX_RATIO 8.0
+
+/**
+ * The input of an operation whose time is measured
+ */
+struct input {
+    unsigned int size;        // The size of the input
+    struct map *map;          // A map of size x size cells
+    struct tileset *tileset;  // The tileset of the map
+    struct graph *graph;      // The graph of the map
+    char *json;               // The map as a JSON document
+    size_t json_length;       // The length of the JSON document
+};
+
+/**
+ * Return the current time, in seconds
+ *
+ * @return  The time
+ */
+double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Return the tileset of the maps: a flat tile that allows the moves between
+ * neighbor cells
+ *
+ * @return  The tileset
+ */
+struct tileset *create_tileset(void) {
+    struct tileset *tileset = tile_create_tileset();
+    tile_add_to_tileset(tileset, 1, "");
+    int moves[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    for (unsigned int m = 0; m < 4; ++m) {
+        tile_add_direction(tileset, 1, moves[m][0], moves[m][1], 0, true);
+        tile_add_direction(tileset, 1, moves[m][0], moves[m][1], 0, false);
+    }
+    return tileset;
+}
+
+/**
+ * Create the input of a given size: a map of two layers, a full ground and a
+ * sparse layer above it, its graph and its JSON document
+ *
+ * @param size  The number of rows and columns of the map
+ * @return      The input
+ */
+struct input create_input(unsigned int size) {
+    struct input input = {size, map_create(), create_tileset(), NULL,
+                          NULL, 0};
+    FILE *stream = open_memstream(&input.json, &input.json_length);
+    fprintf(stream, "{\"tileset\": [{\"id\": 1, \"filename\": \"\"}], "
+            "\"layers\": [");
+    for (int z = 0; z < 2; ++z) {
+        struct layer *layer = map_add_layer(input.map, size, size, 0, 0, z);
+        fprintf(stream, "%s{\"num-rows\": %u, \"num-cols\": %u, "
+                "\"offset\": [0, 0, %d], \"data\": [", z == 0 ? "" : ", ",
+                size, size, z);
+        for (unsigned int i = 0; i < size; ++i) {
+            for (unsigned int j = 0; j < size; ++j) {
+                tile_id tile = z == 0 || (i * 7 + j * 13) % 29 == 0;
+                map_set_layer_tile(layer, i, j, tile);
+                fprintf(stream, "%s%d", i + j == 0 ? "" : ", ", tile);
+            }
+        }
+        fprintf(stream, "]}");
+    }
+    fprintf(stream, "]}");
+    fclose(stream);
+    input.graph = graph_create(input.map, input.tileset);
+    return input;
+}
+
+/**
+ * Delete an input
+ *
+ * @param input  The input
+ */
+void delete_input(struct input *input) {
+    graph_delete(input->graph);
+    map_delete(input->map);
+    tile_delete_tileset(input->tileset);
+    free(input->json);
+}
+
+/**
+ * Build the graph of the map of an input
+ *
+ * @param input  The input
+ */
+void build_graph(struct input *input) {
+    graph_delete(graph_create(input->map, input->tileset));
+}
+
+/**
+ * Search a shortest walk between two opposite corners of the ground
+ *
+ * @param input  The input
+ */
+void search_walk(struct input *input) {
+    struct location start = {0, 0, 0};
+    struct location end = {input->size - 1, input->size - 1, 0};
+    while (!map_is_location_top_free(input->map, start.x, start.y, 0))
+        ++start.y;
+    while (!map_is_location_top_free(input->map, end.x, end.y, 0))
+        --end.y;
+    struct graph_walk *walk = graph_shortest_walk(input->graph, &start, &end);
+    if (walk != NULL)
+        graph_delete_walk(walk);
+}
+
+/**
+ * Compute the bounding box of the map of an input
+ *
+ * @param input  The input
+ */
+void compute_bounding_box(struct input *input) {
+    map_get_bounding_box(input->map);
+}
+
+/**
+ * Fill a tileset of size^2 / 20 tiles, then look up all its tiles by id
+ *
+ * @param input  The input
+ */
+void look_up_tiles(struct input *input) {
+    unsigned int num_tiles = input->size * input->size / 20;
+    struct tileset *tileset = tile_create_tileset();
+    for (unsigned int i = 0; i < num_tiles; ++i)
+        tile_add_to_tileset(tileset, (tile_id)(i * 7919 % num_tiles) + 1,
+                            "tile.png");
+    for (unsigned int i = 1; i <= num_tiles; ++i)
+        tile_by_id(tileset, i);
+    tile_delete_tileset(tileset);
+}
+
+/**
+ * Load the map of an input from its JSON document
+ *
+ * @param input  The input
+ */
+void load_map(struct input *input) {
+    FILE *stream = fmemopen(input->json, input->json_length, "r");
+    isomap_delete(isomap_create_from_json_file(stream));
+    fclose(stream);
+}
+
+/**
+ * Return the time of an operation on an input, in seconds
+ *
+ * @param operation  The operation
+ * @param input      The input
+ * @return           The time
+ */
+double measure(void (*operation)(struct input *input), struct input *input) {
+    double start = now();
+    operation(input);
+    return now() - start;
+}
+
+/**
+ * Tell if the time of an operation grows linearly with the size of its input
+ *
+ * The size of the input is multiplied by `SIZE_GROWTH` in both dimensions,
+ * so that the time of a linear operation is multiplied by
+ * `SIZE_GROWTH * SIZE_GROWTH`, and the time of a quadratic operation by the
+ * square of that. The test passes if the time is multiplied by at most
+ * `MAX_RATIO`, which leaves room for the noise of shared hosts: the fastest
+ * of several runs is kept, and the runs on both inputs alternate so that
+ * they suffer from the same load. Both inputs are larger than the usual
+ * caches, so that the small one is not favored.
+ *
+ * @param name       The name of the operation
+ * @param operation  The operation
+ * @param small      The small input
+ * @param large      The large input
+ */
+void ok_linear(const char *name, void (*operation)(struct input *input),
+               struct input *small, struct input *large) {
+    double small_time = 0.0, large_time = 0.0;
+    for (unsigned int r = 0; r < REPETITIONS; ++r) {
+        double small_elapsed = measure(operation, small);
+        double large_elapsed = measure(operation, large);
+        if (r == 0 || small_elapsed < small_time)
+            small_time = small_elapsed;
+        if (r == 0 || large_elapsed < large_time)
+            large_time = large_elapsed;
+    }
+    double ratio = large_time / (small_time > 0.0 ? small_time : 1e-9);
+    diag("%s: %.3f ms -> %.3f ms (x%.1f)", name, 1000 * small_time,
+         1000 * large_time, ratio);
+    ok(ratio <= MAX_RATIO, "%s grows linearly (x%.1f for x%d cells)", name,
+       ratio, SIZE_GROWTH * SIZE_GROWTH);
+}
+
+int main () {
+    diag("Creating maps of 256x256 and 512x512 cells");
+    struct input small = create_input(256);
+    struct input large = create_input(256 * SIZE_GROWTH);
+    ok(large.graph->num_nodes == SIZE_GROWTH * SIZE_GROWTH *
+                                 small.graph->num_nodes,
+       "large map has %d times more nodes", SIZE_GROWTH * SIZE_GROWTH);
+    diag("Comparing the times of the operations");
+    ok_linear("graph_create", build_graph, &small, &large);
+    ok_linear("graph_shortest_walk", search_walk, &small, &large);
+    ok_linear("map_get_bounding_box", compute_bounding_box, &small, &large);
+    ok_linear("tile_by_id", look_up_tiles, &small, &large);
+    ok_linear("isomap_create_from_json_file", load_map, &small, &large);
+    delete_input(&small);
+    delete_input(&large);
+    done_testing();
+}
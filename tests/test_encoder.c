@@ -0,0 +1,192 @@
+#include "../src/encoder.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cairo.h>
+#include <tap.h>
+
+#define WIDTH 150
+#define HEIGHT 200
+#define ROWS_PER_CALL 37
+
+/**
+ * Encode a surface to a file, a few rows at a time
+ *
+ * @param surface      The surface
+ * @param filename     The filename
+ * @param format       The image format
+ * @param level        The compression level
+ * @param num_threads  The number of threads
+ * @return             True if the encoding succeeded
+ */
+bool encode_surface(cairo_surface_t *surface, const char *filename,
+                    enum encoder_format format, int level,
+                    unsigned int num_threads) {
+    FILE *stream = fopen(filename, "wb");
+    if (stream == NULL)
+        return false;
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char *data = cairo_image_surface_get_data(surface);
+    struct encoder *encoder = encoder_create(stream, format, width, height,
+                                             level, num_threads);
+    for (int y = 0; y < height; y += ROWS_PER_CALL)
+        encoder_write_rows(encoder, data + y * stride, stride, ROWS_PER_CALL);
+    bool valid = encoder_delete(encoder);
+    fclose(stream);
+    return valid;
+}
+
+/**
+ * Return true if two surfaces have the same pixels
+ *
+ * @param first   The first surface
+ * @param second  The second surface
+ * @return        True if the pixels are the same
+ */
+bool is_same_surface(cairo_surface_t *first, cairo_surface_t *second) {
+    int width = cairo_image_surface_get_width(first);
+    int height = cairo_image_surface_get_height(first);
+    if (cairo_surface_status(second) != CAIRO_STATUS_SUCCESS ||
+        cairo_image_surface_get_width(second) != width ||
+        cairo_image_surface_get_height(second) != height)
+        return false;
+    for (int y = 0; y < height; ++y)
+        if (memcmp(cairo_image_surface_get_data(first) +
+                   y * cairo_image_surface_get_stride(first),
+                   cairo_image_surface_get_data(second) +
+                   y * cairo_image_surface_get_stride(second), 4 * width) != 0)
+            return false;
+    return true;
+}
+
+/**
+ * Return true if two files have the same bytes
+ *
+ * @param first   The first filename
+ * @param second  The second filename
+ * @return        True if the files are identical
+ */
+bool is_same_file(const char *first, const char *second) {
+    FILE *f = fopen(first, "rb");
+    FILE *g = fopen(second, "rb");
+    int c, d;
+    do {
+        c = fgetc(f);
+        d = fgetc(g);
+    } while (c == d && c != EOF);
+    fclose(f);
+    fclose(g);
+    return c == d;
+}
+
+/**
+ * Read a whole file
+ *
+ * @param filename  The filename
+ * @param length    The length of the file, set by the function
+ * @return          The bytes of the file
+ */
+unsigned char *read_file(const char *filename, long *length) {
+    FILE *stream = fopen(filename, "rb");
+    fseek(stream, 0, SEEK_END);
+    *length = ftell(stream);
+    rewind(stream);
+    unsigned char *bytes = malloc(*length);
+    *length = fread(bytes, 1, *length, stream);
+    fclose(stream);
+    return bytes;
+}
+
+int main () {
+    srand(40);
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                          WIDTH, HEIGHT);
+    unsigned char *data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            uint32_t alpha = x < WIDTH / 2 ? 255 : rand() % 256;
+            uint32_t pixel = alpha << 24;
+            for (unsigned int k = 0; k < 24; k += 8)
+                pixel |= (y < HEIGHT / 2 ? (x * y) % (alpha + 1)
+                                         : rand() % (alpha + 1)) << k;
+            ((uint32_t*)(data + y * stride))[x] = pixel;
+        }
+    }
+    cairo_surface_mark_dirty(surface);
+    cairo_surface_write_to_png(surface, "encoder-cairo.png");
+    cairo_surface_t *expected =
+        cairo_image_surface_create_from_png("encoder-cairo.png");
+
+    diag("Encoding png files");
+    int levels[] = {0, 1, 6, 9};
+    for (unsigned int l = 0; l < 4; ++l) {
+        ok(encode_surface(surface, "encoder.png", ENCODER_PNG, levels[l], 1),
+           "png file of level %d is encoded", levels[l]);
+        cairo_surface_t *image =
+            cairo_image_surface_create_from_png("encoder.png");
+        ok(is_same_surface(image, expected),
+           "png file of level %d has the same pixels as with cairo",
+           levels[l]);
+        cairo_surface_destroy(image);
+    }
+    encode_surface(surface, "encoder-threads.png", ENCODER_PNG, 9, 3);
+    ok(is_same_file("encoder.png", "encoder-threads.png"),
+       "png file encoded with 3 threads is identical");
+    long length;
+    unsigned char *bytes = read_file("encoder.png", &length);
+    ok(length > 8 && memcmp(bytes, "\x89PNG\r\n\x1a\n", 8) == 0 &&
+       memcmp(bytes + length - 8, "IEND", 4) == 0,
+       "png file starts with the signature and ends with IEND");
+    free(bytes);
+
+    diag("Encoding uncompressed files");
+    encode_surface(surface, "encoder.raw", ENCODER_RAW, 0, 1);
+    unsigned char *raw = read_file("encoder.raw", &length);
+    ok(length == 4 * WIDTH * HEIGHT, "raw file has 4 bytes per pixel");
+    encode_surface(surface, "encoder.ppm", ENCODER_PPM, 0, 1);
+    bytes = read_file("encoder.ppm", &length);
+    const char *header = "P6\n150 200\n255\n";
+    bool same_rgb = length == (long)strlen(header) + 3 * WIDTH * HEIGHT &&
+                    memcmp(bytes, header, strlen(header)) == 0;
+    for (long i = 0; same_rgb && i < WIDTH * HEIGHT; ++i)
+        same_rgb = memcmp(bytes + strlen(header) + 3 * i, raw + 4 * i, 3) == 0;
+    ok(same_rgb, "ppm file has the RGB bytes of the raw file");
+    free(bytes);
+    encode_surface(surface, "encoder.pam", ENCODER_PAM, 0, 1);
+    bytes = read_file("encoder.pam", &length);
+    header = "P7\nWIDTH 150\nHEIGHT 200\nDEPTH 4\nMAXVAL 255\n"
+             "TUPLTYPE RGB_ALPHA\nENDHDR\n";
+    ok(length == (long)strlen(header) + 4 * WIDTH * HEIGHT &&
+       memcmp(bytes, header, strlen(header)) == 0 &&
+       memcmp(bytes + strlen(header), raw, 4 * WIDTH * HEIGHT) == 0,
+       "pam file has the RGBA bytes of the raw file");
+    free(bytes);
+    free(raw);
+    enum encoder_format format;
+    ok(encoder_format_by_name("qoi", &format) && format == ENCODER_QOI &&
+       !encoder_format_by_name("jpeg", &format),
+       "formats are found by name");
+
+    diag("Encoding qoi files");
+    cairo_surface_t *red = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                      100, 10);
+    cairo_t *cr = cairo_create(red);
+    cairo_set_source_rgb(cr, 1, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    encode_surface(red, "encoder.qoi", ENCODER_QOI, 0, 1);
+    bytes = read_file("encoder.qoi", &length);
+    ok(length == 14 + 1 + 17 + 8 && memcmp(bytes, "qoif", 4) == 0 &&
+       bytes[14] == 0x5a &&
+       bytes[length - 9] == (0xc0 | 6) && bytes[length - 1] == 1,
+       "red qoi image is a difference followed by runs");
+    free(bytes);
+    cairo_surface_destroy(red);
+    cairo_surface_destroy(expected);
+    cairo_surface_destroy(surface);
+    done_testing();
+}
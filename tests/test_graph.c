@@ -1,8 +1,56 @@
 #include "../src/isomap.h"
 #include "../src/graph.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <tap.h>
 
+/**
+ * Return true if two walks visit the same locations
+ *
+ * @param walk   The first walk (or NULL)
+ * @param other  The second walk (or NULL)
+ * @return       True if the walks are the same
+ */
+bool is_same_walk(const struct graph_walk *walk,
+                  const struct graph_walk *other) {
+    if (walk == NULL || other == NULL)
+        return walk == other;
+    if (walk->num_nodes != other->num_nodes)
+        return false;
+    for (unsigned int i = 0; i < walk->num_nodes; ++i)
+        if (!geometry_equal_location(&walk->nodes[i]->location,
+                                     &other->nodes[i]->location))
+            return false;
+    return true;
+}
+
+/**
+ * Return true if the walks between all pairs of top-free locations of a map
+ * are the same with and without its graph
+ *
+ * @param isomap  The isomap
+ * @return        True if all walks are the same
+ */
+bool are_same_walks(const struct isomap *isomap) {
+    struct graph *graph = graph_create(isomap->map, isomap->tileset);
+    bool same = true;
+    for (unsigned int i = 0; same && i < graph->num_nodes; ++i) {
+        for (unsigned int j = 0; same && j < graph->num_nodes; ++j) {
+            const struct location *start = &graph->nodes[i].location;
+            const struct location *end = &graph->nodes[j].location;
+            struct graph_walk *walk = graph_shortest_walk(graph, start, end);
+            struct graph_walk *other =
+                graph_shortest_walk_in_map(isomap->map, isomap->tileset,
+                                           start, end);
+            same = is_same_walk(walk, other);
+            if (walk != NULL) graph_delete_walk(walk);
+            if (other != NULL) graph_delete_walk(other);
+        }
+    }
+    graph_delete(graph);
+    return same;
+}
+
 int main () {
     FILE *input = fopen("../data/map10x10-64x64.json", "r");
     struct isomap *isomap = isomap_create_from_json_file(input);
@@ -14,8 +62,26 @@ int main () {
     struct location end = {9, 0, 1};
     struct graph_walk *walk = graph_shortest_walk(graph, &start, &end);
     graph_print_walk(stdout, walk, "# ");
+    diag("Searching walks without the graph");
+    struct graph_walk *other = graph_shortest_walk_in_map(isomap->map,
+                                                          isomap->tileset,
+                                                          &start, &end);
+    ok(is_same_walk(walk, other),
+       "walk from (0,9,1) to (9,0,1) is the same without the graph");
+    graph_delete_walk(other);
     graph_delete_walk(walk);
     graph_delete(graph);
+    ok(are_same_walks(isomap), "all walks are the same without the graph");
+    srand(43);
+    for (unsigned int k = 0; k < 30; ++k)
+        map_set_tile_by_location(isomap->map, rand() % 10, rand() % 10,
+                                 rand() % 3, rand() % 4);
+    ok(are_same_walks(isomap),
+       "all walks are the same without the graph after random changes");
+    struct location hidden = {0, 0, 0};
+    ok(graph_shortest_walk_in_map(isomap->map, isomap->tileset,
+                                  &hidden, &end) == NULL,
+       "no walk starts at a location that is not top-free");
     isomap_delete(isomap);
     done_testing();
 }
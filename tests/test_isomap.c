@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include "../src/isomap.h"
 #include "../src/tile.h"
 #include "../src/map.h"
@@ -15,9 +16,54 @@ int main () {
     struct isomap *isomap = isomap_create_from_json_file(input);
     pass("create isomap from %s", filename);
     isomap_print(stdout, isomap, "# ");
-    isomap_draw_to_png(isomap, "isomap.png");
-    pass("create png file from isomap");
+    diag("Converting the isomap to the binary format");
+    FILE *binary = tmpfile();
+    isomap_write_binary(binary, isomap);
+    rewind(binary);
+    struct isomap *copy = isomap_create_from_binary_file(binary);
+    ok(copy != NULL, "load isomap from binary file");
+    ok(copy->tileset->num_tiles == isomap->tileset->num_tiles &&
+       copy->map->num_layers == isomap->map->num_layers,
+       "binary isomap has the same tiles and layers");
+    bool same = true;
+    for (const struct location *location =
+             map_get_occupied_location(isomap->map, true);
+         location != NULL;
+         location = map_get_occupied_location(isomap->map, false))
+        same = same &&
+               map_get_tile_by_location(isomap->map, location->x,
+                                        location->y, location->z) ==
+               map_get_tile_by_location(copy->map, location->x,
+                                        location->y, location->z);
+    ok(same, "binary isomap has the same tiles at each location");
+    map_set_tile_by_location(copy->map, 0, 0, 0, 0);
+    ok(map_get_tile_by_location(copy->map, 0, 0, 0) == 0,
+       "binary isomap can be modified");
+    isomap_delete(copy);
+    fclose(binary);
     isomap_delete(isomap);
     fclose(input);
+    diag("Converting an isomap with an empty run-length layer");
+    char json[] = "{\"tileset\": [{\"id\": 1, \"filename\": \"\"}], "
+                  "\"layers\": [{\"num-rows\": 0, \"num-cols\": 3, "
+                  "\"offset\": [0, 0, 0], \"storage\": \"rle\", "
+                  "\"data\": []}]}";
+    input = fmemopen(json, sizeof(json) - 1, "r");
+    isomap = isomap_create_from_json_file(input);
+    fclose(input);
+    ok(isomap != NULL && isomap->map->num_layers == 1 &&
+       isomap->map->layers[0].storage == LAYER_RLE,
+       "load isomap with an empty run-length layer");
+    binary = tmpfile();
+    isomap_write_binary(binary, isomap);
+    rewind(binary);
+    copy = isomap_create_from_binary_file(binary);
+    ok(copy != NULL && copy->map->num_layers == 1 &&
+       copy->map->layers[0].num_rows == 0 &&
+       copy->map->layers[0].storage == LAYER_RLE,
+       "empty run-length layer is read back from the binary file");
+    if (copy != NULL) isomap_delete(copy);
+    fclose(binary);
+    isomap_delete(isomap);
     done_testing();
 }
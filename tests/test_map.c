@@ -1,4 +1,6 @@
 #include "../src/map.h"
+#include "../src/chunk.h"
+#include "../src/rle.h"
 #include <stdio.h>
 #include <tap.h>
 
@@ -53,5 +55,117 @@ int main () {
        "bounding box maximum coordinates are (7,4,3)");
     diag("Deleting the map");
     map_delete(map);
+    diag("Creating a map with a chunked 100000x100000 layer");
+    map = map_create();
+    map_add_layer_with_storage(map, LAYER_CHUNKED, 100000, 100000, -5, 0, 0);
+    map_add_layer(map, 2, 2, 0, 0, 1);
+    map_set_tile_by_location(map, 99990, 70000, 0, 4);
+    map_set_tile_by_location(map, 10, 40, 0, 2);
+    map_set_tile_by_location(map, 10, 3, 0, 1);
+    map_set_tile_by_location(map, 0, 0, 1, 5);
+    map_set_tile_by_location(map, 1, 1, 0, 0);
+    ok(map->layers[0].chunks->num_chunks == 3,
+       "only 3 chunks are allocated");
+    ok(map_get_tile_by_location(map, 10, 40, 0) == 2,
+       "tile at location (10,40,0) is 2");
+    ok(map_get_tile_by_location(map, 500, 500, 0) == 0,
+       "tile at location (500,500,0) is 0 (empty chunk)");
+    ok(map_get_tile_by_location(map, 99995, 0, 0) == -1,
+       "tile at location (99995,0,0) is -1 (does not exist)");
+    const struct location *location = map_get_occupied_location(map, true);
+    ok(location->x == 10 && location->y == 3 && location->z == 0,
+       "first occupied location is (10,3,0)");
+    location = map_get_occupied_location(map, false);
+    ok(location->x == 10 && location->y == 40 && location->z == 0,
+       "second occupied location is (10,40,0)");
+    location = map_get_occupied_location(map, false);
+    ok(location->x == 99990 && location->y == 70000 && location->z == 0,
+       "third occupied location is (99990,70000,0)");
+    location = map_get_occupied_location(map, false);
+    ok(location->x == 0 && location->y == 0 && location->z == 1,
+       "fourth occupied location is (0,0,1)");
+    ok(map_get_occupied_location(map, false) == NULL,
+       "there are 4 occupied locations");
+    b = map_get_bounding_box(map);
+    ok(b.xmin == 0 && b.ymin == 0 && b.zmin == 0 &&
+       b.xmax == 99990 && b.ymax == 70000 && b.zmax == 1,
+       "bounding box is (0,0,0;99990,70000,1)");
+    map_delete(map);
+    diag("Creating a map with a run-length 4x5 layer");
+    map = map_create();
+    struct layer *layer = map_add_layer_with_storage(map, LAYER_RLE,
+                                                     4, 5, 1, 1, 0);
+    for (int x = 1; x <= 4; ++x)
+        for (int y = 1; y <= 5; ++y)
+            map_set_tile_by_location(map, x, y, 0, x <= 2 ? 2 : 0);
+    map_set_tile_by_location(map, 4, 5, 0, 1);
+    ok(layer->runs->num_runs == 3, "layer has 3 runs");
+    ok(map_get_tile_by_location(map, 2, 5, 0) == 2,
+       "tile at location (2,5,0) is 2");
+    ok(map_get_tile_by_location(map, 3, 1, 0) == 0,
+       "tile at location (3,1,0) is 0");
+    n = 0;
+    for (location = map_get_occupied_location(map, true);
+         location != NULL;
+         location = map_get_occupied_location(map, false))
+        ++n;
+    ok(n == 11, "number of occupied locations is 11");
+    b = map_get_bounding_box(map);
+    ok(b.xmin == 1 && b.ymin == 1 && b.xmax == 4 && b.ymax == 5,
+       "bounding box is (1,1,0;4,5,0)");
+    diag("Converting the layer to dense, then chunked, then run-length");
+    map_convert_layer(layer, LAYER_DENSE);
+    ok(layer->storage == LAYER_DENSE && layer->tiles[3][4] == 1,
+       "dense layer has tile 1 at (3,4)");
+    map_set_tile_by_location(map, 3, 3, 0, 3);
+    map_convert_layer(layer, LAYER_CHUNKED);
+    ok(map_get_tile_by_location(map, 3, 3, 0) == 3,
+       "chunked layer has tile 3 at location (3,3,0)");
+    map_convert_layer(layer, LAYER_RLE);
+    ok(layer->runs->num_runs == 5, "run-length layer has 5 runs");
+    ok(map_get_tile_by_location(map, 1, 1, 0) == 2 &&
+       map_get_tile_by_location(map, 4, 4, 0) == 0 &&
+       map_get_tile_by_location(map, 4, 5, 0) == 1,
+       "tiles are preserved by the conversions");
+    map_delete(map);
+    diag("Tracking the changes of a map");
+    map = map_create();
+    map_add_layer(map, 100, 100, 0, 0, 0);
+    ok(map->version == 1, "adding a layer increments the version");
+    unsigned long version = map->version;
+    const struct map_change *changes;
+    ok(map_get_changes(map, version, &changes) == 0,
+       "nothing changed since version 1");
+    map_set_tile_by_location(map, 2, 3, 0, 1);
+    map_set_tile_by_location(map, 2, 4, 0, 1);
+    map_set_tile_by_location(map, 2, 4, 0, 1);
+    map_set_tile_by_location(map, 200, 4, 0, 1);
+    ok(map->version == 3, "only actual modifications are counted");
+    ok(map_get_changes(map, version, &changes) == 1 &&
+       changes[0].version == 3,
+       "neighboring changes are coalesced");
+    b = map_get_changed_box(map, version);
+    ok(b.xmin == 2 && b.ymin == 3 && b.xmax == 2 && b.ymax == 4,
+       "changed box is (2,3,0;2,4,0)");
+    version = map->version;
+    map_set_tile_by_location(map, 90, 90, 0, 2);
+    ok(map_get_changes(map, version, &changes) == 1 &&
+       changes[0].box.xmin == 90 && changes[0].box.ymin == 90,
+       "distant change is recorded separately");
+    b = map_get_changed_box(map, 1);
+    ok(b.xmin == 2 && b.ymin == 3 && b.xmax == 90 && b.ymax == 90,
+       "changes since version 1 are in box (2,3,0;90,90,0)");
+    diag("Filling the log of changes");
+    map_add_layer(map, 1000, 1000, 0, 0, 1);
+    version = map->version;
+    for (int i = 0; i < 2 * MAP_MAX_CHANGES; ++i)
+        map_set_tile_by_location(map, 7 * i, 999 - 7 * i, 1, 1);
+    ok(map->num_changes == MAP_MAX_CHANGES, "log is compacted");
+    b = map_get_changed_box(map, version);
+    ok(b.xmin <= 0 && b.ymax >= 999 &&
+       b.xmax >= 7 * (2 * MAP_MAX_CHANGES - 1) &&
+       b.ymin <= 999 - 7 * (2 * MAP_MAX_CHANGES - 1),
+       "compacted log still covers all changes");
+    map_delete(map);
     done_testing();
 }
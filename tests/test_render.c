@@ -0,0 +1,167 @@
+#include "../src/map.h"
+#include "../src/render.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <tap.h>
+
+/**
+ * Return true if a surface is equal to a rectangle of another surface
+ *
+ * @param surface  The surface
+ * @param full     The other surface
+ * @param x        The x-coordinate of the rectangle in `full`
+ * @param y        The y-coordinate of the rectangle in `full`
+ * @return         True if all pixels inside `full` are equal
+ */
+bool is_same_rectangle(cairo_surface_t *surface, cairo_surface_t *full,
+                       int x, int y) {
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            if (x + i < 0 || y + j < 0 ||
+                x + i >= cairo_image_surface_get_width(full) ||
+                y + j >= cairo_image_surface_get_height(full))
+                continue;
+            uint32_t p = ((uint32_t*)(cairo_image_surface_get_data(surface) +
+                          j * cairo_image_surface_get_stride(surface)))[i];
+            uint32_t q = ((uint32_t*)(cairo_image_surface_get_data(full) +
+                          (y + j) * cairo_image_surface_get_stride(full)))[x + i];
+            if (p != q)
+                return false;
+        }
+    }
+    return true;
+}
+
+int main () {
+    const char *filename = "../data/map10x10-256x256.json";
+    FILE *input = fopen(filename, "r");
+    if (input == NULL)
+        BAIL_OUT("problem opening %s", filename);
+    struct isomap *isomap = isomap_create_from_json_file(input);
+    fclose(input);
+    diag("Drawing the full image");
+    struct render_projection projection = render_get_projection(isomap);
+    struct render_viewport full_viewport = render_full_viewport(&projection);
+    ok(full_viewport.width == 2688 && full_viewport.height == 1670,
+       "full image is 2688x1670");
+    cairo_surface_t *full = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                       full_viewport.width,
+                                                       full_viewport.height);
+    ok(render_draw(isomap, &projection, &full_viewport, full, 1,
+                   RENDER_CAIRO) == 5,
+       "full image is drawn without 5 hidden tiles");
+
+    diag("Drawing the full image to png files, strip by strip");
+    ok(render_draw_to_png(isomap, NULL, "render.png", 1, RENDER_CAIRO),
+       "png file is written");
+    cairo_surface_t *image = cairo_image_surface_create_from_png("render.png");
+    ok(cairo_surface_status(image) == CAIRO_STATUS_SUCCESS &&
+       cairo_image_surface_get_height(image) == 1670 &&
+       is_same_rectangle(image, full, 0, 0),
+       "png file is the same as the full image");
+    cairo_surface_destroy(image);
+    render_draw_to_png(isomap, NULL, "render-threads.png", 7, RENDER_CAIRO);
+    FILE *single = fopen("render.png", "rb");
+    FILE *multiple = fopen("render-threads.png", "rb");
+    int c, d;
+    do {
+        c = fgetc(single);
+        d = fgetc(multiple);
+    } while (c == d && c != EOF);
+    ok(c == d, "png file drawn with 7 threads is identical");
+    fclose(single);
+    fclose(multiple);
+    FILE *full_device = fopen("/dev/full", "wb");
+    ok(!render_draw_to_stream(isomap, NULL, full_device, ENCODER_QOI, 0, 1,
+                              RENDER_DIRECT),
+       "failed write is reported");
+    fclose(full_device);
+
+    diag("Drawing viewports with the direct backend");
+    struct render_viewport viewports[] = {
+        {1000, 400, 300, 200}, {-100, -50, 400, 300},
+        {2500, 1500, 300, 200}, {0, 700, 2688, 1}
+    };
+    for (unsigned int v = 0; v < 4; ++v) {
+        struct render_viewport *viewport = viewports + v;
+        cairo_surface_t *surface =
+            cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                       viewport->width, viewport->height);
+        render_draw(isomap, &projection, viewport, surface, 3, RENDER_DIRECT);
+        ok(is_same_rectangle(surface, full, viewport->x, viewport->y),
+           "viewport (%d,%d,%u,%u) is the same as in the full image",
+           viewport->x, viewport->y, viewport->width, viewport->height);
+        cairo_surface_destroy(surface);
+    }
+
+    struct render_viewport thin = {1000, 400, 300, 10};
+    cairo_surface_t *bands = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                        thin.width,
+                                                        thin.height);
+    render_draw(isomap, &projection, &thin, bands, 8, RENDER_CAIRO);
+    ok(is_same_rectangle(bands, full, thin.x, thin.y),
+       "viewport of 10 rows drawn with 8 threads is the same");
+    cairo_surface_destroy(bands);
+
+    cairo_surface_t *direct =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                   full_viewport.width, full_viewport.height);
+    render_draw(isomap, &projection, &full_viewport, direct, 4, RENDER_DIRECT);
+    ok(is_same_rectangle(direct, full, 0, 0),
+       "full image drawn with the direct backend is the same");
+    cairo_surface_destroy(direct);
+
+    diag("Drawing a tile pyramid");
+    ok(render_draw_pyramid(isomap, "pyramid", 512, ENCODER_DEFAULT_LEVEL, 2,
+                           RENDER_DIRECT) == 4,
+       "pyramid of 512x512 images has 4 levels");
+    image = cairo_image_surface_create_from_png("pyramid/3/2/1.png");
+    ok(cairo_surface_status(image) == CAIRO_STATUS_SUCCESS &&
+       is_same_rectangle(image, full, 1024, 512),
+       "image (2,1) of level 3 is the same as in the full image");
+    cairo_surface_destroy(image);
+    image = cairo_image_surface_create_from_png("pyramid/0/0/0.png");
+    ok(cairo_surface_status(image) == CAIRO_STATUS_SUCCESS &&
+       cairo_image_surface_get_width(image) == 512,
+       "image (0,0) of level 0 is 512 pixels wide");
+    cairo_surface_destroy(image);
+    image = cairo_image_surface_create_from_png("pyramid/3/6/0.png");
+    ok(cairo_surface_status(image) != CAIRO_STATUS_SUCCESS,
+       "image (6,0) of level 3 is outside the full image");
+    cairo_surface_destroy(image);
+
+    diag("Updating the full image after modifying the map");
+    unsigned long version = isomap->map->version;
+    map_set_tile_by_location(isomap->map, 3, 4, 1, 2);
+    map_set_tile_by_location(isomap->map, 6, 7, 2, 0);
+    map_set_tile_by_location(isomap->map, 4, 4, 2, 3);
+    struct box box = {3, 4, 1, 3, 4, 1};
+    unsigned long area = render_update(isomap, &projection, &full_viewport,
+                                       full, &box, 1, 2, RENDER_DIRECT);
+    ok(area > 0 && area < full_viewport.width * full_viewport.height / 20,
+       "modifying one location renders %lu pixels again", area);
+    ok(render_update_since(isomap, &projection, &full_viewport, full,
+                           version, 2, RENDER_DIRECT),
+       "full image is updated");
+    cairo_surface_t *updated =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                   full_viewport.width, full_viewport.height);
+    render_draw(isomap, &projection, &full_viewport, updated, 1, RENDER_CAIRO);
+    ok(is_same_rectangle(updated, full, 0, 0),
+       "updated image is the same as the image of the modified map");
+    cairo_surface_destroy(updated);
+    version = isomap->map->version;
+    map_set_tile_by_location(isomap->map, 0, 0, 3, 0);
+    map_set_tile_by_location(isomap->map, 1, 1, 3, 0);
+    map_set_tile_by_location(isomap->map, 2, 4, 3, 0);
+    map_set_tile_by_location(isomap->map, 5, 5, 3, 0);
+    ok(!render_update_since(isomap, &projection, &full_viewport, full,
+                            version, 2, RENDER_DIRECT),
+       "full image is not updated when the projection changes");
+    cairo_surface_destroy(full);
+    isomap_delete(isomap);
+    done_testing();
+}
@@ -0,0 +1,45 @@
+#include "../src/rle.h"
+#include <stdio.h>
+#include <tap.h>
+
+int main () {
+    diag("Creating a sequence of 20 empty tiles");
+    struct rle *rle = rle_create(20);
+    ok(rle->num_runs == 1, "sequence has 1 run");
+    ok(rle_get(rle, 19) == 0, "tile 19 is 0");
+    diag("Setting tiles 4 to 9 to 2");
+    for (unsigned long i = 4; i < 10; ++i)
+        rle_set(rle, i, 2);
+    ok(rle->num_runs == 3, "sequence has 3 runs");
+    ok(rle_get(rle, 3) == 0, "tile 3 is 0");
+    ok(rle_get(rle, 4) == 2, "tile 4 is 2");
+    ok(rle_get(rle, 9) == 2, "tile 9 is 2");
+    ok(rle_get(rle, 10) == 0, "tile 10 is 0");
+    ok(rle_find_run(rle, 7) == 1, "tile 7 is in run 1");
+    ok(rle_run_end(rle, 1) == 10, "run 1 ends at 10");
+    diag("Setting tile 6 to 3");
+    rle_set(rle, 6, 3);
+    ok(rle->num_runs == 5, "sequence has 5 runs");
+    ok(rle_get(rle, 6) == 3, "tile 6 is 3");
+    ok(rle_get(rle, 7) == 2, "tile 7 is 2");
+    diag("Setting tile 6 back to 2");
+    rle_set(rle, 6, 2);
+    ok(rle->num_runs == 3, "runs are merged, sequence has 3 runs");
+    diag("Setting tiles 0 and 19 to 1");
+    rle_set(rle, 0, 1);
+    rle_set(rle, 19, 1);
+    ok(rle->num_runs == 5, "sequence has 5 runs");
+    ok(rle_get(rle, 0) == 1 && rle_get(rle, 1) == 0,
+       "tile 0 is 1 and tile 1 is 0");
+    ok(rle_get(rle, 19) == 1 && rle_get(rle, 18) == 0,
+       "tile 19 is 1 and tile 18 is 0");
+    diag("Setting tiles 0 to 3 to 2");
+    for (unsigned long i = 0; i < 4; ++i)
+        rle_set(rle, i, 2);
+    ok(rle->num_runs == 3, "sequence has 3 runs");
+    ok(rle->starts[1] == 10 && rle->values[1] == 0,
+       "run 1 starts at 10 with tile 0");
+    diag("Deleting the sequence");
+    rle_delete(rle);
+    done_testing();
+}
@@ -0,0 +1,85 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/isomap.h"
+#include "../src/graph.h"
+#include "../src/serializer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+
+/**
+ * Write the records of the graph of an isomap, of a walk and of a distance
+ * in a given format
+ *
+ * @param isomap  The isomap
+ * @param format  The format of the records
+ * @return        The records (to be freed)
+ */
+char *write_records(const struct isomap *isomap,
+                    enum serializer_format format) {
+    char *text;
+    size_t length;
+    FILE *stream = open_memstream(&text, &length);
+    struct serializer *serializer = malloc(sizeof(struct serializer));
+    serializer_initialize(serializer, stream, format);
+    struct graph *graph = graph_create(isomap->map, isomap->tileset);
+    serializer_write_graph(serializer, graph);
+    struct location start = {0, 0, 1}, end = {2, 2, 1}, hidden = {0, 0, 0};
+    struct graph_walk *walk = graph_shortest_walk(graph, &start, &end);
+    serializer_write_walk(serializer, &start, &end, walk);
+    graph_delete_walk(walk);
+    walk = graph_shortest_walk(graph, &hidden, &end);
+    serializer_write_distance(serializer, &hidden, &end, walk);
+    if (walk != NULL) graph_delete_walk(walk);
+    serializer_write_error(serializer, 4, "expected two locations X,Y,Z");
+    serializer_finish(serializer);
+    graph_delete(graph);
+    free(serializer);
+    fclose(stream);
+    return text;
+}
+
+int main () {
+    FILE *input = fopen("../data/map3x3.json", "r");
+    struct isomap *isomap = isomap_create_from_json_file(input);
+    fclose(input);
+    enum serializer_format format;
+    ok(serializer_format_by_name("ndjson", &format) &&
+       format == SERIALIZER_NDJSON, "format ndjson is known");
+    ok(!serializer_format_by_name("xml", &format), "format xml is unknown");
+    diag("Writing records as NDJSON");
+    char *text = write_records(isomap, SERIALIZER_NDJSON);
+    ok(strcmp(text,
+              "{\"type\": \"graph\", \"layers\": 2, \"nodes\": 9, "
+              "\"edges\": 24}\n"
+              "{\"type\": \"walk\", \"start\": [0,0,1], \"end\": [2,2,1], "
+              "\"distance\": 4, \"nodes\": [[0,0,1],[0,1,0],[0,2,0],[1,2,0],"
+              "[2,2,1]]}\n"
+              "{\"type\": \"distance\", \"start\": [0,0,0], "
+              "\"end\": [2,2,1], \"distance\": -1}\n"
+              "{\"type\": \"error\", \"line\": 4, "
+              "\"message\": \"expected two locations X,Y,Z\"}\n") == 0,
+       "records are written one per line");
+    free(text);
+    diag("Writing records as JSON");
+    text = write_records(isomap, SERIALIZER_JSON);
+    ok(strncmp(text, "[\n{\"type\": \"graph\"", 18) == 0,
+       "records start an array");
+    ok(strstr(text, "\"edges\": 24},\n{\"type\": \"walk\"") != NULL,
+       "records are separated by commas");
+    ok(strcmp(text + strlen(text) - 10, "X,Y,Z\"}\n]\n") == 0,
+       "records end the array");
+    free(text);
+    diag("Writing no record");
+    size_t length;
+    FILE *stream = open_memstream(&text, &length);
+    struct serializer *serializer = malloc(sizeof(struct serializer));
+    serializer_initialize(serializer, stream, SERIALIZER_JSON);
+    serializer_finish(serializer);
+    fclose(stream);
+    ok(strcmp(text, "[\n]\n") == 0, "empty array is written");
+    free(serializer);
+    free(text);
+    isomap_delete(isomap);
+    done_testing();
+}
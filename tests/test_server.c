@@ -0,0 +1,169 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/server.h"
+#include "../src/graph.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <tap.h>
+
+#define SOCKET_PATH "server.sock"
+#define NUM_CLIENTS 4
+#define NUM_REQUESTS 50
+
+/**
+ * The arguments of a server thread
+ */
+struct server_thread {
+    struct isomap *isomap; // The isomap
+    bool listening;        // The value returned by the server
+};
+
+/**
+ * Run a server with 3 workers
+ *
+ * @param data  The server thread
+ * @return      NULL
+ */
+void *run_server(void *data) {
+    struct server_thread *thread = data;
+    thread->listening = server_run(thread->isomap, SOCKET_PATH, 3,
+                                   RENDER_CAIRO);
+    return NULL;
+}
+
+/**
+ * Connect to the server, waiting for it to listen
+ *
+ * @return  The file descriptor of the connection
+ */
+int connect_server(void) {
+    struct timespec delay = {0, 10000000};
+    int fd;
+    for (unsigned int i = 0; (fd = server_connect(SOCKET_PATH)) < 0 && i < 500;
+         ++i)
+        nanosleep(&delay, NULL);
+    return fd;
+}
+
+/**
+ * Return true if a request is answered with the expected bytes
+ *
+ * @param fd        The file descriptor of the connection
+ * @param request   The request
+ * @param ok        True if the request should succeed
+ * @param expected  The expected bytes
+ * @param length    The number of expected bytes
+ * @return          True if the response is the expected one
+ */
+bool is_answered(int fd, const char *request, bool ok,
+                 const char *expected, size_t length) {
+    char *response;
+    size_t response_length;
+    bool succeeded = server_request(fd, request, &response, &response_length);
+    bool same = response != NULL && succeeded == ok &&
+                response_length == length &&
+                memcmp(response, expected, length) == 0;
+    free(response);
+    return same;
+}
+
+/**
+ * Send distance requests between pairs of top-free locations
+ *
+ * @param data  The graph
+ * @return      The number of wrong responses
+ */
+void *send_requests(void *data) {
+    const struct graph *graph = data;
+    int fd = connect_server();
+    uintptr_t num_wrong = 0;
+    for (unsigned int r = 0; r < NUM_REQUESTS; ++r) {
+        const struct location *start =
+            &graph->nodes[r % graph->num_nodes].location;
+        const struct location *end =
+            &graph->nodes[(r / graph->num_nodes) % graph->num_nodes].location;
+        struct graph_walk *walk = graph_shortest_walk(graph, start, end);
+        char request[64], expected[16];
+        snprintf(request, 64, "DISTANCE %d,%d,%d %d,%d,%d", start->x, start->y,
+                 start->z, end->x, end->y, end->z);
+        snprintf(expected, 16, "%d\n",
+                 walk == NULL ? -1 : (int)walk->num_nodes - 1);
+        if (!is_answered(fd, request, true, expected, strlen(expected)))
+            ++num_wrong;
+        if (walk != NULL) graph_delete_walk(walk);
+    }
+    close(fd);
+    return (void*)num_wrong;
+}
+
+int main () {
+    FILE *input = fopen("../data/map3x3.json", "r");
+    struct isomap *isomap = isomap_create_from_json_file(input);
+    fclose(input);
+    struct graph *graph = graph_create(isomap->map, isomap->tileset);
+    unlink(SOCKET_PATH);
+    struct server_thread thread = {isomap, false};
+    pthread_t server;
+    pthread_create(&server, NULL, run_server, &thread);
+    int fd = connect_server();
+    ok(fd >= 0, "client connects to the server");
+
+    diag("Answering requests");
+    ok(is_answered(fd, "PING", true, "PONG\n", 5), "PING is answered");
+    const char *walk = "A walk of 5 nodes: [ location(0,0,1) location(0,1,0) "
+                       "location(0,2,0) location(1,2,0) location(2,2,1) ]\n";
+    ok(is_answered(fd, "WALK 0,0,1 2,2,1", true, walk, strlen(walk)),
+       "walk is the same as with -w");
+    ok(is_answered(fd, "DISTANCE 0,0,1 2,2,1", true, "4\n", 2),
+       "distance is the number of moves");
+    ok(is_answered(fd, "DISTANCE 0,0,0 1,1,0", true, "-1\n", 3),
+       "distance without walk is -1");
+    char *image;
+    size_t length;
+    FILE *stream = open_memstream(&image, &length);
+    struct render_viewport viewport = {10, 20, 100, 70};
+    render_draw_to_stream(isomap, &viewport, stream, ENCODER_QOI, 0, 1,
+                          RENDER_CAIRO);
+    fclose(stream);
+    ok(is_answered(fd, "RENDER 10,20,100,70 qoi", true, image, length),
+       "rendered viewport is the same as with -V");
+    free(image);
+    const char *error = "unknown command JUMP\n";
+    ok(is_answered(fd, "JUMP 0,0,1", false, error, strlen(error)),
+       "unknown command is an error");
+    error = "expected two locations X,Y,Z\n";
+    ok(is_answered(fd, "WALK 0,0,1", false, error, strlen(error)),
+       "missing location is an error");
+
+    diag("Answering concurrent clients");
+    pthread_t clients[NUM_CLIENTS];
+    for (unsigned int c = 0; c < NUM_CLIENTS; ++c)
+        pthread_create(clients + c, NULL, send_requests, graph);
+    uintptr_t num_wrong = 0;
+    for (unsigned int c = 0; c < NUM_CLIENTS; ++c) {
+        void *result;
+        pthread_join(clients[c], &result);
+        num_wrong += (uintptr_t)result;
+    }
+    ok(num_wrong == 0, "%d clients get the right distances", NUM_CLIENTS);
+
+    diag("Stopping the server");
+    ok(is_answered(fd, "SHUTDOWN", true, "", 0), "SHUTDOWN is answered");
+    close(fd);
+    pthread_join(server, NULL);
+    ok(thread.listening && access(SOCKET_PATH, F_OK) != 0,
+       "server stops and removes its socket");
+    FILE *file = fopen(SOCKET_PATH, "w");
+    fclose(file);
+    ok(!server_run(isomap, SOCKET_PATH, 1, RENDER_CAIRO),
+       "server does not listen on an existing file");
+    unlink(SOCKET_PATH);
+
+    graph_delete(graph);
+    isomap_delete(isomap);
+    done_testing();
+}
@@ -0,0 +1,66 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/isomap.h"
+#include "../src/graph.h"
+#include "../src/stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+
+int main () {
+    diag("Measuring nothing until enabled");
+    FILE *input = fopen("../data/map3x3.json", "r");
+    struct isomap *isomap = isomap_create_from_json_file(input);
+    fclose(input);
+    ok(stats_get_counter(STATS_LAYERS) == 0 && stats_get_calls(STATS_LOAD) == 0,
+       "loading a map is not measured");
+    isomap_delete(isomap);
+
+    diag("Measuring phases and counters");
+    stats_enable();
+    input = fopen("../data/map3x3.json", "r");
+    isomap = isomap_create_from_json_file(input);
+    fclose(input);
+    ok(stats_get_calls(STATS_LOAD) == 1 &&
+       stats_get_calls(STATS_LOAD_TILESET) == 1 &&
+       stats_get_calls(STATS_LOAD_MAP) == 1,
+       "loading a map is measured once");
+    ok(stats_get_counter(STATS_LAYERS) == 2 &&
+       stats_get_counter(STATS_CELLS) == 18,
+       "layers and cells are counted");
+    struct graph *graph = graph_create(isomap->map, isomap->tileset);
+    ok(stats_get_counter(STATS_NODES) == graph->num_nodes &&
+       stats_get_calls(STATS_GRAPH_EDGES) == 1,
+       "nodes of the graph are counted");
+    struct location start = {0, 0, 1}, end = {2, 2, 1};
+    struct graph_walk *walk = graph_shortest_walk(graph, &start, &end);
+    ok(stats_get_calls(STATS_SEARCH) == 1 &&
+       stats_get_counter(STATS_EXPANDED) > 0 &&
+       stats_get_counter(STATS_EXPANDED) <= graph->num_nodes &&
+       stats_get_counter(STATS_QUEUE_MAX) > 0,
+       "search is measured");
+    graph_delete_walk(walk);
+    struct stats_timer timer = stats_start();
+    stats_stop_cpu(&timer, STATS_SEARCH);
+    ok(stats_get_calls(STATS_SEARCH) == 1,
+       "time of a helping thread is not another call");
+    stats_max(STATS_QUEUE_MAX, 1);
+    ok(stats_get_counter(STATS_QUEUE_MAX) > 1,
+       "maximum of a counter is not lowered");
+
+    diag("Printing statistics");
+    char *text;
+    size_t length;
+    FILE *stream = open_memstream(&text, &length);
+    stats_print(stream, true);
+    fclose(stream);
+    ok(strncmp(text, "{\"phases\": {\"load\": {\"calls\": 1, ", 32) == 0 &&
+       strstr(text, "\"layers\": 2, \"cells\": 18, ") != NULL &&
+       strstr(text, "\"peak-rss-kb\": ") != NULL &&
+       text[length - 2] == '}' && text[length - 1] == '\n',
+       "statistics are printed as JSON");
+    free(text);
+    graph_delete(graph);
+    isomap_delete(isomap);
+    done_testing();
+}
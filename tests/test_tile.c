@@ -1,7 +1,10 @@
 #include "../src/tile.h"
 #include <stdio.h>
+#include <string.h>
 #include <tap.h>
 
+#define NUM_TILES 20000
+
 int main () {
     diag("Creating an empty tileset");
     struct tileset *tileset = tile_create_tileset();
@@ -24,9 +27,73 @@ int main () {
     ok(tileset->tiles[1].num_directions[1] == 0,
        "tile at index 1 has 0 outgoing allowed direction");
     struct vect v = {0, 1, 0};
-    ok(geometry_equal_vect(tileset->tiles[0].directions[1] + 1, &v),
+    ok(geometry_equal_vect(tile_get_directions(tileset, tileset->tiles,
+                                               false) + 1, &v),
        "outgoing direction at index 1, of tile at index 0, is (0,1,0)");
+    ok(tileset->num_directions == 5 && tileset->tiles[1].directions[0] == 4,
+       "directions of the tiles are stored contiguously");
+    diag("Decoding the image of a tile");
+    struct tile *tile = tile_add_to_tileset(tileset, 3, "./art/flat-64x64.png");
+    cairo_surface_t *image = tile_get_image(tileset, tile);
+    ok(cairo_surface_status(image) == CAIRO_STATUS_SUCCESS,
+       "image of tile 3 is decoded");
+    ok(cairo_image_surface_get_width(image) == 64,
+       "image of tile 3 is 64 pixels wide");
+    ok(tile_get_image(tileset, tile_by_id(tileset, 3)) == image,
+       "image of tile 3 is decoded only once");
+    diag("Decoding the images of an atlas");
+    tile = tile_add_to_tileset(tileset, 4, "./art/tileset-64x64.png");
+    tile_set_rectangle(tileset, tile, 64, 0, 64, 64);
+    tile = tile_add_to_tileset(tileset, 5, "./art/tileset-64x64.png");
+    tile_set_rectangle(tileset, tile, 384, 32, 128, 64);
+    cairo_surface_t *flat = tile_get_image(tileset, tile_by_id(tileset, 4));
+    cairo_surface_t *sw = tile_get_image(tileset, tile_by_id(tileset, 5));
+    ok(cairo_image_surface_get_width(flat) == 64 &&
+       cairo_image_surface_get_height(flat) == 64,
+       "image of tile 4 is 64x64");
+    ok(tileset->num_files == 3 &&
+       strcmp(tile_source_filename(tileset, tile_by_id(tileset, 5)),
+              "./art/tileset-64x64.png") == 0,
+       "atlas of tiles 4 and 5 is stored once");
+    ok(cairo_image_surface_get_width(sw) == 64 &&
+       cairo_image_surface_get_height(sw) == 32,
+       "image of tile 5 is clipped to the atlas");
+    bool same = true;
+    for (int y = 0; y < 64; ++y)
+        same = same && memcmp(cairo_image_surface_get_data(flat) +
+                              y * cairo_image_surface_get_stride(flat),
+                              cairo_image_surface_get_data(image) +
+                              y * cairo_image_surface_get_stride(image),
+                              4 * 64) == 0;
+    ok(same, "image of tile 4 is the same as the image of tile 3");
     diag("Deleting the tileset");
     tile_delete_tileset(tileset);
+
+    diag("Adding many tiles with arbitrary ids");
+    tileset = tile_create_tileset();
+    bool found = true;
+    for (int i = 0; i < NUM_TILES; ++i)
+        tile_add_to_tileset(tileset, (i * 7919) % NUM_TILES * 1000 + 1, "");
+    ok(tileset->num_tiles == NUM_TILES && !tileset->sorted,
+       "tileset contains %d tiles in the order they were added", NUM_TILES);
+    ok(tile_add_to_tileset(tileset, 1001, "") == NULL,
+       "tile with an existing id is not added");
+    tile_add_direction(tileset, 5001, 1, 0, 0, true);
+    for (int i = 0; i < NUM_TILES; ++i) {
+        struct tile *t = tile_by_id(tileset, i * 1000 + 1);
+        found = found && t != NULL && t->id == i * 1000 + 1;
+    }
+    ok(found, "all tiles are found by id");
+    ok(tile_by_id(tileset, 2) == NULL && tile_by_id(tileset, -1) == NULL,
+       "missing ids are not found");
+    tile_sort_tileset(tileset);
+    bool sorted = true;
+    for (int i = 0; i < NUM_TILES; ++i)
+        sorted = sorted && tileset->tiles[i].id == i * 1000 + 1 &&
+                 tile_by_id(tileset, i * 1000 + 1) == tileset->tiles + i;
+    ok(sorted, "sorted tiles are ordered by id and still found");
+    ok(tile_by_id(tileset, 5001)->num_directions[0] == 1,
+       "direction is kept when sorting");
+    tile_delete_tileset(tileset);
     done_testing();
 }
@@ -0,0 +1,74 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/writer.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+
+int main () {
+    char *text, expected[64];
+    size_t length;
+    diag("Writing integers and strings");
+    FILE *stream = open_memstream(&text, &length);
+    struct writer writer;
+    writer_initialize(&writer, stream);
+    long long values[] = {0, 7, 10, 99, 100, 12345, -1, -10, -987654,
+                          INT_MAX, INT_MIN, LLONG_MAX, LLONG_MIN};
+    for (unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        writer_put_integer(&writer, values[i]);
+        writer_put_char(&writer, ' ');
+    }
+    writer_put_string(&writer, "location(");
+    writer_put_string(&writer, "");
+    writer_put_char(&writer, ')');
+    ok(writer.length > 0 && length == 0, "text is buffered");
+    writer_flush(&writer);
+    fflush(stream);
+    ok(writer.length == 0, "writer is empty after flush");
+    ok(strcmp(text, "0 7 10 99 100 12345 -1 -10 -987654 2147483647 "
+                    "-2147483648 9223372036854775807 "
+                    "-9223372036854775808 location()") == 0,
+       "text is the one printed by fprintf");
+    fclose(stream);
+    free(text);
+    diag("Writing more text than the buffer size");
+    stream = open_memstream(&text, &length);
+    writer_initialize(&writer, stream);
+    bool same = true;
+    size_t position = 0;
+    for (int i = -100000; i <= 100000; ++i) {
+        writer_put_integer(&writer, i);
+        writer_put_string(&writer, i % 1000 == 0 ? "\n" : ", ");
+    }
+    writer_flush(&writer);
+    fclose(stream);
+    for (int i = -100000; same && i <= 100000; ++i) {
+        int n = snprintf(expected, sizeof(expected), "%d%s", i,
+                         i % 1000 == 0 ? "\n" : ", ");
+        same = position + n <= length &&
+               memcmp(text + position, expected, n) == 0;
+        position += n;
+    }
+    ok(same && position == length, "%zu bytes are written in order", length);
+    free(text);
+    diag("Writing a string larger than the buffer");
+    char *string = malloc(3 * WRITER_BUFFER_SIZE + 1);
+    for (unsigned int i = 0; i < 3 * WRITER_BUFFER_SIZE; ++i)
+        string[i] = 'a' + i % 26;
+    string[3 * WRITER_BUFFER_SIZE] = '\0';
+    stream = open_memstream(&text, &length);
+    writer_initialize(&writer, stream);
+    writer_put_char(&writer, '[');
+    writer_put_string(&writer, string);
+    writer_put_char(&writer, ']');
+    writer_flush(&writer);
+    fclose(stream);
+    ok(length == 3 * WRITER_BUFFER_SIZE + 2 && text[0] == '[' &&
+       memcmp(text + 1, string, 3 * WRITER_BUFFER_SIZE) == 0 &&
+       text[length - 1] == ']', "string is written whole");
+    free(string);
+    free(text);
+    done_testing();
+}
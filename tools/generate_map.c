@@ -0,0 +1,487 @@
+/**
+ * generate_map.c
+ *
+ * Generate large random isometric maps, for stress and scaling tests.
+ *
+ * The tileset, the tile width and the z-offset are copied from a map using
+ * the stock tileset (`data/map10x10-64x64.json` by default), whose tiles are
+ * the end (1), the flat tile (2), the slopes (3, 4, 5 and 7) and the start
+ * (6). The tile of each cell only depends on the seed, on its layer and on
+ * its coordinates, so that the map is written row by row, in JSON or in the
+ * binary format, without ever being held in memory.
+ */
+#include "../src/isomap.h"
+#include "../src/tile.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#ifndef ROOT_DIR
+#define ROOT_DIR "./"
+#endif
+
+#define FORMAT_LENGTH 8
+#define FILENAME_LENGTH 200
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define NUM_KINDS 4
+#define USAGE "\
+Usage: %s [-h|--help] [-r|--rows N] [-c|--columns N]\n\
+    [-l|--layers N] [-O|--offset DX,DY,DZ] [-d|--density P]\n\
+    [-m|--mix F,S,B,E] [-s|--seed N] [-f|--output-format FORMAT]\n\
+    [-o|--output-filename PATH] [-T|--tileset PATH]\n\
+\n\
+Generate a random isometric map with the stock tileset. The map is\n\
+written while it is generated, so that maps much larger than the\n\
+memory can be generated. By default, write the map on stdout.\n\
+\n\
+Optional arguments:\n\
+  -h|--help                  Show this help message and exit.\n\
+  -r|--rows N                The number of rows of each layer.\n\
+                             Default value is 100.\n\
+  -c|--columns N             The number of columns of each layer.\n\
+                             Default value is 100.\n\
+  -l|--layers N              The number of layers. Default value\n\
+                             is 1.\n\
+  -O|--offset DX,DY,DZ       The offset between two consecutive\n\
+                             layers, with a positive DZ. Default\n\
+                             value is (0,0,1).\n\
+  -d|--density P             The percentage of occupied cells in the\n\
+                             layers above the first one, which is\n\
+                             full. Default value is 25.\n\
+  -m|--mix F,S,B,E           The relative frequencies of the flat\n\
+                             tiles, slopes, starts and ends.\n\
+                             Default value is (90,8,1,1).\n\
+  -s|--seed N                The seed of the random map. Default\n\
+                             value is 1.\n\
+  -f|--output-format FORMAT  Select the ouput format (either json\n\
+                             or binary). The default format is json.\n\
+  -o|--output-filename PATH  Write the map to the file PATH.\n\
+  -T|--tileset PATH          Copy the tileset of the JSON map PATH,\n\
+                             which must contain the stock tiles.\n\
+                             Default value is\n\
+                             data/map10x10-64x64.json.\n\
+"
+
+// Types //
+// ----- //
+
+/**
+ * Parsing errors
+ */
+enum status {
+    GENERATE_OK                         = 0,
+    GENERATE_ERROR_FORMAT_NOT_SUPPORTED = 1,
+    GENERATE_ERROR_BAD_OPTION           = 4,
+    GENERATE_ERROR_INVALID_PATH         = 5,
+    GENERATE_ERROR_INVALID_TILESET      = 6,
+    GENERATE_ERROR_BAD_VALUE            = 12,
+};
+
+/**
+ * Arguments from the command line
+ */
+struct arguments {
+    bool show_help;                        // Show help?
+    unsigned int num_rows;                 // The number of rows
+    unsigned int num_columns;              // The number of columns
+    unsigned int num_layers;               // The number of layers
+    int offset[3];                         // The offset between two layers
+    unsigned int density;                  // The density of upper layers
+    unsigned int mix[NUM_KINDS];           // The frequencies of the kinds
+    unsigned long seed;                    // The seed
+    char output_format[FORMAT_LENGTH];     // The output format
+    char output_filename[FILENAME_LENGTH]; // The output filename
+    char tileset_filename[FILENAME_LENGTH];// The map of the tileset
+    char invalid_option;                   // The option with a bad value
+    enum status status;                    // The status of the program
+};
+
+/**
+ * The tiles of each kind in the stock tileset: flat tiles, slopes, starts
+ * and ends, each list ending with 0
+ */
+const tile_id kind_tiles[NUM_KINDS][5] = {
+    {2, 0}, {3, 4, 5, 7, 0}, {6, 0}, {1, 0}
+};
+
+// Help functions //
+// -------------- //
+
+/**
+ * Retrieve an unsigned integer from a string
+ *
+ * @param s        The string containing the integer
+ * @param value    The integer
+ * @param minimum  The smallest allowed value
+ * @param maximum  The largest allowed value
+ * @return         The status
+ */
+enum status parse_unsigned(const char *s, unsigned long *value,
+                           unsigned long minimum, unsigned long maximum) {
+    char tail = '\0';
+    int num_parsed = sscanf(s, "%lu%c", value, &tail);
+    return num_parsed == 1 && s[0] != '-' && *value >= minimum &&
+           *value <= maximum ? GENERATE_OK : GENERATE_ERROR_BAD_VALUE;
+}
+
+/**
+ * Retrieve a bounded unsigned integer from a string, if no error occurred
+ *
+ * @param s          The string containing the integer
+ * @param value      The integer
+ * @param maximum    The largest allowed value
+ * @param arguments  The arguments, whose status is updated
+ */
+void parse_bounded(const char *s, unsigned int *value, unsigned int maximum,
+                   struct arguments *arguments) {
+    unsigned long parsed;
+    if (arguments->status == GENERATE_OK) {
+        arguments->status = parse_unsigned(s, &parsed, 0, maximum);
+        *value = parsed;
+    }
+}
+
+/**
+ * Retrieve the relative frequencies F,S,B,E of the kinds of tiles
+ *
+ * @param s    The string containing the frequencies
+ * @param mix  The frequencies
+ * @return     The status
+ */
+enum status parse_mix(const char *s, unsigned int mix[NUM_KINDS]) {
+    char tail = '\0';
+    int values[NUM_KINDS];
+    int num_parsed = sscanf(s, "%d,%d,%d,%d%c", values, values + 1,
+                            values + 2, values + 3, &tail);
+    if (num_parsed != NUM_KINDS)
+        return GENERATE_ERROR_BAD_VALUE;
+    unsigned int total = 0;
+    for (unsigned int k = 0; k < NUM_KINDS; ++k) {
+        if (values[k] < 0 || values[k] > 1000000)
+            return GENERATE_ERROR_BAD_VALUE;
+        mix[k] = values[k];
+        total += mix[k];
+    }
+    return total > 0 ? GENERATE_OK : GENERATE_ERROR_BAD_VALUE;
+}
+
+/**
+ * Print usage to a stream
+ *
+ * @param argv  The command line arguments
+ * @param file  The stream
+ */
+void print_usage(char *argv[], FILE *file) {
+    fprintf(file, USAGE, argv[0]);
+}
+
+/**
+ * Parse the command line arguments
+ *
+ * @param argc  The number of arguments
+ * @param argv  The arguments
+ * @return      The parsed arguments
+ */
+struct arguments parse_arguments(int argc, char *argv[]) {
+    struct arguments arguments = {
+        .show_help        = false,
+        .num_rows         = 100,
+        .num_columns      = 100,
+        .num_layers       = 1,
+        .offset           = {0, 0, 1},
+        .density          = 25,
+        .mix              = {90, 8, 1, 1},
+        .seed             = 1,
+        .output_format    = "json",
+        .output_filename  = "",
+        .tileset_filename = ROOT_DIR "data/map10x10-64x64.json",
+        .invalid_option   = '\0',
+        .status           = GENERATE_OK
+    };
+    struct option long_opts[] = {
+        {"help",            no_argument,       0, 'h'},
+        {"rows",            required_argument, 0, 'r'},
+        {"columns",         required_argument, 0, 'c'},
+        {"layers",          required_argument, 0, 'l'},
+        {"offset",          required_argument, 0, 'O'},
+        {"density",         required_argument, 0, 'd'},
+        {"mix",             required_argument, 0, 'm'},
+        {"seed",            required_argument, 0, 's'},
+        {"output-format",   required_argument, 0, 'f'},
+        {"output-filename", required_argument, 0, 'o'},
+        {"tileset",         required_argument, 0, 'T'},
+        {0, 0, 0, 0}
+    };
+
+    while (true) {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "hr:c:l:O:d:m:s:f:o:T:", long_opts,
+                            &option_index);
+        if (c == -1) break;
+        char tail = '\0';
+        switch (c) {
+            case 'h': arguments.show_help = true; break;
+            case 'r': parse_bounded(optarg, &arguments.num_rows, INT32_MAX,
+                                    &arguments);
+                      break;
+            case 'c': parse_bounded(optarg, &arguments.num_columns, INT32_MAX,
+                                    &arguments);
+                      break;
+            case 'l': parse_bounded(optarg, &arguments.num_layers, 1024,
+                                    &arguments);
+                      break;
+            case 'O': if (arguments.status == GENERATE_OK &&
+                          (sscanf(optarg, "%d,%d,%d%c", arguments.offset,
+                                  arguments.offset + 1, arguments.offset + 2,
+                                  &tail) != 3 || arguments.offset[2] <= 0))
+                          arguments.status = GENERATE_ERROR_BAD_VALUE;
+                      break;
+            case 'd': parse_bounded(optarg, &arguments.density, 100,
+                                    &arguments);
+                      break;
+            case 'm': arguments.status = arguments.status != GENERATE_OK ?
+                                         arguments.status :
+                                         parse_mix(optarg, arguments.mix);
+                      break;
+            case 's': arguments.status = arguments.status != GENERATE_OK ?
+                                         arguments.status :
+                                         parse_unsigned(optarg, &arguments.seed,
+                                                        0, ULONG_MAX);
+                      break;
+            case 'f': strncpy(arguments.output_format, optarg, FORMAT_LENGTH - 1);
+                      break;
+            case 'o': strncpy(arguments.output_filename, optarg,
+                              FILENAME_LENGTH - 1);
+                      break;
+            case 'T': strncpy(arguments.tileset_filename, optarg,
+                              FILENAME_LENGTH - 1);
+                      break;
+            case '?': arguments.status = GENERATE_ERROR_BAD_OPTION;
+                      break;
+        }
+        if (arguments.status == GENERATE_ERROR_BAD_VALUE &&
+            arguments.invalid_option == '\0')
+            arguments.invalid_option = c;
+    }
+
+    if (arguments.status == GENERATE_ERROR_BAD_OPTION || optind < argc) {
+        fprintf(stderr, "Error: option not recognized\n");
+        print_usage(argv, stderr);
+        exit(GENERATE_ERROR_BAD_OPTION);
+    } else if (arguments.show_help) {
+        print_usage(argv, stdout);
+        exit(GENERATE_OK);
+    } else if (arguments.status == GENERATE_ERROR_BAD_VALUE) {
+        fprintf(stderr, "Error: invalid value for option -%c\n",
+                arguments.invalid_option);
+        print_usage(argv, stderr);
+        exit(GENERATE_ERROR_BAD_VALUE);
+    } else if (strcmp(arguments.output_format, "json") != 0 &&
+               strcmp(arguments.output_format, "binary") != 0) {
+        fprintf(stderr, "Error: format %s not supported\n",
+                arguments.output_format);
+        print_usage(argv, stderr);
+        exit(GENERATE_ERROR_FORMAT_NOT_SUPPORTED);
+    }
+    return arguments;
+}
+
+/**
+ * Return a random number depending only on a seed, a layer and a cell
+ * (splitmix64)
+ *
+ * @param seed    The seed
+ * @param layer   The layer
+ * @param row     The row of the cell
+ * @param column  The column of the cell
+ * @param salt    A number distinguishing several draws for the same cell
+ * @return        The number
+ */
+uint64_t cell_random(uint64_t seed, unsigned int layer,
+                     unsigned int row, unsigned int column,
+                     unsigned int salt) {
+    uint64_t z = seed ^ ((uint64_t)layer << 56 ^ (uint64_t)salt << 48) ^
+                 ((uint64_t)row << 24 ^ column) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Fill a row of a layer with random tiles
+ *
+ * @param arguments  The parsed arguments
+ * @param layer      The index of the layer
+ * @param row        The index of the row
+ * @param tiles      The tiles of the row, set by the function
+ */
+void generate_row(const struct arguments *arguments,
+                  unsigned int layer, unsigned int row, tile_id *tiles) {
+    unsigned int total = 0;
+    for (unsigned int k = 0; k < NUM_KINDS; ++k)
+        total += arguments->mix[k];
+    for (unsigned int column = 0; column < arguments->num_columns; ++column) {
+        tiles[column] = 0;
+        if (layer > 0 &&
+            cell_random(arguments->seed, layer, row, column, 0) % 100 >=
+            arguments->density)
+            continue;
+        uint64_t r = cell_random(arguments->seed, layer, row, column, 1);
+        unsigned int weight = r % total, k = 0;
+        for (; weight >= arguments->mix[k]; ++k)
+            weight -= arguments->mix[k];
+        unsigned int num_tiles = 0;
+        while (kind_tiles[k][num_tiles] != 0)
+            ++num_tiles;
+        tiles[column] = kind_tiles[k][(r >> 32) % num_tiles];
+    }
+}
+
+/**
+ * Write the directions of a tile in JSON
+ *
+ * @param stream    The stream
+ * @param tileset   The tileset
+ * @param tile      The tile
+ * @param incoming  True for the incoming directions, false for the outgoing
+ */
+void write_json_directions(FILE *stream, const struct tileset *tileset,
+                           const struct tile *tile, bool incoming) {
+    const struct vect *directions = tile_get_directions(tileset, tile,
+                                                        incoming);
+    unsigned int num_directions = tile->num_directions[incoming ? 0 : 1];
+    fprintf(stream, "[");
+    for (unsigned int d = 0; d < num_directions; ++d)
+        fprintf(stream, "%s[%d,%d,%d]", d == 0 ? "" : ", ",
+                directions[d].dx, directions[d].dy, directions[d].dz);
+    fprintf(stream, "]");
+}
+
+/**
+ * Write a random map in JSON
+ *
+ * @param stream     The stream
+ * @param isomap     The isomap of the tileset
+ * @param arguments  The parsed arguments
+ */
+void write_json(FILE *stream, const struct isomap *isomap,
+                const struct arguments *arguments) {
+    const struct tileset *tileset = isomap->tileset;
+    fprintf(stream, "{\n    \"tile-width\": %u,\n    \"z-offset\": %u,\n"
+            "    \"tileset\":\n        [\n", isomap->tile_width,
+            isomap->z_offset);
+    for (unsigned int i = 0; i < tileset->num_tiles; ++i) {
+        const struct tile *tile = tileset->tiles + i;
+        const unsigned int *rectangle = tileset->infos[i].rectangle;
+        fprintf(stream, "            {\n                \"id\": %d,\n"
+                "                \"filename\": \"%s\",\n", tile->id,
+                tile_source_filename(tileset, tile));
+        if (rectangle[2] > 0)
+            fprintf(stream, "                \"rectangle\": [%u, %u, %u, %u],\n",
+                    rectangle[0], rectangle[1], rectangle[2], rectangle[3]);
+        fprintf(stream, "                \"incoming\": ");
+        write_json_directions(stream, tileset, tile, true);
+        fprintf(stream, ",\n                \"outgoing\": ");
+        write_json_directions(stream, tileset, tile, false);
+        fprintf(stream, "\n            }%s\n",
+                i + 1 < tileset->num_tiles ? "," : "");
+    }
+    fprintf(stream, "        ],\n    \"layers\":\n        [\n");
+    tile_id *tiles = malloc(arguments->num_columns * sizeof(tile_id));
+    for (unsigned int l = 0; l < arguments->num_layers; ++l) {
+        fprintf(stream, "            {\n                \"num-rows\": %u,\n"
+                "                \"num-cols\": %u,\n"
+                "                \"offset\": [%d, %d, %d],\n"
+                "                \"data\": [", arguments->num_rows,
+                arguments->num_columns, l * arguments->offset[0],
+                l * arguments->offset[1], l * arguments->offset[2]);
+        for (unsigned int r = 0; r < arguments->num_rows; ++r) {
+            generate_row(arguments, l, r, tiles);
+            if (r > 0)
+                fprintf(stream, ",\n                         ");
+            for (unsigned int c = 0; c < arguments->num_columns; ++c)
+                fprintf(stream, c == 0 ? "%d" : ", %d", tiles[c]);
+        }
+        fprintf(stream, "]\n            }%s\n",
+                l + 1 < arguments->num_layers ? "," : "");
+    }
+    fprintf(stream, "        ]\n}\n");
+    free(tiles);
+}
+
+/**
+ * Write a random map in the binary format
+ *
+ * The layers of the isomap are replaced by empty run-length layers with the
+ * right dimensions, whose tiles are written row by row.
+ *
+ * @param stream     The stream
+ * @param isomap     The isomap of the tileset
+ * @param arguments  The parsed arguments
+ */
+void write_binary(FILE *stream, struct isomap *isomap,
+                  const struct arguments *arguments) {
+    struct map *map = isomap->map;
+    isomap->map = map_create();
+    for (unsigned int l = 0; l < arguments->num_layers; ++l)
+        map_add_layer_with_storage(isomap->map, LAYER_RLE,
+                                   arguments->num_rows, arguments->num_columns,
+                                   l * arguments->offset[0],
+                                   l * arguments->offset[1],
+                                   l * arguments->offset[2]);
+    uint64_t position = isomap_write_binary_start(stream, isomap);
+    tile_id *tiles = malloc(arguments->num_columns * sizeof(tile_id));
+    for (unsigned int l = 0; l < arguments->num_layers; ++l) {
+        for (unsigned int r = 0; r < arguments->num_rows; ++r) {
+            generate_row(arguments, l, r, tiles);
+            isomap_write_binary_row(stream, tiles, arguments->num_columns, r,
+                                    &position);
+        }
+    }
+    free(tiles);
+    map_delete(isomap->map);
+    isomap->map = map;
+}
+
+// Functions //
+// --------- //
+
+int main(int argc, char *argv[]) {
+    struct arguments arguments = parse_arguments(argc, argv);
+    FILE *input = fopen(arguments.tileset_filename, "r");
+    if (input == NULL) {
+        fprintf(stderr, "Error: invalid file path\n");
+        exit(GENERATE_ERROR_INVALID_PATH);
+    }
+    struct isomap *isomap = isomap_create_from_json_file(input);
+    fclose(input);
+    bool valid = isomap != NULL;
+    for (unsigned int k = 0; valid && k < NUM_KINDS; ++k)
+        for (unsigned int i = 0; valid && kind_tiles[k][i] != 0; ++i)
+            valid = tile_by_id(isomap->tileset, kind_tiles[k][i]) != NULL;
+    if (!valid) {
+        fprintf(stderr, "Error: invalid tileset\n");
+        exit(GENERATE_ERROR_INVALID_TILESET);
+    }
+    FILE *output = stdout;
+    if (strcmp(arguments.output_filename, "") != 0) {
+        output = fopen(arguments.output_filename, "wb");
+        if (output == NULL) {
+            fprintf(stderr, "Error: invalid file path\n");
+            exit(GENERATE_ERROR_INVALID_PATH);
+        }
+    }
+    setvbuf(output, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    if (strcmp(arguments.output_format, "binary") == 0)
+        write_binary(output, isomap, &arguments);
+    else
+        write_json(output, isomap, &arguments);
+    if (output != stdout) fclose(output);
+    isomap_delete(isomap);
+    return GENERATE_OK;
+}